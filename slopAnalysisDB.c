@@ -0,0 +1,542 @@
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "slopAnalysisDB.h"
+
+#define ANALYSISDB_MAGIC "SLOPADB"
+#define ANALYSISDB_VERSION 1
+#define ANALYSISDB_READ_TRIES 64
+#define ANALYSISDB_WRITE_TRIES 4
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_size;
+    uint64_t slots;
+    uint64_t count;
+    /* Set once a larger table has been renamed over this one. */
+    _Atomic uint32_t stale;
+    uint32_t reserved[9];
+} DBHeader;
+
+typedef struct {
+    uint32_t used;
+    uint32_t reserved;
+    AnalysisKey key;
+    AnalysisRecord record;
+} SlotData;
+
+/* seq is odd while a writer is changing the slot. */
+typedef struct {
+    _Atomic uint32_t seq;
+    uint32_t reserved;
+    SlotData data;
+} DBSlot;
+
+struct AnalysisDB {
+    char* path;
+    int fd;
+    DBHeader* header;
+    DBSlot* slots;
+    size_t map_size;
+    /* Readers share it; writes and remapping take it exclusively. */
+    pthread_rwlock_t lock;
+};
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t len) {
+    const unsigned char* p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t analysisdb_hash(const char* text) {
+    return fnv1a(14695981039346656037ULL, text, strlen(text));
+}
+
+static uint64_t slot_index(const AnalysisKey* key, uint64_t slots) {
+    uint64_t hash = fnv1a(14695981039346656037ULL, &key->dev, sizeof(key->dev));
+    hash = fnv1a(hash, &key->ino, sizeof(key->ino));
+    return hash & (slots - 1);
+}
+
+static size_t table_size(uint64_t slots) {
+    return sizeof(DBHeader) + slots * sizeof(DBSlot);
+}
+
+static int file_lock(int fd, short type) {
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    while (fcntl(fd, F_SETLKW, &fl) != 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int read_slot(const DBSlot* slot, SlotData* out) {
+    for (int i = 0; i < ANALYSISDB_READ_TRIES; i++) {
+        uint32_t before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        memcpy(out, &slot->data, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == before) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void write_slot(DBSlot* slot, const SlotData* data) {
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed) | 1;
+    atomic_store_explicit(&slot->seq, seq, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&slot->data, data, sizeof(*data));
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+}
+
+/* Linear probing on dev/inode, so a rewritten file reuses its old slot. */
+static DBSlot* find_slot(DBSlot* slots, uint64_t count, const AnalysisKey* key, SlotData* found) {
+    uint64_t index = slot_index(key, count);
+    for (uint64_t i = 0; i < count; i++) {
+        DBSlot* slot = &slots[(index + i) & (count - 1)];
+        if (read_slot(slot, found) != 0) {
+            return NULL;
+        }
+        if (!found->used || (found->key.dev == key->dev && found->key.ino == key->ino)) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/* Writes a larger copy of a table next to path and renames it into place. */
+static int create_table(const char* path, uint64_t slots, const DBSlot* from, uint64_t from_slots) {
+    char tmp_path[PATH_MAX + 32];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+
+    int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    size_t size = table_size(slots);
+    void* map = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0) {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+
+    DBHeader* header = map;
+    DBSlot* table = (DBSlot*)(header + 1);
+    memcpy(header->magic, ANALYSISDB_MAGIC, sizeof(header->magic));
+    header->version = ANALYSISDB_VERSION;
+    header->slot_size = sizeof(DBSlot);
+    header->slots = slots;
+
+    for (uint64_t i = 0; i < from_slots; i++) {
+        SlotData data;
+        if (read_slot(&from[i], &data) != 0 || !data.used) {
+            continue;
+        }
+        SlotData existing;
+        DBSlot* slot = find_slot(table, slots, &data.key, &existing);
+        if (slot && !existing.used) {
+            write_slot(slot, &data);
+            header->count++;
+        }
+    }
+
+    munmap(map, size);
+    int ok = close(fd) == 0 && rename(tmp_path, path) == 0;
+    if (!ok) {
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+static void db_unmap(AnalysisDB* db) {
+    if (db->header) {
+        munmap(db->header, db->map_size);
+        db->header = NULL;
+        db->slots = NULL;
+    }
+    if (db->fd >= 0) {
+        close(db->fd);
+        db->fd = -1;
+    }
+}
+
+static int header_valid(const DBHeader* header, off_t file_size) {
+    return memcmp(header->magic, ANALYSISDB_MAGIC, sizeof(header->magic)) == 0 &&
+           header->version == ANALYSISDB_VERSION &&
+           header->slot_size == sizeof(DBSlot) &&
+           header->slots > 0 && (header->slots & (header->slots - 1)) == 0 &&
+           (off_t)table_size(header->slots) == file_size;
+}
+
+/* Empties an unusable file in place; the caller holds its write lock. */
+static int init_table(int fd, uint64_t slots) {
+    DBHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ANALYSISDB_MAGIC, sizeof(header.magic));
+    header.version = ANALYSISDB_VERSION;
+    header.slot_size = sizeof(DBSlot);
+    header.slots = slots;
+
+    if (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)table_size(slots)) != 0 ||
+        pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Maps the table at db->path, creating it if it is missing or unreadable. */
+static int db_map(AnalysisDB* db) {
+    for (int attempt = 0; attempt < ANALYSISDB_WRITE_TRIES; attempt++) {
+        int fd = open(db->path, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            return -1;
+        }
+        if (file_lock(fd, F_WRLCK) != 0) {
+            close(fd);
+            return -1;
+        }
+
+        DBHeader header;
+        struct stat st;
+        int valid = fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(header) &&
+                    pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                    header_valid(&header, st.st_size);
+
+        /* Stale means another process just renamed a larger table over this one. */
+        if (valid && header.stale) {
+            file_lock(fd, F_UNLCK);
+            close(fd);
+            continue;
+        }
+        if (!valid) {
+            if (init_table(fd, ANALYSISDB_INITIAL_SLOTS) != 0) {
+                file_lock(fd, F_UNLCK);
+                close(fd);
+                return -1;
+            }
+            header.slots = ANALYSISDB_INITIAL_SLOTS;
+        }
+
+        size_t size = table_size(header.slots);
+        void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        file_lock(fd, F_UNLCK);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        posix_madvise(map, size, POSIX_MADV_RANDOM);
+        db->fd = fd;
+        db->header = map;
+        db->slots = (DBSlot*)(db->header + 1);
+        db->map_size = size;
+        return 0;
+    }
+    return -1;
+}
+
+AnalysisDB* analysisdb_open(const char* path) {
+    AnalysisDB* db = calloc(1, sizeof(AnalysisDB));
+    if (!db) {
+        return NULL;
+    }
+    db->fd = -1;
+    db->path = strdup(path);
+    if (!db->path || pthread_rwlock_init(&db->lock, NULL) != 0) {
+        free(db->path);
+        free(db);
+        return NULL;
+    }
+    if (db_map(db) != 0) {
+        analysisdb_close(db);
+        return NULL;
+    }
+    return db;
+}
+
+int analysisdb_cache_dir(const char* sub, char* out, size_t size) {
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    char dir[PATH_MAX];
+
+    if (xdg && *xdg) {
+        snprintf(dir, sizeof(dir), "%s", xdg);
+    } else if (home && *home) {
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+            return -1;
+        }
+    } else {
+        return -1;
+    }
+    strncat(dir, "/slopmaster", sizeof(dir) - strlen(dir) - 1);
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    if (sub && *sub) {
+        strncat(dir, "/", sizeof(dir) - strlen(dir) - 1);
+        strncat(dir, sub, sizeof(dir) - strlen(dir) - 1);
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+            return -1;
+        }
+    }
+    return snprintf(out, size, "%s", dir) < (int)size ? 0 : -1;
+}
+
+typedef struct {
+    char* name;
+    int64_t mtime_ns;
+    int64_t size;
+} CacheEntry;
+
+static int compare_entries(const void* a, const void* b) {
+    const CacheEntry* x = a;
+    const CacheEntry* y = b;
+    return (x->mtime_ns > y->mtime_ns) - (x->mtime_ns < y->mtime_ns);
+}
+
+/* Entries are <hash>.<extension>; a writer's temporary carries a further suffix. */
+static int is_temporary(const char* name) {
+    return strchr(name, '.') != strrchr(name, '.');
+}
+
+int analysisdb_cache_touch(const char* path) {
+    return utimensat(AT_FDCWD, path, NULL, 0) == 0 ? 0 : -1;
+}
+
+void analysisdb_cache_trim(const char* sub, uint64_t limit, const char* keep) {
+    char dir_path[PATH_MAX], path[PATH_MAX + 256];
+    if (analysisdb_cache_dir(sub, dir_path, sizeof(dir_path)) != 0) {
+        return;
+    }
+    const char* kept = keep ? strrchr(keep, '/') : NULL;
+    kept = kept ? kept + 1 : keep;
+    DIR* dir = opendir(dir_path);
+    if (!dir) {
+        return;
+    }
+
+    CacheEntry* entries = NULL;
+    size_t count = 0, cap = 0;
+    uint64_t total = 0;
+    struct dirent* entry;
+    struct stat st;
+    while ((entry = readdir(dir)) != NULL) {
+        snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+        if (entry->d_name[0] == '.' || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        /* Other writers' files in the making are not the cache's to evict. */
+        if (is_temporary(entry->d_name)) {
+            continue;
+        }
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            CacheEntry* grown = realloc(entries, cap * sizeof(CacheEntry));
+            if (!grown) {
+                break;
+            }
+            entries = grown;
+        }
+        if (!(entries[count].name = strdup(entry->d_name))) {
+            break;
+        }
+        entries[count].mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+        entries[count].size = st.st_size;
+        total += (uint64_t)st.st_size;
+        count++;
+    }
+    closedir(dir);
+
+    /* Another process may be trimming too; a file already gone still counts as freed. */
+    qsort(entries, count, sizeof(CacheEntry), compare_entries);
+    for (size_t i = 0; i < count && total > limit; i++) {
+        if (kept && strcmp(entries[i].name, kept) == 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir_path, entries[i].name);
+        unlink(path);
+        total -= (uint64_t)entries[i].size;
+    }
+    for (size_t i = 0; i < count; i++) {
+        free(entries[i].name);
+    }
+    free(entries);
+}
+
+AnalysisDB* analysisdb_open_default(void) {
+    char dir[PATH_MAX], path[PATH_MAX + 16];
+
+    if (analysisdb_cache_dir(NULL, dir, sizeof(dir)) != 0) {
+        return NULL;
+    }
+    snprintf(path, sizeof(path), "%s/analysis.db", dir);
+    return analysisdb_open(path);
+}
+
+void analysisdb_close(AnalysisDB* db) {
+    if (!db) {
+        return;
+    }
+    db_unmap(db);
+    pthread_rwlock_destroy(&db->lock);
+    free(db->path);
+    free(db);
+}
+
+/* Called with db->lock held exclusively. */
+static int db_refresh(AnalysisDB* db) {
+    if (db->header && !atomic_load_explicit(&db->header->stale, memory_order_acquire)) {
+        return 0;
+    }
+    db_unmap(db);
+    return db_map(db);
+}
+
+int analysisdb_key(const char* file, AnalysisKey* key) {
+    struct stat st;
+    if (stat(file, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return -1;
+    }
+    key->dev = (uint64_t)st.st_dev;
+    key->ino = (uint64_t)st.st_ino;
+    key->size = st.st_size;
+    key->mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return 0;
+}
+
+int analysisdb_lookup(AnalysisDB* db, const AnalysisKey* key, AnalysisRecord* out) {
+    if (!db || !key) {
+        return -1;
+    }
+
+    pthread_rwlock_rdlock(&db->lock);
+    if (!db->header || atomic_load_explicit(&db->header->stale, memory_order_acquire)) {
+        pthread_rwlock_unlock(&db->lock);
+        pthread_rwlock_wrlock(&db->lock);
+        db_refresh(db);
+        pthread_rwlock_unlock(&db->lock);
+        pthread_rwlock_rdlock(&db->lock);
+    }
+
+    int result = -1;
+    SlotData data;
+    if (db->header && find_slot(db->slots, db->header->slots, key, &data) && data.used &&
+        data.key.size == key->size && data.key.mtime_ns == key->mtime_ns) {
+        *out = data.record;
+        result = 0;
+    }
+    pthread_rwlock_unlock(&db->lock);
+    return result;
+}
+
+static void merge_record(AnalysisRecord* into, const AnalysisRecord* from) {
+    if (from->fields & ANALYSISDB_HAS_INFO) {
+        into->sample_rate = from->sample_rate;
+        into->channels = from->channels;
+        into->duration = from->duration;
+        memcpy(into->format, from->format, sizeof(into->format));
+        memcpy(into->channel_layout, from->channel_layout, sizeof(into->channel_layout));
+        into->format[ANALYSISDB_NAME_SIZE - 1] = '\0';
+        into->channel_layout[ANALYSISDB_NAME_SIZE - 1] = '\0';
+    }
+    if (from->fields & ANALYSISDB_HAS_LOUDNESS) {
+        into->loudness = from->loudness;
+    }
+    if (from->fields & ANALYSISDB_HAS_TRUE_PEAK) {
+        into->true_peak_db = from->true_peak_db;
+    }
+    if (from->fields & ANALYSISDB_HAS_RENDER) {
+        into->render_hash = from->render_hash;
+        into->render_time = from->render_time;
+    }
+    into->fields |= from->fields;
+}
+
+/*
+ * Merges the fields set in record into the entry for key. An entry left
+ * by an older version of the same file is replaced rather than merged.
+ */
+int analysisdb_update(AnalysisDB* db, const AnalysisKey* key, const AnalysisRecord* record) {
+    if (!db || !key || !record) {
+        return -1;
+    }
+
+    int result = -1;
+    pthread_rwlock_wrlock(&db->lock);
+    for (int attempt = 0; attempt < ANALYSISDB_WRITE_TRIES && result != 0; attempt++) {
+        if (db_refresh(db) != 0 || file_lock(db->fd, F_WRLCK) != 0) {
+            break;
+        }
+        DBHeader* header = db->header;
+        if (atomic_load_explicit(&header->stale, memory_order_acquire)) {
+            file_lock(db->fd, F_UNLCK);
+            continue;
+        }
+
+        SlotData data;
+        DBSlot* slot = find_slot(db->slots, header->slots, key, &data);
+        int grow = !slot || (!data.used && (header->count + 1) * 4 > header->slots * 3);
+        if (grow) {
+            if (create_table(db->path, header->slots * 2, db->slots, header->slots) == 0) {
+                atomic_store_explicit(&header->stale, 1, memory_order_release);
+            }
+            file_lock(db->fd, F_UNLCK);
+            continue;
+        }
+
+        if (!data.used) {
+            header->count++;
+        }
+        if (!data.used || data.key.size != key->size || data.key.mtime_ns != key->mtime_ns) {
+            memset(&data, 0, sizeof(data));
+            data.used = 1;
+            data.key = *key;
+        }
+        merge_record(&data.record, record);
+        write_slot(slot, &data);
+        file_lock(db->fd, F_UNLCK);
+        result = 0;
+    }
+    pthread_rwlock_unlock(&db->lock);
+    return result;
+}
+
+void analysisdb_channel_layout(int channels, char* out) {
+    switch (channels) {
+        case 1: snprintf(out, ANALYSISDB_NAME_SIZE, "mono"); break;
+        case 2: snprintf(out, ANALYSISDB_NAME_SIZE, "stereo"); break;
+        case 6: snprintf(out, ANALYSISDB_NAME_SIZE, "5.1"); break;
+        case 8: snprintf(out, ANALYSISDB_NAME_SIZE, "7.1"); break;
+        default: snprintf(out, ANALYSISDB_NAME_SIZE, "%d channels", channels); break;
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef SLOP_ANALYSIS_DB_H
+#define SLOP_ANALYSIS_DB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ANALYSISDB_INITIAL_SLOTS 4096
+#define ANALYSISDB_NAME_SIZE 16
+
+/* Bits of AnalysisRecord.fields that hold a value. */
+#define ANALYSISDB_HAS_INFO 0x1
+#define ANALYSISDB_HAS_LOUDNESS 0x2
+#define ANALYSISDB_HAS_TRUE_PEAK 0x4
+#define ANALYSISDB_HAS_RENDER 0x8
+
+/* Identifies one version of a file; a rewrite changes size or mtime. */
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t size;
+    int64_t mtime_ns;
+} AnalysisKey;
+
+typedef struct {
+    uint32_t fields;
+    int32_t sample_rate;
+    int32_t channels;
+    double duration;
+    char format[ANALYSISDB_NAME_SIZE];
+    char channel_layout[ANALYSISDB_NAME_SIZE];
+    double loudness;
+    double true_peak_db;
+    uint64_t render_hash;
+    int64_t render_time;
+} AnalysisRecord;
+
+/*
+ * Memory-mapped hash table of per-file analysis results, shared by every
+ * slopmaster process. Lookups never block or do I/O beyond the mapping;
+ * updates are serialised with a file lock, so slopGUI and slopTerminal
+ * can use the same database at once. All calls accept a NULL database
+ * and then behave as an empty one.
+ */
+typedef struct AnalysisDB AnalysisDB;
+
+AnalysisDB* analysisdb_open(const char* path);
+AnalysisDB* analysisdb_open_default(void);
+void analysisdb_close(AnalysisDB* db);
+
+int analysisdb_key(const char* file, AnalysisKey* key);
+int analysisdb_lookup(AnalysisDB* db, const AnalysisKey* key, AnalysisRecord* out);
+int analysisdb_update(AnalysisDB* db, const AnalysisKey* key, const AnalysisRecord* record);
+
+/* $XDG_CACHE_HOME/slopmaster[/sub], created if missing. */
+int analysisdb_cache_dir(const char* sub, char* out, size_t size);
+/* Marks a cache file as just used; -1 if it is missing. */
+int analysisdb_cache_touch(const char* path);
+/*
+ * Deletes the least recently used files in the sub cache until it fits
+ * limit bytes, never keep, if given, or a writer's temporary.
+ */
+void analysisdb_cache_trim(const char* sub, uint64_t limit, const char* keep);
+
+void analysisdb_channel_layout(int channels, char* out);
+uint64_t analysisdb_hash(const char* text);
+
+#endif
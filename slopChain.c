@@ -0,0 +1,324 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slopChain.h"
+#include "slopDSP.h"
+
+#ifndef M_SQRT1_2
+#define M_SQRT1_2 0.70710678118654752440
+#endif
+
+#define CHAIN_NUM_EQ 7
+#define CHAIN_NUM_VOCAL_EQ 4
+#define CHAIN_MAX_ECHO_MS 1000.0
+#define CHAIN_TRUE_PEAK_LOOKAHEAD_MS 2.0
+#define CHAIN_TRUE_PEAK_RELEASE_MS 100.0
+
+struct MasterChain {
+    double rate;
+    ChainParams params;
+    Biquad highpass;
+    Biquad lowpass;
+    Compander compand;
+    Biquad eq[CHAIN_NUM_EQ];
+    Multiband bands;
+    Limiter limiter;
+    Echo reverb;
+    Convolver* convolver;
+    ConvIR* ir;
+    Biquad bass;
+    Echo wet;
+    Biquad vocal_highpass;
+    Biquad vocal_lowpass;
+    Biquad vocal_eq[CHAIN_NUM_VOCAL_EQ];
+    Compander vocal_compand;
+    Compressor vocal_comp;
+    TruePeakLimiter true_peak;
+};
+
+static const double chain_eq[CHAIN_NUM_EQ][3] = {
+    { 60, 1.5, 1 }, { 120, 1, -1 }, { 1000, 1.5, -1 }, { 4000, 1, 2 },
+    { 6000, 1, 1.5 }, { 8000, 1, 1 }, { 12000, 1.5, 1 }
+};
+
+static const double vocal_eq[CHAIN_NUM_VOCAL_EQ][2] = {
+    { 200, -3 }, { 1800, 2 }, { 4000, 3 }, { 8000, 1.5 }
+};
+
+static const double compand_in[] = { -80, -60, -40, -20, -10, 0 };
+static const double compand_out[] = { -80, -40, -20, -10, -5, 0 };
+static const double vocal_compand_in[] = { -80, -45, -20, -10, -5, 0 };
+static const double vocal_compand_out[] = { -80, -25, -12, -8, -5, -4 };
+
+void chain_params_default(ChainParams* params) {
+    memset(params, 0, sizeof(*params));
+    params->stereo_width = 1.0;
+    params->low_threshold = params->mid_threshold = params->high_threshold = -12;
+    params->low_ratio = params->mid_ratio = params->high_ratio = 4;
+    params->crossover_low = 200;
+    params->crossover_high = 5000;
+    params->reverb_delay = 60;
+    params->reverb_decay = 0.5;
+}
+
+int chain_params_pre_loudnorm_equal(const ChainParams* a, const ChainParams* b) {
+    return a->stereo_width == b->stereo_width &&
+           a->low_threshold == b->low_threshold && a->low_ratio == b->low_ratio &&
+           a->mid_threshold == b->mid_threshold && a->mid_ratio == b->mid_ratio &&
+           a->high_threshold == b->high_threshold && a->high_ratio == b->high_ratio &&
+           a->crossover_low == b->crossover_low && a->crossover_high == b->crossover_high &&
+           a->bypass == b->bypass;
+}
+
+double chain_loudnorm_gain(double measured_lufs) {
+    if (!isfinite(measured_lufs)) {
+        return 0.0;
+    }
+    double gain = CHAIN_LOUDNORM_TARGET - measured_lufs;
+    if (gain > CHAIN_MAX_LOUDNORM_GAIN) gain = CHAIN_MAX_LOUDNORM_GAIN;
+    if (gain < -CHAIN_MAX_LOUDNORM_GAIN) gain = -CHAIN_MAX_LOUDNORM_GAIN;
+    return gain;
+}
+
+static double clamp_freq(const MasterChain* chain, double freq) {
+    double max = chain->rate * 0.45;
+    return freq < max ? freq : max;
+}
+
+MasterChain* chain_new(double rate) {
+    MasterChain* chain = calloc(1, sizeof(MasterChain));
+    if (!chain) {
+        return NULL;
+    }
+    chain->rate = rate;
+
+    if (echo_init(&chain->reverb, rate, CHAIN_MAX_ECHO_MS) != 0 ||
+        echo_init(&chain->wet, rate, CHAIN_MAX_ECHO_MS) != 0) {
+        chain_free(chain);
+        return NULL;
+    }
+
+    biquad_set_highpass(&chain->highpass, rate, 20, M_SQRT1_2);
+    biquad_set_lowpass(&chain->lowpass, rate, clamp_freq(chain, 20000), M_SQRT1_2);
+    compander_init(&chain->compand, rate, 0.005, 0.1, compand_in, compand_out, 6, 0);
+    for (int i = 0; i < CHAIN_NUM_EQ; i++) {
+        biquad_set_peaking(&chain->eq[i], rate, clamp_freq(chain, chain_eq[i][0]), chain_eq[i][1], chain_eq[i][2]);
+    }
+    multiband_init(&chain->bands, rate, 0.01, 0.1);
+    limiter_init(&chain->limiter, rate, 0.9f, 0.9f, 0.95f, 5, 50);
+    biquad_set_peaking(&chain->bass, rate, 100, 1, 5);
+
+    biquad_set_highpass(&chain->vocal_highpass, rate, 80, M_SQRT1_2);
+    biquad_set_lowpass(&chain->vocal_lowpass, rate, clamp_freq(chain, 12000), M_SQRT1_2);
+    for (int i = 0; i < CHAIN_NUM_VOCAL_EQ; i++) {
+        biquad_set_peaking_octaves(&chain->vocal_eq[i], rate, clamp_freq(chain, vocal_eq[i][0]), 1, vocal_eq[i][1]);
+    }
+    compander_init(&chain->vocal_compand, rate, 0.02, 0.1, vocal_compand_in, vocal_compand_out, 6, 2);
+    compressor_init(&chain->vocal_comp, rate, -12, 3, 10, 100, 2, linear_to_db(5));
+    truepeak_limiter_init(&chain->true_peak, rate, CHAIN_TRUE_PEAK_CEILING,
+                          CHAIN_TRUE_PEAK_LOOKAHEAD_MS, CHAIN_TRUE_PEAK_RELEASE_MS);
+
+    ChainParams defaults;
+    chain_params_default(&defaults);
+    chain_set_params(chain, &defaults);
+    return chain;
+}
+
+void chain_set_params(MasterChain* chain, const ChainParams* params) {
+    double rate = chain->rate;
+    double cross_low = clamp_freq(chain, params->crossover_low);
+    double cross_high = clamp_freq(chain, params->crossover_high);
+
+    multiband_set_crossovers(&chain->bands, rate, cross_low, cross_high > cross_low ? cross_high : cross_low);
+    multiband_set_band(&chain->bands, 0, params->low_threshold, params->low_ratio, 1);
+    multiband_set_band(&chain->bands, 1, params->mid_threshold, params->mid_ratio, 1);
+    multiband_set_band(&chain->bands, 2, params->high_threshold, params->high_ratio, 1);
+
+    double delays[3] = { params->reverb_delay, params->reverb_delay * 1.5, params->reverb_delay * 2 };
+    float decays[3] = { (float)params->reverb_decay, (float)(params->reverb_decay * 0.8),
+                        (float)(params->reverb_decay * 0.6) };
+    echo_configure(&chain->reverb, rate, 0.8f, 0.5f, delays, decays, 3);
+    if (chain->convolver) {
+        convolver_configure(chain->convolver, params->reverb_delay, (float)params->reverb_decay);
+    }
+
+    double wet_delay = 60;
+    float wet_decay = 0.4f;
+    echo_configure(&chain->wet, rate, 0.8f, 0.88f, &wet_delay, &wet_decay, 1);
+
+    if (params->reverb && !chain->params.reverb) {
+        memset(chain->reverb.buffer, 0, (size_t)chain->reverb.size * DSP_CHANNELS * sizeof(float));
+        if (chain->convolver) {
+            convolver_reset(chain->convolver);
+        }
+    }
+    if (params->wet && !chain->params.wet) {
+        memset(chain->wet.buffer, 0, (size_t)chain->wet.size * DSP_CHANNELS * sizeof(float));
+    }
+
+    chain->params = *params;
+}
+
+int chain_set_reverb_ir(MasterChain* chain, ConvIR* ir) {
+    Convolver* convolver = NULL;
+    if (ir && ir == chain->ir) {
+        convolver_reset(chain->convolver);
+        chain_set_params(chain, &chain->params);
+        return 0;
+    }
+    if (ir && !(convolver = convolver_new(ir))) {
+        return -1;
+    }
+    convolver_free(chain->convolver);
+    chain->convolver = convolver;
+    chain->ir = ir;
+    chain_set_params(chain, &chain->params);
+    return 0;
+}
+
+static void chain_pre_block(MasterChain* chain, float* samples, size_t frames) {
+    biquad_process(&chain->highpass, samples, frames);
+    biquad_process(&chain->lowpass, samples, frames);
+    compander_process(&chain->compand, samples, frames);
+    for (int i = 0; i < CHAIN_NUM_EQ; i++) {
+        biquad_process(&chain->eq[i], samples, frames);
+    }
+    /* Width 1.00 is the identity. */
+    if (chain->params.stereo_width != 1.0) {
+        stereo_width_process(samples, frames, (float)chain->params.stereo_width);
+    }
+    multiband_process(&chain->bands, samples, frames);
+}
+
+static void chain_effects_block(MasterChain* chain, float* samples, size_t frames) {
+    const ChainParams* params = &chain->params;
+
+    if (params->reverb && chain->convolver) {
+        convolver_process(chain->convolver, samples, frames);
+    } else if (params->reverb) {
+        echo_process(&chain->reverb, samples, frames, 0.0f, 1.0f);
+    }
+    if (params->bass_boost) {
+        biquad_process(&chain->bass, samples, frames);
+    }
+    if (params->wet) {
+        echo_process(&chain->wet, samples, frames, 0.7f, 0.3f);
+    }
+    if (params->vocal_mode) {
+        biquad_process(&chain->vocal_highpass, samples, frames);
+        biquad_process(&chain->vocal_lowpass, samples, frames);
+        for (int i = 0; i < CHAIN_NUM_VOCAL_EQ; i++) {
+            biquad_process(&chain->vocal_eq[i], samples, frames);
+        }
+        compander_process(&chain->vocal_compand, samples, frames);
+        compressor_process(&chain->vocal_comp, samples, frames);
+        gain_process(samples, frames, 1.5f);
+    }
+}
+
+static void chain_post_block(MasterChain* chain, float* samples, size_t frames, int effects) {
+    const ChainParams* params = &chain->params;
+
+    gain_process(samples, frames, (float)db_to_linear(params->loudnorm_gain_db));
+    limiter_process(&chain->limiter, samples, frames);
+    gain_process(samples, frames, 0.9f);
+    if (effects) {
+        chain_effects_block(chain, samples, frames);
+    }
+
+    if (params->volume_db != 0.0) {
+        gain_process(samples, frames, (float)db_to_linear(params->volume_db));
+    }
+    truepeak_limiter_process(&chain->true_peak, samples, frames);
+}
+
+void chain_process(MasterChain* chain, float* samples, size_t frames) {
+    while (frames > 0) {
+        size_t block = frames < CHAIN_BLOCK_FRAMES ? frames : CHAIN_BLOCK_FRAMES;
+        chain_pre_block(chain, samples, block);
+        chain_post_block(chain, samples, block, 1);
+        samples += block * DSP_CHANNELS;
+        frames -= block;
+    }
+}
+
+void chain_process_stem(MasterChain* chain, float* samples, size_t frames) {
+    while (frames > 0) {
+        size_t block = frames < CHAIN_BLOCK_FRAMES ? frames : CHAIN_BLOCK_FRAMES;
+        chain_pre_block(chain, samples, block);
+        chain_effects_block(chain, samples, block);
+        samples += block * DSP_CHANNELS;
+        frames -= block;
+    }
+}
+
+void chain_process_bus(MasterChain* chain, float* samples, size_t frames) {
+    while (frames > 0) {
+        size_t block = frames < CHAIN_BLOCK_FRAMES ? frames : CHAIN_BLOCK_FRAMES;
+        chain_post_block(chain, samples, block, 0);
+        samples += block * DSP_CHANNELS;
+        frames -= block;
+    }
+}
+
+void chain_process_pre_loudnorm(MasterChain* chain, float* samples, size_t frames) {
+    while (frames > 0) {
+        size_t block = frames < CHAIN_BLOCK_FRAMES ? frames : CHAIN_BLOCK_FRAMES;
+        chain_pre_block(chain, samples, block);
+        samples += block * DSP_CHANNELS;
+        frames -= block;
+    }
+}
+
+void chain_process_post_loudnorm(MasterChain* chain, float* samples, size_t frames) {
+    while (frames > 0) {
+        size_t block = frames < CHAIN_BLOCK_FRAMES ? frames : CHAIN_BLOCK_FRAMES;
+        chain_post_block(chain, samples, block, 1);
+        samples += block * DSP_CHANNELS;
+        frames -= block;
+    }
+}
+
+static void compander_reset(Compander* comp) {
+    memset(comp->env, 0, sizeof(comp->env));
+}
+
+void chain_reset(MasterChain* chain) {
+    biquad_reset(&chain->highpass);
+    biquad_reset(&chain->lowpass);
+    compander_reset(&chain->compand);
+    for (int i = 0; i < CHAIN_NUM_EQ; i++) {
+        biquad_reset(&chain->eq[i]);
+    }
+    multiband_reset(&chain->bands);
+    limiter_init(&chain->limiter, chain->rate, 0.9f, 0.9f, 0.95f, 5, 50);
+    memset(chain->reverb.buffer, 0, (size_t)chain->reverb.size * DSP_CHANNELS * sizeof(float));
+    if (chain->convolver) {
+        convolver_reset(chain->convolver);
+    }
+    memset(chain->wet.buffer, 0, (size_t)chain->wet.size * DSP_CHANNELS * sizeof(float));
+    biquad_reset(&chain->bass);
+    biquad_reset(&chain->vocal_highpass);
+    biquad_reset(&chain->vocal_lowpass);
+    for (int i = 0; i < CHAIN_NUM_VOCAL_EQ; i++) {
+        biquad_reset(&chain->vocal_eq[i]);
+    }
+    compander_reset(&chain->vocal_compand);
+    chain->vocal_comp.env = 0;
+    truepeak_limiter_reset(&chain->true_peak);
+}
+
+int chain_latency(const MasterChain* chain) {
+    return chain->limiter.lookahead + truepeak_limiter_latency(&chain->true_peak);
+}
+
+void chain_free(MasterChain* chain) {
+    if (!chain) {
+        return;
+    }
+    echo_free(&chain->reverb);
+    convolver_free(chain->convolver);
+    echo_free(&chain->wet);
+    free(chain);
+}
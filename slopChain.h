@@ -0,0 +1,70 @@
+#ifndef SLOP_CHAIN_H
+#define SLOP_CHAIN_H
+
+#include <stddef.h>
+
+#include "slopConvolve.h"
+
+#define CHAIN_BLOCK_FRAMES 1024
+#define CHAIN_LOUDNORM_TARGET -14.0
+#define CHAIN_MAX_LOUDNORM_GAIN 24.0
+/* loudnorm's TP=-1, enforced again after every later gain stage. */
+#define CHAIN_TRUE_PEAK_CEILING -1.0
+
+/* Stages a plan (see slopPlan.h) found to be near no-ops for one file. */
+#define CHAIN_BYPASS_DENOISE 0x1
+
+/*
+ * Native, real-time version of the slopGUI mastering chain. Stage order
+ * and constants follow master_audio_file; loudnorm is replaced by the
+ * static loudnorm_gain_db, which callers obtain by running the chain's
+ * pre-loudnorm prefix over the source and measuring it.
+ */
+typedef struct {
+    double stereo_width;
+    double low_threshold, low_ratio;
+    double mid_threshold, mid_ratio;
+    double high_threshold, high_ratio;
+    double crossover_low, crossover_high;
+    int reverb;
+    double reverb_delay, reverb_decay;
+    int bass_boost;
+    int wet;
+    int vocal_mode;
+    double volume_db;
+    double loudnorm_gain_db;
+    unsigned bypass;
+} ChainParams;
+
+typedef struct MasterChain MasterChain;
+
+void chain_params_default(ChainParams* params);
+int chain_params_pre_loudnorm_equal(const ChainParams* a, const ChainParams* b);
+
+MasterChain* chain_new(double rate);
+void chain_set_params(MasterChain* chain, const ChainParams* params);
+/*
+ * With an impulse response the reverb convolves instead of echoing; NULL
+ * restores the echo. Setting the IR already in use only resets it.
+ */
+int chain_set_reverb_ir(MasterChain* chain, ConvIR* ir);
+void chain_process(MasterChain* chain, float* samples, size_t frames);
+void chain_process_pre_loudnorm(MasterChain* chain, float* samples, size_t frames);
+/* The rest of chain_process, for audio the pre-loudnorm prefix already ran on. */
+void chain_process_post_loudnorm(MasterChain* chain, float* samples, size_t frames);
+/*
+ * A stem master splits the chain: every stem runs the pre-loudnorm
+ * stages and its own reverb, bass boost, wet and vocal stages, and the
+ * sum of the stems runs loudnorm, the limiters and the volume. The stem
+ * half adds no latency; the bus half has the chain's.
+ */
+void chain_process_stem(MasterChain* chain, float* samples, size_t frames);
+void chain_process_bus(MasterChain* chain, float* samples, size_t frames);
+void chain_reset(MasterChain* chain);
+/* Frames by which chain_process delays its output; fixed for a chain. */
+int chain_latency(const MasterChain* chain);
+void chain_free(MasterChain* chain);
+
+double chain_loudnorm_gain(double measured_lufs);
+
+#endif
@@ -0,0 +1,977 @@
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <sndfile.h>
+
+#include "slopCluster.h"
+
+/*
+ * Line-based protocol; a header ending in a size is followed by that
+ * many bytes of payload.
+ *
+ *   worker -> coordinator   HELLO <threads>
+ *   coordinator -> worker   SETTINGS <size>            key=value lines
+ *   coordinator -> worker   JOB <id> <size> <ext>      input file
+ *   worker -> coordinator   PROGRESS <id> <fraction>
+ *   worker -> coordinator   DONE <id> <size>           output file
+ *   worker -> coordinator   FAILED <id> <size>         error message
+ */
+#define CLUSTER_LINE 512
+#define CLUSTER_IO_BLOCK 65536
+#define CLUSTER_MAX_SETTINGS 8192
+#define CLUSTER_POLL_MS 1000
+/* How long dispatch waits for every worker to answer before starting without the slow ones. */
+#define CLUSTER_CONNECT_WAIT_SECONDS 5
+
+/* Bytes per second of 16-bit stereo CD audio; sizes files sndfile cannot open. */
+#define CLUSTER_FALLBACK_BYTE_RATE 176400.0
+
+typedef struct {
+    int fd;
+    char buf[CLUSTER_IO_BLOCK];
+    size_t pos;
+    size_t len;
+} Conn;
+
+typedef enum {
+    SHARD_PENDING,
+    SHARD_RUNNING,
+    SHARD_FINISHED
+} ShardState;
+
+typedef struct {
+    const char* input;
+    char* output;
+    double cost;
+    ShardState state;
+    int attempts;
+} Shard;
+
+typedef struct Peer Peer;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    Shard* shards;
+    int count;
+    int remaining;
+    int failed;
+    int alive;
+    int connecting;
+    Peer* peers;
+    int num_peers;
+    char* settings_text;
+    const SlopCallbacks* callbacks;
+    FILE* log;
+} Cluster;
+
+/* slots, ready and num_running are shared with other peers under the cluster mutex. */
+struct Peer {
+    Cluster* cluster;
+    char* host;
+    char* port;
+    pthread_t thread;
+    Conn conn;
+    int slots;
+    int ready;
+    int running[SLOPMASTER_MAX_THREADS];
+    int num_running;
+};
+
+typedef struct {
+    int fd;
+    pthread_mutex_t send_mutex;
+    FILE* log;
+} WorkerConn;
+
+typedef struct {
+    WorkerConn* wc;
+    int id;
+    char* input;
+    char* output;
+    double sent;
+} WorkerJob;
+
+static void cluster_log(FILE* log, const char* format, ...) {
+    if (!log) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    vfprintf(log, format, args);
+    va_end(args);
+    fflush(log);
+}
+
+static int send_all(int fd, const void* data, size_t size) {
+    const char* p = data;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int send_line(int fd, const char* format, ...) {
+    char line[CLUSTER_LINE];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (n < 0 || n >= (int)sizeof(line)) {
+        return -1;
+    }
+    return send_all(fd, line, n);
+}
+
+static int send_file(int fd, const char* path, long long size) {
+    int in = open(path, O_RDONLY);
+    if (in < 0) {
+        return -1;
+    }
+    char block[CLUSTER_IO_BLOCK];
+    while (size > 0) {
+        ssize_t n = read(in, block, size < CLUSTER_IO_BLOCK ? (size_t)size : CLUSTER_IO_BLOCK);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0 || send_all(fd, block, n) != 0) {
+            close(in);
+            return -1;
+        }
+        size -= n;
+    }
+    close(in);
+    return 0;
+}
+
+static void conn_init(Conn* c, int fd) {
+    c->fd = fd;
+    c->pos = 0;
+    c->len = 0;
+}
+
+static int conn_fill(Conn* c) {
+    if (c->pos == c->len) {
+        c->pos = 0;
+        c->len = 0;
+    }
+    for (;;) {
+        ssize_t n = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        c->len += n;
+        return 0;
+    }
+}
+
+/* 0 when a whole line, without its newline, is in line. */
+static int conn_read_line(Conn* c, char* line, size_t size) {
+    size_t n = 0;
+    for (;;) {
+        if (c->pos == c->len && conn_fill(c) != 0) {
+            return -1;
+        }
+        char ch = c->buf[c->pos++];
+        if (ch == '\n') {
+            line[n] = '\0';
+            return 0;
+        }
+        if (n + 1 >= size) {
+            return -1;
+        }
+        line[n++] = ch;
+    }
+}
+
+static int conn_read(Conn* c, void* data, size_t size) {
+    char* p = data;
+    while (size > 0) {
+        if (c->pos == c->len && conn_fill(c) != 0) {
+            return -1;
+        }
+        size_t n = c->len - c->pos < size ? c->len - c->pos : size;
+        memcpy(p, c->buf + c->pos, n);
+        c->pos += n;
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/* Copies size payload bytes to path; with path NULL they are discarded. */
+static int conn_save(Conn* c, const char* path, long long size) {
+    int out = path ? open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    if (path && out < 0) {
+        return -1;
+    }
+    int result = 0;
+    while (size > 0) {
+        if (c->pos == c->len && conn_fill(c) != 0) {
+            result = -1;
+            break;
+        }
+        size_t n = c->len - c->pos < (unsigned long long)size ? c->len - c->pos : (size_t)size;
+        if (out >= 0 && result == 0 && write(out, c->buf + c->pos, n) != (ssize_t)n) {
+            result = -1;
+        }
+        c->pos += n;
+        size -= n;
+    }
+    if (out >= 0 && close(out) != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+/*
+ * Bounds blocking writes, and reads when receive is set, so a hung peer
+ * cannot stall a transfer forever. Workers wait on the coordinator for
+ * as long as their jobs run, so they rely on keepalives instead.
+ */
+static void set_timeouts(int fd, int receive) {
+    struct timeval tv = { SLOPCLUSTER_TIMEOUT_SECONDS, 0 };
+    if (receive) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+#ifdef TCP_KEEPIDLE
+    int idle = 30, interval = 10, probes = 3;
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+#endif
+}
+
+/* ---- Settings ---- */
+
+static char* settings_serialize(const SlopSettings* s) {
+    const ChainParams* p = &s->chain;
+    char* text = malloc(CLUSTER_MAX_SETTINGS);
+    if (!text) {
+        return NULL;
+    }
+    snprintf(text, CLUSTER_MAX_SETTINGS,
+             "stereo_width=%.17g\nlow_threshold=%.17g\nlow_ratio=%.17g\n"
+             "mid_threshold=%.17g\nmid_ratio=%.17g\nhigh_threshold=%.17g\nhigh_ratio=%.17g\n"
+             "crossover_low=%.17g\ncrossover_high=%.17g\nreverb=%d\nreverb_delay=%.17g\n"
+             "reverb_decay=%.17g\nbass_boost=%d\nwet=%d\nvocal_mode=%d\nvolume_db=%.17g\n"
+             "loudnorm_gain_db=%.17g\nformat=%s\nengine=%d\nplan=%d\nkeep_rate=%d\n",
+             p->stereo_width, p->low_threshold, p->low_ratio,
+             p->mid_threshold, p->mid_ratio, p->high_threshold, p->high_ratio,
+             p->crossover_low, p->crossover_high, p->reverb, p->reverb_delay,
+             p->reverb_decay, p->bass_boost, p->wet, p->vocal_mode, p->volume_db,
+             p->loudnorm_gain_db, slopmaster_format_extension(s->format), (int)s->engine, s->plan,
+             s->keep_rate);
+    return text;
+}
+
+/* Unknown keys are skipped, so newer coordinators can talk to older workers. */
+static void settings_parse(char* text, SlopSettings* s) {
+    ChainParams* p = &s->chain;
+    for (char* line = strtok(text, "\n"); line; line = strtok(NULL, "\n")) {
+        char* eq = strchr(line, '=');
+        if (!eq) {
+            continue;
+        }
+        *eq = '\0';
+        const char* key = line;
+        const char* value = eq + 1;
+        double v = atof(value);
+        if (strcmp(key, "stereo_width") == 0) p->stereo_width = v;
+        else if (strcmp(key, "low_threshold") == 0) p->low_threshold = v;
+        else if (strcmp(key, "low_ratio") == 0) p->low_ratio = v;
+        else if (strcmp(key, "mid_threshold") == 0) p->mid_threshold = v;
+        else if (strcmp(key, "mid_ratio") == 0) p->mid_ratio = v;
+        else if (strcmp(key, "high_threshold") == 0) p->high_threshold = v;
+        else if (strcmp(key, "high_ratio") == 0) p->high_ratio = v;
+        else if (strcmp(key, "crossover_low") == 0) p->crossover_low = v;
+        else if (strcmp(key, "crossover_high") == 0) p->crossover_high = v;
+        else if (strcmp(key, "reverb") == 0) p->reverb = (int)v;
+        else if (strcmp(key, "reverb_delay") == 0) p->reverb_delay = v;
+        else if (strcmp(key, "reverb_decay") == 0) p->reverb_decay = v;
+        else if (strcmp(key, "bass_boost") == 0) p->bass_boost = (int)v;
+        else if (strcmp(key, "wet") == 0) p->wet = (int)v;
+        else if (strcmp(key, "vocal_mode") == 0) p->vocal_mode = (int)v;
+        else if (strcmp(key, "volume_db") == 0) p->volume_db = v;
+        else if (strcmp(key, "loudnorm_gain_db") == 0) p->loudnorm_gain_db = v;
+        else if (strcmp(key, "format") == 0) slopmaster_parse_format(value, &s->format);
+        else if (strcmp(key, "engine") == 0) s->engine = v ? SLOPMASTER_ENGINE_NATIVE : SLOPMASTER_ENGINE_FFMPEG;
+        else if (strcmp(key, "plan") == 0) s->plan = (int)v;
+        else if (strcmp(key, "keep_rate") == 0) s->keep_rate = (int)v;
+    }
+}
+
+/* ---- Worker ---- */
+
+static void worker_progress(int job, double fraction, void* user_data) {
+    WorkerJob* wj = user_data;
+    (void)job;
+    if (fraction < wj->sent + 0.01) {
+        return;
+    }
+    wj->sent = fraction;
+    pthread_mutex_lock(&wj->wc->send_mutex);
+    send_line(wj->wc->fd, "PROGRESS %d %.4f\n", wj->id, fraction);
+    pthread_mutex_unlock(&wj->wc->send_mutex);
+}
+
+static void worker_done(int job, SlopStatus status, const char* message, void* user_data) {
+    WorkerJob* wj = user_data;
+    struct stat st;
+    (void)job;
+
+    pthread_mutex_lock(&wj->wc->send_mutex);
+    if (status == SLOPMASTER_OK && stat(wj->output, &st) == 0) {
+        if (send_line(wj->wc->fd, "DONE %d %lld\n", wj->id, (long long)st.st_size) == 0 &&
+            send_file(wj->wc->fd, wj->output, st.st_size) != 0) {
+            /* The header promised bytes that never came; the coordinator must drop us. */
+            shutdown(wj->wc->fd, SHUT_RDWR);
+        }
+    } else if (status != SLOPMASTER_CANCELLED) {
+        if (!message) {
+            message = "No output was written";
+        }
+        /* The coordinator drops a worker whose message is longer than a line. */
+        size_t len = strnlen(message, CLUSTER_LINE - 1);
+        if (send_line(wj->wc->fd, "FAILED %d %zu\n", wj->id, len) == 0) {
+            send_all(wj->wc->fd, message, len);
+        }
+    }
+    pthread_mutex_unlock(&wj->wc->send_mutex);
+
+    cluster_log(wj->wc->log, "Worker: job %d %s\n", wj->id,
+                status == SLOPMASTER_OK ? "done" : status == SLOPMASTER_FAILED ? "failed" : "cancelled");
+    unlink(wj->input);
+    unlink(wj->output);
+    free(wj->input);
+    free(wj->output);
+    free(wj);
+}
+
+/* Keeps an input's extension, which format detection relies on, but nothing else of its name. */
+static int job_extension(const char* ext) {
+    if (strcmp(ext, "-") == 0) {
+        return 1;
+    }
+    if (ext[0] != '.' || strlen(ext) > 8) {
+        return 0;
+    }
+    for (const char* c = ext + 1; *c; c++) {
+        if (!((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9'))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static WorkerJob* worker_receive_job(WorkerConn* wc, Conn* conn, const char* workdir, const SlopSettings* settings,
+                                     int id, long long size, const char* ext) {
+    WorkerJob* wj = calloc(1, sizeof(WorkerJob));
+    size_t len = strlen(workdir) + 32;
+    char name[32];
+    snprintf(name, sizeof(name), "job%d%.9s", id, strcmp(ext, "-") == 0 ? "" : ext);
+    if (wj) {
+        wj->input = malloc(len);
+    }
+    if (!wj || !wj->input) {
+        free(wj);
+        conn_save(conn, NULL, size);
+        return NULL;
+    }
+    snprintf(wj->input, len, "%s/%s", workdir, name);
+    wj->output = slopmaster_output_path(workdir, name, settings->format);
+    wj->wc = wc;
+    wj->id = id;
+    if (!wj->output || conn_save(conn, wj->input, size) != 0) {
+        unlink(wj->input);
+        free(wj->input);
+        free(wj->output);
+        free(wj);
+        return NULL;
+    }
+    return wj;
+}
+
+static void worker_serve_connection(int fd, const char* workdir, int threads, FILE* log) {
+    WorkerConn wc = { fd, PTHREAD_MUTEX_INITIALIZER, log };
+    Conn conn;
+    char line[CLUSTER_LINE];
+    SlopMaster* master = NULL;
+    SlopSettings settings;
+
+    conn_init(&conn, fd);
+    if (send_line(fd, "HELLO %d\n", threads) != 0) {
+        return;
+    }
+
+    long long size;
+    int id;
+    char ext[CLUSTER_LINE];
+    while (conn_read_line(&conn, line, sizeof(line)) == 0) {
+        if (sscanf(line, "SETTINGS %lld", &size) == 1 && !master && size > 0 && size < CLUSTER_MAX_SETTINGS) {
+            char text[CLUSTER_MAX_SETTINGS];
+            if (conn_read(&conn, text, size) != 0) {
+                break;
+            }
+            text[size] = '\0';
+            slopmaster_settings_preset(&settings, SLOPMASTER_PRESET_STANDARD);
+            settings_parse(text, &settings);
+            settings.threads = threads;
+            settings.log = log;
+            if (!(master = slopmaster_new(&settings))) {
+                break;
+            }
+        } else if (sscanf(line, "JOB %d %lld %255s", &id, &size, ext) == 3 && master && size >= 0) {
+            if (!job_extension(ext)) {
+                break;
+            }
+            WorkerJob* wj = worker_receive_job(&wc, &conn, workdir, &settings, id, size, ext);
+            SlopCallbacks callbacks = { worker_progress, worker_done, wj };
+            if (!wj || slopmaster_submit_file(master, wj->input, wj->output, &callbacks) == 0) {
+                if (wj) {
+                    unlink(wj->input);
+                    free(wj->input);
+                    free(wj->output);
+                    free(wj);
+                }
+                pthread_mutex_lock(&wc.send_mutex);
+                const char* message = "Could not store the input file";
+                send_line(fd, "FAILED %d %zu\n", id, strlen(message));
+                send_all(fd, message, strlen(message));
+                pthread_mutex_unlock(&wc.send_mutex);
+            } else {
+                cluster_log(log, "Worker: job %d queued (%lld bytes)\n", id, size);
+            }
+        } else {
+            cluster_log(log, "Worker: unexpected message: %s\n", line);
+            break;
+        }
+    }
+
+    /* A lost coordinator gives its files to other workers; ours are cancelled. */
+    shutdown(fd, SHUT_RDWR);
+    if (master) {
+        slopmaster_free(master);
+    }
+}
+
+int slopcluster_serve(int port, const char* workdir, int threads, FILE* log) {
+    int fd = socket(AF_INET6, SOCK_STREAM, 0);
+    struct sockaddr_in6 addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(port);
+    int on = 1, off = 0;
+    if (fd >= 0) {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+    }
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 4) != 0) {
+        cluster_log(log, "Worker: cannot listen on port %d: %s\n", port, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > SLOPMASTER_MAX_THREADS) {
+        threads = SLOPMASTER_MAX_THREADS;
+    }
+
+    for (;;) {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0) {
+            if (errno != EINTR) {
+                cluster_log(log, "Worker: accept failed: %s\n", strerror(errno));
+            }
+            continue;
+        }
+        set_timeouts(client, 0);
+        cluster_log(log, "Worker: coordinator connected\n");
+        worker_serve_connection(client, workdir, threads, log);
+        close(client);
+        cluster_log(log, "Worker: coordinator disconnected\n");
+    }
+}
+
+/* ---- Coordinator ---- */
+
+/*
+ * Relative cost per second of audio. Only the ratios matter: with one
+ * chain for the whole batch they order files by duration, and they let
+ * the same weights serve if chains ever vary per file.
+ */
+static double chain_cost(const SlopSettings* s) {
+    double cost = 1.0;
+    if (s->engine == SLOPMASTER_ENGINE_NATIVE || s->chain.vocal_mode) {
+        cost += 1.0;
+    }
+    if (s->chain.reverb) {
+        cost += 0.5;
+    }
+    if (s->keep_rate) {
+        cost += 0.5;
+    }
+    return cost;
+}
+
+static double file_seconds(const char* path) {
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    SNDFILE* file = sf_open(path, SFM_READ, &info);
+    if (file) {
+        sf_close(file);
+        if (info.samplerate > 0) {
+            return (double)info.frames / info.samplerate;
+        }
+    }
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size / CLUSTER_FALLBACK_BYTE_RATE : 0.0;
+}
+
+static void shard_finish(Cluster* cluster, int index, SlopStatus status, const char* message) {
+    pthread_mutex_lock(&cluster->mutex);
+    cluster->shards[index].state = SHARD_FINISHED;
+    cluster->remaining--;
+    if (status != SLOPMASTER_OK) {
+        cluster->failed++;
+    }
+    pthread_cond_broadcast(&cluster->cond);
+    pthread_mutex_unlock(&cluster->mutex);
+
+    const SlopCallbacks* cb = &cluster->callbacks[index];
+    if (status == SLOPMASTER_OK && cb->progress) {
+        cb->progress(index + 1, 1.0, cb->user_data);
+    }
+    if (cb->done) {
+        cb->done(index + 1, status, message, cb->user_data);
+    }
+}
+
+/*
+ * The costliest pending shard, now running on peer; -1 if none is
+ * pending or another ready peer has a smaller share of its threads busy
+ * and should take it instead.
+ */
+static int shard_take(Cluster* cluster, Peer* peer) {
+    int best = -1;
+    pthread_mutex_lock(&cluster->mutex);
+    for (int i = 0; i < cluster->num_peers; i++) {
+        Peer* q = &cluster->peers[i];
+        if (q != peer && q->ready && q->num_running < q->slots &&
+            q->num_running * peer->slots < peer->num_running * q->slots) {
+            pthread_mutex_unlock(&cluster->mutex);
+            return -1;
+        }
+    }
+    for (int i = 0; i < cluster->count; i++) {
+        Shard* s = &cluster->shards[i];
+        if (s->state == SHARD_PENDING && (best < 0 || s->cost > cluster->shards[best].cost)) {
+            best = i;
+        }
+    }
+    if (best >= 0) {
+        cluster->shards[best].state = SHARD_RUNNING;
+        cluster->shards[best].attempts++;
+        peer->running[peer->num_running++] = best;
+    }
+    pthread_mutex_unlock(&cluster->mutex);
+    return best;
+}
+
+static void peer_remove_running(Peer* peer, int slot) {
+    pthread_mutex_lock(&peer->cluster->mutex);
+    peer->running[slot] = peer->running[--peer->num_running];
+    pthread_mutex_unlock(&peer->cluster->mutex);
+}
+
+static void shard_requeue(Cluster* cluster, int index) {
+    pthread_mutex_lock(&cluster->mutex);
+    int give_up = cluster->shards[index].attempts >= SLOPCLUSTER_MAX_ATTEMPTS;
+    if (!give_up) {
+        cluster->shards[index].state = SHARD_PENDING;
+        pthread_cond_broadcast(&cluster->cond);
+    }
+    pthread_mutex_unlock(&cluster->mutex);
+
+    const SlopCallbacks* cb = &cluster->callbacks[index];
+    if (give_up) {
+        shard_finish(cluster, index, SLOPMASTER_FAILED, "Lost its worker too many times");
+    } else if (cb->progress) {
+        cb->progress(index + 1, 0.0, cb->user_data);
+    }
+}
+
+static int peer_connect(Peer* peer) {
+    struct addrinfo hints, *res, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(peer->host, peer->port, &hints, &res) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd >= 0) {
+        set_timeouts(fd, 1);
+    }
+    return fd;
+}
+
+static int peer_send_job(Peer* peer, int index) {
+    const char* input = peer->cluster->shards[index].input;
+    struct stat st;
+    if (stat(input, &st) != 0) {
+        return 1;
+    }
+    const char* base = strrchr(input, '/');
+    const char* dot = strrchr(base ? base + 1 : input, '.');
+    const char* ext = dot && job_extension(dot) ? dot : "-";
+    if (send_line(peer->conn.fd, "JOB %d %lld %s\n", index, (long long)st.st_size, ext) != 0 ||
+        send_file(peer->conn.fd, input, st.st_size) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int peer_running_index(Peer* peer, int index) {
+    for (int i = 0; i < peer->num_running; i++) {
+        if (peer->running[i] == index) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Handles one message; -1 if the connection is no longer usable. */
+static int peer_handle_message(Peer* peer, const char* line) {
+    Cluster* cluster = peer->cluster;
+    int index, slot;
+    double fraction;
+    long long size;
+
+    if (sscanf(line, "PROGRESS %d %lf", &index, &fraction) == 2) {
+        if (peer_running_index(peer, index) >= 0 && cluster->callbacks[index].progress) {
+            cluster->callbacks[index].progress(index + 1, fraction, cluster->callbacks[index].user_data);
+        }
+        return 0;
+    }
+    if (sscanf(line, "DONE %d %lld", &index, &size) == 2) {
+        if ((slot = peer_running_index(peer, index)) < 0 || size < 0) {
+            return -1;
+        }
+        const char* output = cluster->shards[index].output;
+        size_t len = strlen(output) + 8;
+        char* part = malloc(len);
+        if (!part) {
+            return -1;
+        }
+        snprintf(part, len, "%s.part", output);
+        int saved = conn_save(&peer->conn, part, size);
+        if (saved != 0) {
+            /* Still running as far as the caller knows, so it is requeued with the rest. */
+            unlink(part);
+            free(part);
+            return -1;
+        }
+        peer_remove_running(peer, slot);
+        if (rename(part, output) == 0) {
+            shard_finish(cluster, index, SLOPMASTER_OK, NULL);
+        } else {
+            unlink(part);
+            shard_finish(cluster, index, SLOPMASTER_FAILED, "Could not write the output file");
+        }
+        free(part);
+        return 0;
+    }
+    if (sscanf(line, "FAILED %d %lld", &index, &size) == 2) {
+        if ((slot = peer_running_index(peer, index)) < 0 || size < 0 || size >= CLUSTER_LINE) {
+            return -1;
+        }
+        char message[CLUSTER_LINE + 16];
+        int n = snprintf(message, sizeof(message), "%s: ", peer->host);
+        if (conn_read(&peer->conn, message + n, size) != 0) {
+            return -1;
+        }
+        message[n + size] = '\0';
+        peer_remove_running(peer, slot);
+        shard_finish(cluster, index, SLOPMASTER_FAILED, message);
+        return 0;
+    }
+    return -1;
+}
+
+static void* peer_thread(void* arg) {
+    Peer* peer = arg;
+    Cluster* cluster = peer->cluster;
+    char line[CLUSTER_LINE];
+    int fd = peer_connect(peer);
+
+    int slots = 0;
+    size_t text_size = strlen(cluster->settings_text);
+
+    conn_init(&peer->conn, fd);
+    if (fd < 0 || conn_read_line(&peer->conn, line, sizeof(line)) != 0 || sscanf(line, "HELLO %d", &slots) != 1 ||
+        send_line(fd, "SETTINGS %zu\n", text_size) != 0 || send_all(fd, cluster->settings_text, text_size) != 0) {
+        cluster_log(cluster->log, "Coordinator: no worker at %s:%s\n", peer->host, peer->port);
+        pthread_mutex_lock(&cluster->mutex);
+        cluster->connecting--;
+        pthread_mutex_unlock(&cluster->mutex);
+        goto lost;
+    }
+    cluster_log(cluster->log, "Coordinator: worker %s:%s has %d threads\n", peer->host, peer->port, slots);
+
+    /* Lets every worker join before the first files are handed out. */
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += CLUSTER_CONNECT_WAIT_SECONDS;
+    pthread_mutex_lock(&cluster->mutex);
+    peer->slots = slots < 1 ? 1 : slots > SLOPMASTER_MAX_THREADS ? SLOPMASTER_MAX_THREADS : slots;
+    peer->ready = 1;
+    cluster->connecting--;
+    pthread_cond_broadcast(&cluster->cond);
+    while (cluster->connecting > 0 && pthread_cond_timedwait(&cluster->cond, &cluster->mutex, &until) == 0) {
+    }
+    pthread_mutex_unlock(&cluster->mutex);
+
+    time_t heard = time(NULL);
+    for (;;) {
+        int index;
+        while (peer->num_running < peer->slots && (index = shard_take(cluster, peer)) >= 0) {
+            int sent = peer_send_job(peer, index);
+            if (sent > 0) {
+                peer_remove_running(peer, peer->num_running - 1);
+                shard_finish(cluster, index, SLOPMASTER_FAILED, "Cannot read the input file");
+                continue;
+            }
+            if (sent < 0) {
+                goto lost;
+            }
+            cluster_log(cluster->log, "Coordinator: %s -> %s:%s\n", cluster->shards[index].input, peer->host,
+                        peer->port);
+            heard = time(NULL);
+        }
+
+        if (peer->num_running == 0) {
+            /* Idle until a file is requeued or the batch ends. */
+            pthread_mutex_lock(&cluster->mutex);
+            int done = cluster->remaining == 0;
+            if (!done) {
+                struct timespec until;
+                clock_gettime(CLOCK_REALTIME, &until);
+                until.tv_sec += 1;
+                pthread_cond_timedwait(&cluster->cond, &cluster->mutex, &until);
+            }
+            pthread_mutex_unlock(&cluster->mutex);
+            if (done) {
+                break;
+            }
+            heard = time(NULL);
+            continue;
+        }
+
+        if (peer->conn.pos == peer->conn.len) {
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            int ready = poll(&pfd, 1, CLUSTER_POLL_MS);
+            if (ready < 0 && errno != EINTR) {
+                goto lost;
+            }
+            if (ready <= 0) {
+                if (time(NULL) - heard > SLOPCLUSTER_TIMEOUT_SECONDS) {
+                    cluster_log(cluster->log, "Coordinator: worker %s:%s timed out\n", peer->host, peer->port);
+                    goto lost;
+                }
+                continue;
+            }
+        }
+        if (conn_read_line(&peer->conn, line, sizeof(line)) != 0 || peer_handle_message(peer, line) != 0) {
+            goto lost;
+        }
+        heard = time(NULL);
+    }
+
+    close(fd);
+    return NULL;
+
+lost:
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (peer->num_running > 0 || fd >= 0) {
+        cluster_log(cluster->log, "Coordinator: lost worker %s:%s, requeueing %d files\n", peer->host, peer->port,
+                    peer->num_running);
+    }
+    pthread_mutex_lock(&cluster->mutex);
+    peer->ready = 0;
+    pthread_mutex_unlock(&cluster->mutex);
+    while (peer->num_running > 0) {
+        int index = peer->running[peer->num_running - 1];
+        peer_remove_running(peer, peer->num_running - 1);
+        shard_requeue(cluster, index);
+    }
+    pthread_mutex_lock(&cluster->mutex);
+    cluster->alive--;
+    pthread_cond_broadcast(&cluster->cond);
+    pthread_mutex_unlock(&cluster->mutex);
+    return NULL;
+}
+
+/* Splits "host:port,host:port"; a missing port is SLOPCLUSTER_DEFAULT_PORT. */
+static Peer* parse_workers(const char* workers, int* count) {
+    int capacity = 1;
+    for (const char* c = workers; *c; c++) {
+        capacity += *c == ',';
+    }
+    Peer* peers = calloc(capacity, sizeof(Peer));
+    char* list = strdup(workers);
+    *count = 0;
+    if (!peers || !list) {
+        free(peers);
+        free(list);
+        return NULL;
+    }
+    char* save = NULL;
+    for (char* item = strtok_r(list, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        Peer* peer = &peers[(*count)++];
+        char* colon = strrchr(item, ':');
+        char port[16];
+        if (colon) {
+            *colon = '\0';
+            snprintf(port, sizeof(port), "%s", colon + 1);
+        } else {
+            snprintf(port, sizeof(port), "%d", SLOPCLUSTER_DEFAULT_PORT);
+        }
+        peer->host = strdup(item);
+        peer->port = strdup(port);
+    }
+    free(list);
+    return peers;
+}
+
+int slopcluster_coordinate(const char* workers, char* const* inputs, int count, const char* output_dir,
+                           const SlopSettings* settings, const SlopCallbacks* callbacks) {
+    Cluster cluster;
+    int num_peers = 0;
+    memset(&cluster, 0, sizeof(cluster));
+    pthread_mutex_init(&cluster.mutex, NULL);
+    pthread_cond_init(&cluster.cond, NULL);
+    cluster.count = count;
+    cluster.remaining = count;
+    cluster.callbacks = callbacks;
+    cluster.log = settings->log;
+    cluster.settings_text = settings_serialize(settings);
+    cluster.shards = calloc(count ? count : 1, sizeof(Shard));
+    Peer* peers = parse_workers(workers, &num_peers);
+
+    if (!cluster.settings_text || !cluster.shards || !peers || num_peers == 0) {
+        for (int i = 0; i < count; i++) {
+            if (callbacks[i].done) {
+                callbacks[i].done(i + 1, SLOPMASTER_FAILED, "Could not start the coordinator", callbacks[i].user_data);
+            }
+        }
+        free(cluster.settings_text);
+        free(cluster.shards);
+        free(peers);
+        return count;
+    }
+
+    double cost = chain_cost(settings), total = 0;
+    for (int i = 0; i < count; i++) {
+        cluster.shards[i].input = inputs[i];
+        cluster.shards[i].output = slopmaster_output_path(output_dir, inputs[i], settings->format);
+        cluster.shards[i].cost = file_seconds(inputs[i]) * cost;
+        total += cluster.shards[i].cost;
+        if (!cluster.shards[i].output) {
+            shard_finish(&cluster, i, SLOPMASTER_FAILED, "Out of memory");
+        }
+    }
+    cluster_log(cluster.log, "Coordinator: %d files, estimated cost %.0f, %d workers\n", count, total, num_peers);
+
+    cluster.alive = num_peers;
+    cluster.connecting = num_peers;
+    cluster.peers = peers;
+    cluster.num_peers = num_peers;
+    for (int i = 0; i < num_peers; i++) {
+        peers[i].cluster = &cluster;
+        if (pthread_create(&peers[i].thread, NULL, peer_thread, &peers[i]) != 0) {
+            pthread_mutex_lock(&cluster.mutex);
+            cluster.alive--;
+            cluster.connecting--;
+            pthread_mutex_unlock(&cluster.mutex);
+            peers[i].cluster = NULL;
+        }
+    }
+
+    /* With every worker gone, whatever is left fails here. */
+    pthread_mutex_lock(&cluster.mutex);
+    while (cluster.remaining > 0 && cluster.alive > 0) {
+        pthread_cond_wait(&cluster.cond, &cluster.mutex);
+    }
+    pthread_mutex_unlock(&cluster.mutex);
+    for (int i = 0; i < num_peers; i++) {
+        if (peers[i].cluster) {
+            pthread_join(peers[i].thread, NULL);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (cluster.shards[i].state != SHARD_FINISHED) {
+            shard_finish(&cluster, i, SLOPMASTER_FAILED, "No workers left");
+        }
+    }
+
+    for (int i = 0; i < num_peers; i++) {
+        free(peers[i].host);
+        free(peers[i].port);
+    }
+    for (int i = 0; i < count; i++) {
+        free(cluster.shards[i].output);
+    }
+    free(peers);
+    free(cluster.shards);
+    free(cluster.settings_text);
+    pthread_cond_destroy(&cluster.cond);
+    pthread_mutex_destroy(&cluster.mutex);
+    return cluster.failed;
+}
@@ -0,0 +1,37 @@
+#ifndef SLOP_CLUSTER_H
+#define SLOP_CLUSTER_H
+
+#include <stdio.h>
+
+#include "slopMaster.h"
+
+#define SLOPCLUSTER_DEFAULT_PORT 7655
+/* A worker silent this long with files in flight is presumed dead. */
+#define SLOPCLUSTER_TIMEOUT_SECONDS 120
+/* Files whose workers die this many times are failed, not retried. */
+#define SLOPCLUSTER_MAX_ATTEMPTS 3
+
+/*
+ * Sharding a batch across machines. Workers listen on TCP and master
+ * whatever a coordinator sends them; files travel over the connection,
+ * so workers need no shared storage, only a working directory. The
+ * coordinator connects to every worker, hands out the costliest
+ * remaining file (duration x chain cost) whenever a worker has a free
+ * thread, and gives the files of a worker that dies or goes silent to
+ * the others.
+ */
+
+/* Serves coordinators one at a time. Returns only if port cannot be opened. */
+int slopcluster_serve(int port, const char* workdir, int threads, FILE* log);
+
+/*
+ * Masters inputs on workers, a comma-separated list of host:port, and
+ * writes each result to output_dir as slopmaster_output_path names it.
+ * callbacks[i] reports on inputs[i], with job i + 1. Album noise
+ * profiles and impulse responses are not sent to workers. Returns the
+ * number of files that failed.
+ */
+int slopcluster_coordinate(const char* workers, char* const* inputs, int count, const char* output_dir,
+                           const SlopSettings* settings, const SlopCallbacks* callbacks);
+
+#endif
@@ -0,0 +1,434 @@
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sndfile.h>
+
+#include "slopCompare.h"
+#include "slopDSP.h"
+#include "slopFFT.h"
+#include "slopResample.h"
+
+#define COMPARE_BLOCK 4096
+/* Frames of the original correlated to find the offset. */
+#define COMPARE_ALIGN_FRAMES 262144
+/* The correlated stretch starts at the first sample this loud. */
+#define COMPARE_ONSET_LEVEL 0.003f
+#define COMPARE_FFT_SIZE 4096
+#define COMPARE_HOP (COMPARE_FFT_SIZE / 2)
+#define COMPARE_BINS (COMPARE_FFT_SIZE / 2 + 1)
+
+typedef struct {
+    SNDFILE* file;
+    int channels;
+    float* scratch;
+    Resampler* resampler;
+} CompareSource;
+
+typedef struct {
+    FFT* fft;
+    float window[COMPARE_FFT_SIZE];
+    int band_first[COMPARE_BANDS];
+    int band_last[COMPARE_BANDS];
+    /* The last COMPARE_FFT_SIZE frames of each signal, per channel. */
+    float residual[DSP_CHANNELS][COMPARE_FFT_SIZE];
+    float processed[DSP_CHANNELS][COMPARE_FFT_SIZE];
+    int fill;
+    double residual_power[COMPARE_BANDS];
+    double processed_power[COMPARE_BANDS];
+    int64_t transforms;
+} BandAnalysis;
+
+static size_t compare_read_raw(CompareSource* src, float* stereo, size_t frames) {
+    if (frames > COMPARE_BLOCK) {
+        frames = COMPARE_BLOCK;
+    }
+    sf_count_t n = sf_readf_float(src->file, src->scratch, (sf_count_t)frames);
+    if (n <= 0) {
+        return 0;
+    }
+    int ch = src->channels;
+    for (sf_count_t i = 0; i < n; i++) {
+        stereo[2 * i] = src->scratch[i * ch];
+        stereo[2 * i + 1] = src->scratch[i * ch + (ch > 1 ? 1 : 0)];
+    }
+    return (size_t)n;
+}
+
+static size_t compare_input(void* user_data, float* stereo, size_t frames) {
+    return compare_read_raw(user_data, stereo, frames);
+}
+
+/* Fills stereo unless the file ends first. */
+static size_t compare_read(CompareSource* src, float* stereo, size_t frames) {
+    size_t done = 0;
+    while (done < frames) {
+        float* out = stereo + done * DSP_CHANNELS;
+        size_t n = src->resampler ? resampler_read(src->resampler, compare_input, src, out, frames - done)
+                                  : compare_read_raw(src, out, frames - done);
+        if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+static int compare_rewind(CompareSource* src) {
+    if (src->resampler) {
+        resampler_reset(src->resampler);
+    }
+    return sf_seek(src->file, 0, SEEK_SET) == 0 ? 0 : -1;
+}
+
+static int64_t compare_skip(CompareSource* src, int64_t frames, float* block) {
+    int64_t done = 0;
+    while (done < frames) {
+        size_t want = frames - done < COMPARE_BLOCK ? (size_t)(frames - done) : COMPARE_BLOCK;
+        size_t n = compare_read(src, block, want);
+        done += n;
+        if (n < want) {
+            break;
+        }
+    }
+    return done;
+}
+
+static int compare_open(CompareSource* src, const char* path, int rate, int* file_rate,
+                        char* message, size_t message_size) {
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    memset(src, 0, sizeof(*src));
+    src->file = sf_open(path, SFM_READ, &info);
+    if (!src->file) {
+        snprintf(message, message_size, "Cannot open %s: %s", path, sf_strerror(NULL));
+        return -1;
+    }
+    src->channels = info.channels;
+    src->scratch = malloc((size_t)COMPARE_BLOCK * info.channels * sizeof(float));
+    if (!src->scratch) {
+        snprintf(message, message_size, "Out of memory");
+        return -1;
+    }
+    *file_rate = info.samplerate;
+    if (rate > 0 && rate != info.samplerate) {
+        src->resampler = resampler_new(info.samplerate, rate);
+        if (!src->resampler) {
+            snprintf(message, message_size, "Cannot resample %s from %d to %d Hz", path, info.samplerate, rate);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void compare_close(CompareSource* src) {
+    if (src->file) {
+        sf_close(src->file);
+    }
+    free(src->scratch);
+    resampler_free(src->resampler);
+}
+
+/* The first frame at least COMPARE_ONSET_LEVEL loud, or 0 for a quiet file. */
+static int64_t find_onset(CompareSource* src, float* block) {
+    int64_t pos = 0;
+    size_t n;
+    while ((n = compare_read(src, block, COMPARE_BLOCK)) > 0) {
+        for (size_t i = 0; i < n * DSP_CHANNELS; i++) {
+            if (fabsf(block[i]) >= COMPARE_ONSET_LEVEL) {
+                return pos + (int64_t)(i / DSP_CHANNELS);
+            }
+        }
+        pos += n;
+    }
+    return 0;
+}
+
+/* Reads up to frames frames as a mono mix into mono, zero-filling the rest. */
+static void read_mono(CompareSource* src, float* mono, size_t frames, float* block) {
+    size_t done = 0;
+    while (done < frames) {
+        size_t want = frames - done < COMPARE_BLOCK ? frames - done : COMPARE_BLOCK;
+        size_t n = compare_read(src, block, want);
+        for (size_t i = 0; i < n; i++) {
+            mono[done + i] = 0.5f * (block[2 * i] + block[2 * i + 1]);
+        }
+        done += n;
+        if (n < want) {
+            break;
+        }
+    }
+    memset(mono + done, 0, (frames - done) * sizeof(float));
+}
+
+/*
+ * Correlates COMPARE_ALIGN_FRAMES of the original from its onset with the
+ * processed file around the same frame, up to max_lag either way.
+ */
+static int find_offset(CompareSource* original, CompareSource* processed, int64_t max_lag,
+                       float* block, int64_t* offset) {
+    int64_t onset = find_onset(original, block);
+    if (compare_rewind(original) != 0) {
+        return -1;
+    }
+
+    size_t span = COMPARE_ALIGN_FRAMES + 2 * (size_t)max_lag;
+    int n = COMPARE_ALIGN_FRAMES;
+    while ((size_t)n < span) {
+        n *= 2;
+    }
+    int bins = n / 2 + 1;
+    FFT* fft = fft_new(n);
+    float* a = calloc(n, sizeof(float));
+    float* b = calloc(n, sizeof(float));
+    float* a_re = malloc(bins * sizeof(float));
+    float* a_im = malloc(bins * sizeof(float));
+    float* b_re = malloc(bins * sizeof(float));
+    float* b_im = malloc(bins * sizeof(float));
+    int result = -1;
+    if (!fft || !a || !b || !a_re || !a_im || !b_re || !b_im) {
+        goto done;
+    }
+
+    /* b starts max_lag before the onset, so lag k of the correlation is offset k - max_lag. */
+    int64_t b_start = onset - max_lag;
+    int64_t lead = b_start < 0 ? -b_start : 0;
+    compare_skip(original, onset, block);
+    compare_skip(processed, b_start > 0 ? b_start : 0, block);
+    read_mono(original, a, COMPARE_ALIGN_FRAMES, block);
+    read_mono(processed, b + lead, span - (size_t)lead, block);
+
+    fft_real_forward(fft, a, a_re, a_im);
+    fft_real_forward(fft, b, b_re, b_im);
+    for (int k = 0; k < bins; k++) {
+        float re = b_re[k] * a_re[k] + b_im[k] * a_im[k];
+        float im = b_im[k] * a_re[k] - b_re[k] * a_im[k];
+        b_re[k] = re;
+        b_im[k] = im;
+    }
+    fft_real_inverse(fft, b_re, b_im, b);
+
+    int64_t best = max_lag;
+    for (int64_t k = 0; k <= 2 * max_lag; k++) {
+        if (fabsf(b[k]) > fabsf(b[best])) {
+            best = k;
+        }
+    }
+    *offset = best - max_lag;
+    result = 0;
+
+done:
+    fft_free(fft);
+    free(a);
+    free(b);
+    free(a_re);
+    free(a_im);
+    free(b_re);
+    free(b_im);
+    return result;
+}
+
+/* Drops whichever file leads so both start at the same aligned frame. */
+static int align_sources(CompareSource* original, CompareSource* processed, int64_t offset, float* block) {
+    if (compare_rewind(original) != 0 || compare_rewind(processed) != 0) {
+        return -1;
+    }
+    compare_skip(offset > 0 ? processed : original, offset > 0 ? offset : -offset, block);
+    return 0;
+}
+
+static void band_analysis_init(BandAnalysis* analysis, int rate, CompareResult* result) {
+    fft_window_hann(analysis->window, COMPARE_FFT_SIZE);
+    double bin_hz = (double)rate / COMPARE_FFT_SIZE;
+    for (int b = 0; b < COMPARE_BANDS; b++) {
+        double center = 1000.0 * pow(2.0, b - 5);
+        int first = (int)ceil(center / M_SQRT2 / bin_hz);
+        int last = (int)ceil(center * M_SQRT2 / bin_hz) - 1;
+        if (first < 1) first = 1;
+        if (last > COMPARE_BINS - 1) last = COMPARE_BINS - 1;
+        result->band_center[b] = b == 0 ? 31.5 : center;
+        analysis->band_first[b] = first;
+        analysis->band_last[b] = last;
+    }
+}
+
+static void band_power(BandAnalysis* analysis, const float* signal, double* power) {
+    float frame[COMPARE_FFT_SIZE], re[COMPARE_BINS], im[COMPARE_BINS];
+    for (int i = 0; i < COMPARE_FFT_SIZE; i++) {
+        frame[i] = signal[i] * analysis->window[i];
+    }
+    fft_real_forward(analysis->fft, frame, re, im);
+    for (int b = 0; b < COMPARE_BANDS; b++) {
+        double sum = 0.0;
+        for (int k = analysis->band_first[b]; k <= analysis->band_last[b]; k++) {
+            sum += (double)re[k] * re[k] + (double)im[k] * im[k];
+        }
+        power[b] += sum;
+    }
+}
+
+static void band_analysis_feed(BandAnalysis* analysis, const float* residual, const float* processed, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        for (int c = 0; c < DSP_CHANNELS; c++) {
+            analysis->residual[c][analysis->fill] = residual[i * DSP_CHANNELS + c];
+            analysis->processed[c][analysis->fill] = processed[i * DSP_CHANNELS + c];
+        }
+        if (++analysis->fill < COMPARE_FFT_SIZE) {
+            continue;
+        }
+        for (int c = 0; c < DSP_CHANNELS; c++) {
+            band_power(analysis, analysis->residual[c], analysis->residual_power);
+            band_power(analysis, analysis->processed[c], analysis->processed_power);
+            memmove(analysis->residual[c], analysis->residual[c] + COMPARE_HOP, COMPARE_HOP * sizeof(float));
+            memmove(analysis->processed[c], analysis->processed[c] + COMPARE_HOP, COMPARE_HOP * sizeof(float));
+        }
+        analysis->fill -= COMPARE_HOP;
+        analysis->transforms++;
+    }
+}
+
+static double power_db(double power) {
+    return power > 0.0 ? 10.0 * log10(power) : -INFINITY;
+}
+
+/* A silent residual nulls completely, whatever it is measured against. */
+static double null_db(double residual_db, double processed_db) {
+    return isinf(residual_db) || isinf(processed_db) ? -INFINITY : residual_db - processed_db;
+}
+
+int compare_files(const char* original, const char* processed, const char* difference,
+                  CompareResult* result, char* message, size_t message_size) {
+    CompareSource orig, proc;
+    int rate = 0, orig_rate = 0;
+    memset(result, 0, sizeof(*result));
+    memset(&orig, 0, sizeof(orig));
+    if (compare_open(&proc, processed, 0, &rate, message, message_size) != 0 ||
+        compare_open(&orig, original, rate, &orig_rate, message, message_size) != 0) {
+        compare_close(&orig);
+        compare_close(&proc);
+        return -1;
+    }
+    result->sample_rate = rate;
+
+    float* block = malloc(2 * (size_t)COMPARE_BLOCK * DSP_CHANNELS * sizeof(float));
+    float* other = block + COMPARE_BLOCK * DSP_CHANNELS;
+    BandAnalysis* analysis = calloc(1, sizeof(BandAnalysis));
+    SNDFILE* out = NULL;
+    int status = -1;
+    if (!block || !analysis || !(analysis->fft = fft_new(COMPARE_FFT_SIZE))) {
+        snprintf(message, message_size, "Out of memory");
+        goto done;
+    }
+
+    band_analysis_init(analysis, rate, result);
+
+    int64_t max_lag = (int64_t)rate * COMPARE_MAX_LAG_MS / 1000;
+    if (find_offset(&orig, &proc, max_lag, block, &result->offset) != 0) {
+        snprintf(message, message_size, "Cannot align %s with %s", processed, original);
+        goto done;
+    }
+
+    /* First pass: the least-squares gain over the whole overlap. */
+    double aa = 0.0, bb = 0.0, ab = 0.0;
+    if (align_sources(&orig, &proc, result->offset, block) != 0) {
+        snprintf(message, message_size, "Cannot seek in %s or %s", original, processed);
+        goto done;
+    }
+    for (;;) {
+        size_t n = compare_read(&orig, block, COMPARE_BLOCK);
+        size_t m = compare_read(&proc, other, n);
+        for (size_t i = 0; i < m * DSP_CHANNELS; i++) {
+            aa += (double)block[i] * block[i];
+            bb += (double)other[i] * other[i];
+            ab += (double)block[i] * other[i];
+        }
+        result->frames += m;
+        if (m < COMPARE_BLOCK) {
+            break;
+        }
+    }
+    if (result->frames == 0) {
+        snprintf(message, message_size, "%s and %s do not overlap", original, processed);
+        goto done;
+    }
+    double gain = aa > 0.0 ? ab / aa : 0.0;
+    result->gain_db = 20.0 * log10(fabs(gain));
+    result->inverted = gain < 0.0;
+    result->correlation = aa > 0.0 && bb > 0.0 ? ab / sqrt(aa * bb) : 0.0;
+
+    if (difference) {
+        SF_INFO info;
+        memset(&info, 0, sizeof(info));
+        info.samplerate = rate;
+        info.channels = DSP_CHANNELS;
+        info.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+        out = sf_open(difference, SFM_WRITE, &info);
+        if (!out) {
+            snprintf(message, message_size, "Cannot create %s: %s", difference, sf_strerror(NULL));
+            goto done;
+        }
+    }
+
+    /* Second pass: the residual's level, peak and bands. */
+    double rr = 0.0;
+    float peak = 0.0f;
+    if (align_sources(&orig, &proc, result->offset, block) != 0) {
+        snprintf(message, message_size, "Cannot seek in %s or %s", original, processed);
+        goto done;
+    }
+    for (int64_t left = result->frames; left > 0;) {
+        size_t want = left < COMPARE_BLOCK ? (size_t)left : COMPARE_BLOCK;
+        size_t n = compare_read(&orig, block, want);
+        size_t m = compare_read(&proc, other, n);
+        for (size_t i = 0; i < m * DSP_CHANNELS; i++) {
+            float r = other[i] - (float)gain * block[i];
+            rr += (double)r * r;
+            if (fabsf(r) > peak) peak = fabsf(r);
+            block[i] = r;
+        }
+        band_analysis_feed(analysis, block, other, m);
+        if (out && sf_writef_float(out, block, (sf_count_t)m) != (sf_count_t)m) {
+            snprintf(message, message_size, "Cannot write %s: %s", difference, sf_strerror(out));
+            goto done;
+        }
+        left -= m;
+        if (m < want) {
+            break;
+        }
+    }
+
+    double samples = (double)result->frames * DSP_CHANNELS;
+    result->processed_db = power_db(bb / samples);
+    result->residual_db = power_db(rr / samples);
+    result->residual_peak_db = peak > 0.0f ? 20.0 * log10(peak) : -INFINITY;
+    result->null_db = null_db(result->residual_db, result->processed_db);
+
+    /* A Hann frame's power over its bins, scaled to the mean square of the frame. */
+    double window_power = 0.0;
+    for (int i = 0; i < COMPARE_FFT_SIZE; i++) {
+        window_power += (double)analysis->window[i] * analysis->window[i];
+    }
+    double scale = 2.0 / ((double)COMPARE_FFT_SIZE * window_power * DSP_CHANNELS * analysis->transforms);
+    for (int b = 0; b < COMPARE_BANDS; b++) {
+        double residual = analysis->transforms ? power_db(analysis->residual_power[b] * scale) : -INFINITY;
+        result->band_residual_db[b] = residual;
+        result->band_null_db[b] = null_db(residual, power_db(analysis->processed_power[b] * scale));
+    }
+    status = 0;
+
+done:
+    if (out && sf_close(out) != 0 && status == 0) {
+        snprintf(message, message_size, "Cannot write %s", difference);
+        status = -1;
+    }
+    if (analysis) {
+        fft_free(analysis->fft);
+    }
+    free(analysis);
+    free(block);
+    compare_close(&orig);
+    compare_close(&proc);
+    return status;
+}
@@ -0,0 +1,48 @@
+#ifndef SLOP_COMPARE_H
+#define SLOP_COMPARE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Octave bands centred on 31.5 Hz to 16 kHz. */
+#define COMPARE_BANDS 10
+/* The furthest the processed file may lead or lag the original. */
+#define COMPARE_MAX_LAG_MS 500
+
+/*
+ * Null test of a processed file against its original. Both are read as
+ * stereo at the processed file's rate, the original resampled if needed.
+ * The offset is the peak of the FFT cross-correlation of the first loud
+ * stretch of both; the gain is the least-squares fit of the aligned
+ * original to the processed file over their whole overlap. Levels are
+ * RMS in dBFS, so a full-scale sine reads -3 dB.
+ */
+typedef struct {
+    int sample_rate;
+    /* Frames compared after alignment. */
+    int64_t frames;
+    /* The processed file's frame for the original's frame 0. */
+    int64_t offset;
+    /* Applied to the original before subtracting; inverted if negative. */
+    double gain_db;
+    int inverted;
+    /* Of the aligned files, over the whole overlap. */
+    double correlation;
+    double processed_db;
+    double residual_db;
+    double residual_peak_db;
+    /* The residual against the processed file, overall and per band. */
+    double null_db;
+    double band_center[COMPARE_BANDS];
+    double band_residual_db[COMPARE_BANDS];
+    double band_null_db[COMPARE_BANDS];
+} CompareResult;
+
+/*
+ * Writes the residual to difference as 32-bit float WAV unless it is
+ * NULL. 0 on success, otherwise -1 with message filled in.
+ */
+int compare_files(const char* original, const char* processed, const char* difference,
+                  CompareResult* result, char* message, size_t message_size);
+
+#endif
@@ -0,0 +1,421 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sndfile.h>
+
+#include "slopConvolve.h"
+#include "slopDSP.h"
+#include "slopFFT.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define CONV_FFT_SIZE (2 * CONV_BLOCK)
+#define CONV_BINS (CONV_BLOCK + 1)
+/* Bins rounded up to whole SIMD vectors. */
+#define CONV_STRIDE ((CONV_BINS + 3) & ~3)
+/* Onset at -60 dBFS, tail cut 90 dB below the peak. */
+#define CONV_ONSET 0.001f
+#define CONV_TAIL_DB -90.0
+/* Half-width of the resampling kernel in zero crossings. */
+#define CONV_RESAMPLE_TAPS 32
+
+struct ConvIR {
+    char* path;
+    double rate;
+    int refs;
+    int channels;
+    int parts;
+    size_t frames;
+    /* [channel][part][CONV_STRIDE] */
+    float* re;
+    float* im;
+    struct ConvIR* next;
+};
+
+struct Convolver {
+    ConvIR* ir;
+    FFT* fft;
+    int head;
+    int pos;
+    float wet;
+    /* [channel][part][CONV_STRIDE], a ring of input spectra. */
+    float* fdl_re;
+    float* fdl_im;
+    float in[DSP_CHANNELS][CONV_FFT_SIZE];
+    float out[DSP_CHANNELS][CONV_BLOCK];
+    float frame[CONV_FFT_SIZE];
+    float acc_re[CONV_STRIDE];
+    float acc_im[CONV_STRIDE];
+    float* delay;
+    int delay_size;
+    int delay_pos;
+    int delay_frames;
+};
+
+static pthread_mutex_t ir_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ConvIR* ir_list = NULL;
+
+static void ir_free(ConvIR* ir) {
+    free(ir->path);
+    free(ir->re);
+    free(ir->im);
+    free(ir);
+}
+
+/* Band-limited resampling with a Blackman-windowed sinc. */
+static float* resample(const float* in, size_t frames, int channels, double ratio, size_t* out_frames) {
+    size_t n = (size_t)ceil(frames * ratio);
+    float* out = calloc(n ? n * channels : 1, sizeof(float));
+    if (!out) {
+        return NULL;
+    }
+    double cutoff = ratio < 1.0 ? ratio : 1.0;
+    double width = CONV_RESAMPLE_TAPS / cutoff;
+
+    for (size_t i = 0; i < n; i++) {
+        double t = i / ratio;
+        long first = (long)ceil(t - width);
+        long last = (long)floor(t + width);
+        if (first < 0) first = 0;
+        if (last >= (long)frames) last = (long)frames - 1;
+        for (long k = first; k <= last; k++) {
+            double x = t - k;
+            double w = 0.42 + 0.5 * cos(M_PI * x / width) + 0.08 * cos(2 * M_PI * x / width);
+            double s = x == 0 ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+            float h = (float)(cutoff * s * w);
+            for (int c = 0; c < channels; c++) {
+                out[i * channels + c] += h * in[k * channels + c];
+            }
+        }
+    }
+    *out_frames = n;
+    return out;
+}
+
+ConvIR* conv_ir_from_samples(const float* samples, size_t frames, int channels, double rate) {
+    if (channels < 1 || channels > DSP_CHANNELS || frames == 0) {
+        return NULL;
+    }
+    ConvIR* ir = calloc(1, sizeof(ConvIR));
+    FFT* fft = fft_new(CONV_FFT_SIZE);
+    float* frame = malloc(CONV_FFT_SIZE * sizeof(float));
+    if (!ir || !fft || !frame) {
+        goto fail;
+    }
+
+    double energy = 0;
+    for (size_t i = 0; i < frames * channels; i++) {
+        energy += (double)samples[i] * samples[i];
+    }
+    if (energy <= 0) {
+        goto fail;
+    }
+    float scale = (float)(1.0 / sqrt(energy / channels));
+
+    ir->rate = rate;
+    ir->refs = 1;
+    ir->channels = channels;
+    ir->frames = frames;
+    ir->parts = (int)((frames + CONV_BLOCK - 1) / CONV_BLOCK);
+    size_t size = (size_t)channels * ir->parts * CONV_STRIDE;
+    ir->re = calloc(size, sizeof(float));
+    ir->im = calloc(size, sizeof(float));
+    if (!ir->re || !ir->im) {
+        goto fail;
+    }
+
+    for (int c = 0; c < channels; c++) {
+        for (int p = 0; p < ir->parts; p++) {
+            size_t start = (size_t)p * CONV_BLOCK;
+            memset(frame, 0, CONV_FFT_SIZE * sizeof(float));
+            for (size_t i = 0; i < CONV_BLOCK && start + i < frames; i++) {
+                frame[i] = samples[(start + i) * channels + c] * scale;
+            }
+            size_t at = ((size_t)c * ir->parts + p) * CONV_STRIDE;
+            fft_real_forward(fft, frame, ir->re + at, ir->im + at);
+        }
+    }
+    free(frame);
+    fft_free(fft);
+    return ir;
+
+fail:
+    free(frame);
+    fft_free(fft);
+    if (ir) {
+        ir_free(ir);
+    }
+    return NULL;
+}
+
+/* Reads up to two channels and trims them to the onset and the audible tail. */
+static float* load_trimmed(const char* path, int* channels, size_t* frames, double* rate) {
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    SNDFILE* file = sf_open(path, SFM_READ, &info);
+    if (!file) {
+        return NULL;
+    }
+    int ch = info.channels < DSP_CHANNELS ? info.channels : DSP_CHANNELS;
+    sf_count_t max = (sf_count_t)(CONV_MAX_IR_SECONDS * info.samplerate);
+    sf_count_t total = info.frames > 0 && info.frames < max ? info.frames : max;
+    float* raw = malloc((size_t)total * info.channels * sizeof(float));
+    float* out = malloc((size_t)total * ch * sizeof(float));
+    sf_count_t n = raw && out ? sf_readf_float(file, raw, total) : 0;
+    sf_close(file);
+
+    float peak = 0;
+    sf_count_t onset = -1, end = 0;
+    for (sf_count_t i = 0; i < n; i++) {
+        for (int c = 0; c < ch; c++) {
+            float x = fabsf(raw[i * info.channels + c]);
+            if (x > peak) peak = x;
+            if (onset < 0 && x > CONV_ONSET) onset = i;
+        }
+    }
+    float tail = peak * (float)db_to_linear(CONV_TAIL_DB);
+    for (sf_count_t i = 0; i < n; i++) {
+        for (int c = 0; c < ch; c++) {
+            if (fabsf(raw[i * info.channels + c]) > tail) end = i + 1;
+        }
+    }
+    if (onset < 0) {
+        free(raw);
+        free(out);
+        return NULL;
+    }
+
+    for (sf_count_t i = onset; i < end; i++) {
+        for (int c = 0; c < ch; c++) {
+            out[(i - onset) * ch + c] = raw[i * info.channels + c];
+        }
+    }
+    free(raw);
+    *channels = ch;
+    *frames = (size_t)(end - onset);
+    *rate = info.samplerate;
+    return out;
+}
+
+static ConvIR* ir_load(const char* path, double rate) {
+    int channels;
+    size_t frames;
+    double file_rate;
+    float* samples = load_trimmed(path, &channels, &frames, &file_rate);
+    if (!samples) {
+        return NULL;
+    }
+    if (file_rate != rate) {
+        float* resampled = resample(samples, frames, channels, rate / file_rate, &frames);
+        free(samples);
+        samples = resampled;
+        if (!samples) {
+            return NULL;
+        }
+    }
+    ConvIR* ir = conv_ir_from_samples(samples, frames, channels, rate);
+    free(samples);
+    if (ir && !(ir->path = strdup(path))) {
+        ir_free(ir);
+        return NULL;
+    }
+    return ir;
+}
+
+ConvIR* conv_ir_get(const char* path, double rate) {
+    pthread_mutex_lock(&ir_mutex);
+    for (ConvIR* ir = ir_list; ir; ir = ir->next) {
+        if (ir->rate == rate && strcmp(ir->path, path) == 0) {
+            ir->refs++;
+            pthread_mutex_unlock(&ir_mutex);
+            return ir;
+        }
+    }
+    pthread_mutex_unlock(&ir_mutex);
+
+    /* Loaded unlocked; if two workers race, the first one cached wins. */
+    ConvIR* loaded = ir_load(path, rate);
+    if (!loaded) {
+        return NULL;
+    }
+    pthread_mutex_lock(&ir_mutex);
+    for (ConvIR* ir = ir_list; ir; ir = ir->next) {
+        if (ir->rate == rate && strcmp(ir->path, path) == 0) {
+            ir->refs++;
+            pthread_mutex_unlock(&ir_mutex);
+            ir_free(loaded);
+            return ir;
+        }
+    }
+    loaded->next = ir_list;
+    ir_list = loaded;
+    pthread_mutex_unlock(&ir_mutex);
+    return loaded;
+}
+
+static void ir_retain(ConvIR* ir) {
+    pthread_mutex_lock(&ir_mutex);
+    ir->refs++;
+    pthread_mutex_unlock(&ir_mutex);
+}
+
+void conv_ir_release(ConvIR* ir) {
+    if (!ir) {
+        return;
+    }
+    pthread_mutex_lock(&ir_mutex);
+    int last = --ir->refs == 0;
+    if (last && ir->path) {
+        ConvIR** link = &ir_list;
+        while (*link != ir) {
+            link = &(*link)->next;
+        }
+        *link = ir->next;
+    }
+    pthread_mutex_unlock(&ir_mutex);
+    if (last) {
+        ir_free(ir);
+    }
+}
+
+double conv_ir_seconds(const ConvIR* ir) {
+    return ir->frames / ir->rate;
+}
+
+Convolver* convolver_new(ConvIR* ir) {
+    Convolver* conv = calloc(1, sizeof(Convolver));
+    if (!conv) {
+        return NULL;
+    }
+    size_t size = (size_t)DSP_CHANNELS * ir->parts * CONV_STRIDE;
+    conv->delay_size = (int)(CONV_MAX_PREDELAY_MS / 1000.0 * ir->rate) + 1;
+    conv->fft = fft_new(CONV_FFT_SIZE);
+    conv->fdl_re = calloc(size, sizeof(float));
+    conv->fdl_im = calloc(size, sizeof(float));
+    conv->delay = calloc((size_t)conv->delay_size * DSP_CHANNELS, sizeof(float));
+    if (!conv->fft || !conv->fdl_re || !conv->fdl_im || !conv->delay) {
+        convolver_free(conv);
+        return NULL;
+    }
+    ir_retain(ir);
+    conv->ir = ir;
+    return conv;
+}
+
+void convolver_configure(Convolver* conv, double predelay_ms, float wet) {
+    if (predelay_ms > CONV_MAX_PREDELAY_MS) {
+        predelay_ms = CONV_MAX_PREDELAY_MS;
+    }
+    int frames = (int)(predelay_ms / 1000.0 * conv->ir->rate) - CONV_BLOCK;
+    conv->delay_frames = frames > 0 ? frames : 0;
+    conv->wet = wet;
+}
+
+/* acc += x * h over n complex bins. */
+static void complex_mac(float* acc_re, float* acc_im, const float* x_re, const float* x_im,
+                        const float* h_re, const float* h_im, int n) {
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= n; i += 4) {
+        __m128 xr = _mm_loadu_ps(x_re + i), xi = _mm_loadu_ps(x_im + i);
+        __m128 hr = _mm_loadu_ps(h_re + i), hi = _mm_loadu_ps(h_im + i);
+        __m128 re = _mm_sub_ps(_mm_mul_ps(xr, hr), _mm_mul_ps(xi, hi));
+        __m128 im = _mm_add_ps(_mm_mul_ps(xr, hi), _mm_mul_ps(xi, hr));
+        _mm_storeu_ps(acc_re + i, _mm_add_ps(_mm_loadu_ps(acc_re + i), re));
+        _mm_storeu_ps(acc_im + i, _mm_add_ps(_mm_loadu_ps(acc_im + i), im));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t xr = vld1q_f32(x_re + i), xi = vld1q_f32(x_im + i);
+        float32x4_t hr = vld1q_f32(h_re + i), hi = vld1q_f32(h_im + i);
+        float32x4_t re = vmlsq_f32(vmlaq_f32(vld1q_f32(acc_re + i), xr, hr), xi, hi);
+        float32x4_t im = vmlaq_f32(vmlaq_f32(vld1q_f32(acc_im + i), xr, hi), xi, hr);
+        vst1q_f32(acc_re + i, re);
+        vst1q_f32(acc_im + i, im);
+    }
+#endif
+    for (; i < n; i++) {
+        acc_re[i] += x_re[i] * h_re[i] - x_im[i] * h_im[i];
+        acc_im[i] += x_re[i] * h_im[i] + x_im[i] * h_re[i];
+    }
+}
+
+/* Overlap-save: the newest two blocks in, the last block of the result out. */
+static void convolver_block(Convolver* conv) {
+    const ConvIR* ir = conv->ir;
+    int parts = ir->parts;
+
+    for (int c = 0; c < DSP_CHANNELS; c++) {
+        int hc = c < ir->channels ? c : ir->channels - 1;
+        float* fdl_re = conv->fdl_re + (size_t)c * parts * CONV_STRIDE;
+        float* fdl_im = conv->fdl_im + (size_t)c * parts * CONV_STRIDE;
+        const float* h_re = ir->re + (size_t)hc * parts * CONV_STRIDE;
+        const float* h_im = ir->im + (size_t)hc * parts * CONV_STRIDE;
+
+        fft_real_forward(conv->fft, conv->in[c], fdl_re + (size_t)conv->head * CONV_STRIDE,
+                         fdl_im + (size_t)conv->head * CONV_STRIDE);
+        memset(conv->acc_re, 0, sizeof(conv->acc_re));
+        memset(conv->acc_im, 0, sizeof(conv->acc_im));
+        for (int p = 0, slot = conv->head; p < parts; p++) {
+            complex_mac(conv->acc_re, conv->acc_im, fdl_re + (size_t)slot * CONV_STRIDE,
+                        fdl_im + (size_t)slot * CONV_STRIDE, h_re + (size_t)p * CONV_STRIDE,
+                        h_im + (size_t)p * CONV_STRIDE, CONV_BINS);
+            slot = slot > 0 ? slot - 1 : parts - 1;
+        }
+        fft_real_inverse(conv->fft, conv->acc_re, conv->acc_im, conv->frame);
+        memcpy(conv->out[c], conv->frame + CONV_BLOCK, CONV_BLOCK * sizeof(float));
+        memcpy(conv->in[c], conv->in[c] + CONV_BLOCK, CONV_BLOCK * sizeof(float));
+    }
+    conv->head = conv->head + 1 < parts ? conv->head + 1 : 0;
+}
+
+void convolver_process(Convolver* conv, float* samples, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        float* x = samples + i * DSP_CHANNELS;
+        int read = conv->delay_pos - conv->delay_frames;
+        if (read < 0) {
+            read += conv->delay_size;
+        }
+        for (int c = 0; c < DSP_CHANNELS; c++) {
+            conv->delay[conv->delay_pos * DSP_CHANNELS + c] = x[c];
+            conv->in[c][CONV_BLOCK + conv->pos] = conv->delay[read * DSP_CHANNELS + c];
+            x[c] += conv->wet * conv->out[c][conv->pos];
+        }
+        conv->delay_pos = conv->delay_pos + 1 < conv->delay_size ? conv->delay_pos + 1 : 0;
+        if (++conv->pos == CONV_BLOCK) {
+            convolver_block(conv);
+            conv->pos = 0;
+        }
+    }
+}
+
+void convolver_reset(Convolver* conv) {
+    size_t size = (size_t)DSP_CHANNELS * conv->ir->parts * CONV_STRIDE;
+    memset(conv->fdl_re, 0, size * sizeof(float));
+    memset(conv->fdl_im, 0, size * sizeof(float));
+    memset(conv->in, 0, sizeof(conv->in));
+    memset(conv->out, 0, sizeof(conv->out));
+    memset(conv->delay, 0, (size_t)conv->delay_size * DSP_CHANNELS * sizeof(float));
+    conv->head = conv->pos = conv->delay_pos = 0;
+}
+
+void convolver_free(Convolver* conv) {
+    if (!conv) {
+        return;
+    }
+    conv_ir_release(conv->ir);
+    fft_free(conv->fft);
+    free(conv->fdl_re);
+    free(conv->fdl_im);
+    free(conv->delay);
+    free(conv);
+}
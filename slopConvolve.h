@@ -0,0 +1,41 @@
+#ifndef SLOP_CONVOLVE_H
+#define SLOP_CONVOLVE_H
+
+#include <stddef.h>
+
+/*
+ * Uniformly partitioned convolution: the impulse response is cut into
+ * CONV_BLOCK-frame partitions whose spectra are multiplied with the
+ * spectra of recent input blocks. The wet path is delayed by one block,
+ * so pre-delays shorter than that are rounded up to it.
+ */
+#define CONV_BLOCK 512
+#define CONV_MAX_IR_SECONDS 10.0
+#define CONV_MAX_PREDELAY_MS 500.0
+
+/*
+ * An impulse response file resampled to one rate, with its leading
+ * silence and inaudible tail trimmed and normalised to unit energy.
+ * Loaded IRs are cached by path and rate and shared read-only by every
+ * convolver that uses them.
+ */
+typedef struct ConvIR ConvIR;
+typedef struct Convolver Convolver;
+
+/* NULL if the file cannot be read or is silent. */
+ConvIR* conv_ir_get(const char* path, double rate);
+ConvIR* conv_ir_from_samples(const float* samples, size_t frames, int channels, double rate);
+void conv_ir_release(ConvIR* ir);
+double conv_ir_seconds(const ConvIR* ir);
+
+/*
+ * Mixes interleaved stereo in place with the wet reverb at wet gain. A
+ * mono IR is used for both channels. Holds a reference to ir.
+ */
+Convolver* convolver_new(ConvIR* ir);
+void convolver_configure(Convolver* conv, double predelay_ms, float wet);
+void convolver_process(Convolver* conv, float* samples, size_t frames);
+void convolver_reset(Convolver* conv);
+void convolver_free(Convolver* conv);
+
+#endif
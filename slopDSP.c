@@ -0,0 +1,623 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slopDSP.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#ifndef M_SQRT1_2
+#define M_SQRT1_2 0.70710678118654752440
+#endif
+
+double db_to_linear(double db) {
+    return pow(10.0, db / 20.0);
+}
+
+double linear_to_db(double linear) {
+    return linear > 1e-10 ? 20.0 * log10(linear) : -200.0;
+}
+
+static double time_coef(double rate, double seconds) {
+    return seconds > 0 ? 1.0 - exp(-1.0 / (rate * seconds)) : 1.0;
+}
+
+void biquad_reset(Biquad* bq) {
+    memset(bq->z1, 0, sizeof(bq->z1));
+    memset(bq->z2, 0, sizeof(bq->z2));
+}
+
+static void biquad_set(Biquad* bq, double b0, double b1, double b2, double a0, double a1, double a2) {
+    bq->b0 = b0 / a0;
+    bq->b1 = b1 / a0;
+    bq->b2 = b2 / a0;
+    bq->a1 = a1 / a0;
+    bq->a2 = a2 / a0;
+}
+
+void biquad_set_lowpass(Biquad* bq, double rate, double freq, double q) {
+    double w0 = 2 * M_PI * freq / rate;
+    double alpha = sin(w0) / (2 * q);
+    double c = cos(w0);
+    biquad_set(bq, (1 - c) / 2, 1 - c, (1 - c) / 2, 1 + alpha, -2 * c, 1 - alpha);
+}
+
+void biquad_set_highpass(Biquad* bq, double rate, double freq, double q) {
+    double w0 = 2 * M_PI * freq / rate;
+    double alpha = sin(w0) / (2 * q);
+    double c = cos(w0);
+    biquad_set(bq, (1 + c) / 2, -(1 + c), (1 + c) / 2, 1 + alpha, -2 * c, 1 - alpha);
+}
+
+void biquad_set_bandpass(Biquad* bq, double rate, double freq, double width_hz) {
+    double w0 = 2 * M_PI * freq / rate;
+    double alpha = sin(w0) / (2 * freq / width_hz);
+    double c = cos(w0);
+    biquad_set(bq, alpha, 0, -alpha, 1 + alpha, -2 * c, 1 - alpha);
+}
+
+static void biquad_set_peaking_alpha(Biquad* bq, double w0, double alpha, double gain_db) {
+    double a = pow(10.0, gain_db / 40.0);
+    double c = cos(w0);
+    biquad_set(bq, 1 + alpha * a, -2 * c, 1 - alpha * a, 1 + alpha / a, -2 * c, 1 - alpha / a);
+}
+
+void biquad_set_peaking(Biquad* bq, double rate, double freq, double q, double gain_db) {
+    double w0 = 2 * M_PI * freq / rate;
+    biquad_set_peaking_alpha(bq, w0, sin(w0) / (2 * q), gain_db);
+}
+
+void biquad_set_peaking_octaves(Biquad* bq, double rate, double freq, double octaves, double gain_db) {
+    double w0 = 2 * M_PI * freq / rate;
+    double alpha = sin(w0) * sinh(log(2.0) / 2 * octaves * w0 / sin(w0));
+    biquad_set_peaking_alpha(bq, w0, alpha, gain_db);
+}
+
+void biquad_set_allpass(Biquad* bq, double rate, double freq, double q) {
+    double w0 = 2 * M_PI * freq / rate;
+    double alpha = sin(w0) / (2 * q);
+    double c = cos(w0);
+    biquad_set(bq, 1 - alpha, -2 * c, 1 + alpha, 1 + alpha, -2 * c, 1 - alpha);
+}
+
+static inline double biquad_tick(Biquad* bq, int c, double in) {
+    double out = bq->b0 * in + bq->z1[c];
+    bq->z1[c] = bq->b1 * in - bq->a1 * out + bq->z2[c];
+    bq->z2[c] = bq->b2 * in - bq->a2 * out;
+    return out;
+}
+
+void biquad_process(Biquad* bq, float* samples, size_t frames) {
+    for (int c = 0; c < DSP_CHANNELS; c++) {
+        double z1 = bq->z1[c], z2 = bq->z2[c];
+        float* s = samples + c;
+        for (size_t i = 0; i < frames; i++, s += DSP_CHANNELS) {
+            double in = *s;
+            double out = bq->b0 * in + z1;
+            z1 = bq->b1 * in - bq->a1 * out + z2;
+            z2 = bq->b2 * in - bq->a2 * out;
+            *s = (float)out;
+        }
+        bq->z1[c] = z1;
+        bq->z2[c] = z2;
+    }
+}
+
+void compander_init(Compander* comp, double rate, double attack, double decay,
+                    const double* in_db, const double* out_db, int num_points, double gain_db) {
+    if (num_points > DSP_MAX_COMPAND_POINTS) {
+        num_points = DSP_MAX_COMPAND_POINTS;
+    }
+    comp->num_points = num_points;
+    memcpy(comp->in_db, in_db, num_points * sizeof(double));
+    memcpy(comp->out_db, out_db, num_points * sizeof(double));
+    comp->attack_coef = time_coef(rate, attack);
+    comp->decay_coef = time_coef(rate, decay);
+    comp->gain_db = gain_db;
+}
+
+static double compander_transfer(const Compander* comp, double in_db) {
+    int n = comp->num_points;
+    if (n == 0) {
+        return in_db;
+    }
+    if (in_db <= comp->in_db[0]) {
+        return in_db + comp->out_db[0] - comp->in_db[0];
+    }
+    for (int i = 1; i < n; i++) {
+        if (in_db <= comp->in_db[i]) {
+            double t = (in_db - comp->in_db[i - 1]) / (comp->in_db[i] - comp->in_db[i - 1]);
+            return comp->out_db[i - 1] + t * (comp->out_db[i] - comp->out_db[i - 1]);
+        }
+    }
+    return in_db + comp->out_db[n - 1] - comp->in_db[n - 1];
+}
+
+void compander_process(Compander* comp, float* samples, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        for (int c = 0; c < DSP_CHANNELS; c++) {
+            float* s = &samples[i * DSP_CHANNELS + c];
+            double level = fabs(*s);
+            double coef = level > comp->env[c] ? comp->attack_coef : comp->decay_coef;
+            comp->env[c] += coef * (level - comp->env[c]);
+
+            double env_db = linear_to_db(comp->env[c]);
+            double gain_db = compander_transfer(comp, env_db) - env_db + comp->gain_db;
+            *s = (float)(*s * db_to_linear(gain_db));
+        }
+    }
+}
+
+void multiband_init(Multiband* mb, double rate, double attack, double decay) {
+    memset(mb, 0, sizeof(*mb));
+    mb->attack_coef = (float)time_coef(rate, attack);
+    mb->decay_coef = (float)time_coef(rate, decay);
+}
+
+/* An LR4 section is two cascaded Butterworth biquads; LR4 low + high is this allpass. */
+void multiband_set_crossovers(Multiband* mb, double rate, double low_hz, double high_hz) {
+    for (int i = 0; i < 2; i++) {
+        biquad_set_lowpass(&mb->low_lp[i], rate, low_hz, M_SQRT1_2);
+        biquad_set_highpass(&mb->low_hp[i], rate, low_hz, M_SQRT1_2);
+        biquad_set_lowpass(&mb->high_lp[i], rate, high_hz, M_SQRT1_2);
+        biquad_set_highpass(&mb->high_hp[i], rate, high_hz, M_SQRT1_2);
+    }
+    biquad_set_allpass(&mb->low_allpass, rate, high_hz, M_SQRT1_2);
+}
+
+/*
+ * Same transfer as a compander with points -80/-80|threshold/threshold/ratio|0/0:
+ * linear in dB below and above the threshold and unity outside [-80, 0] dB.
+ */
+void multiband_set_band(Multiband* mb, int band, double threshold_db, double ratio, double gain_db) {
+    const double floor_db = -80;
+    const double to_log2 = 1.0 / (20.0 * log10(2.0));
+
+    if (threshold_db < floor_db) threshold_db = floor_db;
+    if (threshold_db > 0) threshold_db = 0;
+    double knee_out = threshold_db / (ratio > 0 ? ratio : 1);
+    double below = threshold_db > floor_db ? (knee_out - floor_db) / (threshold_db - floor_db) : 1.0;
+    double above = threshold_db < 0 ? knee_out / threshold_db : 1.0;
+
+    for (int c = 0; c < DSP_CHANNELS; c++) {
+        int lane = band * DSP_CHANNELS + c;
+        mb->floor[lane] = (float)(floor_db * to_log2);
+        mb->knee[lane] = (float)(threshold_db * to_log2);
+        mb->slope_below[lane] = (float)(below - 1);
+        mb->offset_below[lane] = (float)(floor_db * (1 - below) * to_log2);
+        mb->slope_above[lane] = (float)(above - 1);
+        mb->makeup[lane] = (float)(gain_db * to_log2);
+    }
+}
+
+void multiband_reset(Multiband* mb) {
+    for (int i = 0; i < 2; i++) {
+        biquad_reset(&mb->low_lp[i]);
+        biquad_reset(&mb->low_hp[i]);
+        biquad_reset(&mb->high_lp[i]);
+        biquad_reset(&mb->high_hp[i]);
+    }
+    biquad_reset(&mb->low_allpass);
+    memset(mb->env, 0, sizeof(mb->env));
+}
+
+static void multiband_split(Multiband* mb, const float* samples, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        float* lane = &mb->lanes[i * DSP_BAND_LANES];
+        for (int c = 0; c < DSP_CHANNELS; c++) {
+            double in = samples[i * DSP_CHANNELS + c];
+            double low = biquad_tick(&mb->low_lp[1], c, biquad_tick(&mb->low_lp[0], c, in));
+            double rest = biquad_tick(&mb->low_hp[1], c, biquad_tick(&mb->low_hp[0], c, in));
+            double mid = biquad_tick(&mb->high_lp[1], c, biquad_tick(&mb->high_lp[0], c, rest));
+            double high = biquad_tick(&mb->high_hp[1], c, biquad_tick(&mb->high_hp[0], c, rest));
+            lane[c] = (float)biquad_tick(&mb->low_allpass, c, low);
+            lane[DSP_CHANNELS + c] = (float)mid;
+            lane[2 * DSP_CHANNELS + c] = (float)high;
+        }
+    }
+}
+
+#if defined(__SSE2__) || defined(__ARM_NEON)
+
+#if defined(__SSE2__)
+typedef __m128 vec4;
+#define vec_load _mm_loadu_ps
+#define vec_store _mm_storeu_ps
+#define vec_set1 _mm_set1_ps
+#define vec_add _mm_add_ps
+#define vec_sub _mm_sub_ps
+#define vec_mul _mm_mul_ps
+#define vec_min _mm_min_ps
+#define vec_max _mm_max_ps
+
+static inline vec4 vec_abs(vec4 a) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+}
+
+/* a > b ? x : y per lane. */
+static inline vec4 vec_select_gt(vec4 a, vec4 b, vec4 x, vec4 y) {
+    __m128 mask = _mm_cmpgt_ps(a, b);
+    return _mm_or_ps(_mm_and_ps(mask, x), _mm_andnot_ps(mask, y));
+}
+
+/* Splits positive x into its exponent and a mantissa in [1, 2). */
+static inline vec4 vec_frexp(vec4 x, vec4* mantissa) {
+    __m128i bits = _mm_castps_si128(x);
+    *mantissa = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)),
+                                              _mm_set1_epi32(0x3f800000)));
+    return _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+}
+
+static inline vec4 vec_floor(vec4 x) {
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+}
+
+/* 2^n for integral n in [-126, 127]. */
+static inline vec4 vec_pow2i(vec4 n) {
+    return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23));
+}
+#else
+typedef float32x4_t vec4;
+#define vec_load vld1q_f32
+#define vec_store vst1q_f32
+#define vec_set1 vdupq_n_f32
+#define vec_add vaddq_f32
+#define vec_sub vsubq_f32
+#define vec_mul vmulq_f32
+#define vec_min vminq_f32
+#define vec_max vmaxq_f32
+#define vec_abs vabsq_f32
+
+static inline vec4 vec_select_gt(vec4 a, vec4 b, vec4 x, vec4 y) {
+    return vbslq_f32(vcgtq_f32(a, b), x, y);
+}
+
+static inline vec4 vec_frexp(vec4 x, vec4* mantissa) {
+    int32x4_t bits = vreinterpretq_s32_f32(x);
+    *mantissa = vreinterpretq_f32_s32(vorrq_s32(vandq_s32(bits, vdupq_n_s32(0x007fffff)),
+                                                vdupq_n_s32(0x3f800000)));
+    return vcvtq_f32_s32(vsubq_s32(vshrq_n_s32(bits, 23), vdupq_n_s32(127)));
+}
+
+static inline vec4 vec_floor(vec4 x) {
+    float32x4_t t = vcvtq_f32_s32(vcvtq_s32_f32(x));
+    uint32x4_t one = vandq_u32(vcgtq_f32(t, x), vreinterpretq_u32_f32(vdupq_n_f32(1.0f)));
+    return vsubq_f32(t, vreinterpretq_f32_u32(one));
+}
+
+static inline vec4 vec_pow2i(vec4 n) {
+    return vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127)), 23));
+}
+#endif
+
+/* Polynomial fits good to about 1e-4 dB, far below what a gain stage can hear. */
+static inline vec4 vec_log2(vec4 x) {
+    vec4 m;
+    vec4 e = vec_frexp(x, &m);
+    vec4 t = vec_sub(m, vec_set1(1.0f));
+    vec4 p = vec_set1(0.0430049578f);
+    p = vec_add(vec_mul(p, t), vec_set1(-0.187488605f));
+    p = vec_add(vec_mul(p, t), vec_set1(0.409470299f));
+    p = vec_add(vec_mul(p, t), vec_set1(-0.706486449f));
+    p = vec_add(vec_mul(p, t), vec_set1(1.44149241f));
+    p = vec_add(vec_mul(p, t), vec_set1(1.65146709e-05f));
+    return vec_add(e, p);
+}
+
+static inline vec4 vec_exp2(vec4 x) {
+    x = vec_min(vec_max(x, vec_set1(-126.0f)), vec_set1(126.0f));
+    vec4 n = vec_floor(x);
+    vec4 f = vec_sub(x, n);
+    vec4 p = vec_set1(0.0136703095f);
+    p = vec_add(vec_mul(p, f), vec_set1(0.0517449978f));
+    p = vec_add(vec_mul(p, f), vec_set1(0.241604357f));
+    p = vec_add(vec_mul(p, f), vec_set1(0.692972922f));
+    p = vec_add(vec_mul(p, f), vec_set1(1.00000349f));
+    return vec_mul(p, vec_pow2i(n));
+}
+
+static void multiband_gains(Multiband* mb, size_t frames) {
+    vec4 attack = vec_set1(mb->attack_coef), decay = vec_set1(mb->decay_coef);
+    vec4 env_floor = vec_set1(1e-10f), zero = vec_set1(0.0f);
+    vec4 env[2], bottom[2], knee[2], slope_below[2], offset_below[2], slope_above[2], makeup[2];
+
+    for (int v = 0; v < 2; v++) {
+        env[v] = vec_load(mb->env + 4 * v);
+        bottom[v] = vec_load(mb->floor + 4 * v);
+        knee[v] = vec_load(mb->knee + 4 * v);
+        slope_below[v] = vec_load(mb->slope_below + 4 * v);
+        offset_below[v] = vec_load(mb->offset_below + 4 * v);
+        slope_above[v] = vec_load(mb->slope_above + 4 * v);
+        makeup[v] = vec_load(mb->makeup + 4 * v);
+    }
+
+    for (size_t i = 0; i < frames; i++) {
+        float* lane = &mb->lanes[i * DSP_BAND_LANES];
+        for (int v = 0; v < 2; v++) {
+            vec4 in = vec_load(lane + 4 * v);
+            vec4 level = vec_abs(in);
+            vec4 coef = vec_select_gt(level, env[v], attack, decay);
+            env[v] = vec_max(vec_add(env[v], vec_mul(coef, vec_sub(level, env[v]))), env_floor);
+
+            vec4 x = vec_min(vec_max(vec_log2(env[v]), bottom[v]), zero);
+            vec4 gain = vec_select_gt(x, knee[v], vec_mul(slope_above[v], x),
+                                      vec_add(vec_mul(slope_below[v], x), offset_below[v]));
+            vec_store(lane + 4 * v, vec_mul(in, vec_exp2(vec_add(gain, makeup[v]))));
+        }
+    }
+
+    vec_store(mb->env, env[0]);
+    vec_store(mb->env + 4, env[1]);
+}
+
+#else
+
+static void multiband_gains(Multiband* mb, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        float* lane = &mb->lanes[i * DSP_BAND_LANES];
+        for (int l = 0; l < DSP_BANDS * DSP_CHANNELS; l++) {
+            float level = fabsf(lane[l]);
+            float coef = level > mb->env[l] ? mb->attack_coef : mb->decay_coef;
+            mb->env[l] += coef * (level - mb->env[l]);
+            if (mb->env[l] < 1e-10f) mb->env[l] = 1e-10f;
+
+            float x = log2f(mb->env[l]);
+            if (x < mb->floor[l]) x = mb->floor[l];
+            if (x > 0) x = 0;
+            float gain = x > mb->knee[l] ? mb->slope_above[l] * x
+                                         : mb->slope_below[l] * x + mb->offset_below[l];
+            lane[l] *= exp2f(gain + mb->makeup[l]);
+        }
+    }
+}
+
+#endif
+
+void multiband_process(Multiband* mb, float* samples, size_t frames) {
+    while (frames > 0) {
+        size_t block = frames < DSP_BAND_BLOCK ? frames : DSP_BAND_BLOCK;
+        multiband_split(mb, samples, block);
+        multiband_gains(mb, block);
+        for (size_t i = 0; i < block; i++) {
+            const float* lane = &mb->lanes[i * DSP_BAND_LANES];
+            for (int c = 0; c < DSP_CHANNELS; c++) {
+                samples[i * DSP_CHANNELS + c] = lane[c] + lane[DSP_CHANNELS + c] + lane[2 * DSP_CHANNELS + c];
+            }
+        }
+        samples += block * DSP_CHANNELS;
+        frames -= block;
+    }
+}
+
+void compressor_init(Compressor* comp, double rate, double threshold_db, double ratio,
+                     double attack_ms, double release_ms, double makeup, double knee_db) {
+    comp->threshold_db = threshold_db;
+    comp->ratio = ratio > 1 ? ratio : 1;
+    comp->knee_db = knee_db;
+    comp->makeup = makeup;
+    comp->attack_coef = time_coef(rate, attack_ms / 1000.0);
+    comp->release_coef = time_coef(rate, release_ms / 1000.0);
+}
+
+static double compressor_gain_db(const Compressor* comp, double level_db) {
+    double over = level_db - comp->threshold_db;
+    double knee = comp->knee_db;
+
+    if (2 * over < -knee) {
+        return 0.0;
+    }
+    if (knee > 0 && 2 * fabs(over) <= knee) {
+        double x = over + knee / 2;
+        return (1.0 / comp->ratio - 1.0) * x * x / (2 * knee);
+    }
+    return over / comp->ratio - over;
+}
+
+void compressor_process(Compressor* comp, float* samples, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        float* s = &samples[i * DSP_CHANNELS];
+        double power = (s[0] * s[0] + s[1] * s[1]) * 0.5;
+        double coef = power > comp->env ? comp->attack_coef : comp->release_coef;
+        comp->env += coef * (power - comp->env);
+
+        double level_db = comp->env > 1e-20 ? 10.0 * log10(comp->env) : -200.0;
+        float gain = (float)(db_to_linear(compressor_gain_db(comp, level_db)) * comp->makeup);
+        s[0] *= gain;
+        s[1] *= gain;
+    }
+}
+
+int echo_init(Echo* echo, double rate, double max_delay_ms) {
+    memset(echo, 0, sizeof(*echo));
+    echo->size = (int)(max_delay_ms * rate / 1000.0) + 1;
+    echo->buffer = calloc((size_t)echo->size * DSP_CHANNELS, sizeof(float));
+    return echo->buffer ? 0 : -1;
+}
+
+void echo_configure(Echo* echo, double rate, float in_gain, float out_gain,
+                    const double* delays_ms, const float* decays, int num_taps) {
+    if (num_taps > DSP_MAX_ECHO_TAPS) {
+        num_taps = DSP_MAX_ECHO_TAPS;
+    }
+    echo->in_gain = in_gain;
+    echo->out_gain = out_gain;
+    echo->num_taps = num_taps;
+    for (int t = 0; t < num_taps; t++) {
+        int delay = (int)(delays_ms[t] * rate / 1000.0);
+        if (delay < 1) delay = 1;
+        if (delay >= echo->size) delay = echo->size - 1;
+        echo->delay[t] = delay;
+        echo->decay[t] = decays[t];
+    }
+}
+
+void echo_process(Echo* echo, float* samples, size_t frames, float dry_mix, float wet_mix) {
+    for (size_t i = 0; i < frames; i++) {
+        float* s = &samples[i * DSP_CHANNELS];
+        float* slot = &echo->buffer[echo->pos * DSP_CHANNELS];
+
+        for (int c = 0; c < DSP_CHANNELS; c++) {
+            float wet = s[c] * echo->in_gain;
+            for (int t = 0; t < echo->num_taps; t++) {
+                int tap = echo->pos - echo->delay[t];
+                if (tap < 0) tap += echo->size;
+                wet += echo->buffer[tap * DSP_CHANNELS + c] * echo->decay[t];
+            }
+            slot[c] = s[c];
+            s[c] = dry_mix * s[c] + wet_mix * wet * echo->out_gain;
+        }
+
+        if (++echo->pos == echo->size) {
+            echo->pos = 0;
+        }
+    }
+}
+
+void echo_free(Echo* echo) {
+    free(echo->buffer);
+    echo->buffer = NULL;
+}
+
+void limiter_init(Limiter* lim, double rate, float level_in, float level_out, float limit,
+                  double attack_ms, double release_ms) {
+    memset(lim, 0, sizeof(*lim));
+    lim->level_in = level_in;
+    lim->level_out = level_out;
+    lim->limit = limit;
+    lim->lookahead = (int)(attack_ms * rate / 1000.0);
+    if (lim->lookahead < 1) lim->lookahead = 1;
+    if (lim->lookahead > DSP_MAX_LIMITER_LOOKAHEAD) lim->lookahead = DSP_MAX_LIMITER_LOOKAHEAD;
+    lim->release_coef = time_coef(rate, release_ms / 1000.0);
+    lim->gain = 1.0;
+    lim->ramp_target = 1.0;
+}
+
+/*
+ * Lookahead peak limiter. Each incoming frame's required gain starts a
+ * linear ramp over ramp frames; gain is then held for hold frames before
+ * releasing. limiter_process ramps and holds for the lookahead, so the
+ * gain reaches each frame's target exactly when it leaves the delay line.
+ */
+static void limiter_frame(Limiter* lim, float* s, double peak, int ramp, int hold) {
+    float* slot = &lim->delay[lim->pos * DSP_CHANNELS];
+
+    for (int c = 0; c < DSP_CHANNELS; c++) {
+        float in = s[c] * lim->level_in;
+        s[c] = slot[c];
+        slot[c] = in;
+    }
+
+    double target = peak > lim->limit ? lim->limit / peak : 1.0;
+    if (target < 1.0) {
+        if (target < lim->gain) {
+            double step = (target - lim->gain) / ramp;
+            if (step < lim->step) {
+                lim->step = step;
+            }
+        }
+        if (target < lim->ramp_target) {
+            lim->ramp_target = target;
+        }
+        lim->hold = hold;
+    }
+
+    if (lim->step < 0) {
+        lim->gain += lim->step;
+        if (lim->gain <= lim->ramp_target) {
+            lim->gain = lim->ramp_target;
+            lim->step = 0;
+        }
+    } else if (lim->hold > 0) {
+        lim->hold--;
+    } else {
+        lim->gain += (1.0 - lim->gain) * lim->release_coef;
+        lim->ramp_target = 1.0;
+    }
+
+    float gain = (float)(lim->gain * lim->level_out);
+    s[0] *= gain;
+    s[1] *= gain;
+
+    if (++lim->pos == lim->lookahead) {
+        lim->pos = 0;
+    }
+}
+
+void limiter_process(Limiter* lim, float* samples, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        float* s = &samples[i * DSP_CHANNELS];
+        double peak = 0;
+        for (int c = 0; c < DSP_CHANNELS; c++) {
+            float in = fabsf(s[c] * lim->level_in);
+            if (in > peak) peak = in;
+        }
+        limiter_frame(lim, s, peak, lim->lookahead, lim->lookahead);
+    }
+}
+
+void truepeak_limiter_init(TruePeakLimiter* lim, double rate, double ceiling_db,
+                           double lookahead_ms, double release_ms) {
+    limiter_init(&lim->limiter, rate, 1.0f, 1.0f, (float)db_to_linear(ceiling_db), lookahead_ms, release_ms);
+    if (lim->limiter.lookahead <= 2 * TRUEPEAK_TAPS) {
+        lim->limiter.lookahead = 2 * TRUEPEAK_TAPS + 1;
+    }
+    truepeak_init(&lim->detector);
+}
+
+void truepeak_limiter_reset(TruePeakLimiter* lim) {
+    Limiter* l = &lim->limiter;
+    memset(l->delay, 0, sizeof(l->delay));
+    l->gain = l->ramp_target = 1.0;
+    l->step = 0;
+    l->hold = 0;
+    l->pos = 0;
+    truepeak_reset(&lim->detector);
+}
+
+int truepeak_limiter_latency(const TruePeakLimiter* lim) {
+    return lim->limiter.lookahead;
+}
+
+/*
+ * A detected peak trails its frame by up to TRUEPEAK_TAPS frames, so the
+ * ramp finishes that much early and the hold covers as much again after.
+ */
+void truepeak_limiter_process(TruePeakLimiter* lim, float* samples, size_t frames) {
+    int la = lim->limiter.lookahead;
+
+    while (frames > 0) {
+        size_t block = frames < DSP_TRUEPEAK_BLOCK ? frames : DSP_TRUEPEAK_BLOCK;
+        truepeak_frames(&lim->detector, samples, lim->peaks, block);
+        for (size_t i = 0; i < block; i++) {
+            limiter_frame(&lim->limiter, &samples[i * DSP_CHANNELS], lim->peaks[i],
+                          la - TRUEPEAK_TAPS, la + TRUEPEAK_TAPS);
+        }
+        samples += block * DSP_CHANNELS;
+        frames -= block;
+    }
+}
+
+void stereo_width_process(float* samples, size_t frames, float width) {
+    for (size_t i = 0; i < frames; i++) {
+        float* s = &samples[i * DSP_CHANNELS];
+        float mid = (s[0] + s[1]) * 0.5f;
+        float side = (s[0] - s[1]) * 0.5f * width;
+        s[0] = mid + side;
+        s[1] = mid - side;
+    }
+}
+
+void gain_process(float* samples, size_t frames, float gain) {
+    for (size_t i = 0; i < frames * DSP_CHANNELS; i++) {
+        samples[i] *= gain;
+    }
+}
@@ -0,0 +1,155 @@
+#ifndef SLOP_DSP_H
+#define SLOP_DSP_H
+
+#include <stddef.h>
+
+#include "slopLoudness.h"
+
+#define DSP_CHANNELS 2
+#define DSP_MAX_COMPAND_POINTS 8
+#define DSP_MAX_ECHO_TAPS 4
+#define DSP_MAX_LIMITER_LOOKAHEAD 4096
+#define DSP_TRUEPEAK_BLOCK 256
+#define DSP_BANDS 3
+#define DSP_BAND_LANES 8
+#define DSP_BAND_BLOCK 256
+
+/*
+ * Real-time building blocks mirroring the ffmpeg filters used by
+ * master_audio_file. Everything works on interleaved stereo float
+ * in place and never allocates after init.
+ */
+
+typedef struct {
+    double b0, b1, b2, a1, a2;
+    double z1[DSP_CHANNELS];
+    double z2[DSP_CHANNELS];
+} Biquad;
+
+typedef struct {
+    int num_points;
+    double in_db[DSP_MAX_COMPAND_POINTS];
+    double out_db[DSP_MAX_COMPAND_POINTS];
+    double attack_coef;
+    double decay_coef;
+    double gain_db;
+    double env[DSP_CHANNELS];
+} Compander;
+
+/*
+ * Three-band compressor on Linkwitz-Riley (24 dB/octave) crossovers. The
+ * low band is run through an allpass at the upper crossover so the bands
+ * stay in phase and sum flat while the compressor is idle. Envelopes and
+ * gains are computed for all bands and channels together, one SIMD lane
+ * per band and channel (lane = band * DSP_CHANNELS + channel).
+ */
+typedef struct {
+    Biquad low_lp[2];
+    Biquad low_hp[2];
+    Biquad high_lp[2];
+    Biquad high_hp[2];
+    Biquad low_allpass;
+    float attack_coef;
+    float decay_coef;
+    /* Gain computer, in log2 of linear amplitude. */
+    float floor[DSP_BAND_LANES];
+    float knee[DSP_BAND_LANES];
+    float slope_below[DSP_BAND_LANES];
+    float offset_below[DSP_BAND_LANES];
+    float slope_above[DSP_BAND_LANES];
+    float makeup[DSP_BAND_LANES];
+    float env[DSP_BAND_LANES];
+    float lanes[DSP_BAND_BLOCK * DSP_BAND_LANES];
+} Multiband;
+
+typedef struct {
+    double threshold_db;
+    double ratio;
+    double knee_db;
+    double makeup;
+    double attack_coef;
+    double release_coef;
+    double env;
+} Compressor;
+
+typedef struct {
+    float* buffer;
+    int size;
+    int pos;
+    int num_taps;
+    int delay[DSP_MAX_ECHO_TAPS];
+    float decay[DSP_MAX_ECHO_TAPS];
+    float in_gain;
+    float out_gain;
+} Echo;
+
+typedef struct {
+    float level_in;
+    float level_out;
+    float limit;
+    int lookahead;
+    double release_coef;
+    double gain;
+    double step;
+    double ramp_target;
+    int hold;
+    float delay[DSP_MAX_LIMITER_LOOKAHEAD * DSP_CHANNELS];
+    int pos;
+} Limiter;
+
+/*
+ * Lookahead limiter on 4x oversampled true peaks, with a fixed latency
+ * of its lookahead.
+ */
+typedef struct {
+    Limiter limiter;
+    TruePeak detector;
+    float peaks[DSP_TRUEPEAK_BLOCK];
+} TruePeakLimiter;
+
+void biquad_reset(Biquad* bq);
+void biquad_set_lowpass(Biquad* bq, double rate, double freq, double q);
+void biquad_set_highpass(Biquad* bq, double rate, double freq, double q);
+void biquad_set_bandpass(Biquad* bq, double rate, double freq, double width_hz);
+void biquad_set_peaking(Biquad* bq, double rate, double freq, double q, double gain_db);
+void biquad_set_peaking_octaves(Biquad* bq, double rate, double freq, double octaves, double gain_db);
+void biquad_set_allpass(Biquad* bq, double rate, double freq, double q);
+void biquad_process(Biquad* bq, float* samples, size_t frames);
+
+void compander_init(Compander* comp, double rate, double attack, double decay,
+                    const double* in_db, const double* out_db, int num_points, double gain_db);
+void compander_process(Compander* comp, float* samples, size_t frames);
+
+void multiband_init(Multiband* mb, double rate, double attack, double decay);
+void multiband_set_crossovers(Multiband* mb, double rate, double low_hz, double high_hz);
+void multiband_set_band(Multiband* mb, int band, double threshold_db, double ratio, double gain_db);
+void multiband_process(Multiband* mb, float* samples, size_t frames);
+void multiband_reset(Multiband* mb);
+
+void compressor_init(Compressor* comp, double rate, double threshold_db, double ratio,
+                     double attack_ms, double release_ms, double makeup, double knee_db);
+void compressor_process(Compressor* comp, float* samples, size_t frames);
+
+int echo_init(Echo* echo, double rate, double max_delay_ms);
+void echo_configure(Echo* echo, double rate, float in_gain, float out_gain,
+                    const double* delays_ms, const float* decays, int num_taps);
+void echo_process(Echo* echo, float* samples, size_t frames, float dry_mix, float wet_mix);
+void echo_free(Echo* echo);
+
+void limiter_init(Limiter* lim, double rate, float level_in, float level_out, float limit,
+                  double attack_ms, double release_ms);
+void limiter_process(Limiter* lim, float* samples, size_t frames);
+
+void truepeak_limiter_init(TruePeakLimiter* lim, double rate, double ceiling_db,
+                           double lookahead_ms, double release_ms);
+void truepeak_limiter_process(TruePeakLimiter* lim, float* samples, size_t frames);
+void truepeak_limiter_reset(TruePeakLimiter* lim);
+int truepeak_limiter_latency(const TruePeakLimiter* lim);
+
+void stereo_width_process(float* samples, size_t frames, float width);
+void gain_process(float* samples, size_t frames, float gain);
+
+double db_to_linear(double db);
+double linear_to_db(double linear);
+
+#endif
@@ -0,0 +1,401 @@
+#define _XOPEN_SOURCE 700
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slopDenoise.h"
+#include "slopDSP.h"
+#include "slopFFT.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define DENOISE_OVERLAP (DENOISE_FFT_SIZE - DENOISE_HOP)
+#define DENOISE_LEARN_FRAMES 32
+#define DENOISE_SILENCE 1e-10f
+/* Decision-directed smoothing of the a priori SNR; higher is smoother. */
+#define DENOISE_DD_ALPHA 0.98f
+
+static const char profile_magic[8] = "SLOPNPF";
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t bins;
+    double rate;
+} ProfileHeader;
+
+struct NoiseLearner {
+    FFT* fft;
+    double rate;
+    float window[DENOISE_FFT_SIZE];
+    float fifo[DSP_CHANNELS][DENOISE_FFT_SIZE];
+    int pos;
+    float frame[DENOISE_FFT_SIZE];
+    float re[DENOISE_BINS];
+    float im[DENOISE_BINS];
+    int count;
+    float energy[DENOISE_LEARN_FRAMES];
+    float spectra[DENOISE_LEARN_FRAMES][DENOISE_BINS];
+};
+
+struct Denoiser {
+    FFT* fft;
+    float window[DENOISE_FFT_SIZE];
+    /* Reciprocal noise power per bin. */
+    float inv_noise[DENOISE_BINS];
+    float floor_gain;
+    float in[DSP_CHANNELS][DENOISE_FFT_SIZE];
+    float acc[DSP_CHANNELS][DENOISE_FFT_SIZE];
+    float out[DSP_CHANNELS][DENOISE_HOP];
+    float prev[DSP_CHANNELS][DENOISE_BINS];
+    float frame[DENOISE_FFT_SIZE];
+    float re[DENOISE_BINS];
+    float im[DENOISE_BINS];
+    int pos;
+};
+
+/* Square-root Hann for analysis and synthesis; at 75% overlap the products sum to 2. */
+static void window_sqrt_hann(float* window) {
+    fft_window_hann(window, DENOISE_FFT_SIZE);
+    for (int i = 0; i < DENOISE_FFT_SIZE; i++) {
+        window[i] = sqrtf(window[i]);
+    }
+}
+
+void noise_profile_default(NoiseProfile* profile, double rate, double floor_db) {
+    float power = (float)(pow(10.0, floor_db / 10.0) * DENOISE_FFT_SIZE / 2);
+    profile->rate = rate;
+    for (int k = 0; k < DENOISE_BINS; k++) {
+        profile->power[k] = power;
+    }
+}
+
+int noise_profile_load(const char* path, NoiseProfile* profile) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return -1;
+    }
+    ProfileHeader header;
+    int ok = fread(&header, sizeof(header), 1, f) == 1 &&
+             memcmp(header.magic, profile_magic, sizeof(header.magic)) == 0 &&
+             header.version == 1 && header.bins == DENOISE_BINS && header.rate > 0 &&
+             fread(profile->power, sizeof(float), DENOISE_BINS, f) == DENOISE_BINS;
+    fclose(f);
+    if (!ok) {
+        return -1;
+    }
+    profile->rate = header.rate;
+    return 0;
+}
+
+/* Written to a temporary name and renamed, so concurrent jobs never read half a profile. */
+int noise_profile_save(const char* path, const NoiseProfile* profile) {
+    size_t len = strlen(path) + 8;
+    char* tmp = malloc(len);
+    if (!tmp) {
+        return -1;
+    }
+    snprintf(tmp, len, "%s.XXXXXX", path);
+    FILE* f = NULL;
+    int fd = mkstemp(tmp);
+    if (fd >= 0) {
+        f = fdopen(fd, "wb");
+    }
+    if (!f) {
+        free(tmp);
+        return -1;
+    }
+
+    ProfileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, profile_magic, sizeof(header.magic));
+    header.version = 1;
+    header.bins = DENOISE_BINS;
+    header.rate = profile->rate;
+    int ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+             fwrite(profile->power, sizeof(float), DENOISE_BINS, f) == DENOISE_BINS;
+    ok = fclose(f) == 0 && ok && rename(tmp, path) == 0;
+    if (!ok) {
+        remove(tmp);
+    }
+    free(tmp);
+    return ok ? 0 : -1;
+}
+
+NoiseLearner* noise_learner_new(double rate) {
+    NoiseLearner* learner = calloc(1, sizeof(NoiseLearner));
+    if (!learner) {
+        return NULL;
+    }
+    learner->fft = fft_new(DENOISE_FFT_SIZE);
+    if (!learner->fft) {
+        free(learner);
+        return NULL;
+    }
+    learner->rate = rate;
+    window_sqrt_hann(learner->window);
+    return learner;
+}
+
+void noise_learner_reset(NoiseLearner* learner, double rate) {
+    learner->rate = rate;
+    learner->count = 0;
+    learner->pos = 0;
+}
+
+static void learner_power(NoiseLearner* learner, const float* in, float* power) {
+    for (int i = 0; i < DENOISE_FFT_SIZE; i++) {
+        learner->frame[i] = in[i] * learner->window[i];
+    }
+    fft_real_forward(learner->fft, learner->frame, learner->re, learner->im);
+    for (int k = 0; k < DENOISE_BINS; k++) {
+        power[k] += 0.5f * (learner->re[k] * learner->re[k] + learner->im[k] * learner->im[k]);
+    }
+}
+
+/*
+ * Keeps the spectra of the quietest frames seen so far. Energy is checked
+ * in the time domain first, so loud frames never reach the FFT.
+ */
+static void learner_frame(NoiseLearner* learner) {
+    double sum = 0;
+    for (int c = 0; c < DSP_CHANNELS; c++) {
+        for (int i = 0; i < DENOISE_FFT_SIZE; i++) {
+            float x = learner->fifo[c][i] * learner->window[i];
+            sum += x * x;
+        }
+    }
+    float energy = (float)(sum / (DSP_CHANNELS * DENOISE_FFT_SIZE / 2));
+    if (energy < DENOISE_SILENCE) {
+        return;
+    }
+
+    int slot = learner->count;
+    if (slot == DENOISE_LEARN_FRAMES) {
+        slot = 0;
+        for (int i = 1; i < DENOISE_LEARN_FRAMES; i++) {
+            if (learner->energy[i] > learner->energy[slot]) {
+                slot = i;
+            }
+        }
+        if (energy >= learner->energy[slot]) {
+            return;
+        }
+    } else {
+        learner->count++;
+    }
+
+    learner->energy[slot] = energy;
+    memset(learner->spectra[slot], 0, sizeof(learner->spectra[slot]));
+    for (int c = 0; c < DSP_CHANNELS; c++) {
+        learner_power(learner, learner->fifo[c], learner->spectra[slot]);
+    }
+}
+
+void noise_learner_feed(NoiseLearner* learner, const float* samples, size_t frames) {
+    const int hop = DENOISE_FFT_SIZE / 2;
+    size_t i = 0;
+
+    while (i < frames) {
+        size_t n = DENOISE_FFT_SIZE - learner->pos;
+        if (n > frames - i) n = frames - i;
+        for (size_t f = 0; f < n; f++) {
+            for (int c = 0; c < DSP_CHANNELS; c++) {
+                learner->fifo[c][learner->pos + f] = samples[(i + f) * DSP_CHANNELS + c];
+            }
+        }
+        learner->pos += (int)n;
+        i += n;
+        if (learner->pos == DENOISE_FFT_SIZE) {
+            learner_frame(learner);
+            for (int c = 0; c < DSP_CHANNELS; c++) {
+                memmove(learner->fifo[c], learner->fifo[c] + hop, (DENOISE_FFT_SIZE - hop) * sizeof(float));
+            }
+            learner->pos = DENOISE_FFT_SIZE - hop;
+        }
+    }
+}
+
+/* The result never assumes more noise than the reference graph's fixed floor. */
+int noise_learner_finish(NoiseLearner* learner, NoiseProfile* profile) {
+    if (learner->count == 0) {
+        return -1;
+    }
+    noise_profile_default(profile, learner->rate, DENOISE_FLOOR_DB);
+    for (int k = 0; k < DENOISE_BINS; k++) {
+        double sum = 0;
+        for (int i = 0; i < learner->count; i++) {
+            sum += learner->spectra[i][k];
+        }
+        float mean = (float)(sum / learner->count);
+        if (mean < profile->power[k]) {
+            profile->power[k] = mean;
+        }
+    }
+    return 0;
+}
+
+void noise_learner_free(NoiseLearner* learner) {
+    if (!learner) {
+        return;
+    }
+    fft_free(learner->fft);
+    free(learner);
+}
+
+Denoiser* denoise_new(void) {
+    Denoiser* d = calloc(1, sizeof(Denoiser));
+    if (!d) {
+        return NULL;
+    }
+    d->fft = fft_new(DENOISE_FFT_SIZE);
+    if (!d->fft) {
+        free(d);
+        return NULL;
+    }
+    window_sqrt_hann(d->window);
+    d->floor_gain = 1.0f;
+    denoise_reset(d);
+    return d;
+}
+
+/* A profile learned at another rate is read at the same frequencies. */
+void denoise_set_profile(Denoiser* d, const NoiseProfile* profile, double rate, double reduction_db) {
+    double scale = profile->rate > 0 ? rate / profile->rate : 1.0;
+    for (int k = 0; k < DENOISE_BINS; k++) {
+        double pos = k * scale;
+        int i = (int)pos;
+        float power;
+        if (i >= DENOISE_BINS - 1) {
+            power = profile->power[DENOISE_BINS - 1];
+        } else {
+            float t = (float)(pos - i);
+            power = profile->power[i] + t * (profile->power[i + 1] - profile->power[i]);
+        }
+        d->inv_noise[k] = 1.0f / (power > 1e-20f ? power : 1e-20f);
+    }
+    d->floor_gain = (float)pow(10.0, -reduction_db / 20.0);
+}
+
+void denoise_reset(Denoiser* d) {
+    memset(d->in, 0, sizeof(d->in));
+    memset(d->acc, 0, sizeof(d->acc));
+    memset(d->out, 0, sizeof(d->out));
+    memset(d->prev, 0, sizeof(d->prev));
+    d->pos = DENOISE_OVERLAP;
+}
+
+/* Wiener gain on a decision-directed SNR estimate, limited to the reduction. */
+static void denoise_gains(Denoiser* d, float* prev) {
+    const float alpha = DENOISE_DD_ALPHA;
+    const float floor_gain = d->floor_gain;
+    float* re = d->re;
+    float* im = d->im;
+    int k = 0;
+
+#if defined(__SSE2__)
+    __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+    __m128 valpha = _mm_set1_ps(alpha), vbeta = _mm_set1_ps(1.0f - alpha), vfloor = _mm_set1_ps(floor_gain);
+    for (; k + 4 <= DENOISE_BINS; k += 4) {
+        __m128 r = _mm_loadu_ps(re + k), i = _mm_loadu_ps(im + k), inv_noise = _mm_loadu_ps(d->inv_noise + k);
+        __m128 power = _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(i, i));
+        __m128 post = _mm_max_ps(_mm_sub_ps(_mm_mul_ps(power, inv_noise), one), zero);
+        __m128 snr = _mm_add_ps(_mm_mul_ps(valpha, _mm_mul_ps(_mm_loadu_ps(prev + k), inv_noise)),
+                                _mm_mul_ps(vbeta, post));
+        __m128 gain = _mm_max_ps(_mm_sub_ps(one, _mm_div_ps(one, _mm_add_ps(one, snr))), vfloor);
+        _mm_storeu_ps(prev + k, _mm_mul_ps(_mm_mul_ps(gain, gain), power));
+        _mm_storeu_ps(re + k, _mm_mul_ps(r, gain));
+        _mm_storeu_ps(im + k, _mm_mul_ps(i, gain));
+    }
+#elif defined(__ARM_NEON)
+    float32x4_t one = vdupq_n_f32(1.0f), zero = vdupq_n_f32(0.0f), vfloor = vdupq_n_f32(floor_gain);
+    for (; k + 4 <= DENOISE_BINS; k += 4) {
+        float32x4_t r = vld1q_f32(re + k), i = vld1q_f32(im + k), inv_noise = vld1q_f32(d->inv_noise + k);
+        float32x4_t power = vmlaq_f32(vmulq_f32(r, r), i, i);
+        float32x4_t post = vmaxq_f32(vsubq_f32(vmulq_f32(power, inv_noise), one), zero);
+        float32x4_t snr = vmlaq_n_f32(vmulq_n_f32(vmulq_f32(vld1q_f32(prev + k), inv_noise), alpha), post,
+                                      1.0f - alpha);
+        /* A reciprocal estimate and two Newton steps, as ARMv7 has no vector divide. */
+        float32x4_t den = vaddq_f32(one, snr);
+        float32x4_t rcp = vrecpeq_f32(den);
+        rcp = vmulq_f32(rcp, vrecpsq_f32(den, rcp));
+        rcp = vmulq_f32(rcp, vrecpsq_f32(den, rcp));
+        float32x4_t gain = vmaxq_f32(vsubq_f32(one, rcp), vfloor);
+        vst1q_f32(prev + k, vmulq_f32(vmulq_f32(gain, gain), power));
+        vst1q_f32(re + k, vmulq_f32(r, gain));
+        vst1q_f32(im + k, vmulq_f32(i, gain));
+    }
+#endif
+    for (; k < DENOISE_BINS; k++) {
+        float power = re[k] * re[k] + im[k] * im[k];
+        float inv_noise = d->inv_noise[k];
+        float post = power * inv_noise - 1.0f;
+        float snr = alpha * prev[k] * inv_noise + (1.0f - alpha) * (post > 0 ? post : 0);
+        float gain = 1.0f - 1.0f / (1.0f + snr);
+        gain = gain > floor_gain ? gain : floor_gain;
+        prev[k] = gain * gain * power;
+        re[k] *= gain;
+        im[k] *= gain;
+    }
+}
+
+static void denoise_frame(Denoiser* d) {
+    for (int c = 0; c < DSP_CHANNELS; c++) {
+        float* in = d->in[c];
+        float* acc = d->acc[c];
+
+        for (int i = 0; i < DENOISE_FFT_SIZE; i++) {
+            d->frame[i] = in[i] * d->window[i];
+        }
+        fft_real_forward(d->fft, d->frame, d->re, d->im);
+        denoise_gains(d, d->prev[c]);
+        fft_real_inverse(d->fft, d->re, d->im, d->frame);
+        for (int i = 0; i < DENOISE_FFT_SIZE; i++) {
+            acc[i] += d->frame[i] * d->window[i] * 0.5f;
+        }
+
+        memcpy(d->out[c], acc, DENOISE_HOP * sizeof(float));
+        memmove(acc, acc + DENOISE_HOP, DENOISE_OVERLAP * sizeof(float));
+        memset(acc + DENOISE_OVERLAP, 0, DENOISE_HOP * sizeof(float));
+        memmove(in, in + DENOISE_HOP, DENOISE_OVERLAP * sizeof(float));
+    }
+}
+
+/* Each hop of input is exchanged for a finished hop one frame behind it. */
+void denoise_process(Denoiser* d, float* samples, size_t frames) {
+    size_t i = 0;
+
+    while (i < frames) {
+        size_t n = DENOISE_FFT_SIZE - d->pos;
+        if (n > frames - i) n = frames - i;
+        for (size_t f = 0; f < n; f++) {
+            float* s = &samples[(i + f) * DSP_CHANNELS];
+            int slot = d->pos + (int)f;
+            for (int c = 0; c < DSP_CHANNELS; c++) {
+                d->in[c][slot] = s[c];
+                s[c] = d->out[c][slot - DENOISE_OVERLAP];
+            }
+        }
+        d->pos += (int)n;
+        i += n;
+        if (d->pos == DENOISE_FFT_SIZE) {
+            denoise_frame(d);
+            d->pos = DENOISE_OVERLAP;
+        }
+    }
+}
+
+void denoise_free(Denoiser* d) {
+    if (!d) {
+        return;
+    }
+    fft_free(d->fft);
+    free(d);
+}
@@ -0,0 +1,53 @@
+#ifndef SLOP_DENOISE_H
+#define SLOP_DENOISE_H
+
+#include <stddef.h>
+
+#define DENOISE_FFT_SIZE 2048
+#define DENOISE_HOP (DENOISE_FFT_SIZE / 4)
+#define DENOISE_BINS (DENOISE_FFT_SIZE / 2 + 1)
+#define DENOISE_LATENCY DENOISE_FFT_SIZE
+
+/* The reference graph's afftdn=nr=10:nf=-25. */
+#define DENOISE_REDUCTION_DB 10.0
+#define DENOISE_FLOOR_DB -25.0
+
+/*
+ * Mean noise power per bin of a windowed DENOISE_FFT_SIZE frame at rate.
+ * Learned once from the quietest frames of a file or an album and saved,
+ * so later renders skip the learning pass.
+ */
+typedef struct {
+    double rate;
+    float power[DENOISE_BINS];
+} NoiseProfile;
+
+typedef struct NoiseLearner NoiseLearner;
+typedef struct Denoiser Denoiser;
+
+/* White noise at floor_db, the most noise any profile assumes. */
+void noise_profile_default(NoiseProfile* profile, double rate, double floor_db);
+int noise_profile_load(const char* path, NoiseProfile* profile);
+int noise_profile_save(const char* path, const NoiseProfile* profile);
+
+/* Returns -1 from finish if everything fed was digital silence. */
+NoiseLearner* noise_learner_new(double rate);
+/* Starts learning afresh, so one learner serves many files. */
+void noise_learner_reset(NoiseLearner* learner, double rate);
+void noise_learner_feed(NoiseLearner* learner, const float* samples, size_t frames);
+int noise_learner_finish(NoiseLearner* learner, NoiseProfile* profile);
+void noise_learner_free(NoiseLearner* learner);
+
+/*
+ * STFT noise reduction on interleaved stereo, in place, delayed by
+ * DENOISE_LATENCY frames. Both channels share one FFT plan and the
+ * scratch buffers, and a denoiser can be reused across files of any
+ * rate by setting a new profile and resetting it.
+ */
+Denoiser* denoise_new(void);
+void denoise_set_profile(Denoiser* d, const NoiseProfile* profile, double rate, double reduction_db);
+void denoise_process(Denoiser* d, float* samples, size_t frames);
+void denoise_reset(Denoiser* d);
+void denoise_free(Denoiser* d);
+
+#endif
@@ -0,0 +1,782 @@
+#define _XOPEN_SOURCE 700
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "slopEncode.h"
+#include "slopUsage.h"
+#include "slopTrace.h"
+
+#define ENCODE_MAX_CHANNELS 8
+#define ENCODE_BATCH_FRAMES (ENCODE_FLAC_BLOCK * ENCODE_BATCH_BLOCKS)
+#define FLAC_BITS 24
+#define FLAC_MAX_FIXED_ORDER 4
+#define FLAC_MAX_PARTITION_ORDER 8
+#define FLAC_STREAMINFO_SIZE 34
+/* A verbatim frame, side channel at 25 bits, plus header and footer. */
+#define FLAC_MAX_FRAME_BYTES(channels) (32 + (channels) * (ENCODE_FLAC_BLOCK * (FLAC_BITS + 1) / 8 + 8))
+
+typedef enum {
+    BATCH_FREE,
+    BATCH_ENCODING,
+    BATCH_ENCODED
+} BatchState;
+
+typedef struct {
+    BatchState state;
+    float* samples;
+    int32_t* pcm;
+    size_t frames;
+    uint64_t first_block;
+    int blocks, next_block, blocks_done;
+    unsigned char* out;
+    size_t out_size[ENCODE_BATCH_BLOCKS];
+    /* The caller's traced file, for the helpers' and writer's spans. */
+    int trace_file;
+} EncodeBatch;
+
+typedef struct {
+    uint32_t state[4];
+    uint64_t length;
+    unsigned char buffer[64];
+} Md5;
+
+typedef enum {
+    SUBFRAME_CONSTANT,
+    SUBFRAME_VERBATIM,
+    SUBFRAME_FIXED
+} SubframeType;
+
+typedef struct {
+    SubframeType type;
+    int order, partition_order;
+    uint64_t bits;
+    uint8_t params[1 << FLAC_MAX_PARTITION_ORDER];
+} Subframe;
+
+/* One helper's working set: up to four candidate channels and residuals. */
+typedef struct {
+    int32_t channel[ENCODE_MAX_CHANNELS][ENCODE_FLAC_BLOCK];
+    uint32_t residual[ENCODE_FLAC_BLOCK];
+    uint64_t sums[1 << FLAC_MAX_PARTITION_ORDER];
+    Subframe subframes[ENCODE_MAX_CHANNELS];
+} EncodeScratch;
+
+typedef struct {
+    struct Encoder* encoder;
+    EncodeScratch* scratch;
+} Helper;
+
+struct Encoder {
+    int channels, threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t writer;
+    int writer_started;
+    /* Helpers allocated and, of those, started. */
+    pthread_t* helper_threads;
+    Helper* helpers;
+    int started;
+    EncodeBatch batches[ENCODE_BATCHES];
+    int fill, write, quit, failed;
+    /* Whether the caller holds batches[fill]; only the caller touches it. */
+    int filling;
+
+    FILE* flac;
+    SNDFILE* sndfile;
+    int rate;
+    uint64_t next_block, total_frames;
+    size_t min_frame, max_frame;
+    Md5 md5;
+    unsigned char* md5_bytes;
+    /* What the helpers and writer have spent, for the caller's accounting. */
+    ResourceUsage usage;
+};
+
+static uint8_t crc8_table[256];
+static uint16_t crc16_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+    for (int i = 0; i < 256; i++) {
+        uint8_t c8 = (uint8_t)i;
+        uint16_t c16 = (uint16_t)(i << 8);
+        for (int b = 0; b < 8; b++) {
+            c8 = (uint8_t)(c8 & 0x80 ? c8 << 1 ^ 0x07 : c8 << 1);
+            c16 = (uint16_t)(c16 & 0x8000 ? c16 << 1 ^ 0x8005 : c16 << 1);
+        }
+        crc8_table[i] = c8;
+        crc16_table[i] = c16;
+    }
+}
+
+static uint8_t crc8(const unsigned char* data, size_t n) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < n; i++) {
+        crc = crc8_table[crc ^ data[i]];
+    }
+    return crc;
+}
+
+static uint16_t crc16(const unsigned char* data, size_t n) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < n; i++) {
+        crc = (uint16_t)(crc << 8 ^ crc16_table[(crc >> 8) ^ data[i]]);
+    }
+    return crc;
+}
+
+/* RFC 1321. */
+static const uint32_t md5_k[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+static const int md5_r[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+static void md5_init(Md5* md5) {
+    md5->state[0] = 0x67452301;
+    md5->state[1] = 0xefcdab89;
+    md5->state[2] = 0x98badcfe;
+    md5->state[3] = 0x10325476;
+    md5->length = 0;
+}
+
+static void md5_block(Md5* md5, const unsigned char* p) {
+    uint32_t w[16];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)p[4 * i] | (uint32_t)p[4 * i + 1] << 8 | (uint32_t)p[4 * i + 2] << 16 |
+               (uint32_t)p[4 * i + 3] << 24;
+    }
+    uint32_t a = md5->state[0], b = md5->state[1], c = md5->state[2], d = md5->state[3];
+    for (int i = 0; i < 64; i++) {
+        uint32_t f;
+        int g;
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) & 15;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) & 15;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) & 15;
+        }
+        uint32_t t = d;
+        d = c;
+        c = b;
+        uint32_t x = a + f + md5_k[i] + w[g];
+        b = b + (x << md5_r[i] | x >> (32 - md5_r[i]));
+        a = t;
+    }
+    md5->state[0] += a;
+    md5->state[1] += b;
+    md5->state[2] += c;
+    md5->state[3] += d;
+}
+
+static void md5_update(Md5* md5, const unsigned char* data, size_t n) {
+    size_t used = (size_t)(md5->length & 63);
+    md5->length += n;
+    if (used) {
+        size_t take = 64 - used < n ? 64 - used : n;
+        memcpy(md5->buffer + used, data, take);
+        data += take;
+        n -= take;
+        if (used + take < 64) {
+            return;
+        }
+        md5_block(md5, md5->buffer);
+    }
+    for (; n >= 64; data += 64, n -= 64) {
+        md5_block(md5, data);
+    }
+    memcpy(md5->buffer, data, n);
+}
+
+static void md5_final(Md5* md5, unsigned char digest[16]) {
+    uint64_t bits = md5->length * 8;
+    unsigned char pad[72] = { 0x80 };
+    size_t used = (size_t)(md5->length & 63);
+    size_t n = used < 56 ? 56 - used : 120 - used;
+    for (int i = 0; i < 8; i++) {
+        pad[n + i] = (unsigned char)(bits >> (8 * i));
+    }
+    md5_update(md5, pad, n + 8);
+    for (int i = 0; i < 16; i++) {
+        digest[i] = (unsigned char)(md5->state[i / 4] >> (8 * (i % 4)));
+    }
+}
+
+typedef struct {
+    unsigned char* data;
+    size_t pos;
+    uint64_t acc;
+    int bits;
+} BitWriter;
+
+/* n at most 32. */
+static void put_bits(BitWriter* w, uint64_t value, int n) {
+    w->acc = w->acc << n | (value & ((1ull << n) - 1));
+    w->bits += n;
+    while (w->bits >= 8) {
+        w->bits -= 8;
+        w->data[w->pos++] = (unsigned char)(w->acc >> w->bits);
+    }
+}
+
+static void put_zeros(BitWriter* w, uint64_t n) {
+    for (; n >= 32; n -= 32) {
+        put_bits(w, 0, 32);
+    }
+    put_bits(w, 0, (int)n);
+}
+
+static void put_align(BitWriter* w) {
+    if (w->bits) {
+        put_bits(w, 0, 8 - w->bits);
+    }
+}
+
+/* Frame and sample numbers in FLAC's extended UTF-8 coding. */
+static void put_utf8(BitWriter* w, uint64_t n) {
+    if (n < 0x80) {
+        put_bits(w, n, 8);
+        return;
+    }
+    int bytes = n < 0x800 ? 2 : n < 0x10000 ? 3 : n < 0x200000 ? 4 : n < 0x4000000 ? 5 : n < 0x80000000 ? 6 : 7;
+    put_bits(w, (0xFF00u >> bytes & 0xFF) | (bytes < 7 ? n >> (6 * (bytes - 1)) : 0), 8);
+    for (int i = bytes - 2; i >= 0; i--) {
+        put_bits(w, 0x80 | (n >> (6 * i) & 0x3F), 8);
+    }
+}
+
+static int rate_code(int rate) {
+    switch (rate) {
+        case 88200: return 1;
+        case 176400: return 2;
+        case 192000: return 3;
+        case 8000: return 4;
+        case 16000: return 5;
+        case 22050: return 6;
+        case 24000: return 7;
+        case 32000: return 8;
+        case 44100: return 9;
+        case 48000: return 10;
+        case 96000: return 11;
+        default: return 0;
+    }
+}
+
+/* A partition's Rice parameter; bits is an upper bound on what it costs, parameter included. */
+static int rice_param(uint64_t sum, uint32_t count, uint64_t* bits) {
+    int k = 0;
+    while (k < 30 && ((uint64_t)count << (k + 1)) < sum) {
+        k++;
+    }
+    *bits = 5 + (uint64_t)count * (k + 1) + (sum >> k);
+    return k;
+}
+
+static void fixed_residual(const int32_t* x, int n, int order, uint32_t* u) {
+    for (int i = order; i < n; i++) {
+        int64_t r;
+        switch (order) {
+            case 0: r = x[i]; break;
+            case 1: r = (int64_t)x[i] - x[i - 1]; break;
+            case 2: r = (int64_t)x[i] - 2 * (int64_t)x[i - 1] + x[i - 2]; break;
+            case 3: r = (int64_t)x[i] - 3 * (int64_t)x[i - 1] + 3 * (int64_t)x[i - 2] - x[i - 3]; break;
+            default:
+                r = (int64_t)x[i] - 4 * (int64_t)x[i - 1] + 6 * (int64_t)x[i - 2] - 4 * (int64_t)x[i - 3] + x[i - 4];
+                break;
+        }
+        u[i] = (uint32_t)(r < 0 ? -2 * r - 1 : 2 * r);
+    }
+}
+
+/* Picks the cheapest fixed predictor and partitioning, or constant or verbatim. */
+static void choose_subframe(EncodeScratch* s, const int32_t* x, int n, int bps, Subframe* sub) {
+    int constant = 1;
+    for (int i = 1; i < n && constant; i++) {
+        constant = x[i] == x[0];
+    }
+    if (constant) {
+        sub->type = SUBFRAME_CONSTANT;
+        sub->bits = 8 + (uint64_t)bps;
+        return;
+    }
+    sub->type = SUBFRAME_VERBATIM;
+    sub->bits = 8 + (uint64_t)n * bps;
+
+    uint8_t params[1 << FLAC_MAX_PARTITION_ORDER];
+    for (int order = 0; order <= FLAC_MAX_FIXED_ORDER && order < n; order++) {
+        int max_order = 0;
+        while (max_order < FLAC_MAX_PARTITION_ORDER && n % (2 << max_order) == 0 &&
+               (n >> (max_order + 1)) > order) {
+            max_order++;
+        }
+        fixed_residual(x, n, order, s->residual);
+        int parts = 1 << max_order, size = n >> max_order;
+        for (int j = 0; j < parts; j++) {
+            uint64_t sum = 0;
+            for (int i = j == 0 ? order : j * size; i < (j + 1) * size; i++) {
+                sum += s->residual[i];
+            }
+            s->sums[j] = sum;
+        }
+        for (int p = max_order;; p--) {
+            uint64_t bits = 8 + (uint64_t)order * bps + 6;
+            int count = 1 << p;
+            for (int j = 0; j < count; j++) {
+                uint64_t part;
+                params[j] = (uint8_t)rice_param(s->sums[j], (uint32_t)((n >> p) - (j == 0 ? order : 0)), &part);
+                bits += part;
+            }
+            if (bits < sub->bits) {
+                sub->type = SUBFRAME_FIXED;
+                sub->order = order;
+                sub->partition_order = p;
+                sub->bits = bits;
+                memcpy(sub->params, params, (size_t)count);
+            }
+            if (p == 0) {
+                break;
+            }
+            for (int j = 0; j < count / 2; j++) {
+                s->sums[j] = s->sums[2 * j] + s->sums[2 * j + 1];
+            }
+        }
+    }
+}
+
+static void put_subframe(BitWriter* w, EncodeScratch* s, const int32_t* x, int n, int bps, const Subframe* sub) {
+    if (sub->type == SUBFRAME_CONSTANT) {
+        put_bits(w, 0x00, 8);
+        put_bits(w, (uint32_t)x[0], bps);
+        return;
+    }
+    if (sub->type == SUBFRAME_VERBATIM) {
+        put_bits(w, 0x02, 8);
+        for (int i = 0; i < n; i++) {
+            put_bits(w, (uint32_t)x[i], bps);
+        }
+        return;
+    }
+
+    put_bits(w, 0x10 | sub->order << 1, 8);
+    for (int i = 0; i < sub->order; i++) {
+        put_bits(w, (uint32_t)x[i], bps);
+    }
+    int wide = 0, count = 1 << sub->partition_order, size = n >> sub->partition_order;
+    for (int j = 0; j < count; j++) {
+        wide |= sub->params[j] > 14;
+    }
+    put_bits(w, wide, 2);
+    put_bits(w, (uint32_t)sub->partition_order, 4);
+    fixed_residual(x, n, sub->order, s->residual);
+    for (int j = 0; j < count; j++) {
+        int k = sub->params[j];
+        put_bits(w, (uint32_t)k, wide ? 5 : 4);
+        for (int i = j == 0 ? sub->order : j * size; i < (j + 1) * size; i++) {
+            uint32_t u = s->residual[i];
+            uint64_t q = u >> k;
+            if (q + 1 + k <= 32) {
+                put_bits(w, (1ull << k) | (u & ((1ull << k) - 1)), (int)q + 1 + k);
+            } else {
+                put_zeros(w, q);
+                put_bits(w, 1, 1);
+                put_bits(w, u, k);
+            }
+        }
+    }
+}
+
+/* One frame of n frames of pcm; returns its size in bytes. */
+static size_t encode_frame(EncodeScratch* s, const int32_t* pcm, int n, int channels, int rate,
+                           uint64_t number, unsigned char* out) {
+    BitWriter w = { out, 0, 0, 0 };
+    for (int c = 0; c < channels; c++) {
+        for (int i = 0; i < n; i++) {
+            s->channel[c][i] = pcm[i * channels + c];
+        }
+    }
+
+    /* Independent, left/side, right/side or mid/side, whichever is smallest. */
+    int assignment = channels - 1;
+    int sources[ENCODE_MAX_CHANNELS], widths[ENCODE_MAX_CHANNELS];
+    for (int c = 0; c < channels; c++) {
+        choose_subframe(s, s->channel[c], n, FLAC_BITS, &s->subframes[c]);
+        sources[c] = c;
+        widths[c] = FLAC_BITS;
+    }
+    if (channels == 2) {
+        for (int i = 0; i < n; i++) {
+            int32_t l = s->channel[0][i], r = s->channel[1][i];
+            s->channel[2][i] = (l + r) >> 1;
+            s->channel[3][i] = l - r;
+        }
+        choose_subframe(s, s->channel[2], n, FLAC_BITS, &s->subframes[2]);
+        choose_subframe(s, s->channel[3], n, FLAC_BITS + 1, &s->subframes[3]);
+        uint64_t l = s->subframes[0].bits, r = s->subframes[1].bits;
+        uint64_t m = s->subframes[2].bits, d = s->subframes[3].bits;
+        uint64_t best = l + r;
+        if (l + d < best) {
+            best = l + d;
+            assignment = 8;
+            sources[1] = 3;
+        }
+        if (d + r < best) {
+            best = d + r;
+            assignment = 9;
+            sources[0] = 3;
+            sources[1] = 1;
+        }
+        if (m + d < best) {
+            assignment = 10;
+            sources[0] = 2;
+            sources[1] = 3;
+        }
+        for (int c = 0; c < 2; c++) {
+            widths[c] = sources[c] == 3 ? FLAC_BITS + 1 : FLAC_BITS;
+        }
+    }
+
+    put_bits(&w, 0xFFF8, 16);
+    put_bits(&w, n == ENCODE_FLAC_BLOCK ? 12 : 7, 4);
+    put_bits(&w, (uint32_t)rate_code(rate), 4);
+    put_bits(&w, (uint32_t)assignment, 4);
+    put_bits(&w, 6, 3);
+    put_bits(&w, 0, 1);
+    put_utf8(&w, number);
+    if (n != ENCODE_FLAC_BLOCK) {
+        put_bits(&w, (uint32_t)(n - 1), 16);
+    }
+    put_bits(&w, crc8(out, w.pos), 8);
+
+    for (int c = 0; c < channels; c++) {
+        put_subframe(&w, s, s->channel[sources[c]], n, widths[c], &s->subframes[sources[c]]);
+    }
+    put_align(&w);
+    put_bits(&w, crc16(out, w.pos), 16);
+    return w.pos;
+}
+
+static int32_t to_pcm24(float x) {
+    long v = lrintf(x * 8388607.0f);
+    return (int32_t)(v > 8388607 ? 8388607 : v < -8388608 ? -8388608 : v);
+}
+
+static void* helper_thread(void* data) {
+    Helper* helper = data;
+    Encoder* e = helper->encoder;
+    trace_name_thread("encoder helper");
+    pthread_mutex_lock(&e->mutex);
+    for (;;) {
+        EncodeBatch* batch = NULL;
+        for (int i = 0; i < ENCODE_BATCHES && !batch; i++) {
+            EncodeBatch* b = &e->batches[(e->write + i) % ENCODE_BATCHES];
+            if (b->state == BATCH_ENCODING && b->next_block < b->blocks) {
+                batch = b;
+            }
+        }
+        if (!batch) {
+            if (e->quit) {
+                break;
+            }
+            pthread_cond_wait(&e->cond, &e->mutex);
+            continue;
+        }
+        int block = batch->next_block++;
+        pthread_mutex_unlock(&e->mutex);
+
+        ResourceUsage start, end;
+        usage_thread_cpu(&start);
+        trace_set_file(batch->trace_file);
+        uint64_t traced = trace_begin();
+        size_t first = (size_t)block * ENCODE_FLAC_BLOCK;
+        size_t n = batch->frames - first < ENCODE_FLAC_BLOCK ? batch->frames - first : ENCODE_FLAC_BLOCK;
+        int32_t* pcm = batch->pcm + first * e->channels;
+        for (size_t i = 0; i < n * e->channels; i++) {
+            pcm[i] = to_pcm24(batch->samples[first * e->channels + i]);
+        }
+        size_t size = encode_frame(helper->scratch, pcm, (int)n, e->channels, e->rate,
+                                   batch->first_block + block,
+                                   batch->out + (size_t)block * FLAC_MAX_FRAME_BYTES(e->channels));
+        trace_end("encode", traced);
+        usage_thread_cpu(&end);
+
+        pthread_mutex_lock(&e->mutex);
+        usage_add_delta(&e->usage, &end, &start);
+        batch->out_size[block] = size;
+        if (++batch->blocks_done == batch->blocks) {
+            batch->state = BATCH_ENCODED;
+            pthread_cond_broadcast(&e->cond);
+        }
+    }
+    pthread_mutex_unlock(&e->mutex);
+    return NULL;
+}
+
+static int write_flac_batch(Encoder* e, EncodeBatch* b) {
+    for (int block = 0; block < b->blocks; block++) {
+        size_t first = (size_t)block * ENCODE_FLAC_BLOCK;
+        size_t n = b->frames - first < ENCODE_FLAC_BLOCK ? b->frames - first : ENCODE_FLAC_BLOCK;
+        const int32_t* pcm = b->pcm + first * e->channels;
+        for (size_t i = 0; i < n * e->channels; i++) {
+            e->md5_bytes[3 * i] = (unsigned char)pcm[i];
+            e->md5_bytes[3 * i + 1] = (unsigned char)(pcm[i] >> 8);
+            e->md5_bytes[3 * i + 2] = (unsigned char)(pcm[i] >> 16);
+        }
+        md5_update(&e->md5, e->md5_bytes, 3 * n * e->channels);
+
+        size_t size = b->out_size[block];
+        if (fwrite(b->out + (size_t)block * FLAC_MAX_FRAME_BYTES(e->channels), 1, size, e->flac) != size) {
+            return -1;
+        }
+        if (e->min_frame == 0 || size < e->min_frame) {
+            e->min_frame = size;
+        }
+        if (size > e->max_frame) {
+            e->max_frame = size;
+        }
+    }
+    return 0;
+}
+
+/* Writes batches in the order they were filled. */
+static void* writer_thread(void* data) {
+    Encoder* e = data;
+    trace_name_thread("encoder writer");
+    pthread_mutex_lock(&e->mutex);
+    for (;;) {
+        EncodeBatch* b = &e->batches[e->write];
+        if (b->state != BATCH_ENCODED) {
+            if (e->quit) {
+                break;
+            }
+            pthread_cond_wait(&e->cond, &e->mutex);
+            continue;
+        }
+        int failed = e->failed;
+        pthread_mutex_unlock(&e->mutex);
+
+        ResourceUsage start, end;
+        usage_thread(&start);
+        trace_set_file(b->trace_file);
+        uint64_t traced = trace_begin();
+        if (!failed) {
+            if (e->flac) {
+                failed = write_flac_batch(e, b) != 0;
+            } else {
+                failed = sf_writef_float(e->sndfile, b->samples, (sf_count_t)b->frames) != (sf_count_t)b->frames;
+            }
+        }
+        trace_end("write", traced);
+        usage_thread(&end);
+
+        pthread_mutex_lock(&e->mutex);
+        usage_add_delta(&e->usage, &end, &start);
+        e->failed |= failed;
+        b->state = BATCH_FREE;
+        e->write = (e->write + 1) % ENCODE_BATCHES;
+        pthread_cond_broadcast(&e->cond);
+    }
+    pthread_mutex_unlock(&e->mutex);
+    return NULL;
+}
+
+Encoder* encoder_new(int channels, int threads) {
+    if (channels < 1 || channels > ENCODE_MAX_CHANNELS) {
+        return NULL;
+    }
+    pthread_once(&crc_once, crc_init);
+    Encoder* e = calloc(1, sizeof(Encoder));
+    if (!e) {
+        return NULL;
+    }
+    e->channels = channels;
+    e->threads = threads > 0 ? threads : 1;
+    pthread_mutex_init(&e->mutex, NULL);
+    pthread_cond_init(&e->cond, NULL);
+
+    int ok = (e->helpers = calloc((size_t)e->threads, sizeof(Helper))) != NULL &&
+             (e->helper_threads = calloc((size_t)e->threads, sizeof(pthread_t))) != NULL &&
+             (e->md5_bytes = malloc((size_t)ENCODE_FLAC_BLOCK * channels * 3)) != NULL;
+    for (int i = 0; ok && i < ENCODE_BATCHES; i++) {
+        EncodeBatch* b = &e->batches[i];
+        ok = (b->samples = malloc((size_t)ENCODE_BATCH_FRAMES * channels * sizeof(float))) != NULL &&
+             (b->pcm = malloc((size_t)ENCODE_BATCH_FRAMES * channels * sizeof(int32_t))) != NULL &&
+             (b->out = malloc((size_t)ENCODE_BATCH_BLOCKS * FLAC_MAX_FRAME_BYTES(channels))) != NULL;
+    }
+    for (int i = 0; ok && i < e->threads; i++) {
+        e->helpers[i].encoder = e;
+        ok = (e->helpers[i].scratch = malloc(sizeof(EncodeScratch))) != NULL;
+    }
+    ok = ok && pthread_create(&e->writer, NULL, writer_thread, e) == 0;
+    e->writer_started = ok;
+    while (ok && e->started < e->threads) {
+        ok = pthread_create(&e->helper_threads[e->started], NULL, helper_thread, &e->helpers[e->started]) == 0;
+        e->started += ok;
+    }
+    if (!ok) {
+        encoder_free(e);
+        return NULL;
+    }
+    return e;
+}
+
+int encoder_begin_flac(Encoder* e, FILE* file, int rate) {
+    unsigned char header[8 + FLAC_STREAMINFO_SIZE] = { 'f', 'L', 'a', 'C', 0x80, 0, 0, FLAC_STREAMINFO_SIZE };
+    e->flac = file;
+    e->sndfile = NULL;
+    e->rate = rate;
+    e->next_block = e->total_frames = 0;
+    e->min_frame = e->max_frame = 0;
+    e->failed = 0;
+    md5_init(&e->md5);
+    /* STREAMINFO is filled in by encoder_end. */
+    return fwrite(header, 1, sizeof(header), file) == sizeof(header) ? 0 : -1;
+}
+
+int encoder_begin_sndfile(Encoder* e, SNDFILE* file) {
+    e->flac = NULL;
+    e->sndfile = file;
+    e->total_frames = 0;
+    e->failed = 0;
+    return 0;
+}
+
+static void submit_batch(Encoder* e) {
+    EncodeBatch* b = &e->batches[e->fill];
+    pthread_mutex_lock(&e->mutex);
+    b->blocks = (int)((b->frames + ENCODE_FLAC_BLOCK - 1) / ENCODE_FLAC_BLOCK);
+    b->first_block = e->next_block;
+    b->next_block = b->blocks_done = 0;
+    b->trace_file = trace_current_file();
+    b->state = e->flac ? BATCH_ENCODING : BATCH_ENCODED;
+    e->next_block += (uint64_t)b->blocks;
+    e->total_frames += b->frames;
+    e->fill = (e->fill + 1) % ENCODE_BATCHES;
+    e->filling = 0;
+    pthread_cond_broadcast(&e->cond);
+    pthread_mutex_unlock(&e->mutex);
+}
+
+int encoder_write(Encoder* e, const float* samples, size_t frames) {
+    while (frames > 0) {
+        EncodeBatch* b = &e->batches[e->fill];
+        /* A batch is only free once the writer says so, not when it looks empty. */
+        if (!e->filling) {
+            pthread_mutex_lock(&e->mutex);
+            while (b->state != BATCH_FREE) {
+                pthread_cond_wait(&e->cond, &e->mutex);
+            }
+            int failed = e->failed;
+            pthread_mutex_unlock(&e->mutex);
+            if (failed) {
+                return -1;
+            }
+            b->frames = 0;
+            e->filling = 1;
+        }
+        size_t n = ENCODE_BATCH_FRAMES - b->frames < frames ? ENCODE_BATCH_FRAMES - b->frames : frames;
+        memcpy(b->samples + b->frames * e->channels, samples, n * e->channels * sizeof(float));
+        b->frames += n;
+        samples += n * e->channels;
+        frames -= n;
+        if (b->frames == ENCODE_BATCH_FRAMES) {
+            submit_batch(e);
+        }
+    }
+    return 0;
+}
+
+static void put_be(unsigned char* p, uint64_t value, int bytes) {
+    for (int i = bytes - 1; i >= 0; i--) {
+        p[i] = (unsigned char)value;
+        value >>= 8;
+    }
+}
+
+int encoder_end(Encoder* e) {
+    if (e->filling && e->batches[e->fill].frames > 0) {
+        submit_batch(e);
+    }
+    pthread_mutex_lock(&e->mutex);
+    for (int i = 0; i < ENCODE_BATCHES; i++) {
+        while (e->batches[i].state != BATCH_FREE) {
+            pthread_cond_wait(&e->cond, &e->mutex);
+        }
+    }
+    int failed = e->failed;
+    pthread_mutex_unlock(&e->mutex);
+
+    if (e->flac && !failed) {
+        unsigned char info[FLAC_STREAMINFO_SIZE];
+        uint64_t packed = (uint64_t)e->rate << 44 | (uint64_t)(e->channels - 1) << 41 |
+                          (uint64_t)(FLAC_BITS - 1) << 36 | (e->total_frames & 0xFFFFFFFFFull);
+        put_be(info, ENCODE_FLAC_BLOCK, 2);
+        put_be(info + 2, ENCODE_FLAC_BLOCK, 2);
+        put_be(info + 4, e->min_frame, 3);
+        put_be(info + 7, e->max_frame, 3);
+        put_be(info + 10, packed, 8);
+        md5_final(&e->md5, info + 18);
+        failed = fseek(e->flac, 8, SEEK_SET) != 0 || fwrite(info, 1, sizeof(info), e->flac) != sizeof(info) ||
+                 fflush(e->flac) != 0;
+    }
+    e->flac = NULL;
+    e->sndfile = NULL;
+    return failed ? -1 : 0;
+}
+
+void encoder_usage(Encoder* e, ResourceUsage* usage) {
+    pthread_mutex_lock(&e->mutex);
+    *usage = e->usage;
+    pthread_mutex_unlock(&e->mutex);
+}
+
+void encoder_free(Encoder* e) {
+    if (!e) {
+        return;
+    }
+    pthread_mutex_lock(&e->mutex);
+    e->quit = 1;
+    pthread_cond_broadcast(&e->cond);
+    pthread_mutex_unlock(&e->mutex);
+    if (e->writer_started) {
+        pthread_join(e->writer, NULL);
+    }
+    for (int i = 0; i < e->started; i++) {
+        pthread_join(e->helper_threads[i], NULL);
+    }
+    for (int i = 0; e->helpers && i < e->threads; i++) {
+        free(e->helpers[i].scratch);
+    }
+    for (int i = 0; i < ENCODE_BATCHES; i++) {
+        free(e->batches[i].samples);
+        free(e->batches[i].pcm);
+        free(e->batches[i].out);
+    }
+    free(e->helpers);
+    free(e->helper_threads);
+    free(e->md5_bytes);
+    pthread_mutex_destroy(&e->mutex);
+    pthread_cond_destroy(&e->cond);
+    free(e);
+}
@@ -0,0 +1,40 @@
+#ifndef SLOP_ENCODE_H
+#define SLOP_ENCODE_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <sndfile.h>
+
+#include "slopUsage.h"
+
+#define ENCODE_FLAC_BLOCK 4096
+#define ENCODE_BATCH_BLOCKS 32
+#define ENCODE_BATCHES 3
+
+/*
+ * The last stage of a native render, run off the render thread. FLAC is
+ * encoded here, 24-bit: each block of ENCODE_FLAC_BLOCK frames is an
+ * independent frame, so helper threads encode a batch of them at once
+ * and a writer thread appends them in order, patching STREAMINFO with
+ * the length, frame sizes and MD5 at the end. Other formats go through
+ * libsndfile on the writer thread, so their encode overlaps the chain.
+ * MP3 stays serial: libsndfile gives no control over LAME's bit
+ * reservoir, which chunked MP3 would need at every boundary.
+ * An encoder is kept across files and is used by one thread at a time.
+ */
+typedef struct Encoder Encoder;
+
+/* threads helpers, for up to 8 channels. NULL when out of memory. */
+Encoder* encoder_new(int channels, int threads);
+/* Writes the stream header; the caller closes file after encoder_end. */
+int encoder_begin_flac(Encoder* encoder, FILE* file, int rate);
+int encoder_begin_sndfile(Encoder* encoder, SNDFILE* file);
+/* Interleaved frames; -1 once writing has failed. */
+int encoder_write(Encoder* encoder, const float* samples, size_t frames);
+/* Waits until everything queued is written; -1 if anything failed. */
+int encoder_end(Encoder* encoder);
+/* CPU and I/O the encoder's threads have spent since it was made; complete for a file after encoder_end. */
+void encoder_usage(Encoder* encoder, ResourceUsage* usage);
+void encoder_free(Encoder* encoder);
+
+#endif
@@ -0,0 +1,307 @@
+#include <math.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "slopFFT.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/*
+ * A real transform of size n runs as a complex transform of size n / 2
+ * on the even/odd samples packed into re/im, followed by a split pass.
+ * Tables depend only on n and are shared by every plan of that size;
+ * each plan owns its scratch.
+ */
+typedef struct FFTTables {
+    int n;
+    int refs;
+    int* bitrev;
+    /* Twiddles of the stage with half-length h start at index h - 1. */
+    float* stage_cos;
+    float* stage_sin;
+    float* split_cos;
+    float* split_sin;
+    struct FFTTables* next;
+} FFTTables;
+
+struct FFT {
+    int n;
+    int half;
+    FFTTables* tables;
+    float* work_re;
+    float* work_im;
+};
+
+static pthread_mutex_t tables_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FFTTables* tables_list = NULL;
+
+static int is_power_of_two(int n) {
+    return n >= 4 && (n & (n - 1)) == 0;
+}
+
+static void tables_free(FFTTables* t) {
+    free(t->bitrev);
+    free(t->stage_cos);
+    free(t->stage_sin);
+    free(t->split_cos);
+    free(t->split_sin);
+    free(t);
+}
+
+static FFTTables* tables_new(int n) {
+    FFTTables* t = calloc(1, sizeof(FFTTables));
+    if (!t) {
+        return NULL;
+    }
+    int m = n / 2;
+    t->n = n;
+    t->bitrev = malloc(m * sizeof(int));
+    t->stage_cos = malloc(m * sizeof(float));
+    t->stage_sin = malloc(m * sizeof(float));
+    t->split_cos = malloc((m + 1) * sizeof(float));
+    t->split_sin = malloc((m + 1) * sizeof(float));
+    if (!t->bitrev || !t->stage_cos || !t->stage_sin || !t->split_cos || !t->split_sin) {
+        tables_free(t);
+        return NULL;
+    }
+
+    int bits = 0;
+    while ((1 << bits) < m) bits++;
+    for (int i = 0; i < m; i++) {
+        int r = 0;
+        for (int b = 0; b < bits; b++) {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        t->bitrev[i] = r;
+    }
+
+    for (int half = 1; half < m; half <<= 1) {
+        for (int j = 0; j < half; j++) {
+            t->stage_cos[half - 1 + j] = (float)cos(M_PI * j / half);
+            t->stage_sin[half - 1 + j] = (float)sin(M_PI * j / half);
+        }
+    }
+    for (int k = 0; k <= m; k++) {
+        t->split_cos[k] = (float)cos(2 * M_PI * k / n);
+        t->split_sin[k] = (float)sin(2 * M_PI * k / n);
+    }
+    return t;
+}
+
+static FFTTables* tables_acquire(int n) {
+    pthread_mutex_lock(&tables_mutex);
+    FFTTables* t = tables_list;
+    while (t && t->n != n) {
+        t = t->next;
+    }
+    if (!t && (t = tables_new(n)) != NULL) {
+        t->next = tables_list;
+        tables_list = t;
+    }
+    if (t) {
+        t->refs++;
+    }
+    pthread_mutex_unlock(&tables_mutex);
+    return t;
+}
+
+static void tables_release(FFTTables* t) {
+    pthread_mutex_lock(&tables_mutex);
+    if (--t->refs == 0) {
+        FFTTables** link = &tables_list;
+        while (*link != t) {
+            link = &(*link)->next;
+        }
+        *link = t->next;
+        tables_free(t);
+    }
+    pthread_mutex_unlock(&tables_mutex);
+}
+
+FFT* fft_new(int n) {
+    if (!is_power_of_two(n)) {
+        return NULL;
+    }
+
+    FFT* fft = calloc(1, sizeof(FFT));
+    if (!fft) {
+        return NULL;
+    }
+    fft->n = n;
+    fft->half = n / 2;
+    fft->tables = tables_acquire(n);
+    fft->work_re = malloc((fft->half + 1) * sizeof(float));
+    fft->work_im = malloc((fft->half + 1) * sizeof(float));
+    if (!fft->tables || !fft->work_re || !fft->work_im) {
+        fft_free(fft);
+        return NULL;
+    }
+    return fft;
+}
+
+void fft_free(FFT* fft) {
+    if (!fft) {
+        return;
+    }
+    if (fft->tables) {
+        tables_release(fft->tables);
+    }
+    free(fft->work_re);
+    free(fft->work_im);
+    free(fft);
+}
+
+int fft_size(const FFT* fft) {
+    return fft->n;
+}
+
+/* Butterflies of one stage for j in [0, half), four at a time where SIMD is available. */
+static void fft_stage(float* re, float* im, int m, int half, const float* wcos, const float* wsin, float sign) {
+    for (int g = 0; g < m; g += 2 * half) {
+        float* ar = re + g;
+        float* ai = im + g;
+        float* br = ar + half;
+        float* bi = ai + half;
+        int j = 0;
+
+#if defined(__SSE2__)
+        __m128 vsign = _mm_set1_ps(sign);
+        for (; j + 4 <= half; j += 4) {
+            __m128 wr = _mm_loadu_ps(wcos + j);
+            __m128 wi = _mm_mul_ps(vsign, _mm_loadu_ps(wsin + j));
+            __m128 xr = _mm_loadu_ps(br + j), xi = _mm_loadu_ps(bi + j);
+            __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, wr), _mm_mul_ps(xi, wi));
+            __m128 ti = _mm_add_ps(_mm_mul_ps(xr, wi), _mm_mul_ps(xi, wr));
+            __m128 yr = _mm_loadu_ps(ar + j), yi = _mm_loadu_ps(ai + j);
+            _mm_storeu_ps(br + j, _mm_sub_ps(yr, tr));
+            _mm_storeu_ps(bi + j, _mm_sub_ps(yi, ti));
+            _mm_storeu_ps(ar + j, _mm_add_ps(yr, tr));
+            _mm_storeu_ps(ai + j, _mm_add_ps(yi, ti));
+        }
+#elif defined(__ARM_NEON)
+        for (; j + 4 <= half; j += 4) {
+            float32x4_t wr = vld1q_f32(wcos + j);
+            float32x4_t wi = vmulq_n_f32(vld1q_f32(wsin + j), sign);
+            float32x4_t xr = vld1q_f32(br + j), xi = vld1q_f32(bi + j);
+            float32x4_t tr = vmlsq_f32(vmulq_f32(xr, wr), xi, wi);
+            float32x4_t ti = vmlaq_f32(vmulq_f32(xr, wi), xi, wr);
+            float32x4_t yr = vld1q_f32(ar + j), yi = vld1q_f32(ai + j);
+            vst1q_f32(br + j, vsubq_f32(yr, tr));
+            vst1q_f32(bi + j, vsubq_f32(yi, ti));
+            vst1q_f32(ar + j, vaddq_f32(yr, tr));
+            vst1q_f32(ai + j, vaddq_f32(yi, ti));
+        }
+#endif
+
+        for (; j < half; j++) {
+            float wr = wcos[j];
+            float wi = sign * wsin[j];
+            float tr = br[j] * wr - bi[j] * wi;
+            float ti = br[j] * wi + bi[j] * wr;
+            br[j] = ar[j] - tr;
+            bi[j] = ai[j] - ti;
+            ar[j] += tr;
+            ai[j] += ti;
+        }
+    }
+}
+
+/* Takes its input in bit-reversed order; the callers scatter it there as they fill it. */
+static void fft_half_complex(FFT* fft, float* re, float* im, int inverse) {
+    int m = fft->half;
+    const FFTTables* t = fft->tables;
+    float sign = inverse ? 1.0f : -1.0f;
+    int half = 1;
+
+    /* The first two stages' twiddles are 1 and +-i, so they run as one radix-4 pass without multiplies. */
+    if (m >= 4) {
+        for (int g = 0; g < m; g += 4) {
+            float a0r = re[g] + re[g + 1], a0i = im[g] + im[g + 1];
+            float a1r = re[g] - re[g + 1], a1i = im[g] - im[g + 1];
+            float a2r = re[g + 2] + re[g + 3], a2i = im[g + 2] + im[g + 3];
+            float a3r = re[g + 2] - re[g + 3], a3i = im[g + 2] - im[g + 3];
+            float tr = -sign * a3i, ti = sign * a3r;
+            re[g] = a0r + a2r;
+            im[g] = a0i + a2i;
+            re[g + 2] = a0r - a2r;
+            im[g + 2] = a0i - a2i;
+            re[g + 1] = a1r + tr;
+            im[g + 1] = a1i + ti;
+            re[g + 3] = a1r - tr;
+            im[g + 3] = a1i - ti;
+        }
+        half = 4;
+    }
+    for (; half < m; half <<= 1) {
+        fft_stage(re, im, m, half, t->stage_cos + half - 1, t->stage_sin + half - 1, sign);
+    }
+}
+
+void fft_real_forward(FFT* fft, const float* in, float* re, float* im) {
+    int m = fft->half;
+    float* zr = fft->work_re;
+    float* zi = fft->work_im;
+
+    const int* bitrev = fft->tables->bitrev;
+
+    for (int i = 0; i < m; i++) {
+        zr[bitrev[i]] = in[2 * i];
+        zi[bitrev[i]] = in[2 * i + 1];
+    }
+    fft_half_complex(fft, zr, zi, 0);
+    zr[m] = zr[0];
+    zi[m] = zi[0];
+
+    for (int k = 0; k <= m; k++) {
+        float ar = zr[k], ai = zi[k];
+        float br = zr[m - k], bi = -zi[m - k];
+        float er = 0.5f * (ar + br), ei = 0.5f * (ai + bi);
+        float dr = ar - br, di = ai - bi;
+        /* odd = -0.5i * (a - b) */
+        float orr = 0.5f * di, oi = -0.5f * dr;
+        float wr = fft->tables->split_cos[k], wi = -fft->tables->split_sin[k];
+        re[k] = er + orr * wr - oi * wi;
+        im[k] = ei + orr * wi + oi * wr;
+    }
+}
+
+void fft_real_inverse(FFT* fft, const float* re, const float* im, float* out) {
+    int m = fft->half;
+    float* zr = fft->work_re;
+    float* zi = fft->work_im;
+    const int* bitrev = fft->tables->bitrev;
+
+    for (int k = 0; k < m; k++) {
+        float ar = re[k], ai = im[k];
+        float br = re[m - k], bi = -im[m - k];
+        float er = 0.5f * (ar + br), ei = 0.5f * (ai + bi);
+        float dr = 0.5f * (ar - br), di = 0.5f * (ai - bi);
+        /* odd = (a - b) / (2 w^k), with w^-k = conj(w^k) */
+        float wr = fft->tables->split_cos[k], wi = fft->tables->split_sin[k];
+        float orr = dr * wr - di * wi;
+        float oi = dr * wi + di * wr;
+        zr[bitrev[k]] = er - oi;
+        zi[bitrev[k]] = ei + orr;
+    }
+    fft_half_complex(fft, zr, zi, 1);
+
+    float scale = 1.0f / m;
+    for (int i = 0; i < m; i++) {
+        out[2 * i] = zr[i] * scale;
+        out[2 * i + 1] = zi[i] * scale;
+    }
+}
+
+void fft_window_hann(float* window, int n) {
+    for (int i = 0; i < n; i++) {
+        window[i] = (float)(0.5 - 0.5 * cos(2 * M_PI * i / n));
+    }
+}
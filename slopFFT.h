@@ -0,0 +1,25 @@
+#ifndef SLOP_FFT_H
+#define SLOP_FFT_H
+
+#include <stddef.h>
+
+/*
+ * Real-input radix-2 FFT with split real/imaginary spectra. Sizes must be
+ * powers of two. The forward transform is unscaled; the inverse divides
+ * by n so a round trip returns the input. Plans of one size share their
+ * tables, so creating one per file or channel is cheap; a plan carries
+ * scratch buffers, so each thread needs its own.
+ */
+typedef struct FFT FFT;
+
+FFT* fft_new(int n);
+void fft_free(FFT* fft);
+int fft_size(const FFT* fft);
+
+/* n real samples <-> n / 2 + 1 complex bins. */
+void fft_real_forward(FFT* fft, const float* in, float* re, float* im);
+void fft_real_inverse(FFT* fft, const float* re, const float* im, float* out);
+
+void fft_window_hann(float* window, int n);
+
+#endif
@@ -0,0 +1,580 @@
+#include <math.h>
+#include <string.h>
+
+#include "slopFileList.h"
+#include "slopMaster.h"
+
+enum {
+    FILE_COL_CHECKED,
+    FILE_COL_NAME,
+    FILE_COL_KEY,
+    FILE_COL_DURATION,
+    FILE_COL_RATE,
+    FILE_COL_CHANNELS,
+    FILE_COL_LOUDNESS,
+    FILE_COL_PROBE_STATE,
+    FILE_NUM_COLS
+};
+
+enum {
+    PROBE_NONE,
+    PROBE_QUEUED,
+    PROBE_DONE,
+    PROBE_FAILED
+};
+
+struct FileList {
+    gint ref_count;
+    gboolean destroyed;
+
+    GtkWidget* box;
+    GtkWidget* search_entry;
+    GtkWidget* status_label;
+    GtkWidget* tree;
+    GtkListStore* store;
+    GtkTreeModel* filter;
+    GtkTreeModel* sort;
+    gchar* filter_key;
+
+    gchar* dir;
+    GCancellable* cancellable;
+    gint generation;
+    gint num_files;
+    gboolean loading;
+    GHashTable* keep_checked;
+    guint visible_probe_id;
+
+    GThreadPool* probe_pool;
+    FileListProbeFunc probe_func;
+    gpointer probe_data;
+};
+
+typedef struct {
+    FileList* list;
+    gint generation;
+} LoadContext;
+
+typedef struct {
+    FileList* list;
+    gint generation;
+    GtkTreeIter iter;
+    gchar* path;
+    GCancellable* cancellable;
+    FileProbe probe;
+    gboolean ok;
+} ProbeJob;
+
+static void filelist_probe_worker(gpointer data, gpointer user_data);
+static void filelist_on_toggled(GtkCellRendererToggle* renderer, gchar* path, gpointer data);
+static void filelist_on_search_changed(GtkSearchEntry* entry, gpointer data);
+static void filelist_on_select_all(GtkWidget* button, gpointer data);
+static void filelist_on_select_none(GtkWidget* button, gpointer data);
+static void filelist_on_sort_changed(GtkTreeSortable* sortable, gpointer data);
+static void filelist_on_scrolled(GtkAdjustment* adjustment, gpointer data);
+static gboolean filelist_visible_func(GtkTreeModel* model, GtkTreeIter* iter, gpointer data);
+static void filelist_queue_visible_probes(FileList* list);
+
+static FileList* filelist_ref(FileList* list) {
+    g_atomic_int_inc(&list->ref_count);
+    return list;
+}
+
+static void filelist_unref(FileList* list) {
+    if (!g_atomic_int_dec_and_test(&list->ref_count)) {
+        return;
+    }
+    g_object_unref(list->store);
+    g_object_unref(list->filter);
+    g_object_unref(list->sort);
+    g_object_unref(list->box);
+    g_hash_table_destroy(list->keep_checked);
+    g_clear_object(&list->cancellable);
+    g_free(list->filter_key);
+    g_free(list->dir);
+    g_free(list);
+}
+
+gboolean filelist_is_audio_file(const char* name) {
+    return slopmaster_is_audio_file(name);
+}
+
+static void format_duration_cell(GtkTreeViewColumn* column, GtkCellRenderer* cell,
+                                 GtkTreeModel* model, GtkTreeIter* iter, gpointer data) {
+    double duration;
+    gint state;
+    gchar text[32] = "";
+
+    gtk_tree_model_get(model, iter, FILE_COL_DURATION, &duration, FILE_COL_PROBE_STATE, &state, -1);
+    if (duration >= 0) {
+        int seconds = (int)(duration + 0.5);
+        g_snprintf(text, sizeof(text), "%d:%02d", seconds / 60, seconds % 60);
+    } else if (state == PROBE_QUEUED) {
+        g_strlcpy(text, "…", sizeof(text));
+    }
+    g_object_set(cell, "text", text, NULL);
+}
+
+static void format_int_cell(GtkTreeViewColumn* column, GtkCellRenderer* cell,
+                            GtkTreeModel* model, GtkTreeIter* iter, gpointer data) {
+    gint value;
+    gchar text[32] = "";
+
+    gtk_tree_model_get(model, iter, GPOINTER_TO_INT(data), &value, -1);
+    if (value > 0) {
+        g_snprintf(text, sizeof(text), "%d", value);
+    }
+    g_object_set(cell, "text", text, NULL);
+}
+
+static void format_loudness_cell(GtkTreeViewColumn* column, GtkCellRenderer* cell,
+                                 GtkTreeModel* model, GtkTreeIter* iter, gpointer data) {
+    double loudness;
+    gint state;
+    gchar text[32] = "";
+
+    gtk_tree_model_get(model, iter, FILE_COL_LOUDNESS, &loudness, FILE_COL_PROBE_STATE, &state, -1);
+    if (isfinite(loudness)) {
+        g_snprintf(text, sizeof(text), "%.1f", loudness);
+    } else if (state == PROBE_QUEUED) {
+        g_strlcpy(text, "…", sizeof(text));
+    }
+    g_object_set(cell, "text", text, NULL);
+}
+
+static GtkTreeViewColumn* filelist_add_column(FileList* list, const char* title, int sort_column,
+                                              GtkTreeCellDataFunc func, gpointer func_data) {
+    GtkCellRenderer* renderer = gtk_cell_renderer_text_new();
+    GtkTreeViewColumn* column = gtk_tree_view_column_new();
+
+    gtk_tree_view_column_set_title(column, title);
+    gtk_tree_view_column_pack_start(column, renderer, TRUE);
+    if (func) {
+        g_object_set(renderer, "xalign", 1.0, NULL);
+        gtk_tree_view_column_set_cell_data_func(column, renderer, func, func_data, NULL);
+    } else {
+        g_object_set(renderer, "ellipsize", PANGO_ELLIPSIZE_MIDDLE, NULL);
+        gtk_tree_view_column_add_attribute(column, renderer, "text", FILE_COL_NAME);
+        gtk_tree_view_column_set_expand(column, TRUE);
+    }
+    gtk_tree_view_column_set_sort_column_id(column, sort_column);
+    gtk_tree_view_column_set_resizable(column, TRUE);
+    gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+    gtk_tree_view_column_set_fixed_width(column, func ? 70 : 220);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(list->tree), column);
+    return column;
+}
+
+FileList* filelist_new(FileListProbeFunc probe_func, gpointer probe_data) {
+    FileList* list = g_new0(FileList, 1);
+    list->ref_count = 1;
+    list->probe_func = probe_func;
+    list->probe_data = probe_data;
+    list->keep_checked = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    list->probe_pool = g_thread_pool_new(filelist_probe_worker, list, FILELIST_PROBE_THREADS, FALSE, NULL);
+
+    list->store = gtk_list_store_new(FILE_NUM_COLS, G_TYPE_BOOLEAN, G_TYPE_STRING, G_TYPE_STRING,
+                                     G_TYPE_DOUBLE, G_TYPE_INT, G_TYPE_INT, G_TYPE_DOUBLE, G_TYPE_INT);
+    list->filter = gtk_tree_model_filter_new(GTK_TREE_MODEL(list->store), NULL);
+    gtk_tree_model_filter_set_visible_func(GTK_TREE_MODEL_FILTER(list->filter),
+                                           filelist_visible_func, list, NULL);
+    list->sort = gtk_tree_model_sort_new_with_model(list->filter);
+    gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(list->sort), FILE_COL_KEY, GTK_SORT_ASCENDING);
+    g_signal_connect(list->sort, "sort-column-changed", G_CALLBACK(filelist_on_sort_changed), list);
+
+    list->box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    g_object_ref_sink(list->box);
+
+    GtkWidget* toolbar = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_box_pack_start(GTK_BOX(list->box), toolbar, FALSE, FALSE, 0);
+
+    list->search_entry = gtk_search_entry_new();
+    gtk_entry_set_placeholder_text(GTK_ENTRY(list->search_entry), "Filter");
+    gtk_box_pack_start(GTK_BOX(toolbar), list->search_entry, TRUE, TRUE, 0);
+    g_signal_connect(list->search_entry, "search-changed", G_CALLBACK(filelist_on_search_changed), list);
+
+    GtkWidget* all_button = gtk_button_new_with_label("All");
+    gtk_box_pack_start(GTK_BOX(toolbar), all_button, FALSE, FALSE, 0);
+    g_signal_connect(all_button, "clicked", G_CALLBACK(filelist_on_select_all), list);
+    gtk_widget_set_tooltip_text(all_button, "Check every file that matches the filter");
+
+    GtkWidget* none_button = gtk_button_new_with_label("None");
+    gtk_box_pack_start(GTK_BOX(toolbar), none_button, FALSE, FALSE, 0);
+    g_signal_connect(none_button, "clicked", G_CALLBACK(filelist_on_select_none), list);
+    gtk_widget_set_tooltip_text(none_button, "Uncheck every file that matches the filter");
+
+    GtkWidget* scroll = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroll), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_box_pack_start(GTK_BOX(list->box), scroll, TRUE, TRUE, 0);
+
+    list->tree = gtk_tree_view_new_with_model(list->sort);
+    gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(list->tree), TRUE);
+    gtk_tree_view_set_search_column(GTK_TREE_VIEW(list->tree), FILE_COL_NAME);
+    gtk_container_add(GTK_CONTAINER(scroll), list->tree);
+
+    GtkCellRenderer* toggle = gtk_cell_renderer_toggle_new();
+    g_signal_connect(toggle, "toggled", G_CALLBACK(filelist_on_toggled), list);
+    GtkTreeViewColumn* check_column = gtk_tree_view_column_new_with_attributes("", toggle, "active", FILE_COL_CHECKED, NULL);
+    gtk_tree_view_column_set_sizing(check_column, GTK_TREE_VIEW_COLUMN_FIXED);
+    gtk_tree_view_column_set_fixed_width(check_column, 30);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(list->tree), check_column);
+
+    filelist_add_column(list, "File", FILE_COL_KEY, NULL, NULL);
+    filelist_add_column(list, "Length", FILE_COL_DURATION, format_duration_cell, NULL);
+    filelist_add_column(list, "Rate", FILE_COL_RATE, format_int_cell, GINT_TO_POINTER(FILE_COL_RATE));
+    filelist_add_column(list, "Ch", FILE_COL_CHANNELS, format_int_cell, GINT_TO_POINTER(FILE_COL_CHANNELS));
+    filelist_add_column(list, "LUFS", FILE_COL_LOUDNESS, format_loudness_cell, NULL);
+
+    GtkAdjustment* vadjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(list->tree));
+    g_signal_connect(vadjustment, "value-changed", G_CALLBACK(filelist_on_scrolled), list);
+    g_signal_connect(vadjustment, "changed", G_CALLBACK(filelist_on_scrolled), list);
+
+    list->status_label = gtk_label_new("");
+    gtk_widget_set_halign(list->status_label, GTK_ALIGN_START);
+    gtk_box_pack_start(GTK_BOX(list->box), list->status_label, FALSE, FALSE, 0);
+    return list;
+}
+
+void filelist_free(FileList* list) {
+    if (!list) {
+        return;
+    }
+    list->destroyed = TRUE;
+    if (list->cancellable) {
+        g_cancellable_cancel(list->cancellable);
+    }
+    if (list->visible_probe_id) {
+        g_source_remove(list->visible_probe_id);
+        list->visible_probe_id = 0;
+    }
+    g_thread_pool_free(list->probe_pool, FALSE, TRUE);
+    filelist_unref(list);
+}
+
+GtkWidget* filelist_widget(FileList* list) {
+    return list->box;
+}
+
+static void filelist_update_status(FileList* list) {
+    gchar* text = g_strdup_printf(list->loading ? "%d files (loading…)" : "%d files", list->num_files);
+    gtk_label_set_text(GTK_LABEL(list->status_label), text);
+    g_free(text);
+}
+
+static void filelist_queue_probe(FileList* list, GtkTreeIter* store_iter) {
+    gint state;
+    gtk_tree_model_get(GTK_TREE_MODEL(list->store), store_iter, FILE_COL_PROBE_STATE, &state, -1);
+    if (state != PROBE_NONE || !list->probe_func) {
+        return;
+    }
+
+    gchar* name;
+    gtk_tree_model_get(GTK_TREE_MODEL(list->store), store_iter, FILE_COL_NAME, &name, -1);
+
+    ProbeJob* job = g_new0(ProbeJob, 1);
+    job->list = filelist_ref(list);
+    job->generation = list->generation;
+    job->iter = *store_iter;
+    job->path = g_build_filename(list->dir, name, NULL);
+    job->cancellable = g_object_ref(list->cancellable);
+    job->probe.duration = -1;
+    job->probe.loudness = -INFINITY;
+    g_free(name);
+
+    gtk_list_store_set(list->store, store_iter, FILE_COL_PROBE_STATE, PROBE_QUEUED, -1);
+    g_thread_pool_push(list->probe_pool, job, NULL);
+}
+
+static gboolean filelist_probe_done(gpointer data) {
+    ProbeJob* job = (ProbeJob*)data;
+    FileList* list = job->list;
+
+    if (!list->destroyed && job->generation == list->generation) {
+        gtk_list_store_set(list->store, &job->iter,
+                           FILE_COL_DURATION, job->probe.duration,
+                           FILE_COL_RATE, job->probe.sample_rate,
+                           FILE_COL_CHANNELS, job->probe.channels,
+                           FILE_COL_LOUDNESS, job->probe.loudness,
+                           FILE_COL_PROBE_STATE, job->ok ? PROBE_DONE : PROBE_FAILED,
+                           -1);
+    }
+
+    g_object_unref(job->cancellable);
+    g_free(job->path);
+    g_free(job);
+    filelist_unref(list);
+    return G_SOURCE_REMOVE;
+}
+
+static void filelist_probe_worker(gpointer data, gpointer user_data) {
+    ProbeJob* job = (ProbeJob*)data;
+    FileList* list = job->list;
+
+    if (!g_cancellable_is_cancelled(job->cancellable)) {
+        job->ok = list->probe_func(job->path, &job->probe, job->cancellable, list->probe_data);
+    }
+    g_idle_add(filelist_probe_done, job);
+}
+
+static gboolean filelist_probe_visible(gpointer data) {
+    FileList* list = (FileList*)data;
+    GtkTreePath *start, *end;
+
+    list->visible_probe_id = 0;
+    if (!gtk_tree_view_get_visible_range(GTK_TREE_VIEW(list->tree), &start, &end)) {
+        return G_SOURCE_REMOVE;
+    }
+
+    GtkTreeIter sort_iter;
+    gboolean valid = gtk_tree_model_get_iter(list->sort, &sort_iter, start);
+    GtkTreePath* path = gtk_tree_path_copy(start);
+    while (valid) {
+        GtkTreeIter filter_iter, store_iter;
+        gtk_tree_model_sort_convert_iter_to_child_iter(GTK_TREE_MODEL_SORT(list->sort), &filter_iter, &sort_iter);
+        gtk_tree_model_filter_convert_iter_to_child_iter(GTK_TREE_MODEL_FILTER(list->filter), &store_iter, &filter_iter);
+        filelist_queue_probe(list, &store_iter);
+
+        if (gtk_tree_path_compare(path, end) >= 0) {
+            break;
+        }
+        valid = gtk_tree_model_iter_next(list->sort, &sort_iter);
+        gtk_tree_path_next(path);
+    }
+
+    gtk_tree_path_free(path);
+    gtk_tree_path_free(start);
+    gtk_tree_path_free(end);
+    return G_SOURCE_REMOVE;
+}
+
+static void filelist_queue_visible_probes(FileList* list) {
+    if (list->visible_probe_id == 0) {
+        list->visible_probe_id = g_idle_add(filelist_probe_visible, list);
+    }
+}
+
+static void filelist_on_scrolled(GtkAdjustment* adjustment, gpointer data) {
+    filelist_queue_visible_probes((FileList*)data);
+}
+
+/* Sorting by a probed column needs every value, not just the visible ones. */
+static void filelist_on_sort_changed(GtkTreeSortable* sortable, gpointer data) {
+    FileList* list = (FileList*)data;
+    gint column;
+    GtkSortType order;
+
+    if (!gtk_tree_sortable_get_sort_column_id(sortable, &column, &order) ||
+        column == FILE_COL_KEY) {
+        return;
+    }
+
+    GtkTreeIter iter;
+    gboolean valid = gtk_tree_model_get_iter_first(GTK_TREE_MODEL(list->store), &iter);
+    while (valid) {
+        filelist_queue_probe(list, &iter);
+        valid = gtk_tree_model_iter_next(GTK_TREE_MODEL(list->store), &iter);
+    }
+}
+
+static gboolean filelist_visible_func(GtkTreeModel* model, GtkTreeIter* iter, gpointer data) {
+    FileList* list = (FileList*)data;
+    if (!list->filter_key || !*list->filter_key) {
+        return TRUE;
+    }
+
+    gchar* key;
+    gtk_tree_model_get(model, iter, FILE_COL_KEY, &key, -1);
+    gboolean visible = key && strstr(key, list->filter_key) != NULL;
+    g_free(key);
+    return visible;
+}
+
+static void filelist_on_search_changed(GtkSearchEntry* entry, gpointer data) {
+    FileList* list = (FileList*)data;
+    g_free(list->filter_key);
+    list->filter_key = g_utf8_casefold(gtk_entry_get_text(GTK_ENTRY(entry)), -1);
+    gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER(list->filter));
+    filelist_queue_visible_probes(list);
+}
+
+static void filelist_set_visible_checked(FileList* list, gboolean checked) {
+    GtkTreeIter filter_iter;
+    gboolean valid = gtk_tree_model_get_iter_first(list->filter, &filter_iter);
+
+    while (valid) {
+        GtkTreeIter store_iter;
+        gtk_tree_model_filter_convert_iter_to_child_iter(GTK_TREE_MODEL_FILTER(list->filter), &store_iter, &filter_iter);
+        gtk_list_store_set(list->store, &store_iter, FILE_COL_CHECKED, checked, -1);
+        valid = gtk_tree_model_iter_next(list->filter, &filter_iter);
+    }
+}
+
+static void filelist_on_select_all(GtkWidget* button, gpointer data) {
+    filelist_set_visible_checked((FileList*)data, TRUE);
+}
+
+static void filelist_on_select_none(GtkWidget* button, gpointer data) {
+    filelist_set_visible_checked((FileList*)data, FALSE);
+}
+
+static void filelist_on_toggled(GtkCellRendererToggle* renderer, gchar* path, gpointer data) {
+    FileList* list = (FileList*)data;
+    GtkTreeIter sort_iter, filter_iter, store_iter;
+
+    if (!gtk_tree_model_get_iter_from_string(list->sort, &sort_iter, path)) {
+        return;
+    }
+    gtk_tree_model_sort_convert_iter_to_child_iter(GTK_TREE_MODEL_SORT(list->sort), &filter_iter, &sort_iter);
+    gtk_tree_model_filter_convert_iter_to_child_iter(GTK_TREE_MODEL_FILTER(list->filter), &store_iter, &filter_iter);
+
+    gboolean checked;
+    gtk_tree_model_get(GTK_TREE_MODEL(list->store), &store_iter, FILE_COL_CHECKED, &checked, -1);
+    gtk_list_store_set(list->store, &store_iter, FILE_COL_CHECKED, !checked, -1);
+}
+
+GList* filelist_get_checked(FileList* list) {
+    GList* names = NULL;
+    GtkTreeIter iter;
+    gboolean valid = gtk_tree_model_get_iter_first(GTK_TREE_MODEL(list->store), &iter);
+
+    while (valid) {
+        gboolean checked;
+        gchar* name;
+        gtk_tree_model_get(GTK_TREE_MODEL(list->store), &iter, FILE_COL_CHECKED, &checked, FILE_COL_NAME, &name, -1);
+        if (checked) {
+            names = g_list_prepend(names, name);
+        } else {
+            g_free(name);
+        }
+        valid = gtk_tree_model_iter_next(GTK_TREE_MODEL(list->store), &iter);
+    }
+    return g_list_reverse(names);
+}
+
+static void filelist_load_finished(LoadContext* ctx) {
+    FileList* list = ctx->list;
+    if (!list->destroyed && ctx->generation == list->generation) {
+        list->loading = FALSE;
+        g_hash_table_remove_all(list->keep_checked);
+        filelist_update_status(list);
+    }
+    filelist_unref(list);
+    g_free(ctx);
+}
+
+static void filelist_on_next_files(GObject* source, GAsyncResult* result, gpointer data) {
+    LoadContext* ctx = (LoadContext*)data;
+    FileList* list = ctx->list;
+    GFileEnumerator* enumerator = G_FILE_ENUMERATOR(source);
+    GError* error = NULL;
+    GList* infos = g_file_enumerator_next_files_finish(enumerator, result, &error);
+
+    if (error || list->destroyed || ctx->generation != list->generation) {
+        if (error && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_printerr("Error reading directory: %s\n", error->message);
+        }
+        g_clear_error(&error);
+        g_list_free_full(infos, g_object_unref);
+        filelist_load_finished(ctx);
+        return;
+    }
+
+    if (!infos) {
+        g_file_enumerator_close_async(enumerator, G_PRIORITY_DEFAULT, NULL, NULL, NULL);
+        filelist_load_finished(ctx);
+        return;
+    }
+
+    for (GList* it = infos; it; it = it->next) {
+        GFileInfo* info = G_FILE_INFO(it->data);
+        const char* name = g_file_info_get_name(info);
+        if (g_file_info_get_file_type(info) != G_FILE_TYPE_REGULAR || !filelist_is_audio_file(name)) {
+            continue;
+        }
+
+        gchar* display = g_filename_display_name(name);
+        gchar* key = g_utf8_casefold(display, -1);
+        gtk_list_store_insert_with_values(list->store, NULL, -1,
+                                          FILE_COL_CHECKED, g_hash_table_contains(list->keep_checked, name),
+                                          FILE_COL_NAME, name,
+                                          FILE_COL_KEY, key,
+                                          FILE_COL_DURATION, -1.0,
+                                          FILE_COL_RATE, 0,
+                                          FILE_COL_CHANNELS, 0,
+                                          FILE_COL_LOUDNESS, -INFINITY,
+                                          FILE_COL_PROBE_STATE, PROBE_NONE,
+                                          -1);
+        g_free(display);
+        g_free(key);
+        list->num_files++;
+    }
+    g_list_free_full(infos, g_object_unref);
+
+    filelist_update_status(list);
+    filelist_queue_visible_probes(list);
+    g_file_enumerator_next_files_async(enumerator, FILELIST_BATCH_SIZE, G_PRIORITY_DEFAULT,
+                                       list->cancellable, filelist_on_next_files, ctx);
+}
+
+static void filelist_on_enumerate(GObject* source, GAsyncResult* result, gpointer data) {
+    LoadContext* ctx = (LoadContext*)data;
+    FileList* list = ctx->list;
+    GError* error = NULL;
+    GFileEnumerator* enumerator = g_file_enumerate_children_finish(G_FILE(source), result, &error);
+
+    if (!enumerator) {
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            g_printerr("Error opening directory: %s\n", error->message);
+        }
+        g_clear_error(&error);
+        filelist_load_finished(ctx);
+        return;
+    }
+
+    g_file_enumerator_next_files_async(enumerator, FILELIST_BATCH_SIZE, G_PRIORITY_DEFAULT,
+                                       list->cancellable, filelist_on_next_files, ctx);
+    g_object_unref(enumerator);
+}
+
+/*
+ * Reloading the same folder keeps the checked files checked, so the list
+ * can be refreshed after a batch without losing the selection.
+ */
+void filelist_load(FileList* list, const char* dir) {
+    gboolean same_dir = list->dir && strcmp(list->dir, dir) == 0;
+
+    g_hash_table_remove_all(list->keep_checked);
+    if (same_dir) {
+        GList* checked = filelist_get_checked(list);
+        for (GList* it = checked; it; it = it->next) {
+            g_hash_table_add(list->keep_checked, it->data);
+        }
+        g_list_free(checked);
+    }
+
+    if (list->cancellable) {
+        g_cancellable_cancel(list->cancellable);
+        g_object_unref(list->cancellable);
+    }
+    list->cancellable = g_cancellable_new();
+    list->generation++;
+    list->num_files = 0;
+    list->loading = TRUE;
+    g_free(list->dir);
+    list->dir = g_strdup(dir);
+
+    /* Detach while clearing so the view doesn't process every row removal. */
+    gtk_tree_view_set_model(GTK_TREE_VIEW(list->tree), NULL);
+    gtk_list_store_clear(list->store);
+    gtk_tree_view_set_model(GTK_TREE_VIEW(list->tree), list->sort);
+    filelist_update_status(list);
+
+    LoadContext* ctx = g_new0(LoadContext, 1);
+    ctx->list = filelist_ref(list);
+    ctx->generation = list->generation;
+
+    GFile* file = g_file_new_for_path(dir);
+    g_file_enumerate_children_async(file, G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                    G_FILE_QUERY_INFO_NONE, G_PRIORITY_DEFAULT,
+                                    list->cancellable, filelist_on_enumerate, ctx);
+    g_object_unref(file);
+}
@@ -0,0 +1,41 @@
+#ifndef SLOP_FILE_LIST_H
+#define SLOP_FILE_LIST_H
+
+#include <gtk/gtk.h>
+
+#define FILELIST_BATCH_SIZE 256
+#define FILELIST_PROBE_THREADS 2
+
+/* Filled in by a FileListProbeFunc; fields left alone stay "unknown". */
+typedef struct {
+    double duration;
+    int sample_rate;
+    int channels;
+    double loudness;
+} FileProbe;
+
+/*
+ * Runs on a probe worker thread. Should give up early once the
+ * cancellable is cancelled and return FALSE on failure.
+ */
+typedef gboolean (*FileListProbeFunc)(const char* path, FileProbe* probe,
+                                      GCancellable* cancellable, gpointer user_data);
+
+/*
+ * Virtualized, sortable list of the audio files in one folder. Rows are
+ * appended in batches from an async GFileEnumerator; duration, rate,
+ * channels and loudness are probed in the background, starting with the
+ * rows that are on screen.
+ */
+typedef struct FileList FileList;
+
+FileList* filelist_new(FileListProbeFunc probe_func, gpointer probe_data);
+void filelist_free(FileList* list);
+GtkWidget* filelist_widget(FileList* list);
+
+void filelist_load(FileList* list, const char* dir);
+GList* filelist_get_checked(FileList* list);
+
+gboolean filelist_is_audio_file(const char* name);
+
+#endif
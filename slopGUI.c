@@ -3,7 +3,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dirent.h>
 #include <getopt.h>
 #include <errno.h>
 #include <sys/stat.h>
@@ -11,14 +10,28 @@
 #include <pthread.h>
 #include <gtk/gtk.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <gst/gst.h>
+#include <gst/app/gstappsink.h>
 #include <time.h>
 #include <math.h>
 #include <sndfile.h>
 
+#include "slopPeaks.h"
+#include "slopSpectro.h"
+#include "slopWaveView.h"
+#include "slopChain.h"
+#include "slopLoudness.h"
+#include "slopDSP.h"
+#include "slopMeters.h"
+#include "slopMeterView.h"
+#include "slopFileList.h"
+#include "slopJobQueue.h"
+#include "slopAnalysisDB.h"
+#include "slopMaster.h"
+#include "slopCompare.h"
+
 #define MAX_PATH 4096
-#define COMMAND_SIZE 524288
-#define MAX_THREADS 4
 #define COLOR_BACKGROUND "#1D1E2C"
 #define COLOR_PRIMARY "#F17E8A"
 #define COLOR_SECONDARY "#FFBDC1"
@@ -26,72 +39,168 @@
 #define COLOR_TEXT "#FFEBEE"
 #define SAMPLE_RATE 48000
 #define CHANNELS 2
-#define MAX_WAVEFORM_POINTS 1000
+#define PREVIEW_BUFFER_TIME_US 40000
+#define PREVIEW_LATENCY_TIME_US 10000
+#define PREVIEW_ANALYSIS_DELAY_MS 300
+#define JOB_REFRESH_MS 250
+
+enum {
+    AB_ORIGINAL = 0,
+    AB_PROCESSED = 1,
+    AB_SOURCES = 2
+};
+
+typedef struct {
+    char *filename;
+    gint generation;
+    PeakData *peaks;
+    SpectroData *spectro;
+} WaveformJob;
+
+typedef struct {
+    char *input_file;
+    char *output_file;
+    SlopSettings settings;
+    uint64_t settings_hash;
+} MasterJob;
+
+enum {
+    JOB_COL_ID,
+    JOB_COL_NAME,
+    JOB_COL_STATE,
+    JOB_COL_PROGRESS,
+    JOB_COL_ELAPSED,
+    JOB_COL_ORDER,
+    JOB_COL_FINISHED,
+    JOB_NUM_COLS
+};
 
 typedef struct {
-    char input_file[MAX_PATH];
-    char output_file[MAX_PATH];
-    int vocal_mode;
-    char output_format[10];
-} ThreadArgs;
+    char *filename;
+    gint generation;
+    ChainParams params;
+    MasterChain *chain;
+    LoudnessMeter *meter;
+    float *scratch;
+    gsize scratch_frames;
+    double lufs;
+} PreviewAnalysisJob;
+
+typedef struct {
+    char *filename;
+    gint source;
+    gint generation;
+    LoudnessMeter *meter;
+    double lufs;
+} LoudnessJob;
+
+typedef struct {
+    char *original;
+    char *processed;
+    CompareResult result;
+    int status;
+    char message[512];
+} NullTestJob;
+
+typedef gboolean (*DecodeChunkFunc)(const float *samples, gsize frames, gint channels, gint rate, gpointer user_data);
 
 FILE* log_file = NULL;
-int total_files = 0;
-int processed_files = 0;
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
-GtkWidget *window, *master_button, *vocal_checkbox, *file_list, *reverb_checkbox;
+GtkWidget *window, *master_button, *vocal_checkbox, *reverb_checkbox;
+FileList *file_list = NULL;
+AnalysisDB *analysis_db = NULL;
 GtkWidget *bass_booster_checkbox, *wet_checkbox, *reverb_delay_scale, *reverb_decay_scale;
 GtkWidget *format_combo, *stereo_width_scale, *multiband_frame;
 GtkWidget *low_threshold, *low_ratio, *mid_threshold, *mid_ratio, *high_threshold, *high_ratio;
 GtkWidget *crossover_low, *crossover_high, *right_panel, *progress_bar;
-GtkWidget *waveform_drawing_area, *original_file_chooser, *processed_file_chooser;
+GtkWidget *original_file_chooser, *processed_file_chooser;
 GtkWidget *time_label, *seek_bar;
 GtkWidget *volume_adjustment_scale;
 
-GstElement *playbin = NULL;
+WaveView *waveform_view = NULL;
+GtkWidget *preview_button;
+guint waveform_tick_id = 0;
+
+GstElement *ab_pipeline = NULL;
+GstPad *ab_mixer_pads[AB_SOURCES];
+guint ab_bus_watch_id = 0;
+gboolean ab_pipeline_stale = TRUE;
+gint ab_active_source = AB_ORIGINAL;
+gint64 ab_pending_seek = -1;
+double ab_lufs[AB_SOURCES] = {NAN, NAN};
+gint ab_loudness_generation[AB_SOURCES];
+GtkWidget *loudness_match_checkbox;
+GtkWidget *spectrogram_checkbox;
+GtkWidget *null_test_button;
+GtkWidget *null_test_label;
+Meters *playback_meters = NULL;
+MeterView *meter_view = NULL;
 gint64 current_position = 0;
-gboolean is_playing_original = TRUE;
 gboolean is_audio_playing = FALSE;
-GThread *processing_thread;
-GMutex progress_mutex;
-GCond progress_cond;
-gdouble current_progress = 0.0;
-gboolean processing_active = FALSE;
-GstState current_state = GST_STATE_NULL;
+JobQueue *job_queue = NULL;
+GtkListStore *job_store = NULL;
+GtkWidget *job_view;
+GHashTable *job_rows = NULL;
+guint64 job_version = 0;
+guint job_refresh_id = 0;
 gint64 shared_position = 0;
-gboolean position_reset_needed = FALSE;
 guint seek_bar_update_id = 0;
 
 char current_dir[MAX_PATH] = ".";
 char output_format[10] = "wav";
 char *original_file_path = NULL;
 char *processed_file_path = NULL;
-float *waveform_data = NULL;
-int waveform_size = 0;
-gdouble waveform_color[3] = {0.0, 0.8, 0.0};
+gint waveform_generation = 0;
+
+MasterChain *preview_chain = NULL;
+ChainParams preview_params_pending;
+ChainParams preview_analysed_params;
+GMutex preview_params_mutex;
+gint preview_params_dirty = 0;
+gint preview_enabled = 0;
+gint preview_reset_needed = 0;
+gint preview_analysis_generation = 0;
+gboolean preview_analysis_valid = FALSE;
+double preview_loudnorm_gain_db = 0.0;
+guint preview_analysis_timeout_id = 0;
 double volume_adjustment_db = 0.0;
-int check_ffmpeg_installed(void);
-void master_audio_file(const char* input_file, const char* output_file, int vocal_mode, const char* output_format);
 void process_audio_files(void);
 void print_usage(const char* program_name);
-void* process_file_thread(void* arg);
 void update_progress(const char* message, double fraction);
-int is_directory_writable(const char* path);
 void create_gui(void);
 void on_master_clicked(GtkWidget *widget, gpointer data);
 void update_file_list(void);
+gboolean probe_audio_file(const char *path, FileProbe *probe, GCancellable *cancellable, gpointer user_data);
 void apply_theme(void);
 void on_reverb_toggled(GtkToggleButton *button, gpointer user_data);
-gboolean update_progress_bar(gpointer user_data);
-gpointer process_audio_files_thread(gpointer data);
+void collect_master_settings(SlopSettings *settings);
+gboolean run_master_file(const MasterJob *job, JobControl *control);
+gboolean run_master_job(JobControl *control, gpointer job_data, gpointer user_data);
+void master_job_free(gpointer data);
+static gboolean update_job_panel(void);
+gboolean refresh_job_panel(gpointer user_data);
+void on_job_cancel(GtkWidget *widget, gpointer data);
+void on_job_move_to_front(GtkWidget *widget, gpointer data);
+void on_job_pause_toggled(GtkToggleButton *button, gpointer data);
+void on_job_clear_finished(GtkWidget *widget, gpointer data);
 void on_play_original(GtkWidget *widget, gpointer data);
 void on_play_processed(GtkWidget *widget, gpointer data);
 void on_stop_playback(GtkWidget *widget, gpointer data);
-gboolean draw_waveform(GtkWidget *widget, cairo_t *cr, gpointer data);
 void init_audio(void);
 void cleanup_audio(void);
-void play_audio(const char *filename, gboolean is_original);
+void play_audio(gint source);
+gboolean build_ab_pipeline(void);
+void destroy_ab_pipeline(void);
+void apply_ab_volumes(void);
+void on_loudness_match_toggled(GtkToggleButton *button, gpointer user_data);
+void on_spectrogram_toggled(GtkToggleButton *button, gpointer user_data);
+void on_null_test(GtkWidget *widget, gpointer data);
+gpointer null_test_thread(gpointer data);
+gboolean null_test_ready(gpointer data);
+void measure_file_loudness(gint source, const char *filename);
+gpointer loudness_measure_thread(gpointer data);
+gboolean loudness_measure_ready(gpointer data);
 void stop_audio(void);
 void update_play_buttons_sensitivity(void);
 void cleanup_file_paths(void);
@@ -101,8 +210,22 @@ int parse_arguments(int argc, char *argv[]);
 gboolean update_shared_position(gpointer user_data);
 void cleanup_waveform(void);
 void update_waveform(const char *filename);
+gpointer waveform_decode_thread(gpointer data);
+gboolean waveform_peaks_ready(gpointer data);
+gboolean waveform_tick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer user_data);
+void on_waveform_seek(double seconds, gpointer user_data);
+void on_play_preview(GtkWidget *widget, gpointer data);
+void collect_chain_params(ChainParams *params);
+void push_preview_params(void);
+void on_preview_param_changed(GtkWidget *widget, gpointer user_data);
+void connect_preview_controls(void);
+void schedule_preview_analysis(void);
+gboolean start_preview_analysis(gpointer user_data);
+gpointer preview_analysis_thread(gpointer data);
+gboolean preview_analysis_ready(gpointer data);
 void on_file_chosen(GtkFileChooserButton *chooser_button, gpointer user_data);
 static gboolean bus_call(GstBus *bus, GstMessage *msg, gpointer data);
+static gboolean decode_audio_gstreamer(const char *filename, const char *caps, DecodeChunkFunc func, gpointer user_data);
 void format_time(gint64 duration, gchar *str, gsize str_size);
 gboolean update_seek_bar(gpointer data);
 void on_seek_bar_value_changed(GtkRange *range, gpointer user_data);
@@ -128,12 +251,17 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    if (!check_ffmpeg_installed()) {
+    if (!slopmaster_ffmpeg_available()) {
         fprintf(stderr, "Error: FFmpeg is not installed or not in the system PATH.\n");
         fclose(log_file);
         return 1;
     }
 
+    analysis_db = analysisdb_open_default();
+    if (!analysis_db) {
+        fprintf(stderr, "Analysis database unavailable; files will be re-analysed\n");
+    }
+
     init_audio();
     init_concurrent_processing();
     create_gui();
@@ -142,6 +270,7 @@ int main(int argc, char *argv[]) {
     cleanup_audio();
     cleanup_concurrent_processing();
     cleanup_file_paths();
+    analysisdb_close(analysis_db);
     fclose(log_file);
     return 0;
 }
@@ -263,7 +392,9 @@ void create_gui(void) {
     gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(format_combo), "WAV");
     gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(format_combo), "FLAC");
     gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(format_combo), "MP3");
-    gtk_combo_box_set_active(GTK_COMBO_BOX(format_combo), 0);
+    SlopFormat initial_format = SLOPMASTER_FORMAT_WAV;
+    slopmaster_parse_format(output_format, &initial_format);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(format_combo), initial_format);
     gtk_box_pack_start(GTK_BOX(options_box), format_combo, FALSE, FALSE, 0);
     gtk_widget_set_tooltip_text(format_combo, "Select the output file format");
 
@@ -332,14 +463,65 @@ void create_gui(void) {
     GtkWidget *file_frame = gtk_frame_new("Audio Files");
     gtk_box_pack_start(GTK_BOX(right_panel), file_frame, TRUE, TRUE, 0);
 
-    GtkWidget *file_scroll = gtk_scrolled_window_new(NULL, NULL);
-    gtk_container_add(GTK_CONTAINER(file_frame), file_scroll);
-    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(file_scroll), 
-                                   GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
-    gtk_widget_set_size_request(file_scroll, 400, -1);
-
-    file_list = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
-    gtk_container_add(GTK_CONTAINER(file_scroll), file_list);
+    file_list = filelist_new(probe_audio_file, NULL);
+    GtkWidget *file_list_widget = filelist_widget(file_list);
+    gtk_widget_set_size_request(file_list_widget, 400, 200);
+    gtk_container_add(GTK_CONTAINER(file_frame), file_list_widget);
+
+    GtkWidget *jobs_frame = gtk_frame_new("Jobs");
+    gtk_box_pack_start(GTK_BOX(right_panel), jobs_frame, FALSE, FALSE, 0);
+
+    GtkWidget *jobs_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_container_add(GTK_CONTAINER(jobs_frame), jobs_box);
+
+    job_store = gtk_list_store_new(JOB_NUM_COLS, G_TYPE_UINT, G_TYPE_STRING, G_TYPE_STRING,
+                                   G_TYPE_INT, G_TYPE_STRING, G_TYPE_INT64, G_TYPE_BOOLEAN);
+    gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(job_store), JOB_COL_ORDER, GTK_SORT_ASCENDING);
+    job_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(job_store));
+    g_object_unref(job_store);
+    gtk_tree_selection_set_mode(gtk_tree_view_get_selection(GTK_TREE_VIEW(job_view)), GTK_SELECTION_MULTIPLE);
+
+    GtkTreeViewColumn *job_column = gtk_tree_view_column_new_with_attributes("Name", gtk_cell_renderer_text_new(),
+                                                                             "text", JOB_COL_NAME, NULL);
+    gtk_tree_view_column_set_expand(job_column, TRUE);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(job_view), job_column);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(job_view),
+        gtk_tree_view_column_new_with_attributes("State", gtk_cell_renderer_text_new(), "text", JOB_COL_STATE, NULL));
+    job_column = gtk_tree_view_column_new_with_attributes("Progress", gtk_cell_renderer_progress_new(),
+                                                          "value", JOB_COL_PROGRESS, NULL);
+    gtk_tree_view_column_set_min_width(job_column, 100);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(job_view), job_column);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(job_view),
+        gtk_tree_view_column_new_with_attributes("Elapsed", gtk_cell_renderer_text_new(), "text", JOB_COL_ELAPSED, NULL));
+
+    GtkWidget *jobs_scroll = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(jobs_scroll), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+    gtk_widget_set_size_request(jobs_scroll, -1, 120);
+    gtk_container_add(GTK_CONTAINER(jobs_scroll), job_view);
+    gtk_box_pack_start(GTK_BOX(jobs_box), jobs_scroll, TRUE, TRUE, 0);
+
+    GtkWidget *jobs_buttons = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_box_pack_start(GTK_BOX(jobs_box), jobs_buttons, FALSE, FALSE, 0);
+
+    GtkWidget *job_cancel_button = gtk_button_new_with_label("Cancel");
+    gtk_box_pack_start(GTK_BOX(jobs_buttons), job_cancel_button, TRUE, TRUE, 0);
+    g_signal_connect(job_cancel_button, "clicked", G_CALLBACK(on_job_cancel), NULL);
+    gtk_widget_set_tooltip_text(job_cancel_button, "Cancel the selected jobs; a running job is stopped and its partial output removed");
+
+    GtkWidget *job_front_button = gtk_button_new_with_label("Move to Front");
+    gtk_box_pack_start(GTK_BOX(jobs_buttons), job_front_button, TRUE, TRUE, 0);
+    g_signal_connect(job_front_button, "clicked", G_CALLBACK(on_job_move_to_front), NULL);
+    gtk_widget_set_tooltip_text(job_front_button, "Run the selected queued jobs next");
+
+    GtkWidget *job_pause_button = gtk_toggle_button_new_with_label("Pause");
+    gtk_box_pack_start(GTK_BOX(jobs_buttons), job_pause_button, TRUE, TRUE, 0);
+    g_signal_connect(job_pause_button, "toggled", G_CALLBACK(on_job_pause_toggled), NULL);
+    gtk_widget_set_tooltip_text(job_pause_button, "Suspend the running job and hold the rest of the queue");
+
+    GtkWidget *job_clear_button = gtk_button_new_with_label("Clear Finished");
+    gtk_box_pack_start(GTK_BOX(jobs_buttons), job_clear_button, TRUE, TRUE, 0);
+    g_signal_connect(job_clear_button, "clicked", G_CALLBACK(on_job_clear_finished), NULL);
+    gtk_widget_set_tooltip_text(job_clear_button, "Remove done, failed and cancelled jobs from the list");
 
     GtkWidget *ab_frame = gtk_frame_new("Song Comparison");
     gtk_box_pack_start(GTK_BOX(right_panel), ab_frame, FALSE, FALSE, 0);
@@ -387,6 +569,11 @@ void create_gui(void) {
     g_signal_connect(b_button, "clicked", G_CALLBACK(on_play_processed), NULL);
     gtk_widget_set_tooltip_text(b_button, "Play the processed audio");
 
+    preview_button = gtk_button_new_with_label("Preview Master (P)");
+    gtk_box_pack_start(GTK_BOX(playback_box), preview_button, TRUE, TRUE, 0);
+    g_signal_connect(preview_button, "clicked", G_CALLBACK(on_play_preview), NULL);
+    gtk_widget_set_tooltip_text(preview_button, "Play the original with the current settings applied live");
+
     GtkWidget *stop_button = gtk_button_new_with_label("Stop");
     gtk_box_pack_start(GTK_BOX(playback_box), stop_button, TRUE, TRUE, 0);
     g_signal_connect(stop_button, "clicked", G_CALLBACK(on_stop_playback), NULL);
@@ -400,13 +587,46 @@ void create_gui(void) {
     time_label = gtk_label_new("0:00:00");
     gtk_box_pack_start(GTK_BOX(ab_box), time_label, FALSE, FALSE, 0);
 
+    loudness_match_checkbox = gtk_check_button_new_with_label("Match Loudness");
+    gtk_box_pack_start(GTK_BOX(ab_box), loudness_match_checkbox, FALSE, FALSE, 0);
+    g_signal_connect(loudness_match_checkbox, "toggled", G_CALLBACK(on_loudness_match_toggled), NULL);
+    gtk_widget_set_tooltip_text(loudness_match_checkbox, "Play A and B at the same integrated loudness so the comparison is fair");
+
+    spectrogram_checkbox = gtk_check_button_new_with_label("Spectrogram");
+    gtk_box_pack_start(GTK_BOX(ab_box), spectrogram_checkbox, FALSE, FALSE, 0);
+    g_signal_connect(spectrogram_checkbox, "toggled", G_CALLBACK(on_spectrogram_toggled), NULL);
+    gtk_widget_set_tooltip_text(spectrogram_checkbox, "Show the frequency content of the file instead of its waveform");
+
+    GtkWidget *null_test_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 10);
+    gtk_box_pack_start(GTK_BOX(ab_box), null_test_box, FALSE, FALSE, 0);
+
+    null_test_button = gtk_button_new_with_label("Null Test");
+    gtk_box_pack_start(GTK_BOX(null_test_box), null_test_button, FALSE, FALSE, 0);
+    g_signal_connect(null_test_button, "clicked", G_CALLBACK(on_null_test), NULL);
+    gtk_widget_set_tooltip_text(null_test_button, "Align and gain-match the original with the processed file and measure what is left");
+
+    null_test_label = gtk_label_new("");
+    gtk_label_set_xalign(GTK_LABEL(null_test_label), 0.0);
+    gtk_box_pack_start(GTK_BOX(null_test_box), null_test_label, TRUE, TRUE, 0);
+
     GtkWidget *waveform_frame = gtk_frame_new("Waveform");
     gtk_box_pack_start(GTK_BOX(right_panel), waveform_frame, FALSE, FALSE, 0);
 
-    waveform_drawing_area = gtk_drawing_area_new();
-    gtk_widget_set_size_request(waveform_drawing_area, -1, 150);
-    gtk_container_add(GTK_CONTAINER(waveform_frame), waveform_drawing_area);
-    g_signal_connect(G_OBJECT(waveform_drawing_area), "draw", G_CALLBACK(draw_waveform), NULL);
+    waveform_view = waveview_new();
+    GtkWidget *waveform_area = waveview_widget(waveform_view);
+    gtk_widget_set_size_request(waveform_area, -1, 150);
+    gtk_container_add(GTK_CONTAINER(waveform_frame), waveform_area);
+    gtk_widget_set_tooltip_text(waveform_area, "Click to seek, drag to select, Ctrl+scroll to zoom, double-click to fit");
+    waveview_set_seek_func(waveform_view, on_waveform_seek, NULL);
+
+    GtkWidget *meters_frame = gtk_frame_new("Meters");
+    gtk_box_pack_start(GTK_BOX(right_panel), meters_frame, FALSE, FALSE, 0);
+
+    meter_view = meterview_new(playback_meters);
+    GtkWidget *meters_area = meterview_widget(meter_view);
+    gtk_widget_set_size_request(meters_area, -1, 140);
+    gtk_container_add(GTK_CONTAINER(meters_frame), meters_area);
+    gtk_widget_set_tooltip_text(meters_area, "Spectrum with peak hold, loudness, true peak and phase correlation of what is playing");
 
     progress_bar = gtk_progress_bar_new();
     gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(progress_bar), TRUE);
@@ -414,6 +634,7 @@ void create_gui(void) {
     gtk_box_pack_end(GTK_BOX(main_box), progress_bar, FALSE, FALSE, 10);
 
     update_file_list();
+    connect_preview_controls();
     apply_theme();
     gtk_widget_show_all(window);
 }
@@ -464,49 +685,374 @@ void format_time(gint64 duration, gchar *str, gsize str_size) {
 }
 
 gboolean update_seek_bar(gpointer data) {
-    static int update_counter = 0;
     if (!is_audio_playing) return G_SOURCE_CONTINUE;
 
-    gint64 duration;
-    if (gst_element_query_position(playbin, GST_FORMAT_TIME, &shared_position) &&
-        gst_element_query_duration(playbin, GST_FORMAT_TIME, &duration)) {
+    gint64 position, duration;
+    if (gst_element_query_position(ab_pipeline, GST_FORMAT_TIME, &position) &&
+        gst_element_query_duration(ab_pipeline, GST_FORMAT_TIME, &duration)) {
+        shared_position = position;
+
+        g_signal_handlers_block_by_func(seek_bar, on_seek_bar_value_changed, NULL);
         gtk_range_set_range(GTK_RANGE(seek_bar), 0, duration / GST_SECOND);
         gtk_range_set_value(GTK_RANGE(seek_bar), shared_position / GST_SECOND);
+        g_signal_handlers_unblock_by_func(seek_bar, on_seek_bar_value_changed, NULL);
 
         gchar time_str[32];
         format_time(shared_position, time_str, sizeof(time_str));
         gtk_label_set_text(GTK_LABEL(time_label), time_str);
-        
-        update_counter++;
     }
 
     return G_SOURCE_CONTINUE;
 }
 
 void on_seek_bar_value_changed(GtkRange *range, gpointer user_data) {
-    if (!is_audio_playing) return;
-
     gdouble value = gtk_range_get_value(range);
     gint64 position = (gint64)(value * GST_SECOND);
 
-    if (!gst_element_seek_simple(playbin, GST_FORMAT_TIME,
-                                 GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT,
+    if (!is_audio_playing) {
+        shared_position = position;
+        return;
+    }
+
+    if (!gst_element_seek_simple(ab_pipeline, GST_FORMAT_TIME,
+                                 GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE,
                                  position)) {
         g_print("Seek failed!\n");
     } else {
         shared_position = position;
+        g_atomic_int_set(&preview_reset_needed, 1);
+        if (playback_meters) {
+            meters_reset(playback_meters);
+        }
+    }
+}
+
+static GstPadProbeReturn preview_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    if (!g_atomic_int_get(&preview_enabled)) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    if (g_atomic_int_get(&preview_params_dirty) && g_mutex_trylock(&preview_params_mutex)) {
+        ChainParams params = preview_params_pending;
+        g_atomic_int_set(&preview_params_dirty, 0);
+        g_mutex_unlock(&preview_params_mutex);
+        chain_set_params(preview_chain, &params);
+    }
+    if (g_atomic_int_compare_and_exchange(&preview_reset_needed, 1, 0)) {
+        chain_reset(preview_chain);
+    }
+
+    GstBuffer *buffer = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+    GST_PAD_PROBE_INFO_DATA(info) = buffer;
+
+    GstMapInfo map;
+    if (gst_buffer_map(buffer, &map, GST_MAP_READWRITE)) {
+        chain_process(preview_chain, (float *)map.data, map.size / (CHANNELS * sizeof(float)));
+        gst_buffer_unmap(buffer, &map);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static void on_player_element_added(GstBin *bin, GstBin *sub_bin, GstElement *element, gpointer user_data) {
+    GObjectClass *klass = G_OBJECT_GET_CLASS(element);
+    if (g_object_class_find_property(klass, "buffer-time") &&
+        g_object_class_find_property(klass, "latency-time")) {
+        g_object_set(G_OBJECT(element),
+                     "buffer-time", (gint64)PREVIEW_BUFFER_TIME_US,
+                     "latency-time", (gint64)PREVIEW_LATENCY_TIME_US, NULL);
     }
 }
 
 void init_audio(void) {
-    playbin = gst_element_factory_make("playbin", "playbin");
-    if (!playbin) {
-        g_printerr("Failed to create playbin element\n");
+    g_mutex_init(&preview_params_mutex);
+    chain_params_default(&preview_params_pending);
+    preview_chain = chain_new(SAMPLE_RATE);
+    if (!preview_chain) {
+        g_printerr("Live preview unavailable: out of memory\n");
+    }
+    playback_meters = meters_new(SAMPLE_RATE);
+    if (!playback_meters) {
+        g_printerr("Playback meters unavailable\n");
+    }
+}
+
+static GstElement *create_ab_branch(const char *filename, gboolean with_preview) {
+    GError *error = NULL;
+    gchar *desc = g_strdup_printf(
+        "uridecodebin name=dec ! audioconvert ! audioresample ! "
+        "audio/x-raw,format=F32LE,layout=interleaved,channels=%d,rate=%d ! "
+        "identity name=tap", CHANNELS, SAMPLE_RATE);
+    GstElement *branch = gst_parse_bin_from_description(desc, TRUE, &error);
+    g_free(desc);
+
+    if (!branch) {
+        g_printerr("Failed to create playback branch: %s\n", error ? error->message : "unknown");
+        g_clear_error(&error);
+        return NULL;
+    }
+
+    GstElement *dec = gst_bin_get_by_name(GST_BIN(branch), "dec");
+    gchar *uri = gst_filename_to_uri(filename, NULL);
+    g_object_set(G_OBJECT(dec), "uri", uri, NULL);
+    g_free(uri);
+    gst_object_unref(dec);
+
+    if (with_preview && preview_chain) {
+        GstElement *tap = gst_bin_get_by_name(GST_BIN(branch), "tap");
+        GstPad *pad = gst_element_get_static_pad(tap, "src");
+        gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, preview_probe, NULL, NULL);
+        gst_object_unref(pad);
+        gst_object_unref(tap);
+    }
+    return branch;
+}
+
+static GstPadProbeReturn meters_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GstMapInfo map;
+
+    if (buffer && gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        meters_push(playback_meters, (const float *)map.data, map.size / (sizeof(float) * CHANNELS));
+        gst_buffer_unmap(buffer, &map);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+/*
+ * Original and processed files are decoded side by side into one
+ * audiomixer, so both stay prerolled and aligned on the same running
+ * time. Switching A/B only flips the mixer pads' mute flags.
+ */
+gboolean build_ab_pipeline(void) {
+    destroy_ab_pipeline();
+
+    const char *paths[AB_SOURCES] = { original_file_path, processed_file_path };
+    ab_pipeline = gst_pipeline_new("ab_player");
+    GstElement *mixer = gst_element_factory_make("audiomixer", "mixer");
+    GstElement *mix_caps = gst_element_factory_make("capsfilter", NULL);
+    GstElement *convert = gst_element_factory_make("audioconvert", NULL);
+    GstElement *sink = gst_element_factory_make("autoaudiosink", NULL);
+
+    if (!ab_pipeline || !mixer || !mix_caps || !convert || !sink) {
+        g_printerr("Failed to create A/B playback pipeline\n");
+        destroy_ab_pipeline();
+        return FALSE;
+    }
+
+    GstCaps *caps = gst_caps_new_simple("audio/x-raw",
+                                        "format", G_TYPE_STRING, "F32LE",
+                                        "layout", G_TYPE_STRING, "interleaved",
+                                        "channels", G_TYPE_INT, CHANNELS,
+                                        "rate", G_TYPE_INT, SAMPLE_RATE, NULL);
+    g_object_set(G_OBJECT(mix_caps), "caps", caps, NULL);
+    gst_caps_unref(caps);
+
+    gst_bin_add_many(GST_BIN(ab_pipeline), mixer, mix_caps, convert, sink, NULL);
+    gst_element_link_many(mixer, mix_caps, convert, sink, NULL);
+
+    if (playback_meters) {
+        GstPad *meter_pad = gst_element_get_static_pad(mix_caps, "src");
+        gst_pad_add_probe(meter_pad, GST_PAD_PROBE_TYPE_BUFFER, meters_probe, NULL, NULL);
+        gst_object_unref(meter_pad);
+    }
+
+    for (gint i = 0; i < AB_SOURCES; i++) {
+        if (!paths[i]) {
+            continue;
+        }
+        GstElement *branch = create_ab_branch(paths[i], i == AB_ORIGINAL);
+        if (!branch) {
+            continue;
+        }
+        gst_bin_add(GST_BIN(ab_pipeline), branch);
+
+        GstPad *src = gst_element_get_static_pad(branch, "src");
+        ab_mixer_pads[i] = gst_element_get_request_pad(mixer, "sink_%u");
+        if (gst_pad_link(src, ab_mixer_pads[i]) != GST_PAD_LINK_OK) {
+            g_printerr("Failed to link playback branch for %s\n", paths[i]);
+        }
+        gst_object_unref(src);
     }
 
-    GstBus *bus = gst_element_get_bus(playbin);
-    gst_bus_add_watch(bus, (GstBusFunc)bus_call, NULL);
+    GstBus *bus = gst_element_get_bus(ab_pipeline);
+    ab_bus_watch_id = gst_bus_add_watch(bus, (GstBusFunc)bus_call, NULL);
     gst_object_unref(bus);
+    g_signal_connect(ab_pipeline, "deep-element-added", G_CALLBACK(on_player_element_added), NULL);
+
+    ab_pipeline_stale = FALSE;
+    apply_ab_volumes();
+    return TRUE;
+}
+
+void destroy_ab_pipeline(void) {
+    if (ab_bus_watch_id != 0) {
+        g_source_remove(ab_bus_watch_id);
+        ab_bus_watch_id = 0;
+    }
+    for (gint i = 0; i < AB_SOURCES; i++) {
+        if (ab_mixer_pads[i]) {
+            gst_object_unref(ab_mixer_pads[i]);
+            ab_mixer_pads[i] = NULL;
+        }
+    }
+    if (ab_pipeline) {
+        gst_element_set_state(ab_pipeline, GST_STATE_NULL);
+        gst_object_unref(ab_pipeline);
+        ab_pipeline = NULL;
+    }
+}
+
+static double ab_source_loudness(gint source) {
+    if (source == AB_ORIGINAL && g_atomic_int_get(&preview_enabled)) {
+        return CHAIN_LOUDNORM_TARGET + volume_adjustment_db;
+    }
+    return ab_lufs[source];
+}
+
+void apply_ab_volumes(void) {
+    gboolean match = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(loudness_match_checkbox));
+    double loudness[AB_SOURCES] = { ab_source_loudness(AB_ORIGINAL), ab_source_loudness(AB_PROCESSED) };
+    double reference = fmin(loudness[AB_ORIGINAL], loudness[AB_PROCESSED]);
+
+    for (gint i = 0; i < AB_SOURCES; i++) {
+        if (!ab_mixer_pads[i]) {
+            continue;
+        }
+        double gain = 1.0;
+        if (match && isfinite(loudness[AB_ORIGINAL]) && isfinite(loudness[AB_PROCESSED])) {
+            gain = db_to_linear(reference - loudness[i]);
+        }
+        g_object_set(G_OBJECT(ab_mixer_pads[i]), "volume", gain, "mute", i != ab_active_source, NULL);
+    }
+}
+
+void on_loudness_match_toggled(GtkToggleButton *button, gpointer user_data) {
+    apply_ab_volumes();
+}
+
+void on_spectrogram_toggled(GtkToggleButton *button, gpointer user_data) {
+    waveview_show_spectrogram(waveform_view, gtk_toggle_button_get_active(button));
+}
+
+static gboolean feed_loudness_chunk(const float *samples, gsize frames, gint channels, gint rate, gpointer user_data) {
+    LoudnessJob *job = (LoudnessJob *)user_data;
+    if (g_atomic_int_get(&ab_loudness_generation[job->source]) != job->generation) {
+        return FALSE;
+    }
+    loudness_feed(job->meter, samples, frames);
+    return TRUE;
+}
+
+void measure_file_loudness(gint source, const char *filename) {
+    LoudnessJob *job = g_new0(LoudnessJob, 1);
+    job->filename = g_strdup(filename);
+    job->source = source;
+    job->generation = g_atomic_int_add(&ab_loudness_generation[source], 1) + 1;
+    ab_lufs[source] = NAN;
+
+    GThread *thread = g_thread_new("loudness_measure", loudness_measure_thread, job);
+    g_thread_unref(thread);
+}
+
+gpointer loudness_measure_thread(gpointer data) {
+    LoudnessJob *job = (LoudnessJob *)data;
+    gchar *caps = g_strdup_printf("audio/x-raw,format=F32LE,layout=interleaved,channels=%d,rate=%d",
+                                  CHANNELS, SAMPLE_RATE);
+
+    AnalysisKey key;
+    AnalysisRecord record;
+    gboolean have_key = analysisdb_key(job->filename, &key) == 0;
+
+    job->lufs = NAN;
+    if (have_key && analysisdb_lookup(analysis_db, &key, &record) == 0 && (record.fields & ANALYSISDB_HAS_LOUDNESS)) {
+        job->lufs = record.loudness;
+        g_free(caps);
+        g_idle_add(loudness_measure_ready, job);
+        return NULL;
+    }
+
+    job->meter = loudness_new(SAMPLE_RATE);
+    if (job->meter && decode_audio_gstreamer(job->filename, caps, feed_loudness_chunk, job)) {
+        job->lufs = loudness_integrated(job->meter);
+        if (have_key && isfinite(job->lufs)) {
+            memset(&record, 0, sizeof(record));
+            record.fields = ANALYSISDB_HAS_LOUDNESS;
+            record.loudness = job->lufs;
+            analysisdb_update(analysis_db, &key, &record);
+        }
+    }
+
+    g_free(caps);
+    loudness_free(job->meter);
+    g_idle_add(loudness_measure_ready, job);
+    return NULL;
+}
+
+gboolean loudness_measure_ready(gpointer data) {
+    LoudnessJob *job = (LoudnessJob *)data;
+
+    if (g_atomic_int_get(&ab_loudness_generation[job->source]) == job->generation) {
+        ab_lufs[job->source] = job->lufs;
+        g_print("Integrated loudness of %s: %.1f LUFS\n", job->filename, job->lufs);
+        apply_ab_volumes();
+    }
+
+    g_free(job->filename);
+    g_free(job);
+    return G_SOURCE_REMOVE;
+}
+
+void on_null_test(GtkWidget *widget, gpointer data) {
+    if (!original_file_path || !processed_file_path) {
+        gtk_label_set_text(GTK_LABEL(null_test_label), "Choose an original and a processed file first");
+        return;
+    }
+
+    NullTestJob *job = g_new0(NullTestJob, 1);
+    job->original = g_strdup(original_file_path);
+    job->processed = g_strdup(processed_file_path);
+    gtk_widget_set_sensitive(null_test_button, FALSE);
+    gtk_label_set_text(GTK_LABEL(null_test_label), "Comparing...");
+    gtk_widget_set_tooltip_text(null_test_label, NULL);
+
+    GThread *thread = g_thread_new("null_test", null_test_thread, job);
+    g_thread_unref(thread);
+}
+
+gpointer null_test_thread(gpointer data) {
+    NullTestJob *job = (NullTestJob *)data;
+    job->status = compare_files(job->original, job->processed, NULL, &job->result,
+                                job->message, sizeof(job->message));
+    g_idle_add(null_test_ready, job);
+    return NULL;
+}
+
+gboolean null_test_ready(gpointer data) {
+    NullTestJob *job = (NullTestJob *)data;
+    const CompareResult *result = &job->result;
+
+    if (job->status != 0) {
+        gtk_label_set_text(GTK_LABEL(null_test_label), job->message);
+    } else {
+        gchar *text = g_strdup_printf("Offset %+.2f ms, gain %+.2f dB%s, residual %.1f dB RMS, null %.1f dB",
+                                      result->offset * 1000.0 / result->sample_rate, result->gain_db,
+                                      result->inverted ? " (inverted)" : "", result->residual_db, result->null_db);
+        GString *bands = g_string_new("Residual per octave band:");
+        for (int b = 0; b < COMPARE_BANDS; b++) {
+            g_string_append_printf(bands, "\n%.1f Hz: %.1f dB (null %.1f dB)", result->band_center[b],
+                                   result->band_residual_db[b], result->band_null_db[b]);
+        }
+        gtk_label_set_text(GTK_LABEL(null_test_label), text);
+        gtk_widget_set_tooltip_text(null_test_label, bands->str);
+        g_free(text);
+        g_string_free(bands, TRUE);
+    }
+    gtk_widget_set_sensitive(null_test_button, TRUE);
+
+    g_free(job->original);
+    g_free(job->processed);
+    g_free(job);
+    return G_SOURCE_REMOVE;
 }
 
 static gboolean bus_call(GstBus *bus, GstMessage *msg, gpointer data) {
@@ -515,6 +1061,17 @@ static gboolean bus_call(GstBus *bus, GstMessage *msg, gpointer data) {
             g_print("End of stream\n");
             stop_audio();
             break;
+        case GST_MESSAGE_ASYNC_DONE:
+            if (ab_pending_seek > 0) {
+                gint64 position = ab_pending_seek;
+                ab_pending_seek = -1;
+                if (!gst_element_seek_simple(ab_pipeline, GST_FORMAT_TIME,
+                                             GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE,
+                                             position)) {
+                    g_print("Seek failed!\n");
+                }
+            }
+            break;
         case GST_MESSAGE_ERROR: {
             gchar *debug;
             GError *error;
@@ -531,10 +1088,14 @@ static gboolean bus_call(GstBus *bus, GstMessage *msg, gpointer data) {
 }
 
 void cleanup_audio(void) {
-    if (playbin) {
-        gst_element_set_state(playbin, GST_STATE_NULL);
-        gst_object_unref(playbin);
+    destroy_ab_pipeline();
+    g_atomic_int_inc(&preview_analysis_generation);
+    for (gint i = 0; i < AB_SOURCES; i++) {
+        g_atomic_int_inc(&ab_loudness_generation[i]);
     }
+    chain_free(preview_chain);
+    meters_free(playback_meters);
+    g_mutex_clear(&preview_params_mutex);
 }
 
 void update_current_directory(const char* file_path) {
@@ -544,80 +1105,57 @@ void update_current_directory(const char* file_path) {
     g_free(dir_path);
 }
 
-void play_audio(const char *filename, gboolean is_original) {
-    if (!playbin) return;
+void play_audio(gint source) {
+    const char *filename = source == AB_ORIGINAL ? original_file_path : processed_file_path;
+    if (!filename) return;
 
-    g_print("Entering play_audio function\n");
-
-    if (is_audio_playing) {
-        stop_audio();
-
-        g_usleep(100000);
+    if (!ab_pipeline || ab_pipeline_stale) {
+        if (is_audio_playing) {
+            gint64 position;
+            if (gst_element_query_position(ab_pipeline, GST_FORMAT_TIME, &position)) {
+                shared_position = position;
+            }
+            gint64 resume = shared_position;
+            stop_audio();
+            shared_position = resume;
+        }
+        if (!build_ab_pipeline()) {
+            return;
+        }
     }
 
-    gchar *uri = gst_filename_to_uri(filename, NULL);
-    g_object_set(G_OBJECT(playbin), "uri", uri, NULL);
-    g_print("Set new URI: %s\n", uri);
-
-    if (position_reset_needed) {
-        g_print("Resetting position\n");
-        shared_position = 0;
-        position_reset_needed = FALSE;
+    ab_active_source = source;
+    apply_ab_volumes();
+    if (playback_meters) {
+        meters_reset(playback_meters);
     }
 
-    gst_element_set_state(playbin, GST_STATE_PAUSED);
+    if (!is_audio_playing) {
+        g_atomic_int_set(&preview_reset_needed, 1);
+        ab_pending_seek = shared_position;
+        gst_element_set_state(ab_pipeline, GST_STATE_PLAYING);
+        is_audio_playing = TRUE;
 
-    GstState state;
-    GstStateChangeReturn ret = gst_element_get_state(playbin, &state, NULL, GST_CLOCK_TIME_NONE);
-    if (ret == GST_STATE_CHANGE_SUCCESS) {
-        g_print("Successfully changed state to PAUSED\n");
-    } else {
-        g_print("Failed to change state to PAUSED\n");
-    }
-
-    if (!gst_element_seek_simple(playbin, GST_FORMAT_TIME,
-                                 GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE,
-                                 shared_position)) {
-        g_print("Seek failed!\n");
-    } else {
-        g_print("Seek successful\n");
+        if (seek_bar_update_id == 0) {
+            seek_bar_update_id = g_timeout_add(200, update_seek_bar, NULL);
+        }
+        if (waveform_tick_id == 0) {
+            waveform_tick_id = gtk_widget_add_tick_callback(waveview_widget(waveform_view), waveform_tick, NULL, NULL);
+        }
+        meterview_set_active(meter_view, TRUE);
     }
 
-    gst_element_set_state(playbin, GST_STATE_PLAYING);
-    g_print("Set playbin state to PLAYING\n");
-
-    is_playing_original = is_original;
-    is_audio_playing = TRUE;
-    g_free(uri);
-
     update_waveform(filename);
-
-    if (seek_bar_update_id == 0) {
-        seek_bar_update_id = g_timeout_add(200, update_seek_bar, NULL);
-        g_print("Started seek bar update timer\n");
-    }
-
-    g_print("Exiting play_audio function\n");
 }
 
 void stop_audio(void) {
-    if (playbin && is_audio_playing) {
+    if (ab_pipeline && is_audio_playing) {
         g_print("Stopping audio playback\n");
-        
-        gst_element_set_state(playbin, GST_STATE_PAUSED);
 
-        GstState state;
-        GstStateChangeReturn ret = gst_element_get_state(playbin, &state, NULL, GST_CLOCK_TIME_NONE);
-        if (ret == GST_STATE_CHANGE_SUCCESS) {
-            g_print("Successfully changed state to PAUSED\n");
-        } else {
-            g_print("Failed to change state to PAUSED\n");
-        }
+        gst_element_set_state(ab_pipeline, GST_STATE_NULL);
 
-        gst_element_set_state(playbin, GST_STATE_NULL);
-        
         is_audio_playing = FALSE;
-        position_reset_needed = TRUE;
+        ab_pending_seek = -1;
         shared_position = 0;
 
         if (seek_bar_update_id != 0) {
@@ -625,9 +1163,18 @@ void stop_audio(void) {
             seek_bar_update_id = 0;
         }
 
+        if (waveform_tick_id != 0) {
+            gtk_widget_remove_tick_callback(waveview_widget(waveform_view), waveform_tick_id);
+            waveform_tick_id = 0;
+        }
+        waveview_set_playhead(waveform_view, -1.0);
+        meterview_set_active(meter_view, FALSE);
+
+        g_signal_handlers_block_by_func(seek_bar, on_seek_bar_value_changed, NULL);
         gtk_range_set_value(GTK_RANGE(seek_bar), 0);
+        g_signal_handlers_unblock_by_func(seek_bar, on_seek_bar_value_changed, NULL);
         gtk_label_set_text(GTK_LABEL(time_label), "0:00:00");
-        
+
         g_print("Audio playback stopped\n");
     }
 }
@@ -668,13 +1215,17 @@ void on_file_chosen(GtkFileChooserButton *chooser_button, gpointer user_data) {
     if (strcmp(user_data, "original") == 0) {
         g_free(original_file_path);
         original_file_path = g_strdup(file_path);
+        preview_analysis_valid = FALSE;
+        schedule_preview_analysis();
+        measure_file_loudness(AB_ORIGINAL, file_path);
     } else if (strcmp(user_data, "processed") == 0) {
         g_free(processed_file_path);
         processed_file_path = g_strdup(file_path);
+        measure_file_loudness(AB_PROCESSED, file_path);
     }
     update_current_directory(file_path);
     update_play_buttons_sensitivity();
-    position_reset_needed = TRUE;
+    ab_pipeline_stale = TRUE;
 }
 
 void update_play_buttons_sensitivity(void) {
@@ -688,28 +1239,48 @@ void update_play_buttons_sensitivity(void) {
 
     gtk_widget_set_sensitive(a_button, original_file_path != NULL);
     gtk_widget_set_sensitive(b_button, processed_file_path != NULL);
+    gtk_widget_set_sensitive(preview_button, original_file_path != NULL);
 
     g_list_free(children);
 }
 
 void on_play_original(GtkWidget *widget, gpointer data) {
+    g_atomic_int_set(&preview_enabled, 0);
     if (original_file_path) {
         g_print("Playing original audio: %s\n", original_file_path);
-        play_audio(original_file_path, TRUE);
+        play_audio(AB_ORIGINAL);
     } else {
         g_print("No original file selected\n");
     }
 }
 
 void on_play_processed(GtkWidget *widget, gpointer data) {
+    g_atomic_int_set(&preview_enabled, 0);
     if (processed_file_path) {
         g_print("Playing processed audio: %s\n", processed_file_path);
-        play_audio(processed_file_path, FALSE);
+        play_audio(AB_PROCESSED);
     } else {
         g_print("No processed file selected\n");
     }
 }
 
+void on_play_preview(GtkWidget *widget, gpointer data) {
+    if (!original_file_path) {
+        g_print("No original file selected\n");
+        return;
+    }
+    if (!preview_analysis_valid) {
+        schedule_preview_analysis();
+    }
+    push_preview_params();
+    if (!g_atomic_int_get(&preview_enabled)) {
+        g_atomic_int_set(&preview_reset_needed, 1);
+        g_atomic_int_set(&preview_enabled, 1);
+    }
+    g_print("Previewing mastered audio: %s\n", original_file_path);
+    play_audio(AB_ORIGINAL);
+}
+
 void on_stop_playback(GtkWidget *widget, gpointer data) {
     g_print("Stopping audio playback\n");
     stop_audio();
@@ -717,7 +1288,7 @@ void on_stop_playback(GtkWidget *widget, gpointer data) {
 
 gboolean update_shared_position(gpointer user_data) {
     if (is_audio_playing) {
-        gst_element_query_position(playbin, GST_FORMAT_TIME, &shared_position);
+        gst_element_query_position(ab_pipeline, GST_FORMAT_TIME, &shared_position);
     }
     return G_SOURCE_CONTINUE;
 }
@@ -725,16 +1296,23 @@ gboolean update_shared_position(gpointer user_data) {
 void cleanup_file_paths(void) {
     g_free(original_file_path);
     g_free(processed_file_path);
+    filelist_free(file_list);
+    file_list = NULL;
 }
 
 void init_concurrent_processing(void) {
-    g_mutex_init(&progress_mutex);
-    g_cond_init(&progress_cond);
+    job_queue = job_queue_new(run_master_job, NULL, master_job_free);
+    job_rows = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
 }
 
 void cleanup_concurrent_processing(void) {
-    g_mutex_clear(&progress_mutex);
-    g_cond_clear(&progress_cond);
+    if (job_refresh_id != 0) {
+        g_source_remove(job_refresh_id);
+        job_refresh_id = 0;
+    }
+    job_queue_free(job_queue);
+    job_queue = NULL;
+    g_hash_table_destroy(job_rows);
 }
 
 void on_reverb_toggled(GtkToggleButton *button, gpointer user_data) {
@@ -747,273 +1325,494 @@ void on_volume_adjustment_changed(GtkRange *range, gpointer user_data) {
     volume_adjustment_db = gtk_range_get_value(range);
 }
 
-void update_file_list(void) {
-    GList *children, *iter;
-    children = gtk_container_get_children(GTK_CONTAINER(file_list));
-    for(iter = children; iter != NULL; iter = g_list_next(iter))
-        gtk_widget_destroy(GTK_WIDGET(iter->data));
-    g_list_free(children);
+void collect_chain_params(ChainParams *params) {
+    chain_params_default(params);
+    params->stereo_width = gtk_range_get_value(GTK_RANGE(stereo_width_scale)) / 100.0;
+    params->low_threshold = gtk_range_get_value(GTK_RANGE(low_threshold));
+    params->low_ratio = gtk_range_get_value(GTK_RANGE(low_ratio));
+    params->mid_threshold = gtk_range_get_value(GTK_RANGE(mid_threshold));
+    params->mid_ratio = gtk_range_get_value(GTK_RANGE(mid_ratio));
+    params->high_threshold = gtk_range_get_value(GTK_RANGE(high_threshold));
+    params->high_ratio = gtk_range_get_value(GTK_RANGE(high_ratio));
+    params->crossover_low = gtk_range_get_value(GTK_RANGE(crossover_low));
+    params->crossover_high = gtk_range_get_value(GTK_RANGE(crossover_high));
+    params->reverb = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(reverb_checkbox));
+    params->reverb_delay = gtk_range_get_value(GTK_RANGE(reverb_delay_scale));
+    params->reverb_decay = gtk_range_get_value(GTK_RANGE(reverb_decay_scale));
+    params->bass_boost = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(bass_booster_checkbox));
+    params->wet = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(wet_checkbox));
+    params->vocal_mode = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(vocal_checkbox));
+    params->volume_db = gtk_range_get_value(GTK_RANGE(volume_adjustment_scale));
+    params->loudnorm_gain_db = preview_loudnorm_gain_db;
+}
 
-    DIR *dir = opendir(current_dir);
-    if (!dir) {
-        fprintf(stderr, "Error opening directory: %s\n", strerror(errno));
-        return;
+void push_preview_params(void) {
+    ChainParams params;
+    collect_chain_params(&params);
+
+    g_mutex_lock(&preview_params_mutex);
+    preview_params_pending = params;
+    g_mutex_unlock(&preview_params_mutex);
+    g_atomic_int_set(&preview_params_dirty, 1);
+
+    if (preview_analysis_valid && !chain_params_pre_loudnorm_equal(&params, &preview_analysed_params)) {
+        preview_analysis_valid = FALSE;
+        schedule_preview_analysis();
     }
+}
 
-    struct dirent *entry;
-    char input_file[MAX_PATH];
-    struct stat st;
-
-    while ((entry = readdir(dir)) != NULL) {
-        char *input_file = g_strdup_printf("%s/%s", current_dir, entry->d_name);
-        if (stat(input_file, &st) == 0 && S_ISREG(st.st_mode)) {
-            size_t name_len = strlen(entry->d_name);
-            const char *ext = entry->d_name + name_len - 4;
-            if (name_len > 4 && (strcmp(ext, ".wav") == 0 || strcmp(ext, ".mp3") == 0 ||
-                strcmp(ext, ".aac") == 0 || strcmp(ext, ".ogg") == 0 ||
-                (name_len > 5 && strcmp(entry->d_name + name_len - 5, ".flac") == 0))) {
-                GtkWidget *checkbox = gtk_check_button_new_with_label(entry->d_name);
-                gtk_widget_set_name(checkbox, "file-checkbox");
-                gtk_box_pack_start(GTK_BOX(file_list), checkbox, FALSE, FALSE, 0);
-                gtk_widget_show(checkbox);
-            }
-        }
-        g_free(input_file);
+void on_preview_param_changed(GtkWidget *widget, gpointer user_data) {
+    push_preview_params();
+    apply_ab_volumes();
+}
+
+void connect_preview_controls(void) {
+    GtkWidget *scales[] = {
+        stereo_width_scale, low_threshold, low_ratio, mid_threshold, mid_ratio,
+        high_threshold, high_ratio, crossover_low, crossover_high,
+        reverb_delay_scale, reverb_decay_scale, volume_adjustment_scale
+    };
+    GtkWidget *toggles[] = {
+        reverb_checkbox, bass_booster_checkbox, wet_checkbox, vocal_checkbox
+    };
+
+    for (gsize i = 0; i < G_N_ELEMENTS(scales); i++) {
+        g_signal_connect(scales[i], "value-changed", G_CALLBACK(on_preview_param_changed), NULL);
     }
+    for (gsize i = 0; i < G_N_ELEMENTS(toggles); i++) {
+        g_signal_connect(toggles[i], "toggled", G_CALLBACK(on_preview_param_changed), NULL);
+    }
+}
 
-    closedir(dir);
+void schedule_preview_analysis(void) {
+    if (preview_analysis_timeout_id != 0) {
+        g_source_remove(preview_analysis_timeout_id);
+    }
+    preview_analysis_timeout_id = g_timeout_add(PREVIEW_ANALYSIS_DELAY_MS, start_preview_analysis, NULL);
 }
 
-void on_master_clicked(GtkWidget *widget, gpointer data) {
-    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress_bar), 0.0);
-    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(progress_bar), "Processing...");
-    total_files = 0;
-    processed_files = 0;
-    process_audio_files();
+gboolean start_preview_analysis(gpointer user_data) {
+    preview_analysis_timeout_id = 0;
+    if (!original_file_path) {
+        return G_SOURCE_REMOVE;
+    }
+
+    PreviewAnalysisJob *job = g_new0(PreviewAnalysisJob, 1);
+    job->filename = g_strdup(original_file_path);
+    job->generation = g_atomic_int_add(&preview_analysis_generation, 1) + 1;
+    collect_chain_params(&job->params);
+
+    GThread *thread = g_thread_new("preview_analysis", preview_analysis_thread, job);
+    g_thread_unref(thread);
+    return G_SOURCE_REMOVE;
 }
 
-void process_audio_files(void) {
-    GList *children = gtk_container_get_children(GTK_CONTAINER(file_list));
+static gboolean feed_analysis_chunk(const float *samples, gsize frames, gint channels, gint rate, gpointer user_data) {
+    PreviewAnalysisJob *job = (PreviewAnalysisJob *)user_data;
+    if (g_atomic_int_get(&preview_analysis_generation) != job->generation) {
+        return FALSE;
+    }
 
-    total_files = 0;
-    processed_files = 0;
-    current_progress = 0.0;
-    processing_active = TRUE;
+    if (frames > job->scratch_frames) {
+        g_free(job->scratch);
+        job->scratch = g_new(float, frames * CHANNELS);
+        job->scratch_frames = frames;
+    }
+    memcpy(job->scratch, samples, frames * CHANNELS * sizeof(float));
+    chain_process_pre_loudnorm(job->chain, job->scratch, frames);
+    loudness_feed(job->meter, job->scratch, frames);
+    return TRUE;
+}
 
-    for (GList *iter = children; iter != NULL; iter = g_list_next(iter)) {
-        GtkWidget *checkbox = GTK_WIDGET(iter->data);
-        if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(checkbox))) {
-            total_files++;
+/*
+ * loudnorm cannot run in real time, so the preview replaces it with a
+ * static gain: the chain's pre-loudnorm prefix is run over the whole
+ * original and its integrated loudness decides the gain.
+ */
+gpointer preview_analysis_thread(gpointer data) {
+    PreviewAnalysisJob *job = (PreviewAnalysisJob *)data;
+    gchar *caps = g_strdup_printf("audio/x-raw,format=F32LE,layout=interleaved,channels=%d,rate=%d",
+                                  CHANNELS, SAMPLE_RATE);
+
+    job->lufs = -INFINITY;
+    job->chain = chain_new(SAMPLE_RATE);
+    job->meter = loudness_new(SAMPLE_RATE);
+    if (job->chain && job->meter) {
+        chain_set_params(job->chain, &job->params);
+        if (decode_audio_gstreamer(job->filename, caps, feed_analysis_chunk, job)) {
+            job->lufs = loudness_integrated(job->meter);
         }
     }
 
-    processing_thread = g_thread_new("audio_processing", process_audio_files_thread, children);
+    g_free(caps);
+    chain_free(job->chain);
+    loudness_free(job->meter);
+    g_free(job->scratch);
+    g_idle_add(preview_analysis_ready, job);
+    return NULL;
+}
+
+gboolean preview_analysis_ready(gpointer data) {
+    PreviewAnalysisJob *job = (PreviewAnalysisJob *)data;
+
+    if (g_atomic_int_get(&preview_analysis_generation) == job->generation && isfinite(job->lufs)) {
+        preview_loudnorm_gain_db = chain_loudnorm_gain(job->lufs);
+        preview_analysed_params = job->params;
+        preview_analysis_valid = TRUE;
+        g_print("Preview analysis: %.1f LUFS before loudnorm, static gain %.1f dB\n",
+                job->lufs, preview_loudnorm_gain_db);
+        push_preview_params();
+    }
 
-    g_timeout_add(100, update_progress_bar, NULL);
+    g_free(job->filename);
+    g_free(job);
+    return G_SOURCE_REMOVE;
 }
 
-gpointer process_audio_files_thread(gpointer data) {
-    GList *children = (GList *)data;
+void update_file_list(void) {
+    filelist_load(file_list, current_dir);
+}
 
-    for (GList *iter = children; iter != NULL; iter = g_list_next(iter)) {
-        GtkWidget *checkbox = GTK_WIDGET(iter->data);
-        if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(checkbox))) {
-            const char *filename = gtk_button_get_label(GTK_BUTTON(checkbox));
+typedef struct {
+    LoudnessMeter *meter;
+    TruePeak true_peak;
+    float peak;
+    GCancellable *cancellable;
+    float *stereo;
+    gsize stereo_frames;
+    gint64 frames;
+    gint rate;
+    gint channels;
+} ProbeLoudnessState;
+
+/*
+ * Loudness expects stereo. Mono is measured as it plays, on both
+ * channels, so the result matches measure_file_loudness and can share
+ * its database entry; extra channels are dropped.
+ */
+static gboolean feed_probe_loudness(const float *samples, gsize frames, gint channels, gint rate, gpointer user_data) {
+    ProbeLoudnessState *state = (ProbeLoudnessState *)user_data;
+
+    if (g_cancellable_is_cancelled(state->cancellable)) {
+        return FALSE;
+    }
+    if (!state->meter) {
+        state->meter = loudness_new(rate);
+        state->rate = rate;
+        state->channels = channels;
+        if (!state->meter) {
+            return FALSE;
+        }
+    }
+    if (frames > state->stereo_frames) {
+        state->stereo = g_renew(float, state->stereo, frames * 2);
+        state->stereo_frames = frames;
+    }
+    for (gsize i = 0; i < frames; i++) {
+        state->stereo[2 * i] = samples[i * channels];
+        state->stereo[2 * i + 1] = samples[i * channels + (channels > 1 ? 1 : 0)];
+    }
+    loudness_feed(state->meter, state->stereo, frames);
+    state->peak = fmaxf(state->peak, truepeak_process(&state->true_peak, state->stereo, frames));
+    state->frames += frames;
+    return TRUE;
+}
 
-            char *input_file = g_strdup_printf("%s/%s", current_dir, filename);
-            char *output_file = g_strdup_printf("%s/%.*sMastered.%s", current_dir, 
-                                                (int)(strlen(filename) - 4), filename, output_format);
+static void fill_probe(FileProbe *probe, const AnalysisRecord *record) {
+    probe->duration = record->duration;
+    probe->sample_rate = record->sample_rate;
+    probe->channels = record->channels;
+    probe->loudness = record->loudness;
+}
+
+gboolean probe_audio_file(const char *path, FileProbe *probe, GCancellable *cancellable, gpointer user_data) {
+    AnalysisKey key;
+    AnalysisRecord record;
+    gboolean have_key = analysisdb_key(path, &key) == 0;
+    const uint32_t wanted = ANALYSISDB_HAS_INFO | ANALYSISDB_HAS_LOUDNESS;
 
-            master_audio_file(input_file, output_file, 
-                              gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(vocal_checkbox)), 
-                              output_format);
+    if (have_key && analysisdb_lookup(analysis_db, &key, &record) == 0 && (record.fields & wanted) == wanted) {
+        fill_probe(probe, &record);
+        return TRUE;
+    }
 
-            g_free(input_file);
-            g_free(output_file);
+    ProbeLoudnessState state;
+    memset(&state, 0, sizeof(state));
+    state.cancellable = cancellable;
+    truepeak_init(&state.true_peak);
+    memset(&record, 0, sizeof(record));
+    gboolean ok = FALSE;
 
-            g_mutex_lock(&progress_mutex);
-            processed_files++;
-            current_progress = (gdouble)processed_files / total_files;
-            g_cond_signal(&progress_cond);
-            g_mutex_unlock(&progress_mutex);
+    SF_INFO sfinfo;
+    memset(&sfinfo, 0, sizeof(sfinfo));
+    SNDFILE *file = sf_open(path, SFM_READ, &sfinfo);
+    if (file) {
+        SF_FORMAT_INFO format_info;
+        format_info.format = sfinfo.format & SF_FORMAT_TYPEMASK;
+        if (sf_command(NULL, SFC_GET_FORMAT_INFO, &format_info, sizeof(format_info)) == 0 && format_info.extension) {
+            g_strlcpy(record.format, format_info.extension, sizeof(record.format));
+        }
+        record.sample_rate = sfinfo.samplerate;
+        record.channels = sfinfo.channels;
+        record.duration = (double)sfinfo.frames / sfinfo.samplerate;
+
+        float *chunk = malloc((size_t)PEAKS_CHUNK_FRAMES * sfinfo.channels * sizeof(float));
+        sf_count_t count;
+        ok = chunk != NULL;
+        while (ok && (count = sf_readf_float(file, chunk, PEAKS_CHUNK_FRAMES)) > 0) {
+            ok = feed_probe_loudness(chunk, count, sfinfo.channels, sfinfo.samplerate, &state);
+        }
+        free(chunk);
+        sf_close(file);
+    } else {
+        const char *extension = strrchr(path, '.');
+        if (extension) {
+            g_strlcpy(record.format, extension + 1, sizeof(record.format));
+        }
+        ok = decode_audio_gstreamer(path, "audio/x-raw,format=F32LE,layout=interleaved",
+                                    feed_probe_loudness, &state);
+        if (ok && state.rate > 0) {
+            record.sample_rate = state.rate;
+            record.channels = state.channels;
+            record.duration = (double)state.frames / state.rate;
         }
     }
 
-    g_mutex_lock(&progress_mutex);
-    processing_active = FALSE;
-    g_cond_signal(&progress_cond);
-    g_mutex_unlock(&progress_mutex);
+    if (ok && state.meter) {
+        analysisdb_channel_layout(record.channels, record.channel_layout);
+        record.loudness = loudness_integrated(state.meter);
+        record.true_peak_db = state.peak > 0.0f ? 20.0 * log10(state.peak) : -INFINITY;
+        record.fields = wanted | ANALYSISDB_HAS_TRUE_PEAK;
+        fill_probe(probe, &record);
+        if (have_key) {
+            analysisdb_update(analysis_db, &key, &record);
+        }
+    } else if (record.sample_rate > 0) {
+        probe->duration = record.duration;
+        probe->sample_rate = record.sample_rate;
+        probe->channels = record.channels;
+    }
+    loudness_free(state.meter);
+    g_free(state.stereo);
+    return ok;
+}
 
-    g_list_free(children);
-    return NULL;
+void on_master_clicked(GtkWidget *widget, gpointer data) {
+    process_audio_files();
 }
 
-gboolean update_progress_bar(gpointer user_data) {
-    g_mutex_lock(&progress_mutex);
+/*
+ * Settings are read here on the main thread, so each job keeps the
+ * settings that were active when it was queued.
+ */
+void process_audio_files(void) {
+    GList *names = filelist_get_checked(file_list);
+    SlopSettings settings;
+    collect_master_settings(&settings);
+    uint64_t settings_hash = slopmaster_settings_hash(&settings);
+
+    for (GList *iter = names; iter != NULL; iter = g_list_next(iter)) {
+        const char *filename = (const char *)iter->data;
+
+        MasterJob *job = g_new0(MasterJob, 1);
+        job->input_file = g_strdup_printf("%s/%s", current_dir, filename);
+        char *output_file = slopmaster_output_path(current_dir, filename, settings.format);
+        job->output_file = g_strdup(output_file);
+        free(output_file);
+        job->settings = settings;
+        job->settings_hash = settings_hash;
+        job_queue_add(job_queue, filename, job);
+    }
+    g_list_free_full(names, g_free);
 
-    if (!processing_active && current_progress >= 1.0) {
-        gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress_bar), 1.0);
-        gtk_progress_bar_set_text(GTK_PROGRESS_BAR(progress_bar), "Processing complete");
-        g_mutex_unlock(&progress_mutex);
+    if (update_job_panel() && job_refresh_id == 0) {
+        job_refresh_id = g_timeout_add(JOB_REFRESH_MS, refresh_job_panel, NULL);
+    }
+}
 
-        g_thread_join(processing_thread);
+void master_job_free(gpointer data) {
+    MasterJob *job = (MasterJob *)data;
+    g_free(job->input_file);
+    g_free(job->output_file);
+    g_free(job);
+}
 
-        update_file_list();
-        return G_SOURCE_REMOVE;
+gboolean run_master_job(JobControl *control, gpointer job_data, gpointer user_data) {
+    MasterJob *job = (MasterJob *)job_data;
+    gboolean ok = run_master_file(job, control);
+    if (!ok && job_control_is_cancelled(control)) {
+        g_remove(job->output_file);
     }
 
-    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress_bar), current_progress);
-    char progress_text[32];
-    snprintf(progress_text, sizeof(progress_text), "Processing: %.1f%%", current_progress * 100);
-    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(progress_bar), progress_text);
+    AnalysisKey key;
+    if (ok && analysisdb_key(job->input_file, &key) == 0) {
+        AnalysisRecord record;
+        memset(&record, 0, sizeof(record));
+        record.fields = ANALYSISDB_HAS_RENDER;
+        record.render_hash = job->settings_hash;
+        record.render_time = g_get_real_time() / G_USEC_PER_SEC;
+        analysisdb_update(analysis_db, &key, &record);
+    }
+    return ok;
+}
 
-    g_mutex_unlock(&progress_mutex);
-    return G_SOURCE_CONTINUE;
+static void update_job_row(const JobInfo *info) {
+    GtkTreeIter *iter = g_hash_table_lookup(job_rows, GUINT_TO_POINTER(info->id));
+    if (!iter) {
+        iter = g_new(GtkTreeIter, 1);
+        gtk_list_store_append(job_store, iter);
+        g_hash_table_insert(job_rows, GUINT_TO_POINTER(info->id), iter);
+    }
+
+    gchar elapsed[32];
+    int seconds = (int)info->elapsed;
+    g_snprintf(elapsed, sizeof(elapsed), "%d:%02d", seconds / 60, seconds % 60);
+
+    gtk_list_store_set(job_store, iter,
+                       JOB_COL_ID, info->id,
+                       JOB_COL_NAME, info->name,
+                       JOB_COL_STATE, job_state_name(info->state),
+                       JOB_COL_PROGRESS, (gint)(info->progress * 100 + 0.5),
+                       JOB_COL_ELAPSED, elapsed,
+                       JOB_COL_ORDER, info->order,
+                       JOB_COL_FINISHED, info->state == JOB_DONE || info->state == JOB_FAILED ||
+                                         info->state == JOB_CANCELLED,
+                       -1);
 }
 
-void master_audio_file(const char* input_file, const char* output_file, int vocal_mode, const char* output_format) {
-    char filter_complex[COMMAND_SIZE / 2];
-    char vocal_filters[COMMAND_SIZE / 4] = "";
-
-    double stereo_width = gtk_range_get_value(GTK_RANGE(stereo_width_scale)) / 100.0;
-
-    double low_thresh = gtk_range_get_value(GTK_RANGE(low_threshold));
-    double low_comp_ratio = gtk_range_get_value(GTK_RANGE(low_ratio));
-    double mid_thresh = gtk_range_get_value(GTK_RANGE(mid_threshold));
-    double mid_comp_ratio = gtk_range_get_value(GTK_RANGE(mid_ratio));
-    double high_thresh = gtk_range_get_value(GTK_RANGE(high_threshold));
-    double high_comp_ratio = gtk_range_get_value(GTK_RANGE(high_ratio));
-    double cross_low = gtk_range_get_value(GTK_RANGE(crossover_low));
-    double cross_high = gtk_range_get_value(GTK_RANGE(crossover_high));
-
-    snprintf(filter_complex, COMMAND_SIZE / 2,
-        "aformat=channel_layouts=stereo:sample_rates=48000,"
-        "highpass=f=20,lowpass=f=20000,"
-        "afftdn=nr=10:nf=-25,"
-        "compand=attacks=0.005:decays=0.1:points=-80/-80|-60/-40|-40/-20|-20/-10|-10/-5|0/0:soft-knee=6,"
-        "equalizer=f=60:t=q:w=1.5:g=1,"
-        "equalizer=f=120:t=q:w=1:g=-1,"
-        "equalizer=f=1000:t=q:w=1.5:g=-1,"
-        "equalizer=f=4000:t=q:w=1:g=2,"
-        "equalizer=f=6000:t=q:w=1:g=1.5,"
-        "equalizer=f=8000:t=q:w=1:g=1,"
-        "equalizer=f=12000:t=q:w=1.5:g=1,"
-        "stereotools=mlev=1:slev=%.2f:sbal=0:phase=0:mode=lr>lr,"
-        "asplit=3[low][mid][high];"
-        "[low]lowpass=f=%.1f,compand=attacks=0.01:decays=0.1:points=-80/-80|%.1f/%.1f|0/0:soft-knee=6:gain=1[clow];"
-        "[mid]bandpass=f=%.1f:width_type=h:w=%.1f,compand=attacks=0.01:decays=0.1:points=-80/-80|%.1f/%.1f|0/0:soft-knee=6:gain=1[cmid];"
-        "[high]highpass=f=%.1f,compand=attacks=0.01:decays=0.1:points=-80/-80|%.1f/%.1f|0/0:soft-knee=6:gain=1[chigh];"
-        "[clow][cmid][chigh]amix=inputs=3:weights=1 1 1,"
-        "loudnorm=I=-14:TP=-1:LRA=11,"
-        "alimiter=level_in=0.9:level_out=0.9:limit=0.95:attack=5:release=50,"
-        "volume=0.9,pan=stereo|c0=c0|c1=c1",
-        stereo_width, cross_low, low_thresh, low_thresh/low_comp_ratio,
-        (cross_low + cross_high) / 2, cross_high - cross_low,
-        mid_thresh, mid_thresh/mid_comp_ratio,
-        cross_high, high_thresh, high_thresh/high_comp_ratio
-    );
-
-    if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(reverb_checkbox))) {
-        double delay = gtk_range_get_value(GTK_RANGE(reverb_delay_scale));
-        double decay = gtk_range_get_value(GTK_RANGE(reverb_decay_scale));
-        char reverb_filter[100];
-        snprintf(reverb_filter, sizeof(reverb_filter), 
-                ",aecho=0.8:0.5:%d|%d|%d:%.1f|%.1f|%.1f",
-                (int)delay, (int)(delay*1.5), (int)(delay*2),
-                decay, decay*0.8, decay*0.6);
-        strncat(filter_complex, reverb_filter, COMMAND_SIZE / 2 - strlen(filter_complex) - 1);
-    }
-    if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(bass_booster_checkbox))) {
-        strncat(filter_complex, ",equalizer=f=100:t=q:w=1:g=5", COMMAND_SIZE / 2 - strlen(filter_complex) - 1);
-    }
-    if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(wet_checkbox))) {
-        strncat(filter_complex, ",asplit[dry][wet];"
-                                "[wet]aecho=0.8:0.88:60:0.4[wet];"
-                                "[dry][wet]amix=inputs=2:weights=0.7 0.3", 
-                COMMAND_SIZE / 2 - strlen(filter_complex) - 1);
-    }
-
-    if (vocal_mode) {
-        snprintf(vocal_filters, COMMAND_SIZE / 4,
-            ",highpass=f=80,lowpass=f=12000,"
-            "equalizer=f=200:width_type=o:width=1:g=-3,"
-            "equalizer=f=1800:width_type=o:width=1:g=2,"
-            "equalizer=f=4000:width_type=o:width=1:g=3,"
-            "equalizer=f=8000:width_type=o:width=1:g=1.5,"
-            "compand=attacks=0.02:decays=0.1:points=-80/-80|-45/-25|-20/-12|-10/-8|-5/-5|0/-4:soft-knee=6:gain=2,"
-            "acompressor=threshold=-12dB:ratio=3:attack=10:release=100:makeup=2:knee=5,"
-            "volume=1.5"
-        );
-        strncat(filter_complex, vocal_filters, COMMAND_SIZE / 2 - strlen(filter_complex) - 1);
-    }
-
-    char volume_adjustment[50];
-    snprintf(volume_adjustment, sizeof(volume_adjustment), ",volume=%.1fdB", volume_adjustment_db);
-    strncat(filter_complex, volume_adjustment, COMMAND_SIZE / 2 - strlen(filter_complex) - 1);
-
-    char* command = malloc(COMMAND_SIZE);
-    if (!command) {
-        fprintf(stderr, "Memory allocation failed for command\n");
-        return;
+/* Returns TRUE while any job is still queued or running. */
+static gboolean update_job_panel(void) {
+    GArray *changed = g_array_new(FALSE, FALSE, sizeof(JobInfo));
+    job_version = job_queue_snapshot(job_queue, job_version, changed);
+    for (guint i = 0; i < changed->len; i++) {
+        JobInfo *info = &g_array_index(changed, JobInfo, i);
+        update_job_row(info);
+        job_info_clear(info);
     }
+    g_array_free(changed, TRUE);
 
-    char ffmpeg_command[COMMAND_SIZE / 4];
-    char output_options[COMMAND_SIZE / 4];
+    int finished, total;
+    job_queue_counts(job_queue, &finished, &total);
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress_bar), total > 0 ? (double)finished / total : 0.0);
 
-    snprintf(ffmpeg_command, COMMAND_SIZE / 4, "ffmpeg -hwaccel auto -i \"%s\" -threads 0 -filter_complex '", input_file);
+    if (finished == total) {
+        gtk_progress_bar_set_text(GTK_PROGRESS_BAR(progress_bar), total > 0 ? "Processing complete" : "Ready");
+        return FALSE;
+    }
 
-    const char* selected_format = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(format_combo));
-    snprintf(output_options, COMMAND_SIZE / 4, "' -ar 48000 -c:a %s \"%s\" -y", 
-             strcmp(selected_format, "WAV") == 0 ? "pcm_s24le" : 
-             strcmp(selected_format, "FLAC") == 0 ? "flac" : "libmp3lame", 
-             output_file);
+    char progress_text[64];
+    snprintf(progress_text, sizeof(progress_text), "%s: %d of %d files",
+             job_queue_is_paused(job_queue) ? "Paused" : "Processing", finished, total);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(progress_bar), progress_text);
+    return TRUE;
+}
 
-    size_t remaining_space = COMMAND_SIZE - strlen(ffmpeg_command) - strlen(output_options) - 1;
-    if (strlen(filter_complex) > remaining_space) {
-        fprintf(stderr, "Filter complex too long for command buffer\n");
-        free(command);
-        return;
+gboolean refresh_job_panel(gpointer user_data) {
+    if (update_job_panel()) {
+        return G_SOURCE_CONTINUE;
     }
+    job_refresh_id = 0;
+    update_file_list();
+    return G_SOURCE_REMOVE;
+}
 
-    snprintf(command, COMMAND_SIZE, "%s%s%s", ffmpeg_command, filter_complex, output_options);
-    fprintf(log_file, "Executing FFmpeg command:\n%s\n", command);
-    FILE* fp = popen(command, "r");
-    if (!fp) {
-        fprintf(stderr, "Error executing FFmpeg command for %s\n", input_file);
-        free(command);
-        return;
+static void collect_selected_job(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, gpointer data) {
+    guint id;
+    gtk_tree_model_get(model, iter, JOB_COL_ID, &id, -1);
+    *(GList **)data = g_list_prepend(*(GList **)data, GUINT_TO_POINTER(id));
+}
+
+static GList *selected_job_ids(void) {
+    GList *ids = NULL;
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(job_view));
+    gtk_tree_selection_selected_foreach(selection, collect_selected_job, &ids);
+    return g_list_reverse(ids);
+}
+
+void on_job_cancel(GtkWidget *widget, gpointer data) {
+    GList *ids = selected_job_ids();
+    for (GList *iter = ids; iter != NULL; iter = g_list_next(iter)) {
+        job_queue_cancel(job_queue, GPOINTER_TO_UINT(iter->data));
     }
+    g_list_free(ids);
+    update_job_panel();
+}
 
-    char buffer[8192];
-    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-        fprintf(log_file, "%s", buffer);
+void on_job_move_to_front(GtkWidget *widget, gpointer data) {
+    /* Walk backwards so a multi-selection keeps its relative order. */
+    GList *ids = g_list_reverse(selected_job_ids());
+    for (GList *iter = ids; iter != NULL; iter = g_list_next(iter)) {
+        job_queue_move_to_front(job_queue, GPOINTER_TO_UINT(iter->data));
     }
+    g_list_free(ids);
+    update_job_panel();
+}
 
-    int status = pclose(fp);
-    if (status == 0) {
-        fprintf(log_file, "Successfully mastered: %s\n", input_file);
-    } else {
-        fprintf(stderr, "Error processing %s. FFmpeg exited with status: %d\n", input_file, status);
-        fprintf(log_file, "Command that caused the error:\n%s\n", command);
+void on_job_pause_toggled(GtkToggleButton *button, gpointer data) {
+    gboolean paused = gtk_toggle_button_get_active(button);
+    job_queue_set_paused(job_queue, paused);
+    gtk_button_set_label(GTK_BUTTON(button), paused ? "Resume" : "Pause");
+    update_job_panel();
+}
+
+void on_job_clear_finished(GtkWidget *widget, gpointer data) {
+    job_queue_clear_finished(job_queue);
+
+    GtkTreeIter iter;
+    gboolean valid = gtk_tree_model_get_iter_first(GTK_TREE_MODEL(job_store), &iter);
+    while (valid) {
+        gboolean finished;
+        guint id;
+        gtk_tree_model_get(GTK_TREE_MODEL(job_store), &iter, JOB_COL_FINISHED, &finished, JOB_COL_ID, &id, -1);
+        if (finished) {
+            g_hash_table_remove(job_rows, GUINT_TO_POINTER(id));
+            valid = gtk_list_store_remove(job_store, &iter);
+        } else {
+            valid = gtk_tree_model_iter_next(GTK_TREE_MODEL(job_store), &iter);
+        }
     }
+    update_job_panel();
+}
 
-    free(command);
+static void master_job_set_pid(pid_t pid, void *user_data) {
+    job_control_set_pid((JobControl *)user_data, pid);
 }
 
-int check_ffmpeg_installed(void) {
-    return system("ffmpeg -version > /dev/null 2>&1") == 0;
+static void master_job_progress(double fraction, void *user_data) {
+    job_control_set_progress((JobControl *)user_data, fraction);
 }
 
-int is_directory_writable(const char* path) {
-    char test_file[MAX_PATH];
-    snprintf(test_file, sizeof(test_file), "%s/test_write", path);
-    FILE* fp = fopen(test_file, "w");
-    if (fp) {
-        fclose(fp);
-        remove(test_file);
-        return 1;
+/* Plans and runs the job, starting from its stage cache checkpoint when only later stages changed. */
+gboolean run_master_file(const MasterJob *job, JobControl *control) {
+    const char *input_file = job->input_file;
+    SlopRunHooks hooks = { master_job_set_pid, master_job_progress, log_file, control };
+    SlopStatus status = slopmaster_run_file(&job->settings, input_file, job->output_file, &hooks);
+
+    if (status == SLOPMASTER_OK) {
+        fprintf(log_file, "Successfully mastered: %s\n", input_file);
+        return TRUE;
     }
-    return 0;
+    if (job_control_is_cancelled(control)) {
+        fprintf(log_file, "Cancelled: %s\n", input_file);
+    } else {
+        fprintf(stderr, "Error processing %s. See audioMaster.log for the FFmpeg output.\n", input_file);
+    }
+    return FALSE;
+}
+
+/* Reads the current settings, so it must run on the main thread. */
+void collect_master_settings(SlopSettings *settings) {
+    slopmaster_settings_preset(settings, SLOPMASTER_PRESET_STANDARD);
+    collect_chain_params(&settings->chain);
+    settings->chain.loudnorm_gain_db = 0.0;
+    settings->log = log_file;
+    settings->stage_cache_mb = SLOPMASTER_STAGE_CACHE_MB;
+
+    gchar *selected_format = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(format_combo));
+    if (!selected_format || slopmaster_parse_format(selected_format, &settings->format) != 0) {
+        settings->format = SLOPMASTER_FORMAT_WAV;
+    }
+    g_free(selected_format);
 }
 
 void print_usage(const char* program_name) {
@@ -1027,112 +1826,248 @@ void print_usage(const char* program_name) {
            "  -h               Display this help message\n", program_name);
 }
 
-gboolean draw_waveform(GtkWidget *widget, cairo_t *cr, gpointer data) {
-    guint width, height;
-    GtkStyleContext *context;
-
-    context = gtk_widget_get_style_context(widget);
-    width = gtk_widget_get_allocated_width(widget);
-    height = gtk_widget_get_allocated_height(widget);
+void update_waveform(const char *filename) {
+    if (original_file_path && strcmp(filename, original_file_path) == 0) {
+        waveview_set_color(waveform_view, 0.0, 0.8, 0.0);
+    } else {
+        waveview_set_color(waveform_view, 0.8, 0.0, 0.8);
+    }
 
-    gtk_render_background(context, cr, 0, 0, width, height);
+    WaveformJob *job = g_new0(WaveformJob, 1);
+    job->filename = g_strdup(filename);
+    job->generation = g_atomic_int_add(&waveform_generation, 1) + 1;
 
-    if (waveform_data && waveform_size > 0) {
-        cairo_set_source_rgb(cr, waveform_color[0], waveform_color[1], waveform_color[2]);
-        cairo_set_line_width(cr, 1);
+    GThread *thread = g_thread_new("waveform_peaks", waveform_decode_thread, job);
+    g_thread_unref(thread);
+}
 
-        double x_scale = (double)width / waveform_size;
-        double y_scale = height / 2;
+static gboolean waveform_job_stale(WaveformJob *job) {
+    return g_atomic_int_get(&waveform_generation) != job->generation;
+}
 
-        cairo_move_to(cr, 0, height / 2);
-        for (int i = 0; i < waveform_size; i++) {
-            double x = i * x_scale;
-            double y = height / 2 - waveform_data[i] * y_scale;
-            cairo_line_to(cr, x, y);
-        }
+typedef struct {
+    WaveformJob *job;
+    PeakBuilder *peaks;
+    SpectroBuilder *spectro;
+} WaveformBuilders;
+
+/* Only what the caches did not have is built. */
+static gboolean waveform_builders_start(WaveformBuilders *builders, gint channels, gint rate) {
+    if (!builders->job->peaks) {
+        builders->peaks = peaks_builder_new(channels, rate);
+    }
+    if (!builders->job->spectro) {
+        builders->spectro = spectro_builder_new(channels, rate, (int)g_get_num_processors());
+    }
+    return builders->peaks || builders->spectro;
+}
 
-        cairo_stroke(cr);
+static void waveform_builders_feed(WaveformBuilders *builders, const float *samples, gsize frames) {
+    if (builders->peaks) {
+        peaks_builder_feed(builders->peaks, samples, frames);
+    }
+    if (builders->spectro) {
+        spectro_builder_feed(builders->spectro, samples, frames);
     }
+}
 
-    return FALSE;
+static gboolean waveform_builders_finish(WaveformBuilders *builders, gboolean ok) {
+    WaveformJob *job = builders->job;
+    if (!ok || waveform_job_stale(job)) {
+        peaks_builder_free(builders->peaks);
+        spectro_builder_free(builders->spectro);
+        return FALSE;
+    }
+    if (builders->peaks) {
+        job->peaks = peaks_builder_finish(builders->peaks);
+    }
+    if (builders->spectro) {
+        job->spectro = spectro_builder_finish(builders->spectro);
+    }
+    return TRUE;
 }
 
-void update_waveform(const char *filename) {
-    SNDFILE *file;
+static gboolean decode_waveform_sndfile(WaveformJob *job) {
     SF_INFO sfinfo;
-
     memset(&sfinfo, 0, sizeof(sfinfo));
-    file = sf_open(filename, SFM_READ, &sfinfo);
+    SNDFILE *file = sf_open(job->filename, SFM_READ, &sfinfo);
     if (!file) {
-        fprintf(stderr, "Error opening file: %s\n", sf_strerror(file));
-        return;
+        return FALSE;
     }
 
-    float *buffer = malloc(sfinfo.frames * sfinfo.channels * sizeof(float));
-    if (!buffer) {
-        fprintf(stderr, "Memory allocation error\n");
+    WaveformBuilders builders = { job, NULL, NULL };
+    float *chunk = malloc((size_t)PEAKS_CHUNK_FRAMES * sfinfo.channels * sizeof(float));
+    if (!chunk || !waveform_builders_start(&builders, sfinfo.channels, sfinfo.samplerate)) {
+        free(chunk);
         sf_close(file);
-        return;
+        return waveform_builders_finish(&builders, FALSE);
     }
 
-    sf_count_t count = sf_read_float(file, buffer, sfinfo.frames * sfinfo.channels);
+    sf_count_t count;
+    while ((count = sf_readf_float(file, chunk, PEAKS_CHUNK_FRAMES)) > 0) {
+        if (waveform_job_stale(job)) {
+            break;
+        }
+        waveform_builders_feed(&builders, chunk, count);
+    }
 
+    free(chunk);
     sf_close(file);
+    return waveform_builders_finish(&builders, TRUE);
+}
 
-    if (waveform_data) {
-        free(waveform_data);
+static gboolean decode_audio_gstreamer(const char *filename, const char *caps,
+                                       DecodeChunkFunc func, gpointer user_data) {
+    GError *error = NULL;
+    GstElement *pipeline = gst_parse_launch(
+        "uridecodebin name=src ! audioconvert ! audioresample ! "
+        "capsfilter name=caps ! appsink name=sink sync=false max-buffers=8", &error);
+    if (!pipeline) {
+        g_printerr("Decode pipeline error: %s\n", error ? error->message : "unknown");
+        g_clear_error(&error);
+        return FALSE;
     }
-    waveform_data = malloc(MAX_WAVEFORM_POINTS * sizeof(float));
-    if (!waveform_data) {
-        fprintf(stderr, "Memory allocation error for waveform data\n");
-        free(buffer);
-        return;
+
+    GstElement *src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+    GstElement *capsfilter = gst_bin_get_by_name(GST_BIN(pipeline), "caps");
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    gchar *uri = gst_filename_to_uri(filename, NULL);
+    GstCaps *filter_caps = gst_caps_from_string(caps);
+    g_object_set(G_OBJECT(src), "uri", uri, NULL);
+    g_object_set(G_OBJECT(capsfilter), "caps", filter_caps, NULL);
+    gst_caps_unref(filter_caps);
+    g_free(uri);
+
+    GstBus *bus = gst_element_get_bus(pipeline);
+    gint channels = 0, rate = 0;
+    gboolean ok = TRUE;
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    while (ok && !gst_app_sink_is_eos(GST_APP_SINK(sink))) {
+        GstMessage *msg = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR);
+        if (msg) {
+            gst_message_unref(msg);
+            ok = FALSE;
+            break;
+        }
+
+        GstSample *sample = gst_app_sink_try_pull_sample(GST_APP_SINK(sink), 100 * GST_MSECOND);
+        if (!sample) {
+            continue;
+        }
+
+        if (channels == 0) {
+            GstStructure *structure = gst_caps_get_structure(gst_sample_get_caps(sample), 0);
+            gst_structure_get_int(structure, "channels", &channels);
+            gst_structure_get_int(structure, "rate", &rate);
+        }
+
+        GstMapInfo map;
+        GstBuffer *buffer = gst_sample_get_buffer(sample);
+        if (channels > 0 && gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+            ok = func((const float *)map.data, map.size / (channels * sizeof(float)), channels, rate, user_data);
+            gst_buffer_unmap(buffer, &map);
+        }
+        gst_sample_unref(sample);
     }
 
-    waveform_size = MAX_WAVEFORM_POINTS;
-    int samples_per_point = (sfinfo.frames * sfinfo.channels) / MAX_WAVEFORM_POINTS;
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(bus);
+    gst_object_unref(src);
+    gst_object_unref(capsfilter);
+    gst_object_unref(sink);
+    gst_object_unref(pipeline);
+    return ok && channels > 0;
+}
 
-    for (int i = 0; i < MAX_WAVEFORM_POINTS; i++) {
-        float max = 0;
-        for (int j = 0; j < samples_per_point; j++) {
-            int index = i * samples_per_point + j;
-            if (index < count) {
-                float abs_sample = fabs(buffer[index]);
-                if (abs_sample > max) {
-                    max = abs_sample;
-                }
-            }
+static gboolean feed_waveform_chunk(const float *samples, gsize frames, gint channels, gint rate, gpointer user_data) {
+    WaveformBuilders *builders = (WaveformBuilders *)user_data;
+    if (waveform_job_stale(builders->job)) {
+        return FALSE;
+    }
+    if (!builders->peaks && !builders->spectro && !waveform_builders_start(builders, channels, rate)) {
+        return FALSE;
+    }
+    waveform_builders_feed(builders, samples, frames);
+    return TRUE;
+}
+
+static gboolean decode_waveform_gstreamer(WaveformJob *job) {
+    WaveformBuilders builders = { job, NULL, NULL };
+    gboolean ok = decode_audio_gstreamer(job->filename,
+                                         "audio/x-raw,format=F32LE,layout=interleaved,channels=[1,2]",
+                                         feed_waveform_chunk, &builders);
+    return waveform_builders_finish(&builders, ok);
+}
+
+gpointer waveform_decode_thread(gpointer data) {
+    WaveformJob *job = (WaveformJob *)data;
+
+    job->peaks = peaks_cache_load(job->filename);
+    job->spectro = spectro_cache_load(job->filename);
+    if (!job->peaks || !job->spectro) {
+        gboolean had_peaks = job->peaks != NULL;
+        gboolean had_spectro = job->spectro != NULL;
+        if (!decode_waveform_sndfile(job) && !waveform_job_stale(job)) {
+            decode_waveform_gstreamer(job);
+        }
+        if (!had_peaks && job->peaks && peaks_cache_store(job->filename, job->peaks) != 0) {
+            fprintf(stderr, "Could not write peak cache for %s\n", job->filename);
+        }
+        if (!had_spectro && job->spectro && spectro_cache_store(job->filename, job->spectro) != 0) {
+            fprintf(stderr, "Could not write spectrogram cache for %s\n", job->filename);
         }
-        waveform_data[i] = max;
     }
 
-    free(buffer);
+    if (!job->peaks && !waveform_job_stale(job)) {
+        fprintf(stderr, "Error reading waveform from: %s\n", job->filename);
+    }
 
-    if (strcmp(filename, original_file_path) == 0) {
-        waveform_color[0] = 0.0;
-        waveform_color[1] = 0.8;
-        waveform_color[2] = 0.0;
-    } else {
-        waveform_color[0] = 0.8;
-        waveform_color[1] = 0.0;
-        waveform_color[2] = 0.8;
+    g_idle_add(waveform_peaks_ready, job);
+    return NULL;
+}
+
+gboolean waveform_peaks_ready(gpointer data) {
+    WaveformJob *job = (WaveformJob *)data;
+
+    if (!waveform_job_stale(job) && job->peaks) {
+        waveview_set_peaks(waveform_view, job->peaks);
+        waveview_set_spectrogram(waveform_view, job->spectro);
+        job->peaks = NULL;
+        job->spectro = NULL;
     }
 
-    gtk_widget_queue_draw(waveform_drawing_area);
+    peaks_free(job->peaks);
+    spectro_free(job->spectro);
+    g_free(job->filename);
+    g_free(job);
+    return G_SOURCE_REMOVE;
 }
 
-void cleanup_waveform() {
-    if (waveform_data) {
-        free(waveform_data);
-        waveform_data = NULL;
+gboolean waveform_tick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer user_data) {
+    gint64 position;
+    if (is_audio_playing && gst_element_query_position(ab_pipeline, GST_FORMAT_TIME, &position)) {
+        waveview_set_playhead(waveform_view, (double)position / GST_SECOND);
     }
+    return G_SOURCE_CONTINUE;
 }
 
-void *process_file_thread(void *arg) {
-    ThreadArgs *args = (ThreadArgs *)arg;
-    master_audio_file(args->input_file, args->output_file, args->vocal_mode, args->output_format);
-    free(arg);
-    return NULL;
+void on_waveform_seek(double seconds, gpointer user_data) {
+    if (is_audio_playing) {
+        gtk_range_set_value(GTK_RANGE(seek_bar), seconds);
+    } else {
+        shared_position = (gint64)(seconds * GST_SECOND);
+        waveview_set_playhead(waveform_view, seconds);
+    }
+}
+
+void cleanup_waveform() {
+    g_atomic_int_inc(&waveform_generation);
+    waveview_free(waveform_view);
+    waveform_view = NULL;
+    meterview_free(meter_view);
+    meter_view = NULL;
 }
 
 void update_progress(const char *message, double fraction) {
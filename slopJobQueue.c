@@ -0,0 +1,346 @@
+#include <signal.h>
+#include <string.h>
+
+#include "slopJobQueue.h"
+
+struct JobControl {
+    JobQueue* queue;
+    guint id;
+    gchar* name;
+    gpointer data;
+    JobState state;
+    double progress;
+    gint64 order;
+    guint64 version;
+    gint64 started_us;
+    gint64 finished_us;
+    gint64 paused_since_us;
+    gint64 paused_total_us;
+    pid_t pid;
+    gboolean cancelled;
+};
+
+struct JobQueue {
+    GMutex mutex;
+    GCond cond;
+    GThread* worker;
+    GPtrArray* jobs;
+    guint next_id;
+    gint64 head_order;
+    gint64 tail_order;
+    guint64 version;
+    gboolean paused;
+    gboolean quit;
+    JobRunFunc run;
+    gpointer user_data;
+    GDestroyNotify data_free;
+};
+
+static gpointer job_queue_worker(gpointer data);
+
+const char* job_state_name(JobState state) {
+    switch (state) {
+        case JOB_QUEUED: return "Queued";
+        case JOB_RUNNING: return "Running";
+        case JOB_PAUSED: return "Paused";
+        case JOB_DONE: return "Done";
+        case JOB_FAILED: return "Failed";
+        case JOB_CANCELLED: return "Cancelled";
+    }
+    return "";
+}
+
+static gboolean job_is_finished(const JobControl* job) {
+    return job->state == JOB_DONE || job->state == JOB_FAILED || job->state == JOB_CANCELLED;
+}
+
+static void job_touch(JobControl* job) {
+    job->version = ++job->queue->version;
+}
+
+static void job_release_data(JobControl* job) {
+    if (job->data && job->queue->data_free) {
+        job->queue->data_free(job->data);
+    }
+    job->data = NULL;
+}
+
+static void job_free(gpointer data) {
+    JobControl* job = data;
+    job_release_data(job);
+    g_free(job->name);
+    g_free(job);
+}
+
+JobQueue* job_queue_new(JobRunFunc run, gpointer user_data, GDestroyNotify data_free) {
+    JobQueue* queue = g_new0(JobQueue, 1);
+    g_mutex_init(&queue->mutex);
+    g_cond_init(&queue->cond);
+    queue->jobs = g_ptr_array_new_with_free_func(job_free);
+    queue->run = run;
+    queue->user_data = user_data;
+    queue->data_free = data_free;
+    queue->worker = g_thread_new("job_queue", job_queue_worker, queue);
+    return queue;
+}
+
+void job_queue_free(JobQueue* queue) {
+    if (!queue) {
+        return;
+    }
+
+    g_mutex_lock(&queue->mutex);
+    queue->quit = TRUE;
+    queue->paused = FALSE;
+    for (guint i = 0; i < queue->jobs->len; i++) {
+        JobControl* job = g_ptr_array_index(queue->jobs, i);
+        job->cancelled = TRUE;
+        if (job->pid > 0) {
+            kill(job->pid, SIGTERM);
+            kill(job->pid, SIGCONT);
+        }
+    }
+    g_cond_broadcast(&queue->cond);
+    g_mutex_unlock(&queue->mutex);
+
+    g_thread_join(queue->worker);
+    g_ptr_array_free(queue->jobs, TRUE);
+    g_mutex_clear(&queue->mutex);
+    g_cond_clear(&queue->cond);
+    g_free(queue);
+}
+
+static JobControl* job_queue_find(JobQueue* queue, guint id) {
+    for (guint i = 0; i < queue->jobs->len; i++) {
+        JobControl* job = g_ptr_array_index(queue->jobs, i);
+        if (job->id == id) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
+static JobControl* job_queue_next(JobQueue* queue) {
+    JobControl* next = NULL;
+    for (guint i = 0; i < queue->jobs->len; i++) {
+        JobControl* job = g_ptr_array_index(queue->jobs, i);
+        if (job->state == JOB_QUEUED && (!next || job->order < next->order)) {
+            next = job;
+        }
+    }
+    return next;
+}
+
+guint job_queue_add(JobQueue* queue, const char* name, gpointer job_data) {
+    JobControl* job = g_new0(JobControl, 1);
+    job->queue = queue;
+    job->name = g_strdup(name);
+    job->data = job_data;
+    job->state = JOB_QUEUED;
+
+    g_mutex_lock(&queue->mutex);
+    job->id = ++queue->next_id;
+    job->order = ++queue->tail_order;
+    job_touch(job);
+    g_ptr_array_add(queue->jobs, job);
+    g_cond_signal(&queue->cond);
+    g_mutex_unlock(&queue->mutex);
+    return job->id;
+}
+
+void job_queue_cancel(JobQueue* queue, guint id) {
+    g_mutex_lock(&queue->mutex);
+    JobControl* job = job_queue_find(queue, id);
+    if (job && job->state == JOB_QUEUED) {
+        job->state = JOB_CANCELLED;
+        job_release_data(job);
+        job_touch(job);
+    } else if (job && !job_is_finished(job) && !job->cancelled) {
+        job->cancelled = TRUE;
+        if (job->pid > 0) {
+            kill(job->pid, SIGTERM);
+            kill(job->pid, SIGCONT);
+        }
+        job_touch(job);
+    }
+    g_mutex_unlock(&queue->mutex);
+}
+
+void job_queue_move_to_front(JobQueue* queue, guint id) {
+    g_mutex_lock(&queue->mutex);
+    JobControl* job = job_queue_find(queue, id);
+    if (job && job->state == JOB_QUEUED) {
+        job->order = --queue->head_order;
+        job_touch(job);
+    }
+    g_mutex_unlock(&queue->mutex);
+}
+
+/* Pausing also stops the running job's child process, not just dispatch. */
+void job_queue_set_paused(JobQueue* queue, gboolean paused) {
+    g_mutex_lock(&queue->mutex);
+    if (queue->paused != paused) {
+        queue->paused = paused;
+        gint64 now = g_get_monotonic_time();
+
+        for (guint i = 0; i < queue->jobs->len; i++) {
+            JobControl* job = g_ptr_array_index(queue->jobs, i);
+            if (paused && job->state == JOB_RUNNING) {
+                job->state = JOB_PAUSED;
+                job->paused_since_us = now;
+                if (job->pid > 0) {
+                    kill(job->pid, SIGSTOP);
+                }
+                job_touch(job);
+            } else if (!paused && job->state == JOB_PAUSED) {
+                job->state = JOB_RUNNING;
+                job->paused_total_us += now - job->paused_since_us;
+                job->paused_since_us = 0;
+                if (job->pid > 0) {
+                    kill(job->pid, SIGCONT);
+                }
+                job_touch(job);
+            }
+        }
+        g_cond_broadcast(&queue->cond);
+    }
+    g_mutex_unlock(&queue->mutex);
+}
+
+gboolean job_queue_is_paused(JobQueue* queue) {
+    g_mutex_lock(&queue->mutex);
+    gboolean paused = queue->paused;
+    g_mutex_unlock(&queue->mutex);
+    return paused;
+}
+
+void job_queue_clear_finished(JobQueue* queue) {
+    g_mutex_lock(&queue->mutex);
+    for (guint i = queue->jobs->len; i > 0; i--) {
+        JobControl* job = g_ptr_array_index(queue->jobs, i - 1);
+        if (job_is_finished(job)) {
+            g_ptr_array_remove_index(queue->jobs, i - 1);
+        }
+    }
+    g_mutex_unlock(&queue->mutex);
+}
+
+void job_queue_counts(JobQueue* queue, int* finished, int* total) {
+    int done = 0;
+    g_mutex_lock(&queue->mutex);
+    for (guint i = 0; i < queue->jobs->len; i++) {
+        if (job_is_finished(g_ptr_array_index(queue->jobs, i))) {
+            done++;
+        }
+    }
+    *total = (int)queue->jobs->len;
+    g_mutex_unlock(&queue->mutex);
+    *finished = done;
+}
+
+static double job_elapsed(const JobControl* job, gint64 now) {
+    if (job->started_us == 0) {
+        return 0;
+    }
+    gint64 end = job->finished_us ? job->finished_us : now;
+    gint64 paused = job->paused_total_us;
+    if (job->paused_since_us) {
+        paused += end - job->paused_since_us;
+    }
+    return (end - job->started_us - paused) / 1e6;
+}
+
+guint64 job_queue_snapshot(JobQueue* queue, guint64 since_version, GArray* out) {
+    gint64 now = g_get_monotonic_time();
+
+    g_mutex_lock(&queue->mutex);
+    for (guint i = 0; i < queue->jobs->len; i++) {
+        JobControl* job = g_ptr_array_index(queue->jobs, i);
+        if (job->version <= since_version && job->state != JOB_RUNNING && job->state != JOB_PAUSED) {
+            continue;
+        }
+        JobInfo info;
+        info.id = job->id;
+        info.name = g_strdup(job->name);
+        info.state = job->state;
+        info.progress = job->progress;
+        info.elapsed = job_elapsed(job, now);
+        info.order = job->order;
+        g_array_append_val(out, info);
+    }
+    guint64 version = queue->version;
+    g_mutex_unlock(&queue->mutex);
+    return version;
+}
+
+void job_info_clear(JobInfo* info) {
+    g_free(info->name);
+    info->name = NULL;
+}
+
+/*
+ * Register the running job's child so it can be signalled. Set it back
+ * to 0 before reaping the child, so a recycled pid is never signalled.
+ */
+void job_control_set_pid(JobControl* control, pid_t pid) {
+    JobQueue* queue = control->queue;
+    g_mutex_lock(&queue->mutex);
+    control->pid = pid;
+    if (pid > 0 && control->cancelled) {
+        kill(pid, SIGTERM);
+    } else if (pid > 0 && queue->paused) {
+        kill(pid, SIGSTOP);
+    }
+    g_mutex_unlock(&queue->mutex);
+}
+
+void job_control_set_progress(JobControl* control, double fraction) {
+    JobQueue* queue = control->queue;
+    g_mutex_lock(&queue->mutex);
+    control->progress = CLAMP(fraction, 0.0, 1.0);
+    g_mutex_unlock(&queue->mutex);
+}
+
+gboolean job_control_is_cancelled(JobControl* control) {
+    JobQueue* queue = control->queue;
+    g_mutex_lock(&queue->mutex);
+    gboolean cancelled = control->cancelled || queue->quit;
+    g_mutex_unlock(&queue->mutex);
+    return cancelled;
+}
+
+static gpointer job_queue_worker(gpointer data) {
+    JobQueue* queue = data;
+
+    g_mutex_lock(&queue->mutex);
+    while (!queue->quit) {
+        JobControl* job = queue->paused ? NULL : job_queue_next(queue);
+        if (!job) {
+            g_cond_wait(&queue->cond, &queue->mutex);
+            continue;
+        }
+
+        job->state = JOB_RUNNING;
+        job->started_us = g_get_monotonic_time();
+        job_touch(job);
+        g_mutex_unlock(&queue->mutex);
+
+        gboolean ok = queue->run(job, job->data, queue->user_data);
+
+        g_mutex_lock(&queue->mutex);
+        job->pid = 0;
+        job->finished_us = g_get_monotonic_time();
+        if (job->cancelled) {
+            job->state = JOB_CANCELLED;
+        } else {
+            job->state = ok ? JOB_DONE : JOB_FAILED;
+            if (ok) {
+                job->progress = 1.0;
+            }
+        }
+        job_release_data(job);
+        job_touch(job);
+    }
+    g_mutex_unlock(&queue->mutex);
+    return NULL;
+}
@@ -0,0 +1,60 @@
+#ifndef SLOP_JOB_QUEUE_H
+#define SLOP_JOB_QUEUE_H
+
+#include <glib.h>
+#include <sys/types.h>
+
+typedef enum {
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_PAUSED,
+    JOB_DONE,
+    JOB_FAILED,
+    JOB_CANCELLED
+} JobState;
+
+/* Copy of one job's state, as returned by job_queue_snapshot. */
+typedef struct {
+    guint id;
+    gchar* name;
+    JobState state;
+    double progress;
+    double elapsed;
+    gint64 order;
+} JobInfo;
+
+typedef struct JobQueue JobQueue;
+typedef struct JobControl JobControl;
+
+/*
+ * Runs one job on the queue's worker thread. A job that spawns a child
+ * process registers its pid so cancel and pause can signal it; native
+ * work should poll job_control_is_cancelled instead.
+ */
+typedef gboolean (*JobRunFunc)(JobControl* control, gpointer job_data, gpointer user_data);
+
+JobQueue* job_queue_new(JobRunFunc run, gpointer user_data, GDestroyNotify data_free);
+void job_queue_free(JobQueue* queue);
+
+guint job_queue_add(JobQueue* queue, const char* name, gpointer job_data);
+void job_queue_cancel(JobQueue* queue, guint id);
+void job_queue_move_to_front(JobQueue* queue, guint id);
+void job_queue_set_paused(JobQueue* queue, gboolean paused);
+gboolean job_queue_is_paused(JobQueue* queue);
+void job_queue_clear_finished(JobQueue* queue);
+void job_queue_counts(JobQueue* queue, int* finished, int* total);
+
+/*
+ * Jobs whose state changed after since_version, plus any job that is
+ * running. Returns the new version to pass next time.
+ */
+guint64 job_queue_snapshot(JobQueue* queue, guint64 since_version, GArray* out);
+void job_info_clear(JobInfo* info);
+
+void job_control_set_pid(JobControl* control, pid_t pid);
+void job_control_set_progress(JobControl* control, double fraction);
+gboolean job_control_is_cancelled(JobControl* control);
+
+const char* job_state_name(JobState state);
+
+#endif
@@ -0,0 +1,275 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slopLoudness.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+struct LoudnessMeter {
+    double rate;
+    double shelf_b[3], shelf_a[3];
+    double hp_b[3], hp_a[3];
+    double shelf_z[2][2];
+    double hp_z[2][2];
+    int subblock_frames;
+    int subblock_fill;
+    double subblock_energy;
+    double subblocks[LOUDNESS_SUBBLOCKS];
+    int subblock_pos;
+    int subblock_count;
+    double hist_energy[LOUDNESS_HIST_BINS];
+    long hist_count[LOUDNESS_HIST_BINS];
+};
+
+static double energy_to_lufs(double energy) {
+    return energy > 0 ? -0.691 + 10.0 * log10(energy) : -INFINITY;
+}
+
+static void loudness_init_filters(LoudnessMeter* meter) {
+    double rate = meter->rate;
+
+    double f0 = 1681.974450955533;
+    double g = 3.999843853973347;
+    double q = 0.7071752369554196;
+    double k = tan(M_PI * f0 / rate);
+    double vh = pow(10.0, g / 20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    meter->shelf_b[0] = (vh + vb * k / q + k * k) / a0;
+    meter->shelf_b[1] = 2.0 * (k * k - vh) / a0;
+    meter->shelf_b[2] = (vh - vb * k / q + k * k) / a0;
+    meter->shelf_a[1] = 2.0 * (k * k - 1.0) / a0;
+    meter->shelf_a[2] = (1.0 - k / q + k * k) / a0;
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = tan(M_PI * f0 / rate);
+    a0 = 1.0 + k / q + k * k;
+    meter->hp_b[0] = 1.0;
+    meter->hp_b[1] = -2.0;
+    meter->hp_b[2] = 1.0;
+    meter->hp_a[1] = 2.0 * (k * k - 1.0) / a0;
+    meter->hp_a[2] = (1.0 - k / q + k * k) / a0;
+}
+
+LoudnessMeter* loudness_new(double rate) {
+    LoudnessMeter* meter = calloc(1, sizeof(LoudnessMeter));
+    if (!meter) {
+        return NULL;
+    }
+    meter->rate = rate;
+    meter->subblock_frames = (int)(rate / 10.0);
+    loudness_init_filters(meter);
+    return meter;
+}
+
+void loudness_reset(LoudnessMeter* meter) {
+    memset(meter->shelf_z, 0, sizeof(meter->shelf_z));
+    memset(meter->hp_z, 0, sizeof(meter->hp_z));
+    meter->subblock_fill = 0;
+    meter->subblock_energy = 0;
+    meter->subblock_pos = 0;
+    meter->subblock_count = 0;
+    memset(meter->hist_energy, 0, sizeof(meter->hist_energy));
+    memset(meter->hist_count, 0, sizeof(meter->hist_count));
+}
+
+static double k_weight(LoudnessMeter* meter, int c, double x) {
+    double* z = meter->shelf_z[c];
+    double y = meter->shelf_b[0] * x + z[0];
+    z[0] = meter->shelf_b[1] * x - meter->shelf_a[1] * y + z[1];
+    z[1] = meter->shelf_b[2] * x - meter->shelf_a[2] * y;
+
+    z = meter->hp_z[c];
+    double out = meter->hp_b[0] * y + z[0];
+    z[0] = meter->hp_b[1] * y - meter->hp_a[1] * out + z[1];
+    z[1] = meter->hp_b[2] * y - meter->hp_a[2] * out;
+    return out;
+}
+
+static double mean_subblocks(const LoudnessMeter* meter, int count) {
+    if (count > meter->subblock_count) {
+        count = meter->subblock_count;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    double sum = 0;
+    for (int i = 1; i <= count; i++) {
+        int idx = (meter->subblock_pos - i + LOUDNESS_SUBBLOCKS) % LOUDNESS_SUBBLOCKS;
+        sum += meter->subblocks[idx];
+    }
+    return sum / count;
+}
+
+static void loudness_finish_subblock(LoudnessMeter* meter) {
+    meter->subblocks[meter->subblock_pos] = meter->subblock_energy / meter->subblock_frames;
+    meter->subblock_pos = (meter->subblock_pos + 1) % LOUDNESS_SUBBLOCKS;
+    if (meter->subblock_count < LOUDNESS_SUBBLOCKS) {
+        meter->subblock_count++;
+    }
+    meter->subblock_energy = 0;
+    meter->subblock_fill = 0;
+
+    if (meter->subblock_count >= 4) {
+        double energy = mean_subblocks(meter, 4);
+        double lufs = energy_to_lufs(energy);
+        if (lufs >= LOUDNESS_HIST_MIN) {
+            int bin = (int)((lufs - LOUDNESS_HIST_MIN) / LOUDNESS_HIST_STEP);
+            if (bin >= LOUDNESS_HIST_BINS) bin = LOUDNESS_HIST_BINS - 1;
+            meter->hist_energy[bin] += energy;
+            meter->hist_count[bin]++;
+        }
+    }
+}
+
+void loudness_feed(LoudnessMeter* meter, const float* interleaved, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        double l = k_weight(meter, 0, interleaved[2 * i]);
+        double r = k_weight(meter, 1, interleaved[2 * i + 1]);
+        meter->subblock_energy += l * l + r * r;
+
+        if (++meter->subblock_fill == meter->subblock_frames) {
+            loudness_finish_subblock(meter);
+        }
+    }
+}
+
+double loudness_momentary(const LoudnessMeter* meter) {
+    return energy_to_lufs(mean_subblocks(meter, 4));
+}
+
+double loudness_short_term(const LoudnessMeter* meter) {
+    return energy_to_lufs(mean_subblocks(meter, 30));
+}
+
+double loudness_integrated(const LoudnessMeter* meter) {
+    double energy = 0;
+    long count = 0;
+    for (int b = 0; b < LOUDNESS_HIST_BINS; b++) {
+        energy += meter->hist_energy[b];
+        count += meter->hist_count[b];
+    }
+    if (count == 0) {
+        return -INFINITY;
+    }
+
+    double gate = energy_to_lufs(energy / count) - 10.0;
+    int first_bin = (int)ceil((gate - LOUDNESS_HIST_MIN) / LOUDNESS_HIST_STEP);
+    if (first_bin < 0) first_bin = 0;
+
+    energy = 0;
+    count = 0;
+    for (int b = first_bin; b < LOUDNESS_HIST_BINS; b++) {
+        energy += meter->hist_energy[b];
+        count += meter->hist_count[b];
+    }
+    return count ? energy_to_lufs(energy / count) : -INFINITY;
+}
+
+void loudness_free(LoudnessMeter* meter) {
+    free(meter);
+}
+
+void truepeak_init(TruePeak* tp) {
+    int length = TRUEPEAK_FACTOR * TRUEPEAK_TAPS;
+    double center = (length - 1) / 2.0;
+
+    for (int k = 0; k < length; k++) {
+        double x = (k - center) / TRUEPEAK_FACTOR;
+        double sinc = x == 0 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+        double window = 0.42 - 0.5 * cos(2 * M_PI * (k + 0.5) / length)
+                      + 0.08 * cos(4 * M_PI * (k + 0.5) / length);
+        tp->coefs[k / TRUEPEAK_FACTOR][k % TRUEPEAK_FACTOR] = (float)(sinc * window);
+    }
+
+    for (int p = 0; p < TRUEPEAK_FACTOR; p++) {
+        double sum = 0;
+        for (int t = 0; t < TRUEPEAK_TAPS; t++) {
+            sum += tp->coefs[t][p];
+        }
+        for (int t = 0; t < TRUEPEAK_TAPS; t++) {
+            tp->coefs[t][p] = (float)(tp->coefs[t][p] / sum);
+        }
+    }
+    truepeak_reset(tp);
+}
+
+void truepeak_reset(TruePeak* tp) {
+    memset(tp->history, 0, sizeof(tp->history));
+    tp->pos = 0;
+}
+
+/* Pushes one frame and returns the largest of its 4 x 2 interpolated samples. */
+static inline float truepeak_frame(TruePeak* tp, float left, float right) {
+    tp->pos = tp->pos == 0 ? TRUEPEAK_TAPS - 1 : tp->pos - 1;
+    float* hl = tp->history[0];
+    float* hr = tp->history[1];
+    hl[tp->pos] = hl[tp->pos + TRUEPEAK_TAPS] = left;
+    hr[tp->pos] = hr[tp->pos + TRUEPEAK_TAPS] = right;
+    const float* xl = hl + tp->pos;
+    const float* xr = hr + tp->pos;
+
+#if defined(__SSE2__)
+    __m128 yl = _mm_setzero_ps(), yr = _mm_setzero_ps();
+    for (int t = 0; t < TRUEPEAK_TAPS; t++) {
+        __m128 coef = _mm_loadu_ps(tp->coefs[t]);
+        yl = _mm_add_ps(yl, _mm_mul_ps(coef, _mm_set1_ps(xl[t])));
+        yr = _mm_add_ps(yr, _mm_mul_ps(coef, _mm_set1_ps(xr[t])));
+    }
+    __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 m = _mm_max_ps(_mm_and_ps(yl, abs_mask), _mm_and_ps(yr, abs_mask));
+    m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(m);
+#elif defined(__ARM_NEON)
+    float32x4_t yl = vdupq_n_f32(0), yr = vdupq_n_f32(0);
+    for (int t = 0; t < TRUEPEAK_TAPS; t++) {
+        float32x4_t coef = vld1q_f32(tp->coefs[t]);
+        yl = vmlaq_n_f32(yl, coef, xl[t]);
+        yr = vmlaq_n_f32(yr, coef, xr[t]);
+    }
+    float32x4_t m = vmaxq_f32(vabsq_f32(yl), vabsq_f32(yr));
+    float32x2_t h = vpmax_f32(vget_low_f32(m), vget_high_f32(m));
+    return vget_lane_f32(vpmax_f32(h, h), 0);
+#else
+    float peak = 0;
+    for (int p = 0; p < TRUEPEAK_FACTOR; p++) {
+        float yl = 0, yr = 0;
+        for (int t = 0; t < TRUEPEAK_TAPS; t++) {
+            yl += tp->coefs[t][p] * xl[t];
+            yr += tp->coefs[t][p] * xr[t];
+        }
+        yl = fabsf(yl);
+        yr = fabsf(yr);
+        if (yl > peak) peak = yl;
+        if (yr > peak) peak = yr;
+    }
+    return peak;
+#endif
+}
+
+float truepeak_process(TruePeak* tp, const float* interleaved, size_t frames) {
+    float peak = 0;
+    for (size_t i = 0; i < frames; i++) {
+        float y = truepeak_frame(tp, interleaved[2 * i], interleaved[2 * i + 1]);
+        if (y > peak) peak = y;
+    }
+    return peak;
+}
+
+void truepeak_frames(TruePeak* tp, const float* interleaved, float* peaks, size_t frames) {
+    for (size_t i = 0; i < frames; i++) {
+        peaks[i] = truepeak_frame(tp, interleaved[2 * i], interleaved[2 * i + 1]);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef SLOP_LOUDNESS_H
+#define SLOP_LOUDNESS_H
+
+#include <stddef.h>
+
+#define LOUDNESS_SUBBLOCKS 30
+#define LOUDNESS_HIST_BINS 751
+#define LOUDNESS_HIST_MIN -70.0
+#define LOUDNESS_HIST_STEP 0.1
+
+#define TRUEPEAK_FACTOR 4
+#define TRUEPEAK_TAPS 12
+
+/*
+ * ITU-R BS.1770 loudness meter for interleaved stereo float. Energy is
+ * accumulated in 100 ms sub-blocks; gating blocks go into a fixed
+ * histogram so integrated loudness runs in constant memory.
+ */
+typedef struct LoudnessMeter LoudnessMeter;
+
+LoudnessMeter* loudness_new(double rate);
+void loudness_reset(LoudnessMeter* meter);
+void loudness_feed(LoudnessMeter* meter, const float* interleaved, size_t frames);
+double loudness_momentary(const LoudnessMeter* meter);
+double loudness_short_term(const LoudnessMeter* meter);
+double loudness_integrated(const LoudnessMeter* meter);
+void loudness_free(LoudnessMeter* meter);
+
+/*
+ * BS.1770 true-peak detector: 4x polyphase interpolation of interleaved
+ * stereo. Coefficients are stored tap-major so the four phases of a tap
+ * are one SIMD vector, and history is stored twice over so every frame
+ * reads it contiguously. An interpolated peak trails its input by about
+ * TRUEPEAK_TAPS / 2 frames.
+ */
+typedef struct {
+    float coefs[TRUEPEAK_TAPS][TRUEPEAK_FACTOR];
+    float history[2][2 * TRUEPEAK_TAPS];
+    int pos;
+} TruePeak;
+
+void truepeak_init(TruePeak* tp);
+void truepeak_reset(TruePeak* tp);
+float truepeak_process(TruePeak* tp, const float* interleaved, size_t frames);
+/* The true peak of each frame, for limiters. */
+void truepeak_frames(TruePeak* tp, const float* interleaved, float* peaks, size_t frames);
+
+#endif
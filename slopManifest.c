@@ -0,0 +1,458 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+
+#include "slopManifest.h"
+
+#define MANIFEST_MAX_COLUMNS 32
+
+typedef enum {
+    FIELD_INPUT,
+    FIELD_OUTPUT,
+    FIELD_VOCAL,
+    FIELD_REVERB,
+    FIELD_BASS,
+    FIELD_WET,
+    FIELD_FORMAT,
+    FIELD_VOLUME,
+    FIELD_REVERB_DELAY,
+    FIELD_REVERB_DECAY,
+    FIELD_UNKNOWN
+} ManifestField;
+
+static const char* const field_names[] = {
+    "input", "output", "vocal", "reverb", "bass", "wet", "format", "volume", "reverb_delay", "reverb_decay"
+};
+
+struct Manifest {
+    FILE* file;
+    int json;
+    SlopSettings base;
+    char* line;
+    size_t line_size;
+    long line_number;
+    /* CSV header, one field per column. */
+    ManifestField columns[MANIFEST_MAX_COLUMNS];
+    int num_columns;
+    /* A first record read while detecting the format, returned next. */
+    int pending;
+};
+
+static ManifestField field_lookup(const char* name) {
+    for (int i = 0; i < FIELD_UNKNOWN; i++) {
+        if (strcmp(name, field_names[i]) == 0) {
+            return (ManifestField)i;
+        }
+    }
+    return FIELD_UNKNOWN;
+}
+
+static char* trim(char* s) {
+    while (*s == ' ' || *s == '\t') {
+        s++;
+    }
+    size_t n = strlen(s);
+    while (n > 0 && strchr(" \t\r\n", s[n - 1])) {
+        s[--n] = '\0';
+    }
+    return s;
+}
+
+/* A line with its end of line removed; 0 at the end of the file. */
+static int read_line(Manifest* m) {
+    ssize_t n = getline(&m->line, &m->line_size, m->file);
+    if (n < 0) {
+        return 0;
+    }
+    m->line_number++;
+    while (n > 0 && (m->line[n - 1] == '\n' || m->line[n - 1] == '\r')) {
+        m->line[--n] = '\0';
+    }
+    return 1;
+}
+
+/* Skips blank lines and # comments. */
+static int read_record(Manifest* m) {
+    while (read_line(m)) {
+        char* s = trim(m->line);
+        if (*s && *s != '#') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int parse_flag(const char* value, int* flag) {
+    if (strcmp(value, "1") == 0 || strcasecmp(value, "true") == 0 || strcasecmp(value, "yes") == 0) {
+        *flag = 1;
+    } else if (strcmp(value, "0") == 0 || strcasecmp(value, "false") == 0 || strcasecmp(value, "no") == 0) {
+        *flag = 0;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_number(const char* value, double* number) {
+    char* end;
+    errno = 0;
+    double v = strtod(value, &end);
+    if (end == value || *trim(end) || errno) {
+        return -1;
+    }
+    *number = v;
+    return 0;
+}
+
+static int apply_field(ManifestEntry* entry, ManifestField field, const char* value, char* message,
+                       size_t message_size) {
+    ChainParams* p = &entry->settings.chain;
+    int ok = 0;
+    if (!*value) {
+        return 0;
+    }
+    switch (field) {
+        case FIELD_INPUT: entry->input = value; break;
+        case FIELD_OUTPUT: entry->output = value; break;
+        case FIELD_VOCAL: ok = parse_flag(value, &p->vocal_mode); break;
+        case FIELD_REVERB: ok = parse_flag(value, &p->reverb); break;
+        case FIELD_BASS: ok = parse_flag(value, &p->bass_boost); break;
+        case FIELD_WET: ok = parse_flag(value, &p->wet); break;
+        case FIELD_FORMAT: ok = slopmaster_parse_format(value, &entry->settings.format); break;
+        case FIELD_VOLUME: ok = parse_number(value, &p->volume_db); break;
+        case FIELD_REVERB_DELAY: ok = parse_number(value, &p->reverb_delay); break;
+        case FIELD_REVERB_DECAY: ok = parse_number(value, &p->reverb_decay); break;
+        default: break;
+    }
+    if (ok != 0) {
+        snprintf(message, message_size, "bad %s value \"%s\"", field_names[field], value);
+        return -1;
+    }
+    return 0;
+}
+
+/* Splits the next CSV field off *s in place; "" inside quotes is one quote. */
+static char* csv_field(char** s, int* error) {
+    char* p = *s;
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    if (*p != '"') {
+        char* comma = strchr(p, ',');
+        *s = comma ? comma + 1 : NULL;
+        if (comma) {
+            *comma = '\0';
+        }
+        return trim(p);
+    }
+
+    char* field = ++p;
+    char* out = p;
+    for (;;) {
+        if (*p == '\0') {
+            *error = 1;
+            *s = NULL;
+            return field;
+        }
+        if (*p == '"') {
+            if (p[1] == '"') {
+                *out++ = '"';
+                p += 2;
+                continue;
+            }
+            p++;
+            break;
+        }
+        *out++ = *p++;
+    }
+    *out = '\0';
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    if (*p == ',') {
+        *s = p + 1;
+    } else {
+        *error |= *p != '\0';
+        *s = NULL;
+    }
+    return field;
+}
+
+static int csv_header(Manifest* m, char* message, size_t message_size) {
+    char* s = m->line;
+    int error = 0;
+    while (s) {
+        char* name = csv_field(&s, &error);
+        if (m->num_columns == MANIFEST_MAX_COLUMNS) {
+            snprintf(message, message_size, "too many columns");
+            return -1;
+        }
+        ManifestField field = field_lookup(name);
+        if (field == FIELD_UNKNOWN) {
+            snprintf(message, message_size, "unknown column \"%s\"", name);
+            return -1;
+        }
+        m->columns[m->num_columns++] = field;
+    }
+    for (int i = 0; i < m->num_columns; i++) {
+        if (m->columns[i] == FIELD_INPUT) {
+            return error ? -1 : 0;
+        }
+    }
+    snprintf(message, message_size, "no input column");
+    return -1;
+}
+
+static int csv_record(Manifest* m, ManifestEntry* entry, char* message, size_t message_size) {
+    char* s = m->line;
+    int error = 0;
+    for (int i = 0; s; i++) {
+        char* value = csv_field(&s, &error);
+        if (i >= m->num_columns) {
+            snprintf(message, message_size, "more fields than columns");
+            return -1;
+        }
+        if (apply_field(entry, m->columns[i], value, message, message_size) != 0) {
+            return -1;
+        }
+    }
+    if (error) {
+        snprintf(message, message_size, "unterminated quote");
+        return -1;
+    }
+    return 0;
+}
+
+static void put_utf8(char** out, unsigned code) {
+    char* o = *out;
+    if (code < 0x80) {
+        *o++ = (char)code;
+    } else if (code < 0x800) {
+        *o++ = (char)(0xC0 | code >> 6);
+        *o++ = (char)(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        *o++ = (char)(0xE0 | code >> 12);
+        *o++ = (char)(0x80 | (code >> 6 & 0x3F));
+        *o++ = (char)(0x80 | (code & 0x3F));
+    } else {
+        *o++ = (char)(0xF0 | code >> 18);
+        *o++ = (char)(0x80 | (code >> 12 & 0x3F));
+        *o++ = (char)(0x80 | (code >> 6 & 0x3F));
+        *o++ = (char)(0x80 | (code & 0x3F));
+    }
+    *out = o;
+}
+
+static int hex4(const char* p, unsigned* code) {
+    *code = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        int d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (d < 0) {
+            return -1;
+        }
+        *code = *code << 4 | d;
+    }
+    return 0;
+}
+
+/* Decodes the JSON string at *s (past its opening quote) in place; NULL if malformed. */
+static char* json_string(char** s) {
+    char* p = *s;
+    char* start = p;
+    char* out = p;
+    while (*p != '"') {
+        if (*p == '\0' || (unsigned char)*p < 0x20) {
+            return NULL;
+        }
+        if (*p != '\\') {
+            *out++ = *p++;
+            continue;
+        }
+        unsigned code, low;
+        switch (*++p) {
+            case '"': case '\\': case '/': *out++ = *p; break;
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u':
+                if (hex4(p + 1, &code) != 0) {
+                    return NULL;
+                }
+                p += 4;
+                if (code >= 0xD800 && code < 0xDC00) {
+                    if (p[1] != '\\' || p[2] != 'u' || hex4(p + 3, &low) != 0 || low < 0xDC00 || low >= 0xE000) {
+                        return NULL;
+                    }
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                } else if (code >= 0xDC00 && code < 0xE000) {
+                    return NULL;
+                }
+                put_utf8(&out, code);
+                break;
+            default: return NULL;
+        }
+        p++;
+    }
+    *out = '\0';
+    *s = p + 1;
+    return start;
+}
+
+static char* skip_space(char* p) {
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    return p;
+}
+
+/* Numbers, true, false and null are taken as their text, left unterminated at *end. */
+static char* json_scalar(char** s, char** end) {
+    char* start = *s;
+    char* p = start;
+    while (*p && !strchr(",} \t", *p)) {
+        p++;
+    }
+    *s = *end = p;
+    return p > start ? start : NULL;
+}
+
+static int json_record(Manifest* m, ManifestEntry* entry, char* message, size_t message_size) {
+    char* p = skip_space(m->line);
+    if (*p++ != '{') {
+        snprintf(message, message_size, "expected a JSON object");
+        return -1;
+    }
+    p = skip_space(p);
+    if (*p == '}') {
+        return 0;
+    }
+    for (;;) {
+        char* key;
+        char* value;
+        char* value_end = NULL;
+        if (*p != '"' || (p++, key = json_string(&p)) == NULL) {
+            snprintf(message, message_size, "expected a key");
+            return -1;
+        }
+        p = skip_space(p);
+        if (*p++ != ':') {
+            snprintf(message, message_size, "expected ':' after \"%s\"", key);
+            return -1;
+        }
+        p = skip_space(p);
+        if (*p == '"') {
+            p++;
+            value = json_string(&p);
+        } else if (*p != '{' && *p != '[') {
+            value = json_scalar(&p, &value_end);
+        } else {
+            value = NULL;
+        }
+        if (!value) {
+            snprintf(message, message_size, "bad value for \"%s\"", key);
+            return -1;
+        }
+        ManifestField field = field_lookup(key);
+        if (field == FIELD_UNKNOWN) {
+            snprintf(message, message_size, "unknown key \"%s\"", key);
+            return -1;
+        }
+        char separator = *(p = skip_space(p));
+        if (separator) {
+            p++;
+        }
+        if (value_end) {
+            *value_end = '\0';
+            if (strcmp(value, "null") == 0) {
+                *value = '\0';
+            }
+        }
+        if (apply_field(entry, field, value, message, message_size) != 0) {
+            return -1;
+        }
+        p = skip_space(p);
+        if (separator == '}') {
+            break;
+        }
+        if (separator != ',') {
+            snprintf(message, message_size, "expected ',' or '}'");
+            return -1;
+        }
+    }
+    if (*p) {
+        snprintf(message, message_size, "text after the object");
+        return -1;
+    }
+    return 0;
+}
+
+Manifest* manifest_open(const char* path, const SlopSettings* base, char* message, size_t message_size) {
+    Manifest* m = calloc(1, sizeof(Manifest));
+    if (!m) {
+        snprintf(message, message_size, "Out of memory");
+        return NULL;
+    }
+    m->base = *base;
+    m->file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!m->file) {
+        snprintf(message, message_size, "Cannot open manifest %s: %s", path, strerror(errno));
+        free(m);
+        return NULL;
+    }
+
+    if (read_record(m)) {
+        m->json = *trim(m->line) == '{';
+        if (m->json) {
+            m->pending = 1;
+        } else if (csv_header(m, message, message_size) != 0) {
+            char reason[256];
+            snprintf(reason, sizeof(reason), "%s", message);
+            snprintf(message, message_size, "Manifest %s line %ld: %s", path, m->line_number, reason);
+            manifest_close(m);
+            return NULL;
+        }
+    }
+    return m;
+}
+
+int manifest_next(Manifest* m, ManifestEntry* entry, char* message, size_t message_size) {
+    if (!m->pending && !read_record(m)) {
+        return 0;
+    }
+    m->pending = 0;
+
+    memset(entry, 0, sizeof(*entry));
+    entry->settings = m->base;
+    entry->line = m->line_number;
+    char reason[256] = "";
+    int result = m->json ? json_record(m, entry, reason, sizeof(reason))
+                         : csv_record(m, entry, reason, sizeof(reason));
+    if (result == 0 && !entry->input) {
+        snprintf(reason, sizeof(reason), "no input");
+        result = -1;
+    }
+    if (result != 0) {
+        snprintf(message, message_size, "Manifest line %ld: %s", m->line_number, reason);
+        return -1;
+    }
+    return 1;
+}
+
+void manifest_close(Manifest* m) {
+    if (!m) {
+        return;
+    }
+    if (m->file && m->file != stdin) {
+        fclose(m->file);
+    }
+    free(m->line);
+    free(m);
+}
@@ -0,0 +1,33 @@
+#ifndef SLOP_MANIFEST_H
+#define SLOP_MANIFEST_H
+
+#include <stddef.h>
+
+#include "slopMaster.h"
+
+/*
+ * A batch described one file per line, read a line at a time so any
+ * length of manifest runs in constant memory. JSONL lines are flat
+ * objects; CSV starts with a header naming its columns, and fields may
+ * be double-quoted. Keys: input (required), output, vocal, reverb,
+ * bass, wet, format, volume, reverb_delay and reverb_decay. A missing
+ * or empty value keeps the base settings; a missing output is named in
+ * the output directory as usual.
+ */
+typedef struct Manifest Manifest;
+
+typedef struct {
+    /* Valid until the next manifest_next. */
+    const char* input;
+    const char* output;
+    SlopSettings settings;
+    long line;
+} ManifestEntry;
+
+/* JSONL when the first record starts with '{'. NULL with message set on failure. */
+Manifest* manifest_open(const char* path, const SlopSettings* base, char* message, size_t message_size);
+/* 1 with entry filled, 0 at the end, -1 for a malformed line, which is skipped. */
+int manifest_next(Manifest* manifest, ManifestEntry* entry, char* message, size_t message_size);
+void manifest_close(Manifest* manifest);
+
+#endif
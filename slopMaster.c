@@ -0,0 +1,2215 @@
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <sndfile.h>
+
+#include "slopMaster.h"
+#include "slopAnalysisDB.h"
+#include "slopConvolve.h"
+#include "slopDSP.h"
+#include "slopDenoise.h"
+#include "slopEncode.h"
+#include "slopLoudness.h"
+#include "slopPlan.h"
+#include "slopPool.h"
+#include "slopResample.h"
+#include "slopStageCache.h"
+#include "slopTrace.h"
+#include "slopUsage.h"
+
+#define SLOPMASTER_NATIVE_CHUNK 16384
+/* Learned noise profiles are 4 KB each, so about 4000 of them. */
+#define SLOPMASTER_NOISE_CACHE_MB 16
+/* Learning a noise profile reads the whole source, like each of the two passes. */
+#define SLOPMASTER_LEARN_SHARE (1.0 / 3.0)
+/* loudnorm resamples to this in its dynamic mode, the only one the graph uses. */
+#define SLOPMASTER_LOUDNORM_RATE 192000
+/* swresample set up like slopResample: 1024 Kaiser-windowed phases, 96% passband. */
+#define SLOPMASTER_RESAMPLE_OPTIONS "filter_type=kaiser:kaiser_beta=12:filter_size=192:cutoff=0.96:phase_shift=10:exact_rational=1"
+
+typedef enum {
+    JOB_KIND_FILE,
+    JOB_KIND_BUFFER,
+    JOB_KIND_STEMS
+} JobKind;
+
+typedef enum {
+    JOB_STATE_QUEUED,
+    JOB_STATE_RUNNING,
+    JOB_STATE_FINISHED
+} JobState;
+
+typedef struct SlopJob {
+    int id;
+    JobKind kind;
+    char* input;
+    char* output;
+    float* samples;
+    size_t frames;
+    double rate;
+    SlopStem* stems;
+    int stem_count;
+    SlopCallbacks callbacks;
+    /* The master's, or a per-file override of its chain and output. */
+    SlopSettings settings;
+    JobState state;
+    SlopStatus status;
+    atomic_int cancelled;
+    pid_t pid;
+    /* When it was queued and, with settings.accounting, what it cost. */
+    struct timespec queued;
+    uint64_t trace_queued;
+    JobUsage usage;
+    SlopMaster* master;
+    struct SlopJob* next;
+} SlopJob;
+
+struct SlopMaster {
+    SlopSettings settings;
+    char* noise_profile;
+    char* reverb_ir;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    pthread_t threads[SLOPMASTER_MAX_THREADS];
+    int num_threads;
+    SlopJob* head;
+    SlopJob* tail;
+    int next_id;
+    int quit;
+    int workers_started;
+    SlopAllocStats alloc_stats;
+    UsageLog usage_log;
+};
+
+struct SlopStream {
+    MasterChain* chain;
+    ConvIR* reverb_ir;
+};
+
+/* Serialises pipe creation and fork so children never inherit another job's pipes. */
+static pthread_mutex_t spawn_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void slopmaster_settings_preset(SlopSettings* settings, SlopPreset preset) {
+    memset(settings, 0, sizeof(*settings));
+    chain_params_default(&settings->chain);
+    settings->chain.vocal_mode = preset == SLOPMASTER_PRESET_VOCAL;
+    settings->format = SLOPMASTER_FORMAT_WAV;
+    settings->engine = SLOPMASTER_ENGINE_FFMPEG;
+    settings->threads = 1;
+    settings->plan = 1;
+}
+
+/* Growable string for building ffmpeg command lines. */
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+    int failed;
+} StrBuf;
+
+/*
+ * State a worker thread keeps across jobs: DSP state reused while the
+ * rate allows, an arena for per-job buffers and a pool of frame blocks.
+ * Once warmed up, a job of the same shape makes no heap allocations;
+ * allocations counts the ones made so far.
+ */
+typedef struct {
+    Denoiser* denoiser;
+    ConvIR* reverb_ir;
+    Resampler* resampler;
+    MasterChain* chain;
+    double chain_rate;
+    LoudnessMeter* meter;
+    double meter_rate;
+    NoiseLearner* learner;
+    Encoder* encoder;
+    struct StemLane* lanes[SLOPMASTER_MAX_STEMS];
+    Arena arena;
+    FramePool frames;
+    StrBuf command;
+    unsigned long allocations;
+} Worker;
+
+static void strbuf_printf(StrBuf* buf, const char* fmt, ...) {
+    if (buf->failed) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf->data ? buf->data + buf->len : NULL, buf->data ? buf->cap - buf->len : 0, fmt, args);
+    va_end(args);
+    if (n < 0) {
+        buf->failed = 1;
+        return;
+    }
+    if (!buf->data || buf->len + n >= buf->cap) {
+        size_t cap = buf->cap ? buf->cap : 4096;
+        while (cap <= buf->len + n) {
+            cap *= 2;
+        }
+        char* data = cap <= SLOPMASTER_COMMAND_SIZE ? realloc(buf->data, cap) : NULL;
+        if (!data) {
+            buf->failed = 1;
+            return;
+        }
+        buf->data = data;
+        buf->cap = cap;
+        va_start(args, fmt);
+        vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, args);
+        va_end(args);
+    }
+    buf->len += n;
+}
+
+/* Single-quotes a path for sh, so quotes and $ in file names are harmless. */
+static void strbuf_quote(StrBuf* buf, const char* text) {
+    strbuf_printf(buf, "'");
+    for (const char* p = text; *p; p++) {
+        if (*p == '\'') {
+            strbuf_printf(buf, "'\\''");
+        } else {
+            strbuf_printf(buf, "%c", *p);
+        }
+    }
+    strbuf_printf(buf, "'");
+}
+
+/*
+ * Appends text as a filter option value inside the single-quoted graph:
+ * escaped for the option parser, again for the graph parser, then for
+ * the shell.
+ */
+static void strbuf_filter_arg(StrBuf* buf, const char* text) {
+    for (const char* p = text; *p; p++) {
+        if (*p == '\\' || *p == '\'') {
+            strbuf_printf(buf, "\\\\\\");
+        } else if (*p == ':') {
+            strbuf_printf(buf, "\\\\");
+        } else if (strchr("[],;", *p)) {
+            strbuf_printf(buf, "\\");
+        }
+        if (*p == '\'') {
+            strbuf_printf(buf, "'\\''");
+        } else {
+            strbuf_printf(buf, "%c", *p);
+        }
+    }
+}
+
+static const char* format_codec(SlopFormat format) {
+    switch (format) {
+        case SLOPMASTER_FORMAT_FLAC: return "flac";
+        case SLOPMASTER_FORMAT_MP3: return "libmp3lame";
+        default: return "pcm_s24le";
+    }
+}
+
+/* With keep_rate, the input's rate when libsndfile can read it. */
+static int command_rate(const SlopSettings* settings, const char* input) {
+    if (!settings->keep_rate) {
+        return SLOPMASTER_OUTPUT_RATE;
+    }
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    SNDFILE* file = sf_open(input, SFM_READ, &info);
+    if (!file) {
+        return SLOPMASTER_OUTPUT_RATE;
+    }
+    sf_close(file);
+    return info.samplerate;
+}
+
+static void build_input(StrBuf* buf, const char* input) {
+    strbuf_printf(buf, "ffmpeg -hwaccel auto -nostats -progress pipe:1 -i ");
+    strbuf_quote(buf, input);
+    strbuf_printf(buf, " -threads 0 -filter_complex '");
+}
+
+/* The graph up to loudnorm, whose output is the stage cache's checkpoint. */
+static void build_prefix(StrBuf* buf, const SlopSettings* settings, int rate) {
+    const ChainParams* p = &settings->chain;
+    /* acrossover needs increasing split frequencies. */
+    double cross_high = p->crossover_high > p->crossover_low ? p->crossover_high : p->crossover_low + 1;
+
+    /* aresample passes audio already at the rate through untouched. */
+    strbuf_printf(buf,
+        "aresample=%d:" SLOPMASTER_RESAMPLE_OPTIONS ",aformat=channel_layouts=stereo,"
+        "highpass=f=20,lowpass=f=20000,", rate);
+    if (!(p->bypass & CHAIN_BYPASS_DENOISE)) {
+        strbuf_printf(buf, "afftdn=nr=10:nf=-25,");
+    }
+    strbuf_printf(buf,
+        "compand=attacks=0.005:decays=0.1:points=-80/-80|-60/-40|-40/-20|-20/-10|-10/-5|0/0:soft-knee=6,"
+        "equalizer=f=60:t=q:w=1.5:g=1,"
+        "equalizer=f=120:t=q:w=1:g=-1,"
+        "equalizer=f=1000:t=q:w=1.5:g=-1,"
+        "equalizer=f=4000:t=q:w=1:g=2,"
+        "equalizer=f=6000:t=q:w=1:g=1.5,"
+        "equalizer=f=8000:t=q:w=1:g=1,"
+        "equalizer=f=12000:t=q:w=1.5:g=1,");
+    if (p->stereo_width != 1.0) {
+        strbuf_printf(buf, "stereotools=mlev=1:slev=%.2f:sbal=0:phase=0:mode=lr>lr,", p->stereo_width);
+    }
+    strbuf_printf(buf,
+        "acrossover=split=%.1f %.1f:order=4th[low][mid][high];"
+        "[low]compand=attacks=0.01:decays=0.1:points=-80/-80|%.1f/%.1f|0/0:soft-knee=6:gain=1[clow];"
+        "[mid]compand=attacks=0.01:decays=0.1:points=-80/-80|%.1f/%.1f|0/0:soft-knee=6:gain=1[cmid];"
+        "[high]compand=attacks=0.01:decays=0.1:points=-80/-80|%.1f/%.1f|0/0:soft-knee=6:gain=1[chigh];"
+        "[clow][cmid][chigh]amerge=inputs=3,pan=stereo|c0=c0+c2+c4|c1=c1+c3+c5,"
+        "loudnorm=I=%.0f:TP=-1:LRA=11",
+        p->crossover_low, cross_high,
+        p->low_threshold, p->low_threshold / p->low_ratio,
+        p->mid_threshold, p->mid_threshold / p->mid_ratio,
+        p->high_threshold, p->high_threshold / p->high_ratio,
+        CHAIN_LOUDNORM_TARGET);
+}
+
+/*
+ * The rest of the graph; its last, unlabelled output is the master. Its
+ * biquads are pinned to double precision: they get loudnorm's doubles
+ * when run whole but the checkpoint's floats from the stage cache, and
+ * would otherwise pick a precision from that.
+ */
+static void build_tail(StrBuf* buf, const SlopSettings* settings, int rate) {
+    const ChainParams* p = &settings->chain;
+
+    strbuf_printf(buf,
+        "alimiter=level_in=0.9:level_out=0.9:limit=0.95:attack=5:release=50,"
+        "volume=0.9,pan=stereo|c0=c0|c1=c1");
+
+    if (p->reverb && settings->reverb_ir) {
+        double predelay = p->reverb_delay < CONV_MAX_PREDELAY_MS ? p->reverb_delay : CONV_MAX_PREDELAY_MS;
+        strbuf_printf(buf, ",asplit[dry][rev];amovie=");
+        strbuf_filter_arg(buf, settings->reverb_ir);
+        strbuf_printf(buf, ",aformat=sample_fmts=fltp:channel_layouts=stereo,"
+                            "aresample=%d:" SLOPMASTER_RESAMPLE_OPTIONS ","
+                            "silenceremove=start_periods=1:start_threshold=%g:detection=peak,"
+                            "atrim=end=%.0f,adelay=%.0f:all=1[ir];"
+                            "[rev][ir]afir=irnorm=2:irlink=1[rev];"
+                            "[dry][rev]amix=inputs=2:weights=1 %.2f:normalize=0",
+                      rate, 0.001, CONV_MAX_IR_SECONDS, predelay, p->reverb_decay);
+    } else if (p->reverb) {
+        strbuf_printf(buf, ",aecho=0.8:0.5:%d|%d|%d:%.1f|%.1f|%.1f",
+                      (int)p->reverb_delay, (int)(p->reverb_delay * 1.5), (int)(p->reverb_delay * 2),
+                      p->reverb_decay, p->reverb_decay * 0.8, p->reverb_decay * 0.6);
+    }
+    if (p->bass_boost) {
+        strbuf_printf(buf, ",equalizer=f=100:t=q:w=1:g=5:precision=f64");
+    }
+    if (p->wet) {
+        strbuf_printf(buf, ",asplit[dry][wet];"
+                            "[wet]aecho=0.8:0.88:60:0.4[wet];"
+                            "[dry][wet]amix=inputs=2:weights=0.7 0.3");
+    }
+    if (p->vocal_mode) {
+        strbuf_printf(buf,
+            ",highpass=f=80:precision=f64,lowpass=f=12000:precision=f64,"
+            "equalizer=f=200:width_type=o:width=1:g=-3:precision=f64,"
+            "equalizer=f=1800:width_type=o:width=1:g=2:precision=f64,"
+            "equalizer=f=4000:width_type=o:width=1:g=3:precision=f64,"
+            "equalizer=f=8000:width_type=o:width=1:g=1.5:precision=f64,"
+            "compand=attacks=0.02:decays=0.1:points=-80/-80|-45/-25|-20/-12|-10/-8|-5/-5|0/-4:soft-knee=6:gain=2,"
+            "acompressor=threshold=-12dB:ratio=3:attack=10:release=100:makeup=2:knee=5,"
+            "volume=1.5");
+    }
+    if (p->volume_db != 0.0) {
+        strbuf_printf(buf, ",volume=%.1fdB", p->volume_db);
+    }
+    /*
+     * alimiter has no true-peak detection, so it needs four times the rate.
+     * loudnorm's output already has that up to 48 kHz. The way down uses
+     * swresample's default filter, like -ar did before the limiter.
+     */
+    if (4 * rate > SLOPMASTER_LOUDNORM_RATE) {
+        strbuf_printf(buf, ",aresample=%d:" SLOPMASTER_RESAMPLE_OPTIONS, 4 * rate);
+    }
+    strbuf_printf(buf, ",alimiter=limit=%.4f:attack=2:release=100:level=0:latency=1,aresample=%d",
+                  db_to_linear(CHAIN_TRUE_PEAK_CEILING), rate);
+}
+
+static void build_output(StrBuf* buf, const SlopSettings* settings, int rate, const char* output) {
+    strbuf_printf(buf, "-ar %d -c:a %s ", rate, format_codec(settings->format));
+    strbuf_quote(buf, output);
+    strbuf_printf(buf, " -y");
+}
+
+/* Appends the command to buf; -1 if it would outgrow SLOPMASTER_COMMAND_SIZE. */
+static int build_command(StrBuf* buf, const SlopSettings* settings, int rate, const char* input, const char* output) {
+    build_input(buf, input);
+    build_prefix(buf, settings, rate);
+    strbuf_printf(buf, ",");
+    build_tail(buf, settings, rate);
+    strbuf_printf(buf, "' ");
+    build_output(buf, settings, rate, output);
+    return buf->failed ? -1 : 0;
+}
+
+/*
+ * Like build_command, but also writes the checkpoint to stage as a float
+ * WAV at the rate rather than loudnorm's, a quarter of the size. RF64
+ * takes over past the 4 GiB a WAV can describe.
+ */
+static int build_stage_write_command(StrBuf* buf, const SlopSettings* settings, int rate, const char* input,
+                                     const char* output, const char* stage) {
+    build_input(buf, input);
+    build_prefix(buf, settings, rate);
+    strbuf_printf(buf, ",asplit[loud][tail];[loud]aresample=%d:" SLOPMASTER_RESAMPLE_OPTIONS "[stage];[tail]",
+                  rate);
+    build_tail(buf, settings, rate);
+    strbuf_printf(buf, "[out]' -map '[stage]' -c:a pcm_f32le -f wav -rf64 auto ");
+    strbuf_quote(buf, stage);
+    strbuf_printf(buf, " -map '[out]' ");
+    build_output(buf, settings, rate, output);
+    return buf->failed ? -1 : 0;
+}
+
+/* Masters from the checkpoint in stage, running only the tail, at loudnorm's rate as in a full render. */
+static int build_stage_read_command(StrBuf* buf, const SlopSettings* settings, int rate, const char* stage,
+                                    const char* output) {
+    build_input(buf, stage);
+    strbuf_printf(buf, "aresample=%d:" SLOPMASTER_RESAMPLE_OPTIONS ",", SLOPMASTER_LOUDNORM_RATE);
+    build_tail(buf, settings, rate);
+    strbuf_printf(buf, "' ");
+    build_output(buf, settings, rate, output);
+    return buf->failed ? -1 : 0;
+}
+
+char* slopmaster_build_command(const SlopSettings* settings, const char* input, const char* output) {
+    StrBuf buf = { NULL, 0, 0, 0 };
+    if (build_command(&buf, settings, command_rate(settings, input), input, output) != 0) {
+        free(buf.data);
+        return NULL;
+    }
+    return buf.data;
+}
+
+/* Identifies what a render did, independent of file names and of its plan. */
+uint64_t slopmaster_settings_hash(const SlopSettings* settings) {
+    uint64_t hash = 14695981039346656037ULL;
+    SlopSettings unplanned = *settings;
+    unplanned.chain.bypass = 0;
+    char* command = slopmaster_build_command(&unplanned, "", "");
+    if (command) {
+        for (const unsigned char* p = (const unsigned char*)command; *p; p++) {
+            hash ^= *p;
+            hash *= 1099511628211ULL;
+        }
+        free(command);
+    }
+    hash ^= (uint64_t)settings->engine;
+    hash *= 1099511628211ULL;
+    hash ^= (uint64_t)settings->keep_rate;
+    hash *= 1099511628211ULL;
+    if (settings->engine == SLOPMASTER_ENGINE_NATIVE && settings->noise_profile) {
+        hash ^= analysisdb_hash(settings->noise_profile);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static double parse_ffmpeg_duration(const char* line) {
+    const char* p = strstr(line, "Duration: ");
+    int hours, minutes;
+    double seconds;
+    if (p && sscanf(p + 10, "%d:%d:%lf", &hours, &minutes, &seconds) == 3) {
+        return hours * 3600.0 + minutes * 60.0 + seconds;
+    }
+    return -1.0;
+}
+
+typedef struct {
+    char data[4096];
+    size_t len;
+} LineBuf;
+
+/* Progress comes from -progress on stdout; stderr carries the log and Duration. */
+static void consume_line(const char* line, int is_progress, double* duration, const SlopRunHooks* hooks) {
+    long long out_time_us;
+    if (is_progress) {
+        if (hooks->progress && *duration > 0 &&
+            (sscanf(line, "out_time_us=%lld", &out_time_us) == 1 ||
+             sscanf(line, "out_time_ms=%lld", &out_time_us) == 1)) {
+            double fraction = out_time_us / 1e6 / *duration;
+            hooks->progress(fraction < 0 ? 0 : fraction > 1 ? 1 : fraction, hooks->user_data);
+        }
+        return;
+    }
+    if (hooks->log) {
+        fprintf(hooks->log, "%s\n", line);
+    }
+    if (*duration <= 0) {
+        *duration = parse_ffmpeg_duration(line);
+    }
+}
+
+static void consume_output(LineBuf* buf, const char* data, size_t len, int is_progress,
+                           double* duration, const SlopRunHooks* hooks) {
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] == '\n' || buf->len == sizeof(buf->data) - 1) {
+            buf->data[buf->len] = '\0';
+            consume_line(buf->data, is_progress, duration, hooks);
+            buf->len = 0;
+            if (data[i] == '\n') {
+                continue;
+            }
+        }
+        buf->data[buf->len++] = data[i];
+    }
+}
+
+#define SHELL_EXEC "exec "
+
+/*
+ * Runs "exec <command>" through sh -c, so the pid handed to set_pid is
+ * ffmpeg itself and can be signalled directly. usage, if given, gains
+ * ffmpeg's CPU time, I/O and peak memory and the duration it reported.
+ */
+static SlopStatus run_shell(const char* shell_command, const SlopRunHooks* hooks, JobUsage* usage) {
+    static const SlopRunHooks no_hooks = { NULL, NULL, NULL, NULL };
+    const char* command = shell_command + strlen(SHELL_EXEC);
+    if (!hooks) {
+        hooks = &no_hooks;
+    }
+    if (hooks->log) {
+        fprintf(hooks->log, "Executing FFmpeg command:\n%s\n", command);
+    }
+
+    int out_pipe[2], err_pipe[2];
+    uint64_t traced = trace_begin();
+    pthread_mutex_lock(&spawn_mutex);
+    if (pipe(out_pipe) != 0) {
+        pthread_mutex_unlock(&spawn_mutex);
+        return SLOPMASTER_FAILED;
+    }
+    if (pipe(err_pipe) != 0) {
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        pthread_mutex_unlock(&spawn_mutex);
+        return SLOPMASTER_FAILED;
+    }
+    fcntl(out_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(err_pipe[0], F_SETFD, FD_CLOEXEC);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(out_pipe[1], STDOUT_FILENO);
+        dup2(err_pipe[1], STDERR_FILENO);
+        close(out_pipe[1]);
+        close(err_pipe[1]);
+        execl("/bin/sh", "sh", "-c", shell_command, (char*)NULL);
+        _exit(127);
+    }
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+    pthread_mutex_unlock(&spawn_mutex);
+
+    if (pid < 0) {
+        close(out_pipe[0]);
+        close(err_pipe[0]);
+        return SLOPMASTER_FAILED;
+    }
+    if (hooks->set_pid) {
+        hooks->set_pid(pid, hooks->user_data);
+    }
+    trace_end("spawn", traced);
+    traced = trace_begin();
+
+    struct pollfd fds[2] = { { out_pipe[0], POLLIN, 0 }, { err_pipe[0], POLLIN, 0 } };
+    LineBuf lines[2];
+    lines[0].len = lines[1].len = 0;
+    int open_fds = 2;
+    double duration = -1.0;
+    char buffer[8192];
+
+    while (open_fds > 0) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            ssize_t n = read(fds[i].fd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                open_fds--;
+                continue;
+            }
+            consume_output(&lines[i], buffer, (size_t)n, i == 0, &duration, hooks);
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        if (fds[i].fd >= 0) {
+            close(fds[i].fd);
+        }
+    }
+
+    /* Forget the pid before reaping it, so a recycled pid is never signalled. */
+    if (hooks->set_pid) {
+        hooks->set_pid(0, hooks->user_data);
+    }
+    int status = 0;
+    usage_wait_child(pid, &status, usage ? &usage->usage : NULL, usage ? &usage->max_rss_kb : NULL);
+    trace_end("ffmpeg", traced);
+    if (usage && duration > 0) {
+        usage->audio_seconds = duration;
+    }
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        return SLOPMASTER_OK;
+    }
+    if (hooks->log) {
+        fprintf(hooks->log, "FFmpeg exited with status %d; command:\n%s\n", status, command);
+    }
+    return WIFSIGNALED(status) ? SLOPMASTER_CANCELLED : SLOPMASTER_FAILED;
+}
+
+SlopStatus slopmaster_run_command(const char* command, const SlopRunHooks* hooks) {
+    size_t shell_len = strlen(SHELL_EXEC) + strlen(command) + 1;
+    char* shell_command = malloc(shell_len);
+    if (!shell_command) {
+        return SLOPMASTER_FAILED;
+    }
+    snprintf(shell_command, shell_len, SHELL_EXEC "%s", command);
+    SlopStatus status = run_shell(shell_command, hooks, NULL);
+    free(shell_command);
+    return status;
+}
+
+/*
+ * Runs a planned file from its checkpoint in the stage cache, or writes
+ * the checkpoint alongside the master. A checkpoint ffmpeg cannot read,
+ * e.g. one another process evicted, is dropped and the file rendered in
+ * full. The command is built in command, failed if it is too long.
+ */
+static SlopStatus run_ffmpeg_staged(StrBuf* command, const SlopSettings* planned, const char* input,
+                                    const char* output, const SlopRunHooks* hooks, JobUsage* usage) {
+    int rate = command_rate(planned, input);
+    char stage[PATH_MAX], temp[PATH_MAX + 64];
+    int staged = 0;
+    SlopStatus status;
+
+    command->len = 0;
+    command->failed = 0;
+    if (planned->stage_cache_mb > 0) {
+        strbuf_printf(command, "ffmpeg:");
+        build_prefix(command, planned, rate);
+        staged = !command->failed && stagecache_path(input, command->data, "wav", stage, sizeof(stage)) == 0;
+        command->len = 0;
+    }
+
+    if (staged && stagecache_touch(stage) == 0) {
+        strbuf_printf(command, SHELL_EXEC);
+        if (build_stage_read_command(command, planned, rate, stage, output) != 0) {
+            return SLOPMASTER_FAILED;
+        }
+        if ((status = run_shell(command->data, hooks, usage)) != SLOPMASTER_FAILED) {
+            return status;
+        }
+        unlink(stage);
+        command->len = 0;
+    }
+
+    strbuf_printf(command, SHELL_EXEC);
+    if (staged) {
+        stagecache_temp_path(stage, temp, sizeof(temp));
+        if (build_stage_write_command(command, planned, rate, input, output, temp) != 0) {
+            return SLOPMASTER_FAILED;
+        }
+        if ((status = run_shell(command->data, hooks, usage)) == SLOPMASTER_OK) {
+            stagecache_commit(temp, stage, (uint64_t)planned->stage_cache_mb << 20);
+        } else {
+            unlink(temp);
+        }
+        return status;
+    }
+    if (build_command(command, planned, rate, input, output) != 0) {
+        return SLOPMASTER_FAILED;
+    }
+    return run_shell(command->data, hooks, usage);
+}
+
+/*
+ * Input for the native engine: a libsndfile handle or a caller's buffer,
+ * read as stereo. With a resampler attached, reads are converted to the
+ * chain's rate. With a denoiser attached, reads return denoised audio
+ * aligned with the input: its latency is skipped and flushed with silence.
+ */
+typedef struct {
+    SNDFILE* file;
+    int channels;
+    double rate;
+    float* scratch;
+    float* samples;
+    size_t frames;
+    size_t pos;
+    Resampler* resampler;
+    Denoiser* denoise;
+    size_t skip;
+    size_t flush;
+} NativeSource;
+
+static size_t source_read_raw(NativeSource* src, float* stereo, size_t frames) {
+    if (!src->file) {
+        size_t n = src->frames - src->pos < frames ? src->frames - src->pos : frames;
+        memcpy(stereo, src->samples + src->pos * DSP_CHANNELS, n * DSP_CHANNELS * sizeof(float));
+        src->pos += n;
+        return n;
+    }
+
+    sf_count_t n = sf_readf_float(src->file, src->scratch, (sf_count_t)frames);
+    if (n <= 0) {
+        return 0;
+    }
+    int ch = src->channels;
+    for (sf_count_t i = 0; i < n; i++) {
+        stereo[2 * i] = src->scratch[i * ch];
+        stereo[2 * i + 1] = src->scratch[i * ch + (ch > 1 ? 1 : 0)];
+    }
+    return (size_t)n;
+}
+
+static size_t source_input(void* user_data, float* stereo, size_t frames) {
+    return source_read_raw(user_data, stereo, frames);
+}
+
+static size_t source_read_rate(NativeSource* src, float* stereo, size_t frames) {
+    if (!src->resampler) {
+        return source_read_raw(src, stereo, frames);
+    }
+    return resampler_read(src->resampler, source_input, src, stereo, frames);
+}
+
+static size_t source_read(NativeSource* src, float* stereo, size_t frames) {
+    if (!src->denoise) {
+        return source_read_rate(src, stereo, frames);
+    }
+
+    size_t done = 0;
+    while (done < frames) {
+        float* out = stereo + done * DSP_CHANNELS;
+        size_t n = source_read_rate(src, out, frames - done);
+        if (n == 0) {
+            n = frames - done < src->flush ? frames - done : src->flush;
+            if (n == 0) {
+                break;
+            }
+            memset(out, 0, n * DSP_CHANNELS * sizeof(float));
+            src->flush -= n;
+        }
+        denoise_process(src->denoise, out, n);
+        if (src->skip > 0) {
+            size_t drop = n < src->skip ? n : src->skip;
+            memmove(out, out + drop * DSP_CHANNELS, (n - drop) * DSP_CHANNELS * sizeof(float));
+            src->skip -= drop;
+            n -= drop;
+        }
+        done += n;
+    }
+    return done;
+}
+
+static int source_rewind(NativeSource* src) {
+    src->pos = 0;
+    if (src->resampler) {
+        resampler_reset(src->resampler);
+    }
+    if (src->denoise) {
+        denoise_reset(src->denoise);
+        src->skip = src->flush = DENOISE_LATENCY;
+    }
+    return src->file ? (sf_seek(src->file, 0, SEEK_SET) == 0 ? 0 : -1) : 0;
+}
+
+/* The file's own profile lives in the cache under its analysis key. */
+static int noise_cache_path(const char* input, char* out, size_t size) {
+    AnalysisKey key;
+    char dir[PATH_MAX], name[128];
+    if (analysisdb_key(input, &key) != 0 || analysisdb_cache_dir("noise", dir, sizeof(dir)) != 0) {
+        return -1;
+    }
+    snprintf(name, sizeof(name), "%llu:%llu:%lld:%lld", (unsigned long long)key.dev,
+             (unsigned long long)key.ino, (long long)key.size, (long long)key.mtime_ns);
+    return snprintf(out, size, "%s/%016llx.noise", dir,
+                    (unsigned long long)analysisdb_hash(name)) < (int)size ? 0 : -1;
+}
+
+/* The album profile if set, else the file's cached one; "" when there is neither. */
+static void stored_profile_path(const SlopSettings* settings, const char* input, char* out, size_t size) {
+    const char* album = settings->noise_profile;
+    if (album && *album) {
+        snprintf(out, size, "%s", album);
+    } else if (!input || noise_cache_path(input, out, size) != 0) {
+        out[0] = '\0';
+    }
+}
+
+static void report_progress(SlopJob* job, double fraction) {
+    if (job->callbacks.progress) {
+        job->callbacks.progress(job->id, fraction, job->callbacks.user_data);
+    }
+}
+
+/*
+ * Loads the album or cached profile, or learns one at the source's own
+ * rate from the quietest frames of the source and saves it, with learner
+ * if given. Learning reports progress up to share, over the source's
+ * frames, and sets *learned. Leaves the source rewound.
+ */
+static int load_noise_profile(SlopJob* job, NativeSource* src, float* block, NoiseLearner* learner,
+                              double frames, double share, NoiseProfile* profile, int* learned) {
+    NoiseLearner* own = NULL;
+    const char* album = job->settings.noise_profile;
+    int cached = !(album && *album);
+    char path[PATH_MAX];
+    size_t n, done = 0;
+
+    *learned = 0;
+    stored_profile_path(&job->settings, job->input, path, sizeof(path));
+    if (path[0] && noise_profile_load(path, profile) == 0) {
+        if (cached) {
+            analysisdb_cache_touch(path);
+        }
+        return 0;
+    }
+
+    if (learner) {
+        noise_learner_reset(learner, src->rate);
+    } else if (!(learner = own = noise_learner_new(src->rate))) {
+        noise_profile_default(profile, src->rate, DENOISE_FLOOR_DB);
+        return 0;
+    }
+    /* A cluster worker is dropped after a silence, so a long learning pass must report too. */
+    *learned = 1;
+    while (!atomic_load(&job->cancelled) && (n = source_read_raw(src, block, SLOPMASTER_NATIVE_CHUNK)) > 0) {
+        noise_learner_feed(learner, block, n);
+        done += n;
+        report_progress(job, share * (done < frames ? done / frames : 1.0));
+    }
+    if (noise_learner_finish(learner, profile) != 0) {
+        noise_profile_default(profile, src->rate, DENOISE_FLOOR_DB);
+    } else if (path[0] && !atomic_load(&job->cancelled) && noise_profile_save(path, profile) == 0 && cached) {
+        /* Every file, and every cluster worker's upload of one, adds a profile. */
+        analysisdb_cache_trim("noise", (uint64_t)SLOPMASTER_NOISE_CACHE_MB << 20, path);
+    }
+    noise_learner_free(own);
+    return source_rewind(src);
+}
+
+static unsigned plan_from_profile(const SlopSettings* settings, const char* input, const NoiseProfile* profile) {
+    PlanAnalysis analysis = { PLAN_HAS_NOISE_FLOOR, plan_noise_floor_db(profile) };
+    char text[PLAN_TEXT_SIZE];
+    unsigned bypass = plan_bypass(&analysis, text, sizeof(text));
+    if (settings->log) {
+        fprintf(settings->log, "Plan for %s: %s\n", input ? input : "buffer", text);
+    }
+    return bypass;
+}
+
+/* The worker's chain, rebuilt only when the rate changes; NULL when out of memory. */
+static MasterChain* worker_chain(Worker* worker, double rate) {
+    if (worker->chain && worker->chain_rate == rate) {
+        chain_reset(worker->chain);
+        return worker->chain;
+    }
+    chain_free(worker->chain);
+    worker->chain = chain_new(rate);
+    worker->chain_rate = rate;
+    worker->allocations++;
+    return worker->chain;
+}
+
+static LoudnessMeter* worker_meter(Worker* worker, double rate) {
+    if (worker->meter && worker->meter_rate == rate) {
+        loudness_reset(worker->meter);
+        return worker->meter;
+    }
+    loudness_free(worker->meter);
+    worker->meter = loudness_new(rate);
+    worker->meter_rate = rate;
+    worker->allocations++;
+    return worker->meter;
+}
+
+static NoiseLearner* worker_learner(Worker* worker, double rate) {
+    if (!worker->learner) {
+        worker->learner = noise_learner_new(rate);
+        worker->allocations++;
+    }
+    return worker->learner;
+}
+
+/* Per-job scratch for reading channels-channel files, from the worker's arena or the heap. */
+static float* source_scratch(Worker* worker, int channels) {
+    size_t size = (size_t)SLOPMASTER_NATIVE_CHUNK * channels * sizeof(float);
+    return worker ? arena_alloc(&worker->arena, size) : malloc(size);
+}
+
+/*
+ * Plans from the stored noise profile only. Decoding a file just to plan
+ * it would cost the FFmpeg engine more than the stages it could skip.
+ */
+static void plan_file(const SlopSettings* settings, const char* input, SlopSettings* planned) {
+    char path[PATH_MAX];
+    NoiseProfile profile;
+
+    *planned = *settings;
+    if (!settings->plan) {
+        return;
+    }
+    stored_profile_path(settings, input, path, sizeof(path));
+    if (path[0] && noise_profile_load(path, &profile) == 0) {
+        planned->chain.bypass = plan_from_profile(settings, input, &profile);
+    } else if (settings->log) {
+        fprintf(settings->log, "Plan for %s: no stored analysis, running every stage\n", input);
+    }
+}
+
+void slopmaster_plan(const SlopSettings* settings, const char* input, SlopSettings* planned) {
+    plan_file(settings, input, planned);
+}
+
+SlopStatus slopmaster_run_file(const SlopSettings* settings, const char* input, const char* output,
+                               const SlopRunHooks* hooks) {
+    SlopSettings planned;
+    StrBuf command = { NULL, 0, 0, 0 };
+    plan_file(settings, input, &planned);
+    SlopStatus status = run_ffmpeg_staged(&command, &planned, input, output, hooks, NULL);
+    if (command.failed && hooks->log) {
+        fprintf(hooks->log, "FFmpeg command too long for %s\n", input);
+    }
+    free(command.data);
+    return status;
+}
+
+/*
+ * The native checkpoint's key: the stages before loudnorm and what feeds
+ * them, down to the version of an album noise profile.
+ */
+static void native_stage_prefix(const SlopSettings* settings, const ChainParams* p, double rate,
+                                char* out, size_t size) {
+    const char* album = settings->noise_profile;
+    AnalysisKey key;
+    memset(&key, 0, sizeof(key));
+    if (album && *album) {
+        analysisdb_key(album, &key);
+    }
+    snprintf(out, size, "native:%.0f:%u:%.17g:%.17g:%.17g:%.17g:%.17g:%.17g:%.17g:%.17g:%.17g:%llu:%llu:%lld:%lld:%s",
+             rate, p->bypass & CHAIN_BYPASS_DENOISE, p->stereo_width,
+             p->low_threshold, p->low_ratio, p->mid_threshold, p->mid_ratio, p->high_threshold, p->high_ratio,
+             p->crossover_low, p->crossover_high, (unsigned long long)key.dev, (unsigned long long)key.ino,
+             (long long)key.size, (long long)key.mtime_ns, album ? album : "");
+}
+
+static FILE* drop_stage(FILE* stage, char* temp) {
+    fclose(stage);
+    unlink(temp);
+    temp[0] = '\0';
+    return NULL;
+}
+
+/*
+ * Two passes: measure the pre-loudnorm prefix to pick the loudnorm gain,
+ * then run the whole chain. Output goes to sink, or back into the buffer.
+ * With the stage cache, pass 1 also writes the prefix's output, and pass 2
+ * runs only the rest of the chain on it; a file whose checkpoint is
+ * cached skips pass 1.
+ */
+static SlopStatus native_master(SlopJob* job, Worker* worker, NativeSource* src, Encoder* sink, double rate,
+                                sf_count_t total_frames, char* message, size_t message_size) {
+    ChainParams params = job->settings.chain;
+    MasterChain* chain = worker_chain(worker, rate);
+    LoudnessMeter* meter = worker_meter(worker, rate);
+    NoiseLearner* learner = worker_learner(worker, src->rate);
+    float* block = frame_pool_get(&worker->frames);
+    SlopStatus status = SLOPMASTER_FAILED;
+    NoiseProfile profile;
+    size_t n, done = 0, skip, flush;
+    double total = total_frames > 0 ? (double)total_frames : 1.0;
+    double loudness, first, start;
+    int cached = 0, learned;
+    char stage_path[PATH_MAX], stage_temp[PATH_MAX + 64] = "";
+    FILE* stage = NULL;
+    StageHeader header;
+
+    if (!worker->denoiser) {
+        worker->denoiser = denoise_new();
+        worker->allocations++;
+    }
+    if (!chain || !meter || !learner || !block || !worker->denoiser) {
+        snprintf(message, message_size, "Out of memory");
+        goto out;
+    }
+
+    uint64_t traced = trace_begin();
+    if (load_noise_profile(job, src, block, learner, total * src->rate / rate, SLOPMASTER_LEARN_SHARE,
+                           &profile, &learned) != 0) {
+        snprintf(message, message_size, "Input is not seekable");
+        goto out;
+    }
+    trace_end("noise profile", traced);
+    /* Pass 1 runs from first to start, pass 2 from start to the end. */
+    first = learned ? SLOPMASTER_LEARN_SHARE : 0.0;
+    start = first + 0.5 * (1.0 - first);
+    traced = trace_begin();
+    if (job->settings.plan) {
+        params.bypass = plan_from_profile(&job->settings, job->input, &profile);
+    }
+    if (!(params.bypass & CHAIN_BYPASS_DENOISE)) {
+        denoise_set_profile(worker->denoiser, &profile, rate, DENOISE_REDUCTION_DB);
+        src->denoise = worker->denoiser;
+        source_rewind(src);
+    }
+
+    chain_set_params(chain, &params);
+    if (params.reverb && job->settings.reverb_ir) {
+        /*
+         * Taken before the old one is dropped, so consecutive jobs hit the
+         * cache; the chain keeps its convolver while the IR is the same.
+         */
+        ConvIR* ir = conv_ir_get(job->settings.reverb_ir, rate);
+        if (ir != worker->reverb_ir) {
+            worker->allocations++;
+        }
+        conv_ir_release(worker->reverb_ir);
+        worker->reverb_ir = ir;
+        if (!ir || chain_set_reverb_ir(chain, ir) != 0) {
+            snprintf(message, message_size, "Cannot load impulse response %s",
+                     job->settings.reverb_ir);
+            goto out;
+        }
+    } else {
+        chain_set_reverb_ir(chain, NULL);
+    }
+
+    skip = flush = (size_t)chain_latency(chain);
+    if (job->settings.stage_cache_mb > 0 && src->file) {
+        char prefix[512];
+        native_stage_prefix(&job->settings, &params, rate, prefix, sizeof(prefix));
+        if (stagecache_path(job->input, prefix, "stage", stage_path, sizeof(stage_path)) == 0) {
+            stage = stagecache_open(stage_path, &header);
+            if (stage && header.sample_rate == (int)rate && header.tail == (int64_t)flush) {
+                stagecache_touch(stage_path);
+                cached = 1;
+                start = first;
+            } else {
+                if (stage) {
+                    fclose(stage);
+                }
+                stagecache_temp_path(stage_path, stage_temp, sizeof(stage_temp));
+                if (!(stage = stagecache_create(stage_temp, (int)rate))) {
+                    stage_temp[0] = '\0';
+                }
+            }
+        }
+    }
+
+    trace_end("setup", traced);
+
+    if (cached) {
+        loudness = header.loudness;
+    } else {
+        for (;;) {
+            traced = trace_begin();
+            n = source_read(src, block, SLOPMASTER_NATIVE_CHUNK);
+            trace_end("decode", traced);
+            if (n == 0) {
+                break;
+            }
+            if (atomic_load(&job->cancelled)) {
+                status = SLOPMASTER_CANCELLED;
+                goto out;
+            }
+            traced = trace_begin();
+            chain_process_pre_loudnorm(chain, block, n);
+            loudness_feed(meter, block, n);
+            trace_end("pre-loudnorm", traced);
+            if (stage) {
+                traced = trace_begin();
+                if (stagecache_write(stage, block, n) != 0) {
+                    stage = drop_stage(stage, stage_temp);
+                }
+                trace_end("checkpoint write", traced);
+            }
+            done += n;
+            report_progress(job, first + (start - first) * done / total);
+        }
+        loudness = loudness_integrated(meter);
+
+        /* The checkpoint ends with the prefix's response to pass 2's flush. */
+        for (size_t left = flush; stage && left > 0; left -= n) {
+            n = left < SLOPMASTER_NATIVE_CHUNK ? left : SLOPMASTER_NATIVE_CHUNK;
+            memset(block, 0, n * DSP_CHANNELS * sizeof(float));
+            chain_process_pre_loudnorm(chain, block, n);
+            if (stagecache_write(stage, block, n) != 0) {
+                stage = drop_stage(stage, stage_temp);
+            }
+        }
+        if (stage && stagecache_finish(stage, (int64_t)done, (int64_t)flush, loudness) != 0) {
+            stage = drop_stage(stage, stage_temp);
+        }
+        if (stage) {
+            /* Pass 2 reads the open file, even if it was evicted at once. */
+            stagecache_commit(stage_temp, stage_path, (uint64_t)job->settings.stage_cache_mb << 20);
+            stage_temp[0] = '\0';
+        }
+    }
+
+    params.loudnorm_gain_db = chain_loudnorm_gain(loudness);
+    chain_reset(chain);
+    chain_set_params(chain, &params);
+    if (!stage && source_rewind(src) != 0) {
+        snprintf(message, message_size, "Input is not seekable");
+        goto out;
+    }
+
+    /* The chain's latency is skipped at the start and flushed with silence at the end. */
+    done = 0;
+    for (;;) {
+        if (atomic_load(&job->cancelled)) {
+            status = SLOPMASTER_CANCELLED;
+            goto out;
+        }
+        traced = trace_begin();
+        if (stage) {
+            n = stagecache_read(stage, block, SLOPMASTER_NATIVE_CHUNK);
+            trace_end("checkpoint read", traced);
+            if (n == 0) {
+                break;
+            }
+            traced = trace_begin();
+            chain_process_post_loudnorm(chain, block, n);
+        } else {
+            n = source_read(src, block, SLOPMASTER_NATIVE_CHUNK);
+            trace_end("decode", traced);
+            if (n == 0) {
+                if (flush == 0) {
+                    break;
+                }
+                n = flush < SLOPMASTER_NATIVE_CHUNK ? flush : SLOPMASTER_NATIVE_CHUNK;
+                memset(block, 0, n * DSP_CHANNELS * sizeof(float));
+                flush -= n;
+            }
+            traced = trace_begin();
+            chain_process(chain, block, n);
+        }
+        trace_end("filter", traced);
+        size_t drop = skip < n ? skip : n;
+        float* out = block + drop * DSP_CHANNELS;
+        skip -= drop;
+        n -= drop;
+        if (sink) {
+            /* Long when the encoder has fallen behind. */
+            traced = trace_begin();
+            if (encoder_write(sink, out, n) != 0) {
+                snprintf(message, message_size, "Write failed on %s", job->output);
+                goto out;
+            }
+            trace_end("encode", traced);
+        } else {
+            memcpy(src->samples + done * DSP_CHANNELS, out, n * DSP_CHANNELS * sizeof(float));
+        }
+        done += n;
+        report_progress(job, start + (1.0 - start) * done / total);
+    }
+    if (stage && ferror(stage)) {
+        snprintf(message, message_size, "Cannot read the checkpoint of %s", job->input);
+        unlink(stage_path);
+        goto out;
+    }
+    status = SLOPMASTER_OK;
+
+out:
+    src->denoise = NULL;
+    if (stage) {
+        fclose(stage);
+    }
+    if (stage_temp[0]) {
+        unlink(stage_temp);
+    }
+    if (block) {
+        frame_pool_put(&worker->frames, block);
+    }
+    return status;
+}
+
+static int sndfile_format(SlopFormat format) {
+    switch (format) {
+#ifdef SF_FORMAT_MPEG
+        case SLOPMASTER_FORMAT_MP3: return SF_FORMAT_MPEG | SF_FORMAT_MPEG_LAYER_III;
+#else
+        case SLOPMASTER_FORMAT_MP3: return 0;
+#endif
+        default: return SF_FORMAT_WAV | SF_FORMAT_PCM_24;
+    }
+}
+
+/*
+ * The rate a file is mastered and written at: its own with keep_rate,
+ * otherwise SLOPMASTER_OUTPUT_RATE through the worker's resampler, which
+ * is kept while consecutive files share a rate.
+ */
+static int native_output_rate(SlopJob* job, Worker* worker, int in_rate) {
+    const SlopSettings* settings = &job->settings;
+    if (settings->keep_rate || in_rate == SLOPMASTER_OUTPUT_RATE) {
+        return in_rate;
+    }
+    if (!worker->resampler || !resampler_matches(worker->resampler, in_rate, SLOPMASTER_OUTPUT_RATE)) {
+        resampler_free(worker->resampler);
+        worker->resampler = resampler_new(in_rate, SLOPMASTER_OUTPUT_RATE);
+        worker->allocations++;
+    }
+    if (!worker->resampler) {
+        if (settings->log) {
+            fprintf(settings->log, "Cannot resample %s from %d Hz; keeping its rate\n", job->input, in_rate);
+        }
+        return in_rate;
+    }
+    resampler_reset(worker->resampler);
+    return SLOPMASTER_OUTPUT_RATE;
+}
+
+/* FLAC is encoded by the worker's encoder, everything else by libsndfile. */
+typedef struct {
+    SNDFILE* file;
+    FILE* flac;
+} NativeOutput;
+
+/* Each worker's encoder gets its share of the cores, rather than a helper per worker each. */
+static int encoder_helpers(int workers) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = workers < 1 ? 1 : workers > SLOPMASTER_MAX_THREADS ? SLOPMASTER_MAX_THREADS : workers;
+    return cores > workers ? (int)(cores / workers) : 1;
+}
+
+static int native_open_output(SlopJob* job, Worker* worker, int rate, NativeOutput* out,
+                              char* message, size_t message_size) {
+    out->file = NULL;
+    out->flac = NULL;
+    if (!worker->encoder) {
+        worker->encoder = encoder_new(DSP_CHANNELS, encoder_helpers(job->settings.threads));
+        worker->allocations++;
+    }
+    if (!worker->encoder) {
+        snprintf(message, message_size, "Out of memory");
+        return -1;
+    }
+
+    if (job->settings.format == SLOPMASTER_FORMAT_FLAC) {
+        out->flac = fopen(job->output, "wb");
+        if (!out->flac || encoder_begin_flac(worker->encoder, out->flac, rate) != 0) {
+            snprintf(message, message_size, "Cannot create %s: %s", job->output, strerror(errno));
+            if (out->flac) {
+                fclose(out->flac);
+                unlink(job->output);
+            }
+            return -1;
+        }
+    } else {
+        SF_INFO out_info;
+        memset(&out_info, 0, sizeof(out_info));
+        out_info.samplerate = rate;
+        out_info.channels = DSP_CHANNELS;
+        out_info.format = sndfile_format(job->settings.format);
+        out->file = out_info.format ? sf_open(job->output, SFM_WRITE, &out_info) : NULL;
+        if (!out->file) {
+            snprintf(message, message_size, out_info.format ? "Cannot create %s: %s"
+                                                             : "MP3 output needs libsndfile 1.1 or newer",
+                     job->output, sf_strerror(NULL));
+            return -1;
+        }
+        encoder_begin_sndfile(worker->encoder, out->file);
+    }
+    return 0;
+}
+
+/* Finishes the file, or removes it if status says the job failed. */
+static SlopStatus native_close_output(SlopJob* job, Worker* worker, NativeOutput* out, SlopStatus status,
+                                      char* message, size_t message_size) {
+    uint64_t traced = trace_begin();
+    int failed = encoder_end(worker->encoder) != 0;
+    failed |= out->flac ? fclose(out->flac) != 0 : sf_close(out->file) != 0;
+    trace_end("finish", traced);
+    if (failed && status == SLOPMASTER_OK) {
+        snprintf(message, message_size, "Cannot finish %s", job->output);
+        status = SLOPMASTER_FAILED;
+    }
+    if (status != SLOPMASTER_OK) {
+        unlink(job->output);
+    }
+    return status;
+}
+
+static SlopStatus run_native_file(SlopJob* job, Worker* worker, char* message, size_t message_size) {
+    SF_INFO in_info;
+    memset(&in_info, 0, sizeof(in_info));
+    uint64_t traced = trace_begin();
+    SNDFILE* in = sf_open(job->input, SFM_READ, &in_info);
+    if (!in) {
+        snprintf(message, message_size, "Cannot open %s: %s", job->input, sf_strerror(NULL));
+        return SLOPMASTER_FAILED;
+    }
+
+    int rate = native_output_rate(job, worker, in_info.samplerate);
+    job->usage.audio_seconds = (double)in_info.frames / in_info.samplerate;
+    NativeOutput out;
+    if (native_open_output(job, worker, rate, &out, message, message_size) != 0) {
+        sf_close(in);
+        return SLOPMASTER_FAILED;
+    }
+    trace_end("open", traced);
+
+    NativeSource src = { in, in_info.channels, in_info.samplerate, NULL, NULL, 0, 0, NULL, NULL, 0, 0 };
+    src.scratch = source_scratch(worker, in_info.channels);
+    src.resampler = rate != in_info.samplerate ? worker->resampler : NULL;
+    sf_count_t frames = (sf_count_t)((double)in_info.frames * rate / in_info.samplerate);
+    SlopStatus status = SLOPMASTER_FAILED;
+    if (src.scratch) {
+        status = native_master(job, worker, &src, worker->encoder, rate, frames, message, message_size);
+    }
+    sf_close(in);
+    return native_close_output(job, worker, &out, status, message, message_size);
+}
+
+/* Hands rounds of SLOPMASTER_NATIVE_CHUNK frames to a stem job's lanes. */
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    int round;
+    int pending;
+    int rewind;
+    int quit;
+} StemBus;
+
+/*
+ * One stem's reader, block and half-chain, run on a thread of its own. A
+ * worker keeps its lanes across stem jobs, as it does its own DSP state.
+ */
+typedef struct StemLane {
+    NativeSource src;
+    MasterChain* chain;
+    double chain_rate;
+    ConvIR* reverb_ir;
+    Resampler* resampler;
+    float* block;
+    size_t frames;
+    int failed;
+    /* What the lane's thread spent on the job. */
+    ResourceUsage usage;
+    int trace_file;
+    StemBus* bus;
+    pthread_t thread;
+} StemLane;
+
+static void stem_lane_free(StemLane* lane) {
+    if (!lane) {
+        return;
+    }
+    chain_free(lane->chain);
+    conv_ir_release(lane->reverb_ir);
+    resampler_free(lane->resampler);
+    free(lane->block);
+    free(lane);
+}
+
+/* Each round reads a whole chunk, padded with silence past the stem's end. */
+static void* stem_lane_thread(void* data) {
+    StemLane* lane = data;
+    StemBus* bus = lane->bus;
+    int round = 0;
+    ResourceUsage start, end;
+    usage_thread(&start);
+    trace_name_thread("stem lane");
+    trace_set_file(lane->trace_file);
+
+    pthread_mutex_lock(&bus->mutex);
+    for (;;) {
+        while (bus->round == round && !bus->quit) {
+            pthread_cond_wait(&bus->start_cond, &bus->mutex);
+        }
+        if (bus->quit) {
+            break;
+        }
+        round = bus->round;
+        int rewind = bus->rewind;
+        pthread_mutex_unlock(&bus->mutex);
+
+        if (rewind) {
+            lane->failed |= source_rewind(&lane->src) != 0;
+            chain_reset(lane->chain);
+        }
+        size_t n, done = 0;
+        uint64_t traced = trace_begin();
+        while (done < SLOPMASTER_NATIVE_CHUNK &&
+               (n = source_read(&lane->src, lane->block + done * DSP_CHANNELS, SLOPMASTER_NATIVE_CHUNK - done)) > 0) {
+            done += n;
+        }
+        memset(lane->block + done * DSP_CHANNELS, 0,
+               (SLOPMASTER_NATIVE_CHUNK - done) * DSP_CHANNELS * sizeof(float));
+        trace_end("decode", traced);
+        traced = trace_begin();
+        chain_process_stem(lane->chain, lane->block, SLOPMASTER_NATIVE_CHUNK);
+        trace_end("filter", traced);
+        lane->frames = done;
+
+        pthread_mutex_lock(&bus->mutex);
+        if (--bus->pending == 0) {
+            pthread_cond_signal(&bus->done_cond);
+        }
+    }
+    pthread_mutex_unlock(&bus->mutex);
+    usage_thread(&end);
+    memset(&lane->usage, 0, sizeof(lane->usage));
+    usage_add_delta(&lane->usage, &end, &start);
+    return NULL;
+}
+
+/* Runs one round on every lane and sums them; 0 once every stem has ended. */
+static size_t stem_round(StemBus* bus, StemLane** lanes, int count, int rewind, float* sum) {
+    uint64_t traced = trace_begin();
+    pthread_mutex_lock(&bus->mutex);
+    bus->rewind = rewind;
+    bus->pending = count;
+    bus->round++;
+    pthread_cond_broadcast(&bus->start_cond);
+    while (bus->pending > 0) {
+        pthread_cond_wait(&bus->done_cond, &bus->mutex);
+    }
+    pthread_mutex_unlock(&bus->mutex);
+    /* Waiting on the slowest lane. */
+    trace_end("stem barrier", traced);
+
+    size_t frames = 0;
+    memcpy(sum, lanes[0]->block, SLOPMASTER_NATIVE_CHUNK * DSP_CHANNELS * sizeof(float));
+    for (int i = 0; i < count; i++) {
+        if (i > 0) {
+            for (size_t j = 0; j < SLOPMASTER_NATIVE_CHUNK * DSP_CHANNELS; j++) {
+                sum[j] += lanes[i]->block[j];
+            }
+        }
+        if (lanes[i]->frames > frames) {
+            frames = lanes[i]->frames;
+        }
+    }
+    return frames;
+}
+
+/* Readies a lane for a stem: its reader, its resampler and its half of the chain. */
+static int stem_lane_open(SlopJob* job, Worker* worker, StemLane* lane, const SlopStem* stem, SNDFILE* file,
+                          const SF_INFO* info, int rate, char* message, size_t message_size) {
+    NativeSource src = { file, info->channels, info->samplerate, NULL, NULL, 0, 0, NULL, NULL, 0, 0 };
+    lane->src = src;
+    lane->src.scratch = source_scratch(worker, info->channels);
+    lane->frames = 0;
+    lane->failed = 0;
+    lane->trace_file = trace_file(stem->input);
+
+    if (rate != info->samplerate) {
+        if (!lane->resampler || !resampler_matches(lane->resampler, info->samplerate, rate)) {
+            resampler_free(lane->resampler);
+            lane->resampler = resampler_new(info->samplerate, rate);
+            worker->allocations++;
+        }
+        if (lane->resampler) {
+            resampler_reset(lane->resampler);
+        }
+        lane->src.resampler = lane->resampler;
+    }
+    if (!lane->block) {
+        lane->block = malloc(SLOPMASTER_NATIVE_CHUNK * DSP_CHANNELS * sizeof(float));
+        worker->allocations++;
+    }
+    if (!lane->chain || lane->chain_rate != rate) {
+        chain_free(lane->chain);
+        lane->chain = chain_new(rate);
+        lane->chain_rate = rate;
+        worker->allocations++;
+    } else {
+        chain_reset(lane->chain);
+    }
+    if (!lane->src.scratch || !lane->block || !lane->chain || (rate != info->samplerate && !lane->resampler)) {
+        snprintf(message, message_size, "Out of memory");
+        return -1;
+    }
+
+    chain_set_params(lane->chain, &stem->chain);
+    if (stem->chain.reverb && job->settings.reverb_ir) {
+        ConvIR* ir = conv_ir_get(job->settings.reverb_ir, rate);
+        if (ir != lane->reverb_ir) {
+            worker->allocations++;
+        }
+        conv_ir_release(lane->reverb_ir);
+        lane->reverb_ir = ir;
+        if (!ir || chain_set_reverb_ir(lane->chain, ir) != 0) {
+            snprintf(message, message_size, "Cannot load impulse response %s", job->settings.reverb_ir);
+            return -1;
+        }
+    } else {
+        chain_set_reverb_ir(lane->chain, NULL);
+    }
+    return 0;
+}
+
+/*
+ * Like native_master, but the source is the float sum of the stems' lanes,
+ * which run their half of the chain in lockstep, one round at a time, so
+ * memory stays a chunk per stem whatever their length. Loudness is
+ * measured on the sum as the bus hears it, effects included.
+ */
+static SlopStatus run_stems(SlopJob* job, Worker* worker, char* message, size_t message_size) {
+    int count = job->stem_count;
+    SNDFILE* files[SLOPMASTER_MAX_STEMS] = { NULL };
+    StemLane* lanes[SLOPMASTER_MAX_STEMS] = { NULL };
+    StemBus bus = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 0, 0 };
+    ChainParams params = job->settings.chain;
+    MasterChain* chain = NULL;
+    LoudnessMeter* meter = NULL;
+    SlopStatus status = SLOPMASTER_FAILED;
+    NativeOutput out = { NULL, NULL };
+    int opened = 0, started = 0, rate = 0;
+    double total = 1.0;
+    float* sum = NULL;
+    size_t n, done = 0, skip, flush;
+
+    for (int i = 0; i < count; i++) {
+        if (!worker->lanes[i]) {
+            worker->lanes[i] = calloc(1, sizeof(StemLane));
+            worker->allocations++;
+        }
+        if (!(lanes[i] = worker->lanes[i])) {
+            snprintf(message, message_size, "Out of memory");
+            goto out;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        SF_INFO info;
+        memset(&info, 0, sizeof(info));
+        if (!(files[i] = sf_open(job->stems[i].input, SFM_READ, &info))) {
+            snprintf(message, message_size, "Cannot open %s: %s", job->stems[i].input, sf_strerror(NULL));
+            goto out;
+        }
+        if (i == 0) {
+            rate = job->settings.keep_rate ? info.samplerate : SLOPMASTER_OUTPUT_RATE;
+        }
+        if (stem_lane_open(job, worker, lanes[i], &job->stems[i], files[i], &info, rate,
+                           message, message_size) != 0) {
+            goto out;
+        }
+        double frames = (double)info.frames * rate / info.samplerate;
+        if (frames > total) {
+            total = frames;
+        }
+    }
+    job->usage.audio_seconds = total / rate;
+
+    chain = worker_chain(worker, rate);
+    meter = worker_meter(worker, rate);
+    sum = frame_pool_get(&worker->frames);
+    if (!chain || !meter || !sum) {
+        snprintf(message, message_size, "Out of memory");
+        goto out;
+    }
+    chain_set_params(chain, &params);
+    if (native_open_output(job, worker, rate, &out, message, message_size) != 0) {
+        goto out;
+    }
+    opened = 1;
+    for (; started < count; started++) {
+        lanes[started]->bus = &bus;
+        if (pthread_create(&lanes[started]->thread, NULL, stem_lane_thread, lanes[started]) != 0) {
+            snprintf(message, message_size, "Cannot start stem threads");
+            goto out;
+        }
+    }
+
+    while ((n = stem_round(&bus, lanes, count, 0, sum)) > 0) {
+        if (atomic_load(&job->cancelled)) {
+            status = SLOPMASTER_CANCELLED;
+            goto out;
+        }
+        uint64_t traced = trace_begin();
+        loudness_feed(meter, sum, n);
+        trace_end("loudness", traced);
+        done += n;
+        report_progress(job, 0.5 * done / total);
+    }
+
+    params.loudnorm_gain_db = chain_loudnorm_gain(loudness_integrated(meter));
+    chain_reset(chain);
+    chain_set_params(chain, &params);
+
+    /* The bus chain's latency is skipped at the start and flushed with silence at the end. */
+    done = 0;
+    skip = flush = (size_t)chain_latency(chain);
+    for (int rewind = 1;; rewind = 0) {
+        if (atomic_load(&job->cancelled)) {
+            status = SLOPMASTER_CANCELLED;
+            goto out;
+        }
+        n = stem_round(&bus, lanes, count, rewind, sum);
+        for (int i = 0; rewind && i < count; i++) {
+            if (lanes[i]->failed) {
+                snprintf(message, message_size, "Input is not seekable: %s", job->stems[i].input);
+                goto out;
+            }
+        }
+        if (n == 0) {
+            if (flush == 0) {
+                break;
+            }
+            n = flush < SLOPMASTER_NATIVE_CHUNK ? flush : SLOPMASTER_NATIVE_CHUNK;
+            memset(sum, 0, n * DSP_CHANNELS * sizeof(float));
+            flush -= n;
+        }
+        uint64_t traced = trace_begin();
+        chain_process_bus(chain, sum, n);
+        trace_end("filter", traced);
+        size_t drop = skip < n ? skip : n;
+        skip -= drop;
+        n -= drop;
+        traced = trace_begin();
+        if (encoder_write(worker->encoder, sum + drop * DSP_CHANNELS, n) != 0) {
+            snprintf(message, message_size, "Write failed on %s", job->output);
+            goto out;
+        }
+        trace_end("encode", traced);
+        done += n;
+        report_progress(job, 0.5 + 0.5 * done / total);
+    }
+    status = SLOPMASTER_OK;
+
+out:
+    pthread_mutex_lock(&bus.mutex);
+    bus.quit = 1;
+    pthread_cond_broadcast(&bus.start_cond);
+    pthread_mutex_unlock(&bus.mutex);
+    for (int i = 0; i < started; i++) {
+        pthread_join(lanes[i]->thread, NULL);
+        usage_add(&job->usage.usage, &lanes[i]->usage);
+    }
+    for (int i = 0; i < count; i++) {
+        if (files[i]) {
+            sf_close(files[i]);
+        }
+    }
+    if (sum) {
+        frame_pool_put(&worker->frames, sum);
+    }
+    if (opened) {
+        status = native_close_output(job, worker, &out, status, message, message_size);
+    }
+    pthread_mutex_destroy(&bus.mutex);
+    pthread_cond_destroy(&bus.start_cond);
+    pthread_cond_destroy(&bus.done_cond);
+    return status;
+}
+
+static void job_set_pid(pid_t pid, void* user_data) {
+    SlopJob* job = user_data;
+    pthread_mutex_lock(&job->master->mutex);
+    job->pid = pid;
+    if (pid > 0 && atomic_load(&job->cancelled)) {
+        kill(pid, SIGTERM);
+    }
+    pthread_mutex_unlock(&job->master->mutex);
+}
+
+static void job_progress(double fraction, void* user_data) {
+    report_progress(user_data, fraction);
+}
+
+/* The command is built in the worker's buffer, which keeps its capacity across jobs. */
+static SlopStatus run_ffmpeg_file(SlopJob* job, Worker* worker, char* message, size_t message_size) {
+    SlopSettings planned;
+    StrBuf* command = &worker->command;
+    size_t cap = command->cap;
+    uint64_t traced = trace_begin();
+    plan_file(&job->settings, job->input, &planned);
+    trace_end("plan", traced);
+    SlopRunHooks hooks = { job_set_pid, job_progress, job->settings.log, job };
+    SlopStatus status = run_ffmpeg_staged(command, &planned, job->input, job->output, &hooks, &job->usage);
+    if (command->cap != cap) {
+        worker->allocations++;
+    }
+
+    if (atomic_load(&job->cancelled)) {
+        status = SLOPMASTER_CANCELLED;
+    } else if (command->failed) {
+        snprintf(message, message_size, "FFmpeg command too long");
+    } else if (status != SLOPMASTER_OK) {
+        snprintf(message, message_size, "FFmpeg failed on %s", job->input);
+    } else {
+        report_progress(job, 1.0);
+    }
+    if (status != SLOPMASTER_OK) {
+        unlink(job->output);
+    }
+    return status;
+}
+
+static SlopStatus run_job(SlopJob* job, Worker* worker, char* message, size_t message_size) {
+    if (atomic_load(&job->cancelled)) {
+        return SLOPMASTER_CANCELLED;
+    }
+    arena_reset(&worker->arena);
+    if (job->kind == JOB_KIND_BUFFER) {
+        job->usage.audio_seconds = job->frames / job->rate;
+        NativeSource src = { NULL, DSP_CHANNELS, job->rate, NULL, job->samples, job->frames, 0, NULL, NULL, 0, 0 };
+        return native_master(job, worker, &src, NULL, job->rate, (sf_count_t)job->frames, message, message_size);
+    }
+    if (job->kind == JOB_KIND_STEMS) {
+        return run_stems(job, worker, message, message_size);
+    }
+    if (job->settings.engine == SLOPMASTER_ENGINE_NATIVE) {
+        return run_native_file(job, worker, message, message_size);
+    }
+    return run_ffmpeg_file(job, worker, message, message_size);
+}
+
+static unsigned long worker_allocations(const Worker* worker) {
+    return worker->allocations + worker->arena.allocations + worker->frames.allocations;
+}
+
+/* A worker's counters as a job starts, taken from them as it ends. */
+typedef struct {
+    struct timespec time;
+    ResourceUsage thread;
+    ResourceUsage encoder;
+} UsageMark;
+
+static void mark_usage(Worker* worker, UsageMark* mark) {
+    clock_gettime(CLOCK_MONOTONIC, &mark->time);
+    usage_thread(&mark->thread);
+    memset(&mark->encoder, 0, sizeof(mark->encoder));
+    if (worker->encoder) {
+        encoder_usage(worker->encoder, &mark->encoder);
+    }
+}
+
+static double seconds_since(const struct timespec* start, const struct timespec* end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Adds the worker thread's and its encoder's share to what the job's
+ * ffmpeg process or stem lanes spent. The native engine runs in-process,
+ * so its peak memory is the process's.
+ */
+static void finish_usage(SlopJob* job, Worker* worker, const UsageMark* start, SlopStatus status) {
+    static const char* names[] = { "ok", "failed", "cancelled" };
+    UsageMark end;
+    mark_usage(worker, &end);
+    JobUsage* usage = &job->usage;
+    int ffmpeg = job->kind == JOB_KIND_FILE && job->settings.engine == SLOPMASTER_ENGINE_FFMPEG;
+    usage->job = job->id;
+    usage->input = job->input;
+    usage->output = job->output;
+    usage->engine = ffmpeg ? "ffmpeg" : "native";
+    usage->status = names[status];
+    usage->queue_seconds = seconds_since(&job->queued, &start->time);
+    usage->wall_seconds = seconds_since(&start->time, &end.time);
+    usage_add_delta(&usage->usage, &end.thread, &start->thread);
+    usage_add_delta(&usage->usage, &end.encoder, &start->encoder);
+    if (!ffmpeg) {
+        usage->max_rss_kb = usage_process_peak_kb();
+    }
+}
+
+static void* worker_thread(void* data) {
+    SlopMaster* master = data;
+    Worker worker;
+    int jobs = 0;
+
+    memset(&worker, 0, sizeof(worker));
+    arena_init(&worker.arena);
+    frame_pool_init(&worker.frames, SLOPMASTER_NATIVE_CHUNK, DSP_CHANNELS);
+
+    char name[32];
+    pthread_mutex_lock(&master->mutex);
+    snprintf(name, sizeof(name), "worker %d", ++master->workers_started);
+    trace_name_thread(name);
+    for (;;) {
+        SlopJob* job = master->head;
+        while (job && job->state != JOB_STATE_QUEUED) {
+            job = job->next;
+        }
+        if (!job) {
+            if (master->quit) {
+                break;
+            }
+            pthread_cond_wait(&master->work_cond, &master->mutex);
+            continue;
+        }
+        job->state = JOB_STATE_RUNNING;
+        pthread_mutex_unlock(&master->mutex);
+        trace_set_file(trace_file(job->input));
+        trace_end_async("queue wait", job->trace_queued, job->id);
+
+        char message[PATH_MAX + 128] = "";
+        unsigned long allocations = worker_allocations(&worker);
+        int accounting = job->settings.accounting != NULL;
+        UsageMark mark;
+        if (accounting) {
+            mark_usage(&worker, &mark);
+        }
+        uint64_t traced = trace_begin();
+        SlopStatus status = run_job(job, &worker, message, sizeof(message));
+        trace_end("job", traced);
+        trace_set_file(0);
+        allocations = worker_allocations(&worker) - allocations;
+        if (accounting) {
+            finish_usage(job, &worker, &mark, status);
+        }
+        if (job->callbacks.done) {
+            job->callbacks.done(job->id, status, status == SLOPMASTER_FAILED ? message : NULL,
+                                job->callbacks.user_data);
+        }
+
+        pthread_mutex_lock(&master->mutex);
+        job->status = status;
+        job->state = JOB_STATE_FINISHED;
+        master->alloc_stats.jobs++;
+        master->alloc_stats.allocations += allocations;
+        if (jobs++ > 0) {
+            master->alloc_stats.steady_allocations += allocations;
+        }
+        if (worker.arena.peak > master->alloc_stats.arena_peak) {
+            master->alloc_stats.arena_peak = worker.arena.peak;
+        }
+        if (accounting) {
+            usage_log_add(&master->usage_log, &job->usage);
+        }
+        pthread_cond_broadcast(&master->done_cond);
+    }
+    pthread_mutex_unlock(&master->mutex);
+    denoise_free(worker.denoiser);
+    conv_ir_release(worker.reverb_ir);
+    resampler_free(worker.resampler);
+    chain_free(worker.chain);
+    loudness_free(worker.meter);
+    noise_learner_free(worker.learner);
+    encoder_free(worker.encoder);
+    for (int i = 0; i < SLOPMASTER_MAX_STEMS; i++) {
+        stem_lane_free(worker.lanes[i]);
+    }
+    arena_free(&worker.arena);
+    frame_pool_free(&worker.frames);
+    free(worker.command.data);
+    return NULL;
+}
+
+SlopMaster* slopmaster_new(const SlopSettings* settings) {
+    SlopMaster* master = calloc(1, sizeof(SlopMaster));
+    if (!master) {
+        return NULL;
+    }
+    if (settings) {
+        master->settings = *settings;
+    } else {
+        slopmaster_settings_preset(&master->settings, SLOPMASTER_PRESET_STANDARD);
+    }
+    if (master->settings.noise_profile) {
+        master->noise_profile = strdup(master->settings.noise_profile);
+        master->settings.noise_profile = master->noise_profile;
+    }
+    if (master->settings.reverb_ir) {
+        master->reverb_ir = strdup(master->settings.reverb_ir);
+        master->settings.reverb_ir = master->reverb_ir;
+    }
+    usage_log_init(&master->usage_log, master->settings.accounting);
+    int threads = master->settings.threads;
+    threads = threads < 1 ? 1 : threads > SLOPMASTER_MAX_THREADS ? SLOPMASTER_MAX_THREADS : threads;
+
+    pthread_mutex_init(&master->mutex, NULL);
+    pthread_cond_init(&master->work_cond, NULL);
+    pthread_cond_init(&master->done_cond, NULL);
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&master->threads[i], NULL, worker_thread, master) != 0) {
+            break;
+        }
+        master->num_threads++;
+    }
+    if (master->num_threads == 0) {
+        slopmaster_free(master);
+        return NULL;
+    }
+    return master;
+}
+
+static void free_job(SlopJob* job) {
+    for (int i = 0; i < job->stem_count; i++) {
+        free((char*)job->stems[i].input);
+    }
+    free(job->stems);
+    free(job->input);
+    free(job->output);
+    free(job);
+}
+
+static void cancel_locked(SlopJob* job) {
+    atomic_store(&job->cancelled, 1);
+    if (job->pid > 0) {
+        kill(job->pid, SIGTERM);
+    }
+}
+
+void slopmaster_free(SlopMaster* master) {
+    if (!master) {
+        return;
+    }
+
+    pthread_mutex_lock(&master->mutex);
+    master->quit = 1;
+    for (SlopJob* job = master->head; job; job = job->next) {
+        cancel_locked(job);
+    }
+    pthread_cond_broadcast(&master->work_cond);
+    pthread_mutex_unlock(&master->mutex);
+
+    for (int i = 0; i < master->num_threads; i++) {
+        pthread_join(master->threads[i], NULL);
+    }
+    while (master->head) {
+        SlopJob* next = master->head->next;
+        free_job(master->head);
+        master->head = next;
+    }
+    pthread_mutex_destroy(&master->mutex);
+    pthread_cond_destroy(&master->work_cond);
+    pthread_cond_destroy(&master->done_cond);
+    usage_log_free(&master->usage_log);
+    free(master->noise_profile);
+    free(master->reverb_ir);
+    free(master);
+}
+
+static int submit(SlopMaster* master, SlopJob* job, const SlopCallbacks* callbacks) {
+    job->master = master;
+    job->state = JOB_STATE_QUEUED;
+    atomic_init(&job->cancelled, 0);
+    clock_gettime(CLOCK_MONOTONIC, &job->queued);
+    job->trace_queued = trace_begin();
+    if (callbacks) {
+        job->callbacks = *callbacks;
+    }
+
+    pthread_mutex_lock(&master->mutex);
+    job->id = ++master->next_id;
+    if (master->tail) {
+        master->tail->next = job;
+    } else {
+        master->head = job;
+    }
+    master->tail = job;
+    pthread_cond_signal(&master->work_cond);
+    pthread_mutex_unlock(&master->mutex);
+    return job->id;
+}
+
+int slopmaster_submit_file(SlopMaster* master, const char* input, const char* output,
+                           const SlopCallbacks* callbacks) {
+    return slopmaster_submit_file_settings(master, input, output, NULL, callbacks);
+}
+
+int slopmaster_submit_file_settings(SlopMaster* master, const char* input, const char* output,
+                                    const SlopSettings* settings, const SlopCallbacks* callbacks) {
+    SlopJob* job = calloc(1, sizeof(SlopJob));
+    if (!job) {
+        return 0;
+    }
+    job->kind = JOB_KIND_FILE;
+    job->settings = master->settings;
+    if (settings) {
+        job->settings.chain = settings->chain;
+        job->settings.format = settings->format;
+        job->settings.plan = settings->plan;
+        job->settings.keep_rate = settings->keep_rate;
+    }
+    job->input = strdup(input);
+    job->output = strdup(output);
+    if (!job->input || !job->output) {
+        free_job(job);
+        return 0;
+    }
+    return submit(master, job, callbacks);
+}
+
+int slopmaster_submit_buffer(SlopMaster* master, float* samples, size_t frames, double rate,
+                             const SlopCallbacks* callbacks) {
+    SlopJob* job = calloc(1, sizeof(SlopJob));
+    if (!job) {
+        return 0;
+    }
+    job->kind = JOB_KIND_BUFFER;
+    job->settings = master->settings;
+    job->samples = samples;
+    job->frames = frames;
+    job->rate = rate;
+    return submit(master, job, callbacks);
+}
+
+int slopmaster_submit_stems(SlopMaster* master, const SlopStem* stems, int count, const char* output,
+                            const SlopSettings* settings, const SlopCallbacks* callbacks) {
+    if (count < 1 || count > SLOPMASTER_MAX_STEMS) {
+        return 0;
+    }
+    SlopJob* job = calloc(1, sizeof(SlopJob));
+    if (!job) {
+        return 0;
+    }
+    job->kind = JOB_KIND_STEMS;
+    job->settings = master->settings;
+    if (settings) {
+        job->settings.chain = settings->chain;
+        job->settings.format = settings->format;
+        job->settings.keep_rate = settings->keep_rate;
+    }
+    job->input = strdup(stems[0].input);
+    job->output = strdup(output);
+    job->stems = calloc((size_t)count, sizeof(SlopStem));
+    if (!job->input || !job->output || !job->stems) {
+        free_job(job);
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        job->stems[i].chain = stems[i].chain;
+        if (!(job->stems[i].input = strdup(stems[i].input))) {
+            free_job(job);
+            return 0;
+        }
+        job->stem_count++;
+    }
+    return submit(master, job, callbacks);
+}
+
+static SlopJob* find_job(SlopMaster* master, int id, SlopJob** prev) {
+    *prev = NULL;
+    for (SlopJob* job = master->head; job; job = job->next) {
+        if (job->id == id) {
+            return job;
+        }
+        *prev = job;
+    }
+    return NULL;
+}
+
+static void unlink_job(SlopMaster* master, SlopJob* job, SlopJob* prev) {
+    if (prev) {
+        prev->next = job->next;
+    } else {
+        master->head = job->next;
+    }
+    if (master->tail == job) {
+        master->tail = prev;
+    }
+    free_job(job);
+}
+
+void slopmaster_cancel(SlopMaster* master, int id) {
+    SlopJob* prev;
+    pthread_mutex_lock(&master->mutex);
+    SlopJob* job = find_job(master, id, &prev);
+    if (job && job->state != JOB_STATE_FINISHED) {
+        cancel_locked(job);
+    }
+    pthread_mutex_unlock(&master->mutex);
+}
+
+SlopStatus slopmaster_wait(SlopMaster* master, int id) {
+    SlopJob* prev;
+    SlopStatus status = SLOPMASTER_FAILED;
+
+    pthread_mutex_lock(&master->mutex);
+    SlopJob* job = find_job(master, id, &prev);
+    while (job && job->state != JOB_STATE_FINISHED) {
+        pthread_cond_wait(&master->done_cond, &master->mutex);
+        job = find_job(master, id, &prev);
+    }
+    if (job) {
+        status = job->status;
+        unlink_job(master, job, prev);
+    }
+    pthread_mutex_unlock(&master->mutex);
+    return status;
+}
+
+void slopmaster_wait_all(SlopMaster* master) {
+    pthread_mutex_lock(&master->mutex);
+    for (;;) {
+        SlopJob* job = master->head;
+        while (job && job->state == JOB_STATE_FINISHED) {
+            job = job->next;
+        }
+        if (!job) {
+            break;
+        }
+        pthread_cond_wait(&master->done_cond, &master->mutex);
+    }
+    while (master->head) {
+        unlink_job(master, master->head, NULL);
+    }
+    pthread_mutex_unlock(&master->mutex);
+}
+
+void slopmaster_throttle(SlopMaster* master, int max_pending) {
+    pthread_mutex_lock(&master->mutex);
+    for (;;) {
+        int pending = 0;
+        SlopJob* prev = NULL;
+        SlopJob* job = master->head;
+        while (job) {
+            SlopJob* next = job->next;
+            if (job->state == JOB_STATE_FINISHED) {
+                unlink_job(master, job, prev);
+            } else {
+                pending++;
+                prev = job;
+            }
+            job = next;
+        }
+        if (pending < max_pending) {
+            break;
+        }
+        pthread_cond_wait(&master->done_cond, &master->mutex);
+    }
+    pthread_mutex_unlock(&master->mutex);
+}
+
+void slopmaster_alloc_stats(SlopMaster* master, SlopAllocStats* stats) {
+    pthread_mutex_lock(&master->mutex);
+    *stats = master->alloc_stats;
+    pthread_mutex_unlock(&master->mutex);
+}
+
+void slopmaster_usage_summary(SlopMaster* master, FILE* out) {
+    pthread_mutex_lock(&master->mutex);
+    usage_log_summary(&master->usage_log, out);
+    pthread_mutex_unlock(&master->mutex);
+}
+
+SlopStream* slopmaster_stream_new(const SlopSettings* settings, double rate) {
+    SlopStream* stream = calloc(1, sizeof(SlopStream));
+    if (!stream) {
+        return NULL;
+    }
+    stream->chain = chain_new(rate);
+    if (!stream->chain) {
+        free(stream);
+        return NULL;
+    }
+    chain_set_params(stream->chain, &settings->chain);
+    if (settings->chain.reverb && settings->reverb_ir) {
+        stream->reverb_ir = conv_ir_get(settings->reverb_ir, rate);
+        if (!stream->reverb_ir || chain_set_reverb_ir(stream->chain, stream->reverb_ir) != 0) {
+            slopmaster_stream_free(stream);
+            return NULL;
+        }
+    }
+    return stream;
+}
+
+void slopmaster_stream_process(SlopStream* stream, float* samples, size_t frames) {
+    chain_process(stream->chain, samples, frames);
+}
+
+int slopmaster_stream_latency(const SlopStream* stream) {
+    return chain_latency(stream->chain);
+}
+
+void slopmaster_stream_free(SlopStream* stream) {
+    if (!stream) {
+        return;
+    }
+    chain_free(stream->chain);
+    conv_ir_release(stream->reverb_ir);
+    free(stream);
+}
+
+int slopmaster_ffmpeg_available(void) {
+    return system("ffmpeg -version > /dev/null 2>&1") == 0;
+}
+
+int slopmaster_is_audio_file(const char* name) {
+    static const char* extensions[] = { ".wav", ".mp3", ".aac", ".ogg", ".flac" };
+    size_t len = strlen(name);
+
+    for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++) {
+        size_t ext_len = strlen(extensions[i]);
+        if (len > ext_len && strcasecmp(name + len - ext_len, extensions[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int slopmaster_is_directory_writable(const char* path) {
+    char test_file[PATH_MAX];
+    snprintf(test_file, sizeof(test_file), "%s/test_write", path);
+    FILE* fp = fopen(test_file, "w");
+    if (fp) {
+        fclose(fp);
+        remove(test_file);
+        return 1;
+    }
+    return 0;
+}
+
+int slopmaster_parse_format(const char* name, SlopFormat* format) {
+    if (strcasecmp(name, "wav") == 0) {
+        *format = SLOPMASTER_FORMAT_WAV;
+    } else if (strcasecmp(name, "flac") == 0) {
+        *format = SLOPMASTER_FORMAT_FLAC;
+    } else if (strcasecmp(name, "mp3") == 0) {
+        *format = SLOPMASTER_FORMAT_MP3;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char* slopmaster_format_extension(SlopFormat format) {
+    switch (format) {
+        case SLOPMASTER_FORMAT_FLAC: return "flac";
+        case SLOPMASTER_FORMAT_MP3: return "mp3";
+        default: return "wav";
+    }
+}
+
+/* "<dir>/<name without extension>Mastered.<ext>"; free() the result. */
+char* slopmaster_output_path(const char* dir, const char* input_name, SlopFormat format) {
+    const char* base = strrchr(input_name, '/');
+    base = base ? base + 1 : input_name;
+    const char* dot = strrchr(base, '.');
+    int stem = dot && dot != base ? (int)(dot - base) : (int)strlen(base);
+    const char* ext = slopmaster_format_extension(format);
+
+    size_t size = strlen(dir) + stem + strlen(ext) + 16;
+    char* path = malloc(size);
+    if (path) {
+        snprintf(path, size, "%s/%.*sMastered.%s", dir, stem, base, ext);
+    }
+    return path;
+}
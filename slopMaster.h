@@ -0,0 +1,213 @@
+#ifndef SLOP_MASTER_H
+#define SLOP_MASTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "slopChain.h"
+
+#define SLOPMASTER_MAX_THREADS 16
+#define SLOPMASTER_COMMAND_SIZE 65536
+#define SLOPMASTER_OUTPUT_RATE 48000
+#define SLOPMASTER_MAX_STEMS 16
+/* A stage cache limit; 48 kHz checkpoints take 1.4 GB an hour, so about three hours. */
+#define SLOPMASTER_STAGE_CACHE_MB 4096
+
+/*
+ * libslopmaster: the mastering engine shared by slopTerminal and slopGUI,
+ * usable in-process by other programs. Every function is thread-safe;
+ * a SlopMaster runs submitted jobs on its own worker threads.
+ */
+
+typedef enum {
+    SLOPMASTER_PRESET_STANDARD,
+    SLOPMASTER_PRESET_VOCAL
+} SlopPreset;
+
+/*
+ * FFMPEG runs the reference filter graph in an ffmpeg child process.
+ * NATIVE runs the native resampler, denoiser and slopChain in-process
+ * through libsndfile, with no subprocess.
+ */
+typedef enum {
+    SLOPMASTER_ENGINE_FFMPEG,
+    SLOPMASTER_ENGINE_NATIVE
+} SlopEngine;
+
+typedef enum {
+    SLOPMASTER_FORMAT_WAV,
+    SLOPMASTER_FORMAT_FLAC,
+    SLOPMASTER_FORMAT_MP3
+} SlopFormat;
+
+typedef struct {
+    ChainParams chain;
+    SlopFormat format;
+    SlopEngine engine;
+    int threads;
+    /* Optional; ffmpeg output and errors are appended here. */
+    FILE* log;
+    /*
+     * Optional, native engine: a noise profile file shared by every job,
+     * e.g. one per album, learned from the first file that finds it
+     * missing. Without it each file's profile is learned once and cached.
+     */
+    const char* noise_profile;
+    /*
+     * Optional: an impulse response file the reverb convolves with instead
+     * of echoing. reverb_delay becomes its pre-delay and reverb_decay its
+     * wet gain.
+     */
+    const char* reverb_ir;
+    /* Analyse each file first and skip stages that would be near no-ops. */
+    int plan;
+    /*
+     * Master and write each file at its own sample rate instead of
+     * SLOPMASTER_OUTPUT_RATE, e.g. to keep 96 kHz sessions high-rate.
+     * Buffer jobs and streams always keep their rate.
+     */
+    int keep_rate;
+    /*
+     * Size limit of the stage cache in MB; 0 turns it off. File renders
+     * checkpoint everything up to loudness normalisation, and a later
+     * render of the file that differs only after it (the volume, reverb,
+     * bass boost, wet or vocal stages, or the format) starts from there.
+     */
+    int stage_cache_mb;
+    /*
+     * Optional: one JSON line per finished job is appended here, with its
+     * queue wait, wall and CPU time, peak memory, bytes read and written,
+     * audio duration and realtime factor (see README).
+     */
+    FILE* accounting;
+} SlopSettings;
+
+typedef enum {
+    SLOPMASTER_OK,
+    SLOPMASTER_FAILED,
+    SLOPMASTER_CANCELLED
+} SlopStatus;
+
+/* Called from worker threads. message is only set for failures. */
+typedef void (*SlopProgressFunc)(int job, double fraction, void* user_data);
+typedef void (*SlopDoneFunc)(int job, SlopStatus status, const char* message, void* user_data);
+
+typedef struct {
+    SlopProgressFunc progress;
+    SlopDoneFunc done;
+    void* user_data;
+} SlopCallbacks;
+
+/*
+ * Heap allocations worker threads made for jobs: arena and frame pool
+ * growth and rebuilt DSP state. A regression shows up as steady-state
+ * allocations, made by jobs after each worker's first.
+ */
+typedef struct {
+    unsigned long jobs;
+    unsigned long allocations;
+    unsigned long steady_allocations;
+    size_t arena_peak;
+} SlopAllocStats;
+
+/* One stem of a stem job and the chain its own stages run with. */
+typedef struct {
+    const char* input;
+    ChainParams chain;
+} SlopStem;
+
+typedef struct SlopMaster SlopMaster;
+typedef struct SlopStream SlopStream;
+
+void slopmaster_settings_preset(SlopSettings* settings, SlopPreset preset);
+
+SlopMaster* slopmaster_new(const SlopSettings* settings);
+void slopmaster_free(SlopMaster* master);
+
+/*
+ * Jobs are numbered from 1 and run in submission order with the settings
+ * the SlopMaster was created with. A buffer job masters interleaved
+ * stereo in place with the native engine; the buffer must stay valid
+ * until the job is done. Returns 0 if the job could not be queued.
+ */
+int slopmaster_submit_file(SlopMaster* master, const char* input, const char* output,
+                           const SlopCallbacks* callbacks);
+int slopmaster_submit_buffer(SlopMaster* master, float* samples, size_t frames, double rate,
+                             const SlopCallbacks* callbacks);
+/*
+ * A file job with its own chain, format, plan and keep_rate; the engine,
+ * log, noise profile and impulse response stay the master's.
+ */
+int slopmaster_submit_file_settings(SlopMaster* master, const char* input, const char* output,
+                                    const SlopSettings* settings, const SlopCallbacks* callbacks);
+/*
+ * Masters up to SLOPMASTER_MAX_STEMS time-aligned stems into one file
+ * with the native engine, whatever the master's engine. Each stem is
+ * read and run through its half of the chain (see chain_process_stem)
+ * on a thread of its own, in lockstep with the others, and the float sum
+ * runs the bus half of settings' chain (or the master's) once. Stems are
+ * not denoised or planned; shorter stems are padded with silence.
+ */
+int slopmaster_submit_stems(SlopMaster* master, const SlopStem* stems, int count, const char* output,
+                            const SlopSettings* settings, const SlopCallbacks* callbacks);
+void slopmaster_cancel(SlopMaster* master, int job);
+
+/* Waiting on a job releases it; job numbers are not reused. */
+SlopStatus slopmaster_wait(SlopMaster* master, int job);
+void slopmaster_wait_all(SlopMaster* master);
+/*
+ * Blocks until fewer than max_pending jobs are queued or running,
+ * releasing finished jobs as wait_all does, so a caller streaming
+ * submissions keeps the queue and its memory bounded.
+ */
+void slopmaster_throttle(SlopMaster* master, int max_pending);
+void slopmaster_alloc_stats(SlopMaster* master, SlopAllocStats* stats);
+/*
+ * With settings.accounting set: p50/p95/p99 of the jobs' wall time,
+ * queue wait, CPU time and peak memory, and the slowest jobs, so far.
+ */
+void slopmaster_usage_summary(SlopMaster* master, FILE* out);
+
+/*
+ * Real-time chain for blocks of interleaved stereo. A stream cannot see
+ * ahead, so loudness normalisation uses the fixed chain.loudnorm_gain_db.
+ * Its output lags its input by a fixed latency in frames.
+ */
+SlopStream* slopmaster_stream_new(const SlopSettings* settings, double rate);
+void slopmaster_stream_process(SlopStream* stream, float* samples, size_t frames);
+int slopmaster_stream_latency(const SlopStream* stream);
+void slopmaster_stream_free(SlopStream* stream);
+
+/* Lets a caller that manages its own processes run the ffmpeg engine. */
+typedef struct {
+    void (*set_pid)(pid_t pid, void* user_data);
+    void (*progress)(double fraction, void* user_data);
+    FILE* log;
+    void* user_data;
+} SlopRunHooks;
+
+/*
+ * Copies settings with the stages input's stored noise profile shows to
+ * be near no-ops bypassed, and logs the plan. Never decodes input: the
+ * profile is the album one or the one a native render cached, and
+ * without either nothing is bypassed.
+ */
+void slopmaster_plan(const SlopSettings* settings, const char* input, SlopSettings* planned);
+
+char* slopmaster_build_command(const SlopSettings* settings, const char* input, const char* output);
+uint64_t slopmaster_settings_hash(const SlopSettings* settings);
+SlopStatus slopmaster_run_command(const char* command, const SlopRunHooks* hooks);
+/* Plans, builds and runs a file's ffmpeg command, through the stage cache if enabled. */
+SlopStatus slopmaster_run_file(const SlopSettings* settings, const char* input, const char* output,
+                               const SlopRunHooks* hooks);
+
+int slopmaster_ffmpeg_available(void);
+int slopmaster_is_audio_file(const char* name);
+int slopmaster_is_directory_writable(const char* path);
+int slopmaster_parse_format(const char* name, SlopFormat* format);
+const char* slopmaster_format_extension(SlopFormat format);
+char* slopmaster_output_path(const char* dir, const char* input_name, SlopFormat format);
+
+#endif
@@ -0,0 +1,193 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "slopMeterView.h"
+
+struct MeterView {
+    GtkWidget* area;
+    Meters* meters;
+    MeterReadings readings;
+    guint tick_id;
+};
+
+static gboolean meterview_draw(GtkWidget* widget, cairo_t* cr, gpointer data);
+
+MeterView* meterview_new(Meters* meters) {
+    MeterView* view = g_new0(MeterView, 1);
+    view->meters = meters;
+    if (meters) {
+        meters_read(meters, &view->readings);
+    }
+
+    view->area = gtk_drawing_area_new();
+    g_object_ref_sink(view->area);
+    g_signal_connect(view->area, "draw", G_CALLBACK(meterview_draw), view);
+    return view;
+}
+
+void meterview_free(MeterView* view) {
+    if (!view) {
+        return;
+    }
+    meterview_set_active(view, FALSE);
+    g_object_unref(view->area);
+    g_free(view);
+}
+
+GtkWidget* meterview_widget(MeterView* view) {
+    return view->area;
+}
+
+static gboolean meterview_tick(GtkWidget* widget, GdkFrameClock* frame_clock, gpointer data) {
+    MeterView* view = (MeterView*)data;
+    unsigned long previous = view->readings.generation;
+
+    meters_read(view->meters, &view->readings);
+    if (view->readings.generation != previous) {
+        gtk_widget_queue_draw(widget);
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+void meterview_set_active(MeterView* view, gboolean active) {
+    if (active && view->tick_id == 0 && view->meters) {
+        view->tick_id = gtk_widget_add_tick_callback(view->area, meterview_tick, view, NULL);
+    } else if (!active && view->tick_id != 0) {
+        gtk_widget_remove_tick_callback(view->area, view->tick_id);
+        view->tick_id = 0;
+        meters_read(view->meters, &view->readings);
+        gtk_widget_queue_draw(view->area);
+    }
+}
+
+static double meterview_db_to_y(double db, double height) {
+    double t = (db + METERVIEW_RANGE_DB) / METERVIEW_RANGE_DB;
+    if (t < 0) t = 0;
+    if (t > 1) t = 1;
+    return height * (1.0 - t);
+}
+
+static void meterview_draw_spectrum(MeterView* view, cairo_t* cr, double width, double height) {
+    const MeterReadings* r = &view->readings;
+    double band_width = width / METERS_BANDS;
+
+    cairo_set_source_rgba(cr, 1.0, 1.0, 1.0, 0.08);
+    cairo_set_line_width(cr, 1);
+    for (int db = -80; db < 0; db += 20) {
+        double y = floor(meterview_db_to_y(db, height)) + 0.5;
+        cairo_move_to(cr, 0, y);
+        cairo_line_to(cr, width, y);
+    }
+    cairo_stroke(cr);
+
+    cairo_set_source_rgb(cr, 0.2, 0.7, 0.9);
+    for (int b = 0; b < METERS_BANDS; b++) {
+        double y = meterview_db_to_y(r->spectrum_db[b], height);
+        cairo_rectangle(cr, b * band_width, y, fmax(band_width - 1, 1), height - y);
+    }
+    cairo_fill(cr);
+
+    cairo_set_source_rgb(cr, 0.9, 0.9, 0.9);
+    for (int b = 0; b < METERS_BANDS; b++) {
+        if (r->peak_hold_db[b] <= METERS_FLOOR_DB) {
+            continue;
+        }
+        double y = floor(meterview_db_to_y(r->peak_hold_db[b], height)) + 0.5;
+        cairo_move_to(cr, b * band_width, y);
+        cairo_line_to(cr, (b + 1) * band_width - 1, y);
+    }
+    cairo_stroke(cr);
+
+    cairo_set_source_rgba(cr, 1.0, 1.0, 1.0, 0.5);
+    cairo_set_font_size(cr, 9);
+    static const double labels[] = { 100, 1000, 10000 };
+    for (size_t i = 0; i < sizeof(labels) / sizeof(labels[0]); i++) {
+        for (int b = 0; b < METERS_BANDS; b++) {
+            if (meters_band_frequency(view->meters, b) >= labels[i]) {
+                char text[16];
+                snprintf(text, sizeof(text), labels[i] >= 1000 ? "%.0fk" : "%.0f",
+                         labels[i] >= 1000 ? labels[i] / 1000 : labels[i]);
+                cairo_move_to(cr, b * band_width + 2, height - 3);
+                cairo_show_text(cr, text);
+                break;
+            }
+        }
+    }
+}
+
+static void meterview_format_db(char* text, size_t size, const char* label, double value, const char* unit) {
+    if (isfinite(value)) {
+        snprintf(text, size, "%-4s %6.1f %s", label, value, unit);
+    } else {
+        snprintf(text, size, "%-4s   -inf %s", label, unit);
+    }
+}
+
+static void meterview_draw_readouts(MeterView* view, cairo_t* cr, double x, double width, double height) {
+    const MeterReadings* r = &view->readings;
+    char text[64];
+
+    cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, 11);
+    cairo_set_source_rgb(cr, 0.9, 0.9, 0.9);
+
+    const struct { const char* label; double value; const char* unit; } rows[] = {
+        { "M", r->momentary, "LUFS" },
+        { "S", r->short_term, "LUFS" },
+        { "I", r->integrated, "LUFS" },
+        { "TP", r->true_peak_db, "dBTP" },
+        { "max", r->true_peak_max_db, "dBTP" },
+    };
+    double y = 14;
+    for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); i++) {
+        meterview_format_db(text, sizeof(text), rows[i].label, rows[i].value, rows[i].unit);
+        if (i >= 3 && rows[i].value > 0) {
+            cairo_set_source_rgb(cr, 1.0, 0.35, 0.3);
+        }
+        cairo_move_to(cr, x + 6, y);
+        cairo_show_text(cr, text);
+        cairo_set_source_rgb(cr, 0.9, 0.9, 0.9);
+        y += 16;
+    }
+
+    /* Correlation bar: -1 on the left, +1 on the right. */
+    double bar_x = x + 6, bar_w = width - 12;
+    double bar_y = fmin(y + 4, height - 14), bar_h = 8;
+    cairo_set_source_rgba(cr, 1.0, 1.0, 1.0, 0.15);
+    cairo_rectangle(cr, bar_x, bar_y, bar_w, bar_h);
+    cairo_fill(cr);
+
+    double center = bar_x + bar_w / 2;
+    double pos = center + r->correlation * bar_w / 2;
+    if (r->correlation < 0) {
+        cairo_set_source_rgb(cr, 1.0, 0.35, 0.3);
+    } else {
+        cairo_set_source_rgb(cr, 0.3, 0.85, 0.4);
+    }
+    cairo_rectangle(cr, fmin(center, pos), bar_y, fabs(pos - center), bar_h);
+    cairo_fill(cr);
+
+    cairo_set_source_rgb(cr, 0.9, 0.9, 0.9);
+    cairo_set_font_size(cr, 9);
+    snprintf(text, sizeof(text), "corr %+.2f", r->correlation);
+    cairo_move_to(cr, bar_x, bar_y + bar_h + 10);
+    cairo_show_text(cr, text);
+}
+
+static gboolean meterview_draw(GtkWidget* widget, cairo_t* cr, gpointer data) {
+    MeterView* view = (MeterView*)data;
+    double width = gtk_widget_get_allocated_width(widget);
+    double height = gtk_widget_get_allocated_height(widget);
+    double spectrum_width = fmax(width - METERVIEW_READOUT_WIDTH, 0);
+
+    cairo_set_source_rgb(cr, 0.1, 0.1, 0.1);
+    cairo_paint(cr);
+
+    if (!view->meters) {
+        return FALSE;
+    }
+
+    meterview_draw_spectrum(view, cr, spectrum_width, height);
+    meterview_draw_readouts(view, cr, spectrum_width, width - spectrum_width, height);
+    return FALSE;
+}
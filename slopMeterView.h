@@ -0,0 +1,23 @@
+#ifndef SLOP_METER_VIEW_H
+#define SLOP_METER_VIEW_H
+
+#include <gtk/gtk.h>
+
+#include "slopMeters.h"
+
+#define METERVIEW_READOUT_WIDTH 170
+#define METERVIEW_RANGE_DB 90.0
+
+/*
+ * Spectrum, loudness, true-peak and correlation display for a Meters
+ * instance. While active it polls the meters from the widget's frame
+ * clock and redraws only when a new snapshot has been published.
+ */
+typedef struct MeterView MeterView;
+
+MeterView* meterview_new(Meters* meters);
+void meterview_free(MeterView* view);
+GtkWidget* meterview_widget(MeterView* view);
+void meterview_set_active(MeterView* view, gboolean active);
+
+#endif
@@ -0,0 +1,375 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "slopMeters.h"
+#include "slopFFT.h"
+#include "slopLoudness.h"
+
+#define METERS_MIN_FREQ 20.0
+#define METERS_MAX_FREQ 20000.0
+#define METERS_SPECTRUM_FALL_DB 30.0
+#define METERS_PEAK_HOLD_SECONDS 1.5
+#define METERS_PEAK_FALL_DB 15.0
+#define METERS_TRUE_PEAK_HOLD_SECONDS 1.0
+#define METERS_TRUE_PEAK_FALL_DB 20.0
+#define METERS_CORRELATION_SECONDS 0.3
+#define METERS_WAIT_MS 50
+
+struct Meters {
+    double rate;
+    double hop_seconds;
+
+    float ring[METERS_RING_FRAMES * 2];
+    atomic_size_t write_pos;
+    size_t read_pos;
+    atomic_int reset_requested;
+    atomic_int running;
+    pthread_t thread;
+    pthread_mutex_t wake_mutex;
+    pthread_cond_t wake_cond;
+
+    FFT* fft;
+    float window[METERS_FFT_SIZE];
+    float history[METERS_FFT_SIZE];
+    float frame[METERS_FFT_SIZE];
+    float re[METERS_FFT_SIZE / 2 + 1];
+    float im[METERS_FFT_SIZE / 2 + 1];
+    float hop[METERS_HOP_FRAMES * 2];
+    int band_first[METERS_BANDS];
+    int band_last[METERS_BANDS];
+    double band_center[METERS_BANDS];
+    double spectrum_offset_db;
+    double peak_hold_timer[METERS_BANDS];
+
+    LoudnessMeter* loudness;
+    TruePeak true_peak;
+    double true_peak_hold_timer;
+    double corr_decay;
+    double corr_lr, corr_ll, corr_rr;
+
+    MeterReadings work;
+    pthread_mutex_t readings_mutex;
+    MeterReadings published;
+};
+
+static void* meters_thread(void* data);
+
+static void meters_init_bands(Meters* meters) {
+    double top = fmin(METERS_MAX_FREQ, meters->rate / 2);
+    double bin_hz = meters->rate / METERS_FFT_SIZE;
+    int max_bin = METERS_FFT_SIZE / 2;
+
+    for (int b = 0; b < METERS_BANDS; b++) {
+        double lo = METERS_MIN_FREQ * pow(top / METERS_MIN_FREQ, (double)b / METERS_BANDS);
+        double hi = METERS_MIN_FREQ * pow(top / METERS_MIN_FREQ, (double)(b + 1) / METERS_BANDS);
+        int first = (int)floor(lo / bin_hz + 0.5);
+        int last = (int)floor(hi / bin_hz + 0.5) - 1;
+        if (first > max_bin) first = max_bin;
+        if (last < first) last = first;
+        if (last > max_bin) last = max_bin;
+        meters->band_first[b] = first;
+        meters->band_last[b] = last;
+        meters->band_center[b] = sqrt(lo * hi);
+    }
+}
+
+static void meters_clear_readings(MeterReadings* r) {
+    for (int b = 0; b < METERS_BANDS; b++) {
+        r->spectrum_db[b] = (float)METERS_FLOOR_DB;
+        r->peak_hold_db[b] = (float)METERS_FLOOR_DB;
+    }
+    r->momentary = -INFINITY;
+    r->short_term = -INFINITY;
+    r->integrated = -INFINITY;
+    r->true_peak_db = -INFINITY;
+    r->true_peak_max_db = -INFINITY;
+    r->correlation = 0;
+}
+
+Meters* meters_new(double rate) {
+    Meters* meters = calloc(1, sizeof(Meters));
+    if (!meters) {
+        return NULL;
+    }
+    meters->rate = rate;
+    meters->hop_seconds = METERS_HOP_FRAMES / rate;
+    meters->corr_decay = exp(-meters->hop_seconds / METERS_CORRELATION_SECONDS);
+    meters->spectrum_offset_db = -20.0 * log10(METERS_FFT_SIZE / 4.0);
+
+    meters->fft = fft_new(METERS_FFT_SIZE);
+    meters->loudness = loudness_new(rate);
+    if (!meters->fft || !meters->loudness) {
+        fft_free(meters->fft);
+        loudness_free(meters->loudness);
+        free(meters);
+        return NULL;
+    }
+    fft_window_hann(meters->window, METERS_FFT_SIZE);
+    meters_init_bands(meters);
+    truepeak_init(&meters->true_peak);
+    meters_clear_readings(&meters->work);
+    meters->published = meters->work;
+
+    pthread_mutex_init(&meters->wake_mutex, NULL);
+    pthread_cond_init(&meters->wake_cond, NULL);
+    pthread_mutex_init(&meters->readings_mutex, NULL);
+    atomic_init(&meters->write_pos, 0);
+    atomic_init(&meters->reset_requested, 0);
+    atomic_init(&meters->running, 1);
+
+    if (pthread_create(&meters->thread, NULL, meters_thread, meters) != 0) {
+        pthread_mutex_destroy(&meters->wake_mutex);
+        pthread_cond_destroy(&meters->wake_cond);
+        pthread_mutex_destroy(&meters->readings_mutex);
+        fft_free(meters->fft);
+        loudness_free(meters->loudness);
+        free(meters);
+        return NULL;
+    }
+    return meters;
+}
+
+void meters_free(Meters* meters) {
+    if (!meters) {
+        return;
+    }
+    atomic_store(&meters->running, 0);
+    pthread_mutex_lock(&meters->wake_mutex);
+    pthread_cond_signal(&meters->wake_cond);
+    pthread_mutex_unlock(&meters->wake_mutex);
+    pthread_join(meters->thread, NULL);
+
+    pthread_mutex_destroy(&meters->wake_mutex);
+    pthread_cond_destroy(&meters->wake_cond);
+    pthread_mutex_destroy(&meters->readings_mutex);
+    fft_free(meters->fft);
+    loudness_free(meters->loudness);
+    free(meters);
+}
+
+void meters_push(Meters* meters, const float* interleaved, size_t frames) {
+    if (frames > METERS_RING_FRAMES) {
+        interleaved += (frames - METERS_RING_FRAMES) * 2;
+        frames = METERS_RING_FRAMES;
+    }
+
+    size_t write = atomic_load_explicit(&meters->write_pos, memory_order_relaxed);
+    size_t offset = write % METERS_RING_FRAMES;
+    size_t first = frames < METERS_RING_FRAMES - offset ? frames : METERS_RING_FRAMES - offset;
+    memcpy(meters->ring + offset * 2, interleaved, first * 2 * sizeof(float));
+    memcpy(meters->ring, interleaved + first * 2, (frames - first) * 2 * sizeof(float));
+    atomic_store_explicit(&meters->write_pos, write + frames, memory_order_release);
+
+    /* Wake the worker once per hop, but never wait on it from here. */
+    if (write / METERS_HOP_FRAMES != (write + frames) / METERS_HOP_FRAMES &&
+        pthread_mutex_trylock(&meters->wake_mutex) == 0) {
+        pthread_cond_signal(&meters->wake_cond);
+        pthread_mutex_unlock(&meters->wake_mutex);
+    }
+}
+
+void meters_reset(Meters* meters) {
+    atomic_store(&meters->reset_requested, 1);
+}
+
+void meters_read(Meters* meters, MeterReadings* out) {
+    pthread_mutex_lock(&meters->readings_mutex);
+    *out = meters->published;
+    pthread_mutex_unlock(&meters->readings_mutex);
+}
+
+double meters_band_frequency(const Meters* meters, int band) {
+    return meters->band_center[band];
+}
+
+/* Sums of L*R, L*L and R*R over one hop, for the correlation meter. */
+static void meters_block_stats(const float* in, size_t frames, double* lr, double* ll, double* rr) {
+    size_t total = frames * 2;
+    size_t i = 0;
+    float sum_lr = 0, sum_ll = 0, sum_rr = 0;
+
+#if defined(__SSE2__)
+    __m128 vsq = _mm_setzero_ps(), vcross = _mm_setzero_ps();
+    for (; i + 4 <= total; i += 4) {
+        __m128 a = _mm_loadu_ps(in + i);
+        __m128 swapped = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+        vsq = _mm_add_ps(vsq, _mm_mul_ps(a, a));
+        vcross = _mm_add_ps(vcross, _mm_mul_ps(a, swapped));
+    }
+    float sq[4], cross[4];
+    _mm_storeu_ps(sq, vsq);
+    _mm_storeu_ps(cross, vcross);
+    sum_ll = sq[0] + sq[2];
+    sum_rr = sq[1] + sq[3];
+    sum_lr = cross[0] + cross[2];
+#elif defined(__ARM_NEON)
+    float32x4_t vsq = vdupq_n_f32(0), vcross = vdupq_n_f32(0);
+    for (; i + 4 <= total; i += 4) {
+        float32x4_t a = vld1q_f32(in + i);
+        vsq = vmlaq_f32(vsq, a, a);
+        vcross = vmlaq_f32(vcross, a, vrev64q_f32(a));
+    }
+    float sq[4], cross[4];
+    vst1q_f32(sq, vsq);
+    vst1q_f32(cross, vcross);
+    sum_ll = sq[0] + sq[2];
+    sum_rr = sq[1] + sq[3];
+    sum_lr = cross[0] + cross[2];
+#endif
+
+    for (; i + 2 <= total; i += 2) {
+        sum_ll += in[i] * in[i];
+        sum_rr += in[i + 1] * in[i + 1];
+        sum_lr += in[i] * in[i + 1];
+    }
+    *lr = sum_lr;
+    *ll = sum_ll;
+    *rr = sum_rr;
+}
+
+static void meters_reset_state(Meters* meters) {
+    memset(meters->history, 0, sizeof(meters->history));
+    memset(meters->peak_hold_timer, 0, sizeof(meters->peak_hold_timer));
+    loudness_reset(meters->loudness);
+    truepeak_reset(&meters->true_peak);
+    meters->true_peak_hold_timer = 0;
+    meters->corr_lr = meters->corr_ll = meters->corr_rr = 0;
+    meters_clear_readings(&meters->work);
+}
+
+static void meters_update_spectrum(Meters* meters, const float* hop) {
+    int keep = METERS_FFT_SIZE - METERS_HOP_FRAMES;
+    memmove(meters->history, meters->history + METERS_HOP_FRAMES, keep * sizeof(float));
+    float* tail = meters->history + keep;
+    for (int i = 0; i < METERS_HOP_FRAMES; i++) {
+        tail[i] = (hop[2 * i] + hop[2 * i + 1]) * 0.5f;
+    }
+    for (int i = 0; i < METERS_FFT_SIZE; i++) {
+        meters->frame[i] = meters->history[i] * meters->window[i];
+    }
+    fft_real_forward(meters->fft, meters->frame, meters->re, meters->im);
+
+    MeterReadings* r = &meters->work;
+    double fall = METERS_SPECTRUM_FALL_DB * meters->hop_seconds;
+    double peak_fall = METERS_PEAK_FALL_DB * meters->hop_seconds;
+
+    for (int b = 0; b < METERS_BANDS; b++) {
+        float power = 0;
+        for (int k = meters->band_first[b]; k <= meters->band_last[b]; k++) {
+            float p = meters->re[k] * meters->re[k] + meters->im[k] * meters->im[k];
+            if (p > power) power = p;
+        }
+        double db = power > 0 ? 10.0 * log10(power) + meters->spectrum_offset_db : METERS_FLOOR_DB;
+        if (db < METERS_FLOOR_DB) db = METERS_FLOOR_DB;
+
+        double shown = fmax(db, r->spectrum_db[b] - fall);
+        r->spectrum_db[b] = (float)shown;
+
+        if (shown >= r->peak_hold_db[b]) {
+            r->peak_hold_db[b] = (float)shown;
+            meters->peak_hold_timer[b] = METERS_PEAK_HOLD_SECONDS;
+        } else if (meters->peak_hold_timer[b] > 0) {
+            meters->peak_hold_timer[b] -= meters->hop_seconds;
+        } else {
+            r->peak_hold_db[b] = (float)fmax(shown, r->peak_hold_db[b] - peak_fall);
+        }
+    }
+}
+
+static void meters_analyze_hop(Meters* meters, const float* hop) {
+    MeterReadings* r = &meters->work;
+
+    loudness_feed(meters->loudness, hop, METERS_HOP_FRAMES);
+    r->momentary = loudness_momentary(meters->loudness);
+    r->short_term = loudness_short_term(meters->loudness);
+    r->integrated = loudness_integrated(meters->loudness);
+
+    double tp = 20.0 * log10(truepeak_process(&meters->true_peak, hop, METERS_HOP_FRAMES));
+    if (tp >= r->true_peak_db) {
+        r->true_peak_db = tp;
+        meters->true_peak_hold_timer = METERS_TRUE_PEAK_HOLD_SECONDS;
+    } else if (meters->true_peak_hold_timer > 0) {
+        meters->true_peak_hold_timer -= meters->hop_seconds;
+    } else {
+        r->true_peak_db = fmax(tp, r->true_peak_db - METERS_TRUE_PEAK_FALL_DB * meters->hop_seconds);
+    }
+    if (tp > r->true_peak_max_db) {
+        r->true_peak_max_db = tp;
+    }
+
+    double lr, ll, rr;
+    meters_block_stats(hop, METERS_HOP_FRAMES, &lr, &ll, &rr);
+    meters->corr_lr = meters->corr_lr * meters->corr_decay + lr;
+    meters->corr_ll = meters->corr_ll * meters->corr_decay + ll;
+    meters->corr_rr = meters->corr_rr * meters->corr_decay + rr;
+    double denom = sqrt(meters->corr_ll * meters->corr_rr);
+    r->correlation = denom > 1e-9 ? meters->corr_lr / denom : 0;
+
+    meters_update_spectrum(meters, hop);
+}
+
+static void meters_publish(Meters* meters) {
+    meters->work.generation++;
+    pthread_mutex_lock(&meters->readings_mutex);
+    meters->published = meters->work;
+    pthread_mutex_unlock(&meters->readings_mutex);
+}
+
+static void* meters_thread(void* data) {
+    Meters* meters = data;
+
+    while (atomic_load(&meters->running)) {
+        pthread_mutex_lock(&meters->wake_mutex);
+        size_t write = atomic_load_explicit(&meters->write_pos, memory_order_acquire);
+        if (write - meters->read_pos < METERS_HOP_FRAMES && atomic_load(&meters->running)) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += METERS_WAIT_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&meters->wake_cond, &meters->wake_mutex, &deadline);
+        }
+        pthread_mutex_unlock(&meters->wake_mutex);
+
+        write = atomic_load_explicit(&meters->write_pos, memory_order_acquire);
+        if (atomic_exchange(&meters->reset_requested, 0)) {
+            meters_reset_state(meters);
+            meters->read_pos = write;
+            meters_publish(meters);
+            continue;
+        }
+
+        /* If the worker fell behind, drop the oldest audio rather than lag. */
+        if (write - meters->read_pos > METERS_RING_FRAMES - METERS_HOP_FRAMES) {
+            meters->read_pos = write - METERS_HOP_FRAMES;
+        }
+
+        int analyzed = 0;
+        while (write - meters->read_pos >= METERS_HOP_FRAMES) {
+            size_t offset = meters->read_pos % METERS_RING_FRAMES;
+            size_t first = METERS_RING_FRAMES - offset;
+            if (first > METERS_HOP_FRAMES) first = METERS_HOP_FRAMES;
+            memcpy(meters->hop, meters->ring + offset * 2, first * 2 * sizeof(float));
+            memcpy(meters->hop + first * 2, meters->ring, (METERS_HOP_FRAMES - first) * 2 * sizeof(float));
+            meters_analyze_hop(meters, meters->hop);
+            meters->read_pos += METERS_HOP_FRAMES;
+            analyzed = 1;
+        }
+        if (analyzed) {
+            meters_publish(meters);
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,40 @@
+#ifndef SLOP_METERS_H
+#define SLOP_METERS_H
+
+#include <stddef.h>
+
+#define METERS_FFT_SIZE 4096
+#define METERS_HOP_FRAMES 1024
+#define METERS_RING_FRAMES 32768
+#define METERS_BANDS 96
+#define METERS_FLOOR_DB -90.0
+
+/* Snapshot of every meter, published once per analysis hop. */
+typedef struct {
+    unsigned long generation;
+    float spectrum_db[METERS_BANDS];
+    float peak_hold_db[METERS_BANDS];
+    double momentary;
+    double short_term;
+    double integrated;
+    double true_peak_db;
+    double true_peak_max_db;
+    double correlation;
+} MeterReadings;
+
+/*
+ * Playback meters for interleaved stereo float. meters_push is called
+ * from the streaming thread and never blocks; a worker thread drains the
+ * ring buffer in METERS_HOP_FRAMES hops and publishes MeterReadings that
+ * the UI picks up with meters_read.
+ */
+typedef struct Meters Meters;
+
+Meters* meters_new(double rate);
+void meters_free(Meters* meters);
+void meters_push(Meters* meters, const float* interleaved, size_t frames);
+void meters_reset(Meters* meters);
+void meters_read(Meters* meters, MeterReadings* out);
+double meters_band_frequency(const Meters* meters, int band);
+
+#endif
@@ -0,0 +1,484 @@
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "slopPeaks.h"
+
+#define PEAKS_MAGIC "SLOPPK1"
+
+struct PeakBuilder {
+    int in_channels;
+    int channels;
+    int sample_rate;
+    int64_t frames;
+    int bin_fill;
+    float cur_min[PEAKS_MAX_CHANNELS];
+    float cur_max[PEAKS_MAX_CHANNELS];
+    PeakPair* bins;
+    int64_t num_bins;
+    int64_t cap_bins;
+};
+
+typedef struct {
+    char magic[8];
+    int32_t channels;
+    int32_t sample_rate;
+    int32_t num_levels;
+    uint32_t path_len;
+    int64_t frames;
+    int64_t file_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} PeakFileHeader;
+
+static int16_t quantize_peak(float v) {
+    if (v > 1.0f) v = 1.0f;
+    if (v < -1.0f) v = -1.0f;
+    return (int16_t)lrintf(v * 32767.0f);
+}
+
+static void reduce_minmax_scalar(const float* in, size_t frames, int in_channels, int channels, float* mn, float* mx) {
+    for (size_t i = 0; i < frames; i++) {
+        for (int c = 0; c < in_channels; c++) {
+            float v = in[i * in_channels + c];
+            int dst = c % channels;
+            if (v < mn[dst]) mn[dst] = v;
+            if (v > mx[dst]) mx[dst] = v;
+        }
+    }
+}
+
+/*
+ * Folds `frames` interleaved frames into the running per-channel min/max.
+ * Mono and stereo take the vector path: four lanes hold either four mono
+ * frames or two L/R pairs, so the lanes are folded back per channel once
+ * at the end instead of on every sample.
+ */
+static void reduce_minmax(const float* in, size_t frames, int in_channels, int channels, float* mn, float* mx) {
+    if (in_channels > 2) {
+        reduce_minmax_scalar(in, frames, in_channels, channels, mn, mx);
+        return;
+    }
+
+    size_t total = frames * in_channels;
+    size_t i = 0;
+
+#if defined(__SSE2__) || defined(__ARM_NEON)
+    if (total >= 8) {
+        float lane_min[4], lane_max[4];
+        for (int l = 0; l < 4; l++) {
+            lane_min[l] = mn[l % in_channels];
+            lane_max[l] = mx[l % in_channels];
+        }
+#if defined(__SSE2__)
+        __m128 vmin0 = _mm_loadu_ps(lane_min), vmax0 = _mm_loadu_ps(lane_max);
+        __m128 vmin1 = vmin0, vmax1 = vmax0;
+        for (; i + 8 <= total; i += 8) {
+            __m128 a = _mm_loadu_ps(in + i);
+            __m128 b = _mm_loadu_ps(in + i + 4);
+            vmin0 = _mm_min_ps(vmin0, a);
+            vmax0 = _mm_max_ps(vmax0, a);
+            vmin1 = _mm_min_ps(vmin1, b);
+            vmax1 = _mm_max_ps(vmax1, b);
+        }
+        _mm_storeu_ps(lane_min, _mm_min_ps(vmin0, vmin1));
+        _mm_storeu_ps(lane_max, _mm_max_ps(vmax0, vmax1));
+#else
+        float32x4_t vmin0 = vld1q_f32(lane_min), vmax0 = vld1q_f32(lane_max);
+        float32x4_t vmin1 = vmin0, vmax1 = vmax0;
+        for (; i + 8 <= total; i += 8) {
+            float32x4_t a = vld1q_f32(in + i);
+            float32x4_t b = vld1q_f32(in + i + 4);
+            vmin0 = vminq_f32(vmin0, a);
+            vmax0 = vmaxq_f32(vmax0, a);
+            vmin1 = vminq_f32(vmin1, b);
+            vmax1 = vmaxq_f32(vmax1, b);
+        }
+        vst1q_f32(lane_min, vminq_f32(vmin0, vmin1));
+        vst1q_f32(lane_max, vmaxq_f32(vmax0, vmax1));
+#endif
+        for (int l = 0; l < 4; l++) {
+            int c = l % in_channels;
+            if (lane_min[l] < mn[c]) mn[c] = lane_min[l];
+            if (lane_max[l] > mx[c]) mx[c] = lane_max[l];
+        }
+    }
+#endif
+
+    for (; i < total; i++) {
+        int c = (int)(i % in_channels);
+        if (in[i] < mn[c]) mn[c] = in[i];
+        if (in[i] > mx[c]) mx[c] = in[i];
+    }
+}
+
+static void builder_reset_bin(PeakBuilder* builder) {
+    for (int c = 0; c < PEAKS_MAX_CHANNELS; c++) {
+        builder->cur_min[c] = INFINITY;
+        builder->cur_max[c] = -INFINITY;
+    }
+    builder->bin_fill = 0;
+}
+
+static int builder_push_bin(PeakBuilder* builder) {
+    if (builder->num_bins == builder->cap_bins) {
+        int64_t new_cap = builder->cap_bins ? builder->cap_bins * 2 : 4096;
+        PeakPair* grown = realloc(builder->bins, new_cap * builder->channels * sizeof(PeakPair));
+        if (!grown) {
+            return -1;
+        }
+        builder->bins = grown;
+        builder->cap_bins = new_cap;
+    }
+
+    PeakPair* bin = builder->bins + builder->num_bins * builder->channels;
+    for (int c = 0; c < builder->channels; c++) {
+        bin[c].min = quantize_peak(builder->cur_min[c]);
+        bin[c].max = quantize_peak(builder->cur_max[c]);
+    }
+    builder->num_bins++;
+    builder_reset_bin(builder);
+    return 0;
+}
+
+PeakBuilder* peaks_builder_new(int channels, int sample_rate) {
+    if (channels < 1) {
+        return NULL;
+    }
+
+    PeakBuilder* builder = calloc(1, sizeof(PeakBuilder));
+    if (!builder) {
+        return NULL;
+    }
+    builder->in_channels = channels;
+    builder->channels = channels < PEAKS_MAX_CHANNELS ? channels : PEAKS_MAX_CHANNELS;
+    builder->sample_rate = sample_rate;
+    builder_reset_bin(builder);
+    return builder;
+}
+
+void peaks_builder_feed(PeakBuilder* builder, const float* interleaved, size_t frames) {
+    while (frames > 0) {
+        size_t take = PEAKS_BASE_FRAMES - builder->bin_fill;
+        if (take > frames) {
+            take = frames;
+        }
+
+        reduce_minmax(interleaved, take, builder->in_channels, builder->channels,
+                      builder->cur_min, builder->cur_max);
+        builder->bin_fill += (int)take;
+        builder->frames += take;
+        interleaved += take * builder->in_channels;
+        frames -= take;
+
+        if (builder->bin_fill == PEAKS_BASE_FRAMES && builder_push_bin(builder) != 0) {
+            builder_reset_bin(builder);
+        }
+    }
+}
+
+PeakData* peaks_builder_finish(PeakBuilder* builder) {
+    if (builder->bin_fill > 0) {
+        builder_push_bin(builder);
+    }
+
+    PeakData* peaks = calloc(1, sizeof(PeakData));
+    if (!peaks) {
+        peaks_builder_free(builder);
+        return NULL;
+    }
+
+    int ch = builder->channels;
+    peaks->channels = ch;
+    peaks->sample_rate = builder->sample_rate;
+    peaks->frames = builder->frames;
+    peaks->levels[0] = builder->bins;
+    peaks->level_bins[0] = builder->num_bins;
+    peaks->frames_per_bin[0] = PEAKS_BASE_FRAMES;
+    peaks->num_levels = 1;
+    builder->bins = NULL;
+    free(builder);
+
+    while (peaks->num_levels < PEAKS_MAX_LEVELS &&
+           peaks->level_bins[peaks->num_levels - 1] > PEAKS_MIN_LEVEL_BINS) {
+        int l = peaks->num_levels;
+        int64_t src_bins = peaks->level_bins[l - 1];
+        int64_t dst_bins = (src_bins + 1) / 2;
+        const PeakPair* src = peaks->levels[l - 1];
+        PeakPair* dst = malloc(dst_bins * ch * sizeof(PeakPair));
+        if (!dst) {
+            break;
+        }
+
+        for (int64_t i = 0; i < dst_bins; i++) {
+            for (int c = 0; c < ch; c++) {
+                PeakPair a = src[(2 * i) * ch + c];
+                PeakPair b = (2 * i + 1 < src_bins) ? src[(2 * i + 1) * ch + c] : a;
+                dst[i * ch + c].min = a.min < b.min ? a.min : b.min;
+                dst[i * ch + c].max = a.max > b.max ? a.max : b.max;
+            }
+        }
+
+        peaks->levels[l] = dst;
+        peaks->level_bins[l] = dst_bins;
+        peaks->frames_per_bin[l] = peaks->frames_per_bin[l - 1] * 2;
+        peaks->num_levels++;
+    }
+
+    return peaks;
+}
+
+void peaks_builder_free(PeakBuilder* builder) {
+    if (builder) {
+        free(builder->bins);
+        free(builder);
+    }
+}
+
+void peaks_free(PeakData* peaks) {
+    if (!peaks) {
+        return;
+    }
+    for (int l = 0; l < peaks->num_levels; l++) {
+        free(peaks->levels[l]);
+    }
+    free(peaks);
+}
+
+int peaks_pick_level(const PeakData* peaks, double frames_per_pixel) {
+    int level = 0;
+    for (int l = 1; l < peaks->num_levels; l++) {
+        if ((double)peaks->frames_per_bin[l] <= frames_per_pixel) {
+            level = l;
+        }
+    }
+    return level;
+}
+
+void peaks_range(const PeakData* peaks, int level, int64_t first_bin, int64_t last_bin, int channel, float* min, float* max) {
+    int64_t bins = peaks->level_bins[level];
+    if (first_bin < 0) first_bin = 0;
+    if (last_bin >= bins) last_bin = bins - 1;
+
+    if (first_bin > last_bin || channel >= peaks->channels) {
+        *min = 0.0f;
+        *max = 0.0f;
+        return;
+    }
+
+    const PeakPair* data = peaks->levels[level];
+    int ch = peaks->channels;
+    int16_t lo = data[first_bin * ch + channel].min;
+    int16_t hi = data[first_bin * ch + channel].max;
+    for (int64_t i = first_bin + 1; i <= last_bin; i++) {
+        if (data[i * ch + channel].min < lo) lo = data[i * ch + channel].min;
+        if (data[i * ch + channel].max > hi) hi = data[i * ch + channel].max;
+    }
+    *min = lo / 32767.0f;
+    *max = hi / 32767.0f;
+}
+
+static int make_dirs(char* path) {
+    for (char* p = path + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+                *p = '/';
+                return -1;
+            }
+            *p = '/';
+        }
+    }
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    return 0;
+}
+
+static int peaks_cache_dir(char* out, size_t out_size) {
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+
+    if (xdg && *xdg) {
+        snprintf(out, out_size, "%s/slopmaster/peaks", xdg);
+    } else if (home && *home) {
+        snprintf(out, out_size, "%s/.cache/slopmaster/peaks", home);
+    } else {
+        return -1;
+    }
+    return make_dirs(out);
+}
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t len) {
+    const unsigned char* p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int peaks_cache_key(const char* file, char* abs_path, struct stat* st) {
+    if (!realpath(file, abs_path)) {
+        return -1;
+    }
+    if (stat(abs_path, st) != 0 || !S_ISREG(st->st_mode)) {
+        return -1;
+    }
+    return 0;
+}
+
+static int peaks_cache_path_for(const char* abs_path, const struct stat* st, char* out, size_t out_size) {
+    char dir[PATH_MAX];
+    if (peaks_cache_dir(dir, sizeof(dir)) != 0) {
+        return -1;
+    }
+
+    int64_t size = st->st_size;
+    int64_t mtime_sec = st->st_mtim.tv_sec;
+    int64_t mtime_nsec = st->st_mtim.tv_nsec;
+    uint64_t hash = 14695981039346656037ULL;
+    hash = fnv1a(hash, abs_path, strlen(abs_path));
+    hash = fnv1a(hash, &size, sizeof(size));
+    hash = fnv1a(hash, &mtime_sec, sizeof(mtime_sec));
+    hash = fnv1a(hash, &mtime_nsec, sizeof(mtime_nsec));
+
+    int n = snprintf(out, out_size, "%s/%016llx.peaks", dir, (unsigned long long)hash);
+    return (n < 0 || (size_t)n >= out_size) ? -1 : 0;
+}
+
+int peaks_cache_path(const char* file, char* out, size_t out_size) {
+    char abs_path[PATH_MAX];
+    struct stat st;
+    if (peaks_cache_key(file, abs_path, &st) != 0) {
+        return -1;
+    }
+    return peaks_cache_path_for(abs_path, &st, out, out_size);
+}
+
+PeakData* peaks_cache_load(const char* file) {
+    char abs_path[PATH_MAX], cache_path[PATH_MAX];
+    struct stat st;
+    if (peaks_cache_key(file, abs_path, &st) != 0 ||
+        peaks_cache_path_for(abs_path, &st, cache_path, sizeof(cache_path)) != 0) {
+        return NULL;
+    }
+
+    FILE* fp = fopen(cache_path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+
+    PeakFileHeader header;
+    char stored_path[PATH_MAX];
+    PeakData* peaks = NULL;
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, PEAKS_MAGIC, sizeof(header.magic)) != 0 ||
+        header.file_size != st.st_size ||
+        header.mtime_sec != st.st_mtim.tv_sec ||
+        header.mtime_nsec != st.st_mtim.tv_nsec ||
+        header.channels < 1 || header.channels > PEAKS_MAX_CHANNELS ||
+        header.num_levels < 1 || header.num_levels > PEAKS_MAX_LEVELS ||
+        header.path_len >= sizeof(stored_path) ||
+        fread(stored_path, 1, header.path_len, fp) != header.path_len) {
+        goto fail;
+    }
+    stored_path[header.path_len] = '\0';
+    if (strcmp(stored_path, abs_path) != 0) {
+        goto fail;
+    }
+
+    peaks = calloc(1, sizeof(PeakData));
+    if (!peaks) {
+        goto fail;
+    }
+    peaks->channels = header.channels;
+    peaks->sample_rate = header.sample_rate;
+    peaks->frames = header.frames;
+
+    for (int l = 0; l < header.num_levels; l++) {
+        int64_t level_info[2];
+        if (fread(level_info, sizeof(level_info), 1, fp) != 1 || level_info[1] < 0) {
+            goto fail;
+        }
+        size_t count = (size_t)level_info[1] * peaks->channels;
+        peaks->levels[l] = malloc(count ? count * sizeof(PeakPair) : 1);
+        if (!peaks->levels[l]) {
+            goto fail;
+        }
+        peaks->num_levels = l + 1;
+        peaks->frames_per_bin[l] = level_info[0];
+        peaks->level_bins[l] = level_info[1];
+        if (fread(peaks->levels[l], sizeof(PeakPair), count, fp) != count) {
+            goto fail;
+        }
+    }
+
+    fclose(fp);
+    return peaks;
+
+fail:
+    fclose(fp);
+    peaks_free(peaks);
+    return NULL;
+}
+
+int peaks_cache_store(const char* file, const PeakData* peaks) {
+    char abs_path[PATH_MAX], cache_path[PATH_MAX], tmp_path[PATH_MAX + 32];
+    struct stat st;
+    if (peaks_cache_key(file, abs_path, &st) != 0 ||
+        peaks_cache_path_for(abs_path, &st, cache_path, sizeof(cache_path)) != 0) {
+        return -1;
+    }
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", cache_path, (long)getpid());
+    FILE* fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        return -1;
+    }
+
+    PeakFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PEAKS_MAGIC, sizeof(header.magic));
+    header.channels = peaks->channels;
+    header.sample_rate = peaks->sample_rate;
+    header.num_levels = peaks->num_levels;
+    header.path_len = (uint32_t)strlen(abs_path);
+    header.frames = peaks->frames;
+    header.file_size = st.st_size;
+    header.mtime_sec = st.st_mtim.tv_sec;
+    header.mtime_nsec = st.st_mtim.tv_nsec;
+
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+             fwrite(abs_path, 1, header.path_len, fp) == header.path_len;
+
+    for (int l = 0; ok && l < peaks->num_levels; l++) {
+        int64_t level_info[2] = { peaks->frames_per_bin[l], peaks->level_bins[l] };
+        size_t count = (size_t)peaks->level_bins[l] * peaks->channels;
+        ok = fwrite(level_info, sizeof(level_info), 1, fp) == 1 &&
+             fwrite(peaks->levels[l], sizeof(PeakPair), count, fp) == count;
+    }
+
+    if (fclose(fp) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmp_path, cache_path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
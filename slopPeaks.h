@@ -0,0 +1,49 @@
+#ifndef SLOP_PEAKS_H
+#define SLOP_PEAKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PEAKS_MAX_CHANNELS 2
+#define PEAKS_MAX_LEVELS 24
+#define PEAKS_BASE_FRAMES 256
+#define PEAKS_MIN_LEVEL_BINS 64
+#define PEAKS_CHUNK_FRAMES 65536
+
+/* One min/max pair per channel per bin, quantised to 16 bits. */
+typedef struct {
+    int16_t min;
+    int16_t max;
+} PeakPair;
+
+/*
+ * Multi-resolution peak mipmap. Level 0 covers PEAKS_BASE_FRAMES frames
+ * per bin and every following level halves the bin count. Bins are
+ * interleaved by channel: bin i of channel c is levels[l][i * channels + c].
+ */
+typedef struct {
+    int channels;
+    int sample_rate;
+    int64_t frames;
+    int num_levels;
+    int64_t frames_per_bin[PEAKS_MAX_LEVELS];
+    int64_t level_bins[PEAKS_MAX_LEVELS];
+    PeakPair *levels[PEAKS_MAX_LEVELS];
+} PeakData;
+
+typedef struct PeakBuilder PeakBuilder;
+
+PeakBuilder* peaks_builder_new(int channels, int sample_rate);
+void peaks_builder_feed(PeakBuilder* builder, const float* interleaved, size_t frames);
+PeakData* peaks_builder_finish(PeakBuilder* builder);
+void peaks_builder_free(PeakBuilder* builder);
+
+void peaks_free(PeakData* peaks);
+int peaks_pick_level(const PeakData* peaks, double frames_per_pixel);
+void peaks_range(const PeakData* peaks, int level, int64_t first_bin, int64_t last_bin, int channel, float* min, float* max);
+
+int peaks_cache_path(const char* file, char* out, size_t out_size);
+PeakData* peaks_cache_load(const char* file);
+int peaks_cache_store(const char* file, const PeakData* peaks);
+
+#endif
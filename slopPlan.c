@@ -0,0 +1,47 @@
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "slopPlan.h"
+
+static void append(char* text, size_t size, const char* fmt, ...) {
+    if (!text || size == 0) {
+        return;
+    }
+    size_t len = strlen(text);
+    if (len + 1 >= size) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(text + len, size - len, fmt, args);
+    va_end(args);
+}
+
+double plan_noise_floor_db(const NoiseProfile* profile) {
+    double sum = 0;
+    for (int k = 1; k < DENOISE_BINS; k++) {
+        sum += profile->power[k];
+    }
+    double power = sum / (DENOISE_BINS - 1) / (DENOISE_FFT_SIZE / 2);
+    return power > 1e-20 ? 10.0 * log10(power) : -200.0;
+}
+
+unsigned plan_bypass(const PlanAnalysis* analysis, char* text, size_t size) {
+    unsigned bypass = 0;
+
+    if (text && size > 0) {
+        text[0] = '\0';
+    }
+    if (analysis->fields & PLAN_HAS_NOISE_FLOOR) {
+        append(text, size, "noise floor %.1f dBFS", analysis->noise_floor_db);
+        if (analysis->noise_floor_db < PLAN_NOISE_FLOOR_DB) {
+            bypass |= CHAIN_BYPASS_DENOISE;
+            append(text, size, "; skip noise reduction (floor below %.0f dBFS)", PLAN_NOISE_FLOOR_DB);
+        }
+    } else {
+        append(text, size, "noise floor unknown");
+    }
+    return bypass;
+}
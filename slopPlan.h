@@ -0,0 +1,30 @@
+#ifndef SLOP_PLAN_H
+#define SLOP_PLAN_H
+
+#include <stddef.h>
+
+#include "slopChain.h"
+#include "slopDenoise.h"
+
+/* Skipping noise reduction changes nothing above this level. */
+#define PLAN_NOISE_FLOOR_DB -70.0
+#define PLAN_TEXT_SIZE 512
+
+#define PLAN_HAS_NOISE_FLOOR 0x1
+
+typedef struct {
+    unsigned fields;
+    double noise_floor_db;
+} PlanAnalysis;
+
+/*
+ * Picks the CHAIN_BYPASS_* stages that would be near no-ops for a file
+ * with this analysis. text, if given, receives the analysis, every
+ * skipped stage and why.
+ */
+unsigned plan_bypass(const PlanAnalysis* analysis, char* text, size_t size);
+
+/* Broadband level of a profile in dBFS, the mean power of one sample. */
+double plan_noise_floor_db(const NoiseProfile* profile);
+
+#endif
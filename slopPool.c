@@ -0,0 +1,127 @@
+#define _XOPEN_SOURCE 700
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "slopPool.h"
+
+#define ARENA_MIN_CHUNK (256 * 1024)
+
+struct ArenaChunk {
+    size_t size;
+    size_t used;
+    struct ArenaChunk* next;
+    /* Keeps data POOL_ALIGN-aligned after the header. */
+    _Alignas(POOL_ALIGN) unsigned char data[];
+};
+
+static size_t align_up(size_t n) {
+    return (n + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+}
+
+static ArenaChunk* chunk_new(Arena* arena, size_t size) {
+    void* memory = NULL;
+    if (posix_memalign(&memory, POOL_ALIGN, sizeof(ArenaChunk) + size) != 0) {
+        return NULL;
+    }
+    arena->allocations++;
+    ArenaChunk* chunk = memory;
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->next = NULL;
+    return chunk;
+}
+
+void arena_init(Arena* arena) {
+    memset(arena, 0, sizeof(*arena));
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    size = align_up(size ? size : 1);
+    ArenaChunk* chunk = arena->chunks;
+    if (!chunk || chunk->size - chunk->used < size) {
+        size_t want = chunk ? 2 * chunk->size : ARENA_MIN_CHUNK;
+        ArenaChunk* grown = chunk_new(arena, want > size ? want : align_up(size));
+        if (!grown) {
+            return NULL;
+        }
+        grown->next = chunk;
+        arena->chunks = chunk = grown;
+    }
+    void* p = chunk->data + chunk->used;
+    chunk->used += size;
+    arena->used += size;
+    if (arena->used > arena->peak) {
+        arena->peak = arena->used;
+    }
+    return p;
+}
+
+void arena_reset(Arena* arena) {
+    ArenaChunk* chunk = arena->chunks;
+    if (chunk && chunk->next) {
+        size_t total = 0;
+        for (ArenaChunk* c = chunk; c; c = c->next) {
+            total += c->size;
+        }
+        arena_free(arena);
+        arena->chunks = chunk_new(arena, total);
+    } else if (chunk) {
+        chunk->used = 0;
+    }
+    arena->used = 0;
+}
+
+/* Keeps the counters, so a freed arena still reports what it cost. */
+void arena_free(Arena* arena) {
+    ArenaChunk* chunk = arena->chunks;
+    while (chunk) {
+        ArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+    arena->used = 0;
+}
+
+void frame_pool_init(FramePool* pool, size_t frames, int channels) {
+    memset(pool, 0, sizeof(*pool));
+    pool->frames = frames;
+    pool->channels = channels;
+}
+
+float* frame_pool_get(FramePool* pool) {
+    for (int i = 0; i < FRAME_POOL_BUFFERS; i++) {
+        if (pool->in_use[i]) {
+            continue;
+        }
+        if (!pool->buffers[i]) {
+            void* memory = NULL;
+            if (posix_memalign(&memory, POOL_ALIGN, pool->frames * pool->channels * sizeof(float)) != 0) {
+                return NULL;
+            }
+            pool->buffers[i] = memory;
+            pool->allocations++;
+        }
+        pool->in_use[i] = 1;
+        return pool->buffers[i];
+    }
+    return NULL;
+}
+
+void frame_pool_put(FramePool* pool, float* buffer) {
+    for (int i = 0; i < FRAME_POOL_BUFFERS; i++) {
+        if (pool->buffers[i] == buffer) {
+            pool->in_use[i] = 0;
+            return;
+        }
+    }
+}
+
+void frame_pool_free(FramePool* pool) {
+    for (int i = 0; i < FRAME_POOL_BUFFERS; i++) {
+        free(pool->buffers[i]);
+        pool->buffers[i] = NULL;
+        pool->in_use[i] = 0;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef SLOP_POOL_H
+#define SLOP_POOL_H
+
+#include <stddef.h>
+
+#define POOL_ALIGN 64
+#define FRAME_POOL_BUFFERS 4
+
+/*
+ * Bump allocator for state that lives for one job. Reset at the start
+ * of each job; when a job outgrew it, the chunks are merged into one on
+ * reset, so jobs of the same shape never allocate again.
+ */
+typedef struct ArenaChunk ArenaChunk;
+
+typedef struct {
+    ArenaChunk* chunks;
+    size_t used;
+    size_t peak;
+    /* Heap allocations made so far. */
+    unsigned long allocations;
+} Arena;
+
+void arena_init(Arena* arena);
+/* POOL_ALIGN-aligned and uninitialised; NULL when out of memory. */
+void* arena_alloc(Arena* arena, size_t size);
+void arena_reset(Arena* arena);
+void arena_free(Arena* arena);
+
+/*
+ * FRAME_POOL_BUFFERS aligned buffers of frames interleaved frames each,
+ * allocated on first use and then handed out and returned without
+ * touching the heap, between stages and across jobs.
+ */
+typedef struct {
+    float* buffers[FRAME_POOL_BUFFERS];
+    int in_use[FRAME_POOL_BUFFERS];
+    size_t frames;
+    int channels;
+    unsigned long allocations;
+} FramePool;
+
+void frame_pool_init(FramePool* pool, size_t frames, int channels);
+/* NULL when every buffer is in use or out of memory. */
+float* frame_pool_get(FramePool* pool);
+void frame_pool_put(FramePool* pool, float* buffer);
+void frame_pool_free(FramePool* pool);
+
+#endif
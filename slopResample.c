@@ -0,0 +1,292 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "slopResample.h"
+#include "slopDSP.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* Half the kernel in input samples when upsampling; widened when downsampling. */
+#define RESAMPLE_HALF_TAPS 96
+#define RESAMPLE_BETA 12.0
+#define RESAMPLE_CUTOFF 0.96
+#define RESAMPLE_BLOCK 4096
+
+/*
+ * Output frame j sits at input position j * down / up. Each of the up
+ * phases is a row of taps coefficients over the input frames around it.
+ */
+typedef struct ResampleTables {
+    long in_rate;
+    long out_rate;
+    int refs;
+    int up;
+    int down;
+    int half;
+    int taps;
+    float* coefs;
+    struct ResampleTables* next;
+} ResampleTables;
+
+struct Resampler {
+    ResampleTables* tables;
+    /* Planar history; hist[c][0] is input frame base. */
+    float* hist[DSP_CHANNELS];
+    size_t len;
+    size_t cap;
+    long long base;
+    long long index;
+    int phase;
+    long long in_total;
+    long long out_total;
+    int ended;
+    float block[RESAMPLE_BLOCK * DSP_CHANNELS];
+};
+
+static pthread_mutex_t tables_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ResampleTables* tables_list = NULL;
+
+static long gcd(long a, long b) {
+    while (b) {
+        long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static double bessel_i0(double x) {
+    double sum = 1, term = 1;
+    for (int k = 1; k < 64; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+static ResampleTables* tables_new(long in_rate, long out_rate) {
+    long g = gcd(in_rate, out_rate);
+    long up = out_rate / g, down = in_rate / g;
+    if (up > RESAMPLE_MAX_PHASES) {
+        return NULL;
+    }
+    ResampleTables* t = calloc(1, sizeof(ResampleTables));
+    if (!t) {
+        return NULL;
+    }
+    double scale = up < down ? (double)up / down : 1.0;
+    t->in_rate = in_rate;
+    t->out_rate = out_rate;
+    t->up = (int)up;
+    t->down = (int)down;
+    t->half = ((int)ceil(RESAMPLE_HALF_TAPS / scale) + 1) & ~1;
+    t->taps = 2 * t->half;
+    t->coefs = malloc((size_t)t->up * t->taps * sizeof(float));
+    if (!t->coefs) {
+        free(t);
+        return NULL;
+    }
+
+    double cutoff = RESAMPLE_CUTOFF * scale;
+    double norm = bessel_i0(RESAMPLE_BETA);
+    for (int p = 0; p < t->up; p++) {
+        float* row = t->coefs + (size_t)p * t->taps;
+        double sum = 0;
+        for (int n = 0; n < t->taps; n++) {
+            double x = (double)p / t->up + t->half - 1 - n;
+            double r = x / t->half;
+            double w = r * r < 1.0 ? bessel_i0(RESAMPLE_BETA * sqrt(1.0 - r * r)) / norm : 0.0;
+            double s = x == 0 ? 1.0 : sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+            row[n] = (float)(cutoff * s * w);
+            sum += row[n];
+        }
+        for (int n = 0; n < t->taps; n++) {
+            row[n] = (float)(row[n] / sum);
+        }
+    }
+    return t;
+}
+
+static ResampleTables* tables_acquire(long in_rate, long out_rate) {
+    pthread_mutex_lock(&tables_mutex);
+    ResampleTables* t = tables_list;
+    while (t && (t->in_rate != in_rate || t->out_rate != out_rate)) {
+        t = t->next;
+    }
+    if (!t && (t = tables_new(in_rate, out_rate)) != NULL) {
+        t->next = tables_list;
+        tables_list = t;
+    }
+    if (t) {
+        t->refs++;
+    }
+    pthread_mutex_unlock(&tables_mutex);
+    return t;
+}
+
+static void tables_release(ResampleTables* t) {
+    pthread_mutex_lock(&tables_mutex);
+    if (--t->refs == 0) {
+        ResampleTables** link = &tables_list;
+        while (*link != t) {
+            link = &(*link)->next;
+        }
+        *link = t->next;
+        free(t->coefs);
+        free(t);
+    }
+    pthread_mutex_unlock(&tables_mutex);
+}
+
+Resampler* resampler_new(double in_rate, double out_rate) {
+    long in = lround(in_rate), out = lround(out_rate);
+    if (in <= 0 || out <= 0) {
+        return NULL;
+    }
+    Resampler* r = calloc(1, sizeof(Resampler));
+    if (!r) {
+        return NULL;
+    }
+    r->tables = tables_acquire(in, out);
+    if (!r->tables) {
+        free(r);
+        return NULL;
+    }
+    r->cap = (size_t)r->tables->taps + RESAMPLE_BLOCK;
+    for (int c = 0; c < DSP_CHANNELS; c++) {
+        if (!(r->hist[c] = malloc(r->cap * sizeof(float)))) {
+            resampler_free(r);
+            return NULL;
+        }
+    }
+    resampler_reset(r);
+    return r;
+}
+
+/* The first outputs read half a kernel of silence before the input. */
+void resampler_reset(Resampler* r) {
+    int half = r->tables->half;
+    for (int c = 0; c < DSP_CHANNELS; c++) {
+        memset(r->hist[c], 0, half * sizeof(float));
+    }
+    r->len = half;
+    r->base = -half;
+    r->index = 0;
+    r->phase = 0;
+    r->in_total = 0;
+    r->out_total = 0;
+    r->ended = 0;
+}
+
+int resampler_matches(const Resampler* r, double in_rate, double out_rate) {
+    return r->tables->in_rate == lround(in_rate) && r->tables->out_rate == lround(out_rate);
+}
+
+void resampler_free(Resampler* r) {
+    if (!r) {
+        return;
+    }
+    if (r->tables) {
+        tables_release(r->tables);
+    }
+    for (int c = 0; c < DSP_CHANNELS; c++) {
+        free(r->hist[c]);
+    }
+    free(r);
+}
+
+static float dot(const float* x, const float* h, int n) {
+    int i = 0;
+    float sum = 0;
+#if defined(__SSE2__)
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(h + i)));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    sum = _mm_cvtss_f32(acc);
+#elif defined(__ARM_NEON)
+    float32x4_t acc = vdupq_n_f32(0);
+    for (; i + 4 <= n; i += 4) {
+        acc = vmlaq_f32(acc, vld1q_f32(x + i), vld1q_f32(h + i));
+    }
+    float32x2_t pair = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    sum = vget_lane_f32(vpadd_f32(pair, pair), 0);
+#endif
+    for (; i < n; i++) {
+        sum += x[i] * h[i];
+    }
+    return sum;
+}
+
+/* Drops history no future output needs, then appends input or, once it has ended, silence. */
+static void refill(Resampler* r, ResampleInput input, void* user_data) {
+    long long keep = r->index - r->tables->half + 1;
+    if (keep > r->base) {
+        size_t shift = (size_t)(keep - r->base);
+        for (int c = 0; c < DSP_CHANNELS; c++) {
+            memmove(r->hist[c], r->hist[c] + shift, (r->len - shift) * sizeof(float));
+        }
+        r->len -= shift;
+        r->base = keep;
+    }
+
+    size_t room = r->cap - r->len;
+    size_t n = 0;
+    if (!r->ended) {
+        n = input(user_data, r->block, room < RESAMPLE_BLOCK ? room : RESAMPLE_BLOCK);
+        r->ended = n == 0;
+        r->in_total += n;
+        for (size_t i = 0; i < n; i++) {
+            for (int c = 0; c < DSP_CHANNELS; c++) {
+                r->hist[c][r->len + i] = r->block[i * DSP_CHANNELS + c];
+            }
+        }
+    } else {
+        n = room;
+        for (int c = 0; c < DSP_CHANNELS; c++) {
+            memset(r->hist[c] + r->len, 0, n * sizeof(float));
+        }
+    }
+    r->len += n;
+}
+
+size_t resampler_read(Resampler* r, ResampleInput input, void* user_data, float* out, size_t frames) {
+    const ResampleTables* t = r->tables;
+    size_t done = 0;
+
+    while (done < frames) {
+        if (r->ended && r->out_total * t->down >= r->in_total * t->up) {
+            break;
+        }
+        if (r->index + t->half + 1 - r->base > (long long)r->len) {
+            refill(r, input, user_data);
+            continue;
+        }
+        size_t at = (size_t)(r->index - t->half + 1 - r->base);
+        const float* row = t->coefs + (size_t)r->phase * t->taps;
+        for (int c = 0; c < DSP_CHANNELS; c++) {
+            out[done * DSP_CHANNELS + c] = dot(r->hist[c] + at, row, t->taps);
+        }
+        done++;
+        r->out_total++;
+        r->phase += t->down;
+        r->index += r->phase / t->up;
+        r->phase %= t->up;
+    }
+    return done;
+}
@@ -0,0 +1,32 @@
+#ifndef SLOP_RESAMPLE_H
+#define SLOP_RESAMPLE_H
+
+#include <stddef.h>
+
+/*
+ * Polyphase windowed-sinc resampler for interleaved stereo: Kaiser
+ * window, about 120 dB stopband, flat to 92% of the lower Nyquist. The
+ * rate ratio must reduce to at most RESAMPLE_MAX_PHASES output phases,
+ * which covers every standard rate pair. Filter tables are cached per
+ * rate pair and shared by every resampler that uses them.
+ */
+#define RESAMPLE_MAX_PHASES 1024
+
+typedef struct Resampler Resampler;
+
+/* Fills stereo with up to frames input frames; 0 at the end of the stream. */
+typedef size_t (*ResampleInput)(void* user_data, float* stereo, size_t frames);
+
+/* NULL if the ratio needs too many phases. */
+Resampler* resampler_new(double in_rate, double out_rate);
+
+/*
+ * Pulls input as needed and writes up to frames output frames, aligned
+ * with the input and ending after ceil(input frames * out / in).
+ */
+size_t resampler_read(Resampler* r, ResampleInput input, void* user_data, float* out, size_t frames);
+void resampler_reset(Resampler* r);
+int resampler_matches(const Resampler* r, double in_rate, double out_rate);
+void resampler_free(Resampler* r);
+
+#endif
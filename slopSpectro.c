@@ -0,0 +1,537 @@
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "slopSpectro.h"
+#include "slopFFT.h"
+#include "slopPeaks.h"
+
+#define SPECTRO_MAGIC "SLOPSP1"
+#define SPECTRO_BINS (SPECTRO_FFT_SIZE / 2 + 1)
+/* Frames a segment of n columns reads, window overhang included. */
+#define SPECTRO_SEGMENT_FRAMES(n) ((size_t)((n) - 1) * SPECTRO_HOP + SPECTRO_FFT_SIZE)
+/* Segments queued or in progress before feed waits, per worker. */
+#define SPECTRO_QUEUE_PER_WORKER 2
+
+typedef struct SpectroTask {
+    int64_t first_column;
+    int columns;
+    float* samples;
+    uint8_t* out;
+    struct SpectroTask* next;
+    struct SpectroTask* next_queued;
+} SpectroTask;
+
+struct SpectroBuilder {
+    int channels;
+    int sample_rate;
+    int threads;
+    int started;
+    pthread_t* workers;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    SpectroTask* queue_head;
+    SpectroTask* queue_tail;
+    /* Every segment in column order; outputs are joined on finish. */
+    SpectroTask* first;
+    SpectroTask* last;
+    int in_flight;
+    int quit;
+    int failed;
+
+    int band_first[SPECTRO_BANDS];
+    int band_last[SPECTRO_BANDS];
+    float window[SPECTRO_FFT_SIZE];
+    double offset_db;
+
+    /* Mono mix from the first frame the next segment reads. */
+    float* pending;
+    size_t pending_len;
+    int64_t next_column;
+    int64_t frames;
+};
+
+typedef struct {
+    char magic[8];
+    int32_t sample_rate;
+    int32_t bands;
+    int32_t hop;
+    int32_t fft_size;
+    int32_t num_levels;
+    int32_t reserved;
+    int64_t frames;
+} SpectroFileHeader;
+
+static void apply_window(const float* in, const float* window, float* out, int n) {
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(in + i), _mm_loadu_ps(window + i)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(out + i, vmulq_f32(vld1q_f32(in + i), vld1q_f32(window + i)));
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = in[i] * window[i];
+    }
+}
+
+static void power_spectrum(const float* re, const float* im, float* power, int n) {
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= n; i += 4) {
+        __m128 r = _mm_loadu_ps(re + i);
+        __m128 m = _mm_loadu_ps(im + i);
+        _mm_storeu_ps(power + i, _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(m, m)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t r = vld1q_f32(re + i);
+        float32x4_t m = vld1q_f32(im + i);
+        vst1q_f32(power + i, vmlaq_f32(vmulq_f32(r, r), m, m));
+    }
+#endif
+    for (; i < n; i++) {
+        power[i] = re[i] * re[i] + im[i] * im[i];
+    }
+}
+
+static void init_bands(SpectroBuilder* builder) {
+    double top = fmin(SPECTRO_MAX_FREQ, builder->sample_rate / 2.0);
+    double bin_hz = (double)builder->sample_rate / SPECTRO_FFT_SIZE;
+    for (int b = 0; b < SPECTRO_BANDS; b++) {
+        double lo = SPECTRO_MIN_FREQ * pow(top / SPECTRO_MIN_FREQ, (double)b / SPECTRO_BANDS);
+        double hi = SPECTRO_MIN_FREQ * pow(top / SPECTRO_MIN_FREQ, (double)(b + 1) / SPECTRO_BANDS);
+        int first = (int)floor(lo / bin_hz + 0.5);
+        int last = (int)floor(hi / bin_hz + 0.5) - 1;
+        if (first > SPECTRO_BINS - 1) first = SPECTRO_BINS - 1;
+        if (last < first) last = first;
+        if (last > SPECTRO_BINS - 1) last = SPECTRO_BINS - 1;
+        builder->band_first[b] = first;
+        builder->band_last[b] = last;
+    }
+}
+
+static void analyze_segment(SpectroBuilder* builder, FFT* fft, SpectroTask* task) {
+    float frame[SPECTRO_FFT_SIZE];
+    float re[SPECTRO_BINS], im[SPECTRO_BINS], power[SPECTRO_BINS];
+    double scale = 255.0 / -SPECTRO_FLOOR_DB;
+
+    for (int c = 0; c < task->columns; c++) {
+        apply_window(task->samples + (size_t)c * SPECTRO_HOP, builder->window, frame, SPECTRO_FFT_SIZE);
+        fft_real_forward(fft, frame, re, im);
+        power_spectrum(re, im, power, SPECTRO_BINS);
+
+        uint8_t* column = task->out + (size_t)c * SPECTRO_BANDS;
+        for (int b = 0; b < SPECTRO_BANDS; b++) {
+            float p = 0;
+            for (int k = builder->band_first[b]; k <= builder->band_last[b]; k++) {
+                if (power[k] > p) p = power[k];
+            }
+            double db = p > 0 ? 10.0 * log10(p) + builder->offset_db : SPECTRO_FLOOR_DB;
+            double v = (db - SPECTRO_FLOOR_DB) * scale;
+            column[b] = (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : lrint(v));
+        }
+    }
+}
+
+static void* spectro_worker(void* data) {
+    SpectroBuilder* builder = data;
+    FFT* fft = fft_new(SPECTRO_FFT_SIZE);
+
+    pthread_mutex_lock(&builder->mutex);
+    for (;;) {
+        SpectroTask* task = builder->queue_head;
+        if (!task) {
+            if (builder->quit) {
+                break;
+            }
+            pthread_cond_wait(&builder->cond, &builder->mutex);
+            continue;
+        }
+        builder->queue_head = task->next_queued;
+        if (!builder->queue_head) {
+            builder->queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&builder->mutex);
+
+        int ok = fft && (task->out = malloc((size_t)task->columns * SPECTRO_BANDS)) != NULL;
+        if (ok) {
+            analyze_segment(builder, fft, task);
+        }
+        free(task->samples);
+        task->samples = NULL;
+
+        pthread_mutex_lock(&builder->mutex);
+        builder->failed |= !ok;
+        builder->in_flight--;
+        pthread_cond_broadcast(&builder->cond);
+    }
+    pthread_mutex_unlock(&builder->mutex);
+    fft_free(fft);
+    return NULL;
+}
+
+/* Queues the next columns columns and drops the frames only they needed. */
+static void dispatch_segment(SpectroBuilder* builder, int columns) {
+    size_t frames = SPECTRO_SEGMENT_FRAMES(columns);
+    size_t have = builder->pending_len < frames ? builder->pending_len : frames;
+    SpectroTask* task = calloc(1, sizeof(SpectroTask));
+    float* samples = malloc(frames * sizeof(float));
+    if (!task || !samples) {
+        free(task);
+        free(samples);
+        builder->failed = 1;
+    } else {
+        memcpy(samples, builder->pending, have * sizeof(float));
+        memset(samples + have, 0, (frames - have) * sizeof(float));
+        task->first_column = builder->next_column;
+        task->columns = columns;
+        task->samples = samples;
+    }
+
+    size_t drop = (size_t)columns * SPECTRO_HOP;
+    drop = drop < builder->pending_len ? drop : builder->pending_len;
+    memmove(builder->pending, builder->pending + drop, (builder->pending_len - drop) * sizeof(float));
+    builder->pending_len -= drop;
+    builder->next_column += columns;
+    if (!task || !samples) {
+        return;
+    }
+
+    if (builder->last) {
+        builder->last->next = task;
+    } else {
+        builder->first = task;
+    }
+    builder->last = task;
+
+    pthread_mutex_lock(&builder->mutex);
+    while (builder->in_flight >= builder->started * SPECTRO_QUEUE_PER_WORKER) {
+        pthread_cond_wait(&builder->cond, &builder->mutex);
+    }
+    if (builder->queue_tail) {
+        builder->queue_tail->next_queued = task;
+    } else {
+        builder->queue_head = task;
+    }
+    builder->queue_tail = task;
+    builder->in_flight++;
+    pthread_cond_broadcast(&builder->cond);
+    pthread_mutex_unlock(&builder->mutex);
+}
+
+SpectroBuilder* spectro_builder_new(int channels, int sample_rate, int threads) {
+    if (channels < 1 || sample_rate <= 0) {
+        return NULL;
+    }
+    SpectroBuilder* builder = calloc(1, sizeof(SpectroBuilder));
+    if (!builder) {
+        return NULL;
+    }
+    builder->channels = channels;
+    builder->sample_rate = sample_rate;
+    builder->threads = threads > 0 ? threads : 1;
+    builder->offset_db = -20.0 * log10(SPECTRO_FFT_SIZE / 4.0);
+    fft_window_hann(builder->window, SPECTRO_FFT_SIZE);
+    init_bands(builder);
+    pthread_mutex_init(&builder->mutex, NULL);
+    pthread_cond_init(&builder->cond, NULL);
+
+    /* Column 0 is centred on frame HOP / 2, so its window starts before the file. */
+    builder->pending = calloc(SPECTRO_SEGMENT_FRAMES(SPECTRO_SEGMENT_COLUMNS), sizeof(float));
+    builder->pending_len = (SPECTRO_FFT_SIZE - SPECTRO_HOP) / 2;
+    builder->workers = calloc((size_t)builder->threads, sizeof(pthread_t));
+    while (builder->pending && builder->workers && builder->started < builder->threads &&
+           pthread_create(&builder->workers[builder->started], NULL, spectro_worker, builder) == 0) {
+        builder->started++;
+    }
+    if (builder->started == 0) {
+        spectro_builder_free(builder);
+        return NULL;
+    }
+    return builder;
+}
+
+void spectro_builder_feed(SpectroBuilder* builder, const float* interleaved, size_t frames) {
+    size_t need = SPECTRO_SEGMENT_FRAMES(SPECTRO_SEGMENT_COLUMNS);
+    int ch = builder->channels;
+    float gain = 1.0f / ch;
+
+    while (frames > 0) {
+        size_t take = need - builder->pending_len;
+        if (take > frames) {
+            take = frames;
+        }
+        float* out = builder->pending + builder->pending_len;
+        for (size_t i = 0; i < take; i++) {
+            float sum = 0;
+            for (int c = 0; c < ch; c++) {
+                sum += interleaved[i * ch + c];
+            }
+            out[i] = sum * gain;
+        }
+        builder->pending_len += take;
+        builder->frames += take;
+        interleaved += take * ch;
+        frames -= take;
+
+        if (builder->pending_len == need) {
+            dispatch_segment(builder, SPECTRO_SEGMENT_COLUMNS);
+        }
+    }
+}
+
+SpectroData* spectro_builder_finish(SpectroBuilder* builder) {
+    int64_t columns = (builder->frames + SPECTRO_HOP - 1) / SPECTRO_HOP;
+    while (builder->next_column < columns) {
+        int64_t left = columns - builder->next_column;
+        dispatch_segment(builder, left < SPECTRO_SEGMENT_COLUMNS ? (int)left : SPECTRO_SEGMENT_COLUMNS);
+    }
+    pthread_mutex_lock(&builder->mutex);
+    while (builder->in_flight > 0) {
+        pthread_cond_wait(&builder->cond, &builder->mutex);
+    }
+    int failed = builder->failed;
+    pthread_mutex_unlock(&builder->mutex);
+
+    SpectroData* spectro = failed ? NULL : calloc(1, sizeof(SpectroData));
+    if (!spectro) {
+        spectro_builder_free(builder);
+        return NULL;
+    }
+    spectro->sample_rate = builder->sample_rate;
+    spectro->frames = builder->frames;
+    spectro->level_columns[0] = columns;
+    spectro->frames_per_column[0] = SPECTRO_HOP;
+    spectro->num_levels = 1;
+    size_t total = (size_t)columns;
+    while (spectro->num_levels < SPECTRO_MAX_LEVELS &&
+           spectro->level_columns[spectro->num_levels - 1] > SPECTRO_MIN_LEVEL_COLUMNS) {
+        int l = spectro->num_levels++;
+        spectro->level_columns[l] = (spectro->level_columns[l - 1] + 1) / 2;
+        spectro->frames_per_column[l] = spectro->frames_per_column[l - 1] * 2;
+        total += (size_t)spectro->level_columns[l];
+    }
+
+    spectro->data = malloc(total * SPECTRO_BANDS + 1);
+    if (!spectro->data) {
+        free(spectro);
+        spectro_builder_free(builder);
+        return NULL;
+    }
+    uint8_t* level = spectro->data;
+    for (SpectroTask* task = builder->first; task; task = task->next) {
+        memcpy(level + task->first_column * SPECTRO_BANDS, task->out, (size_t)task->columns * SPECTRO_BANDS);
+    }
+    spectro_builder_free(builder);
+
+    for (int l = 0; l < spectro->num_levels; l++) {
+        spectro->levels[l] = level;
+        uint8_t* next = level + spectro->level_columns[l] * SPECTRO_BANDS;
+        if (l + 1 < spectro->num_levels) {
+            int64_t src_columns = spectro->level_columns[l];
+            for (int64_t i = 0; i < spectro->level_columns[l + 1]; i++) {
+                const uint8_t* a = level + 2 * i * SPECTRO_BANDS;
+                const uint8_t* b = 2 * i + 1 < src_columns ? a + SPECTRO_BANDS : a;
+                for (int band = 0; band < SPECTRO_BANDS; band++) {
+                    next[i * SPECTRO_BANDS + band] = a[band] > b[band] ? a[band] : b[band];
+                }
+            }
+        }
+        level = next;
+    }
+    return spectro;
+}
+
+void spectro_builder_free(SpectroBuilder* builder) {
+    if (!builder) {
+        return;
+    }
+    pthread_mutex_lock(&builder->mutex);
+    builder->quit = 1;
+    /* Segments not started yet are dropped with the rest. */
+    builder->queue_head = builder->queue_tail = NULL;
+    pthread_cond_broadcast(&builder->cond);
+    pthread_mutex_unlock(&builder->mutex);
+    for (int i = 0; i < builder->started; i++) {
+        pthread_join(builder->workers[i], NULL);
+    }
+    SpectroTask* task = builder->first;
+    while (task) {
+        SpectroTask* next = task->next;
+        free(task->samples);
+        free(task->out);
+        free(task);
+        task = next;
+    }
+    free(builder->workers);
+    free(builder->pending);
+    pthread_mutex_destroy(&builder->mutex);
+    pthread_cond_destroy(&builder->cond);
+    free(builder);
+}
+
+void spectro_free(SpectroData* spectro) {
+    if (!spectro) {
+        return;
+    }
+    if (spectro->mapping) {
+        munmap(spectro->mapping, spectro->mapping_size);
+    }
+    free(spectro->data);
+    free(spectro);
+}
+
+int spectro_pick_level(const SpectroData* spectro, double frames_per_pixel) {
+    int level = 0;
+    for (int l = 1; l < spectro->num_levels; l++) {
+        if ((double)spectro->frames_per_column[l] <= frames_per_pixel) {
+            level = l;
+        }
+    }
+    return level;
+}
+
+uint8_t spectro_value(const SpectroData* spectro, int level, int64_t first, int64_t last, int band) {
+    int64_t columns = spectro->level_columns[level];
+    if (first < 0) first = 0;
+    if (last >= columns) last = columns - 1;
+    if (first > last || band < 0 || band >= SPECTRO_BANDS) {
+        return 0;
+    }
+
+    const uint8_t* data = spectro->levels[level] + band;
+    uint8_t value = data[first * SPECTRO_BANDS];
+    for (int64_t i = first + 1; i <= last; i++) {
+        if (data[i * SPECTRO_BANDS] > value) value = data[i * SPECTRO_BANDS];
+    }
+    return value;
+}
+
+static int spectro_cache_path(const char* file, char* out, size_t out_size) {
+    if (peaks_cache_path(file, out, out_size) != 0) {
+        return -1;
+    }
+    char* ext = strrchr(out, '.');
+    size_t base = ext ? (size_t)(ext - out) : strlen(out);
+    int n = snprintf(out + base, out_size - base, ".spectro");
+    return (n < 0 || (size_t)n >= out_size - base) ? -1 : 0;
+}
+
+SpectroData* spectro_cache_load(const char* file) {
+    char cache_path[PATH_MAX];
+    if (spectro_cache_path(file, cache_path, sizeof(cache_path)) != 0) {
+        return NULL;
+    }
+    int fd = open(cache_path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(SpectroFileHeader)) {
+        mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+
+    size_t size = (size_t)st.st_size;
+    const SpectroFileHeader* header = mapping;
+    SpectroData* spectro = NULL;
+    if (memcmp(header->magic, SPECTRO_MAGIC, sizeof(header->magic)) != 0 ||
+        header->bands != SPECTRO_BANDS || header->hop != SPECTRO_HOP ||
+        header->fft_size != SPECTRO_FFT_SIZE ||
+        header->num_levels < 1 || header->num_levels > SPECTRO_MAX_LEVELS ||
+        !(spectro = calloc(1, sizeof(SpectroData)))) {
+        goto fail;
+    }
+    spectro->sample_rate = header->sample_rate;
+    spectro->frames = header->frames;
+    spectro->num_levels = header->num_levels;
+    spectro->mapping = mapping;
+    spectro->mapping_size = size;
+
+    const int64_t* level_info = (const int64_t*)(header + 1);
+    size_t offset = sizeof(SpectroFileHeader) + (size_t)header->num_levels * 2 * sizeof(int64_t);
+    if (offset > size) {
+        goto fail;
+    }
+    for (int l = 0; l < header->num_levels; l++) {
+        int64_t columns = level_info[2 * l + 1];
+        if (columns < 0 || (uint64_t)columns > (size - offset) / SPECTRO_BANDS) {
+            goto fail;
+        }
+        spectro->frames_per_column[l] = level_info[2 * l];
+        spectro->level_columns[l] = columns;
+        spectro->levels[l] = (const uint8_t*)mapping + offset;
+        offset += (size_t)columns * SPECTRO_BANDS;
+    }
+    return spectro;
+
+fail:
+    free(spectro);
+    munmap(mapping, size);
+    return NULL;
+}
+
+int spectro_cache_store(const char* file, const SpectroData* spectro) {
+    char cache_path[PATH_MAX], tmp_path[PATH_MAX + 32];
+    if (spectro_cache_path(file, cache_path, sizeof(cache_path)) != 0) {
+        return -1;
+    }
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", cache_path, (long)getpid());
+    FILE* fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        return -1;
+    }
+
+    SpectroFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SPECTRO_MAGIC, sizeof(header.magic));
+    header.sample_rate = spectro->sample_rate;
+    header.bands = SPECTRO_BANDS;
+    header.hop = SPECTRO_HOP;
+    header.fft_size = SPECTRO_FFT_SIZE;
+    header.num_levels = spectro->num_levels;
+    header.frames = spectro->frames;
+
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    for (int l = 0; ok && l < spectro->num_levels; l++) {
+        int64_t level_info[2] = { spectro->frames_per_column[l], spectro->level_columns[l] };
+        ok = fwrite(level_info, sizeof(level_info), 1, fp) == 1;
+    }
+    for (int l = 0; ok && l < spectro->num_levels; l++) {
+        size_t count = (size_t)spectro->level_columns[l] * SPECTRO_BANDS;
+        ok = fwrite(spectro->levels[l], 1, count, fp) == count;
+    }
+
+    if (fclose(fp) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmp_path, cache_path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef SLOP_SPECTRO_H
+#define SLOP_SPECTRO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPECTRO_FFT_SIZE 2048
+#define SPECTRO_HOP 512
+#define SPECTRO_BANDS 128
+#define SPECTRO_MIN_FREQ 20.0
+#define SPECTRO_MAX_FREQ 20000.0
+#define SPECTRO_FLOOR_DB -120.0
+#define SPECTRO_MAX_LEVELS 24
+#define SPECTRO_MIN_LEVEL_COLUMNS 64
+#define SPECTRO_SEGMENT_COLUMNS 256
+
+/*
+ * Log-frequency spectrogram mipmap of the channels' mix. Level 0 has one
+ * column per SPECTRO_HOP frames, centred on it; a column is SPECTRO_BANDS
+ * bytes from the lowest band up, 0 at SPECTRO_FLOOR_DB and 255 at the
+ * level of a full-scale sine. Every following level halves the column
+ * count, keeping the louder of each pair. A spectrogram loaded from the
+ * cache maps the file, so only the columns drawn are read from disk.
+ */
+typedef struct {
+    int sample_rate;
+    int64_t frames;
+    int num_levels;
+    int64_t frames_per_column[SPECTRO_MAX_LEVELS];
+    int64_t level_columns[SPECTRO_MAX_LEVELS];
+    const uint8_t* levels[SPECTRO_MAX_LEVELS];
+    /* Either the cache mapping or one heap block holding every level. */
+    void* mapping;
+    size_t mapping_size;
+    uint8_t* data;
+} SpectroData;
+
+/*
+ * Segments of SPECTRO_SEGMENT_COLUMNS columns are transformed by a pool
+ * of threads workers while the caller keeps feeding; feed blocks while
+ * the pool is a few segments behind.
+ */
+typedef struct SpectroBuilder SpectroBuilder;
+
+SpectroBuilder* spectro_builder_new(int channels, int sample_rate, int threads);
+void spectro_builder_feed(SpectroBuilder* builder, const float* interleaved, size_t frames);
+SpectroData* spectro_builder_finish(SpectroBuilder* builder);
+void spectro_builder_free(SpectroBuilder* builder);
+
+void spectro_free(SpectroData* spectro);
+int spectro_pick_level(const SpectroData* spectro, double frames_per_pixel);
+/* The louder of columns first..last of band, clamped to the level. */
+uint8_t spectro_value(const SpectroData* spectro, int level, int64_t first, int64_t last, int band);
+
+/* Stored next to the file's peak cache, under the same key. */
+SpectroData* spectro_cache_load(const char* file);
+int spectro_cache_store(const char* file, const SpectroData* spectro);
+
+#endif
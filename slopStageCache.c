@@ -0,0 +1,117 @@
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "slopStageCache.h"
+#include "slopAnalysisDB.h"
+
+#define STAGE_MAGIC "SLOPSTG"
+#define STAGE_CHANNELS 2
+
+static atomic_uint temp_counter;
+
+int stagecache_path(const char* input, const char* prefix, const char* extension, char* out, size_t size) {
+    AnalysisKey key;
+    char dir[PATH_MAX];
+    if (analysisdb_key(input, &key) != 0 || analysisdb_cache_dir("stages", dir, sizeof(dir)) != 0) {
+        return -1;
+    }
+
+    size_t len = strlen(prefix) + 128;
+    char* name = malloc(len);
+    if (!name) {
+        return -1;
+    }
+    snprintf(name, len, "%d:%llu:%llu:%lld:%lld:%s", STAGECACHE_VERSION, (unsigned long long)key.dev,
+             (unsigned long long)key.ino, (long long)key.size, (long long)key.mtime_ns, prefix);
+    uint64_t hash = analysisdb_hash(name);
+    free(name);
+    int n = snprintf(out, size, "%s/%016llx.%s", dir, (unsigned long long)hash, extension);
+    return (n < 0 || (size_t)n >= size) ? -1 : 0;
+}
+
+/* Unique per process and call, so concurrent renders of one file never share a temporary. */
+void stagecache_temp_path(const char* path, char* out, size_t size) {
+    snprintf(out, size, "%s.%ld.%u.tmp", path, (long)getpid(), atomic_fetch_add(&temp_counter, 1));
+}
+
+int stagecache_touch(const char* path) {
+    return analysisdb_cache_touch(path);
+}
+
+int stagecache_commit(const char* temp, const char* path, uint64_t limit) {
+    if (rename(temp, path) != 0) {
+        unlink(temp);
+        return -1;
+    }
+    stagecache_trim(limit, path);
+    return 0;
+}
+
+void stagecache_trim(uint64_t limit, const char* keep) {
+    analysisdb_cache_trim("stages", limit, keep);
+}
+
+FILE* stagecache_create(const char* temp, int sample_rate) {
+    FILE* fp = fopen(temp, "w+b");
+    if (!fp) {
+        return NULL;
+    }
+    StageHeader header;
+    memset(&header, 0, sizeof(header));
+    header.sample_rate = sample_rate;
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        fclose(fp);
+        unlink(temp);
+        return NULL;
+    }
+    return fp;
+}
+
+int stagecache_write(FILE* fp, const float* stereo, size_t frames) {
+    return fwrite(stereo, STAGE_CHANNELS * sizeof(float), frames, fp) == frames ? 0 : -1;
+}
+
+/* The magic goes in last, so a checkpoint cut short never reads as whole. */
+int stagecache_finish(FILE* fp, int64_t frames, int64_t tail, double loudness) {
+    StageHeader header;
+    if (fseek(fp, 0, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, fp) != 1) {
+        return -1;
+    }
+    memcpy(header.magic, STAGE_MAGIC, sizeof(header.magic));
+    header.version = STAGECACHE_VERSION;
+    header.frames = frames;
+    header.tail = tail;
+    header.loudness = loudness;
+    if (fseek(fp, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, fp) != 1 || fflush(fp) != 0) {
+        return -1;
+    }
+    return fseek(fp, sizeof(header), SEEK_SET) == 0 ? 0 : -1;
+}
+
+FILE* stagecache_open(const char* path, StageHeader* header) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+    struct stat st;
+    if (fread(header, sizeof(*header), 1, fp) != 1 ||
+        memcmp(header->magic, STAGE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != STAGECACHE_VERSION || header->sample_rate <= 0 ||
+        header->frames < 0 || header->tail < 0 || fstat(fileno(fp), &st) != 0 ||
+        st.st_size != (off_t)(sizeof(*header) + (header->frames + header->tail) * STAGE_CHANNELS * sizeof(float))) {
+        fclose(fp);
+        return NULL;
+    }
+    return fp;
+}
+
+size_t stagecache_read(FILE* fp, float* stereo, size_t frames) {
+    return fread(stereo, STAGE_CHANNELS * sizeof(float), frames, fp);
+}
@@ -0,0 +1,53 @@
+#ifndef SLOP_STAGE_CACHE_H
+#define SLOP_STAGE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Bump when a stage's output changes, so old checkpoints stop matching. */
+#define STAGECACHE_VERSION 2
+
+/*
+ * Checkpoints of a render's prefix, the signal on either side of loudness
+ * normalisation, kept under $XDG_CACHE_HOME/slopmaster/stages. A file is
+ * keyed by the input's identity and a description of every stage up to
+ * the checkpoint, so a render that changes only later stages can start
+ * from it. Writers fill a private temporary file and rename it into
+ * place; the directory is trimmed to a size limit, least recently used
+ * first, and several processes may share it.
+ */
+
+/* Header of a native checkpoint; interleaved stereo floats follow. */
+typedef struct {
+    char magic[8];
+    int32_t version;
+    int32_t sample_rate;
+    /* The input's frames, then the prefix's tail run on silence. */
+    int64_t frames;
+    int64_t tail;
+    double loudness;
+} StageHeader;
+
+/* -1 if the input cannot be keyed. extension names the file's format. */
+int stagecache_path(const char* input, const char* prefix, const char* extension, char* out, size_t size);
+void stagecache_temp_path(const char* path, char* out, size_t size);
+/* Marks path as just used; -1 if it is not cached. */
+int stagecache_touch(const char* path);
+/* Renames temp over path, then trims the cache to limit bytes, keeping path. */
+int stagecache_commit(const char* temp, const char* path, uint64_t limit);
+/* Least recently used first; never keep, if given, or a writer's temporary. */
+void stagecache_trim(uint64_t limit, const char* keep);
+
+/*
+ * Native checkpoints. A new one is written after a placeholder header;
+ * finishing fills the header in and leaves the file at the first frame,
+ * ready to be read back.
+ */
+FILE* stagecache_create(const char* temp, int sample_rate);
+int stagecache_write(FILE* fp, const float* stereo, size_t frames);
+int stagecache_finish(FILE* fp, int64_t frames, int64_t tail, double loudness);
+FILE* stagecache_open(const char* path, StageHeader* header);
+size_t stagecache_read(FILE* fp, float* stereo, size_t frames);
+
+#endif
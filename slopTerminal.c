@@ -3,198 +3,390 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <dirent.h>
 #include <getopt.h>
 #include <errno.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <time.h>
+#include <stdint.h>
 #include <pthread.h>
 
+#include "slopMaster.h"
+#include "slopAnalysisDB.h"
+#include "slopCluster.h"
+#include "slopCompare.h"
+#include "slopManifest.h"
+#include "slopTrace.h"
+
 #define MAX_PATH 1024
-#define COMMAND_SIZE 524288
 #define MAX_THREADS 4
 
 FILE* log_file = NULL;
+AnalysisDB* analysis_db = NULL;
 int total_files = 0;
-int processed_files = 0;
+double* file_progress = NULL;
+char** input_files = NULL;
+const SlopSettings* master_settings = NULL;
+const char* cluster_workers = NULL;
+const char* manifest_path = NULL;
+int stems_mode = 0;
+unsigned long manifest_queued = 0, manifest_done = 0, manifest_failed = 0;
+const char* compare_processed_dir = NULL;
+const char* compare_difference_dir = NULL;
+SlopFormat compare_format;
+int compare_next = 0, compare_failed = 0;
+int verbose = 0;
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
-int check_ffmpeg_installed(void);
-void master_audio_file(const char* input_file, const char* output_file, int vocal_mode, const char* output_format, int reverb, double reverb_delay, double reverb_decay, int bass_boost, int wet);
-int process_audio_files(const char* input_dir, const char* output_dir, int vocal_mode, const char* output_format, int reverb, double reverb_delay, double reverb_decay, int bass_boost, int wet);
+int collect_audio_files(const char* input_dir);
+int process_audio_files(const char* input_dir, const char* output_dir, const SlopSettings* settings);
+int compare_main(int argc, char *argv[]);
+int process_manifest(const char* path, const char* output_dir, const SlopSettings* settings);
+int process_stems(const char* input_dir, const char* output_dir, const SlopSettings* settings);
 void print_usage(const char* program_name);
-void* process_file_thread(void* arg);
-void update_progress();
-int is_directory_writable(const char* path);
-
-typedef struct {
-    char input_file[MAX_PATH];
-    char output_file[MAX_PATH];
-    int vocal_mode;
-    char output_format[10];
-    int reverb;
-    double reverb_delay;
-    double reverb_decay;
-    int bass_boost;
-    int wet;
-} ThreadArgs;
+void on_job_progress(int job, double fraction, void* user_data);
+void on_job_done(int job, SlopStatus status, const char* message, void* user_data);
+void on_manifest_job_done(int job, SlopStatus status, const char* message, void* user_data);
+void update_progress(void);
 
 int main(int argc, char *argv[]) {
     char input_dir[MAX_PATH] = ".";
     char output_dir[MAX_PATH] = ".";
-    int opt, vocal_mode = 0, reverb = 0, bass_boost = 0, wet = 0;
-    int verbose = 0;
-    char output_format[10] = "wav";
-    double reverb_delay = 60.0, reverb_decay = 0.5;
+    int opt, worker_port = 0;
+    const char* accounting_path = NULL;
+    const char* trace_path = NULL;
+    SlopSettings settings;
+    static const struct option long_options[] = {
+        { "keep-rate", no_argument, NULL, 'K' },
+        { "manifest", required_argument, NULL, 'M' },
+        { "stems", no_argument, NULL, 'S' },
+        { "stage-cache", required_argument, NULL, 'G' },
+        { "accounting", required_argument, NULL, 'A' },
+        { "trace", required_argument, NULL, 'T' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    if (argc > 1 && strcmp(argv[1], "compare") == 0) {
+        return compare_main(argc - 1, argv + 1);
+    }
+
+    slopmaster_settings_preset(&settings, SLOPMASTER_PRESET_STANDARD);
+    settings.threads = MAX_THREADS;
 
     log_file = fopen("audioMaster.log", "a");
     if (!log_file) {
         fprintf(stderr, "Error opening log file: %s\n", strerror(errno));
         return 1;
     }
+    settings.log = log_file;
 
-    while ((opt = getopt(argc, argv, "i:o:vhf:nrd:e:bw")) != -1) {
+    while ((opt = getopt_long(argc, argv, "i:o:vhf:nrd:e:I:bwNP:FKC:W:M:SG:A:T:", long_options, NULL)) != -1) {
         switch (opt) {
             case 'i': strncpy(input_dir, optarg, MAX_PATH - 1); break;
             case 'o': strncpy(output_dir, optarg, MAX_PATH - 1); break;
-            case 'v': vocal_mode = 1; break;
-            case 'f': strncpy(output_format, optarg, 9); break;
+            case 'v': settings.chain.vocal_mode = 1; break;
+            case 'f':
+                if (slopmaster_parse_format(optarg, &settings.format) != 0) {
+                    fprintf(stderr, "Unknown output format: %s\n", optarg);
+                    fclose(log_file);
+                    return 1;
+                }
+                break;
             case 'n': verbose = 1; break;
-            case 'r': reverb = 1; break;
-            case 'd': reverb_delay = atof(optarg); break;
-            case 'e': reverb_decay = atof(optarg); break;
-            case 'b': bass_boost = 1; break;
-            case 'w': wet = 1; break;
+            case 'r': settings.chain.reverb = 1; break;
+            case 'd': settings.chain.reverb_delay = atof(optarg); break;
+            case 'e': settings.chain.reverb_decay = atof(optarg); break;
+            case 'I': settings.chain.reverb = 1; settings.reverb_ir = optarg; break;
+            case 'b': settings.chain.bass_boost = 1; break;
+            case 'w': settings.chain.wet = 1; break;
+            case 'N': settings.engine = SLOPMASTER_ENGINE_NATIVE; break;
+            case 'P': settings.noise_profile = optarg; break;
+            case 'F': settings.plan = 0; break;
+            case 'K': settings.keep_rate = 1; break;
+            case 'C': cluster_workers = optarg; break;
+            case 'W': worker_port = atoi(optarg); break;
+            case 'M': manifest_path = optarg; break;
+            case 'S': stems_mode = 1; break;
+            case 'G': settings.stage_cache_mb = atoi(optarg); break;
+            case 'A': accounting_path = optarg; break;
+            case 'T': trace_path = optarg; break;
             case 'h': print_usage(argv[0]); fclose(log_file); return 0;
             default: fprintf(stderr, "Unknown option: %c\n", opt);
                      print_usage(argv[0]); fclose(log_file); return 1;
         }
     }
 
-    if (!is_directory_writable(input_dir) || !is_directory_writable(output_dir)) {
+    if (worker_port > 0) {
+        if (!slopmaster_is_directory_writable(output_dir)) {
+            fprintf(stderr, "Error: Working directory is not writable\n");
+            fclose(log_file);
+            return 1;
+        }
+        printf("Serving coordinators on port %d, working in %s\n", worker_port, output_dir);
+        slopcluster_serve(worker_port, output_dir, settings.threads, log_file);
+        fprintf(stderr, "Error: Cannot listen on port %d\n", worker_port);
+        fclose(log_file);
+        return 1;
+    }
+
+    if (cluster_workers && (settings.noise_profile || settings.reverb_ir)) {
+        fprintf(stderr, "Error: -P and -I cannot be used with -C\n");
+        fclose(log_file);
+        return 1;
+    }
+
+    if (cluster_workers && manifest_path) {
+        fprintf(stderr, "Error: -M cannot be used with -C\n");
+        fclose(log_file);
+        return 1;
+    }
+
+    if (stems_mode && (cluster_workers || manifest_path)) {
+        fprintf(stderr, "Error: -S cannot be used with -C or -M\n");
+        fclose(log_file);
+        return 1;
+    }
+
+    if ((accounting_path || trace_path) && cluster_workers) {
+        fprintf(stderr, "Error: -A and -T cannot be used with -C\n");
+        fclose(log_file);
+        return 1;
+    }
+
+    if ((!manifest_path && !slopmaster_is_directory_writable(input_dir)) ||
+        !slopmaster_is_directory_writable(output_dir)) {
         fprintf(stderr, "Error: Input or output directory is not writable\n");
         fclose(log_file);
         return 1;
     }
-    
-    if (!check_ffmpeg_installed()) {
+
+    if (settings.engine == SLOPMASTER_ENGINE_FFMPEG && !cluster_workers && !stems_mode &&
+        !slopmaster_ffmpeg_available()) {
         fprintf(stderr, "Error: FFmpeg is not installed or not in the system PATH.\n");
         fclose(log_file);
         return 1;
     }
 
-    int result = process_audio_files(input_dir, output_dir, vocal_mode, output_format, reverb, reverb_delay, reverb_decay, bass_boost, wet);
+    if (accounting_path && !(settings.accounting = fopen(accounting_path, "a"))) {
+        fprintf(stderr, "Error opening accounting file %s: %s\n", accounting_path, strerror(errno));
+        fclose(log_file);
+        return 1;
+    }
+
+    if (trace_path && trace_start(trace_path) != 0) {
+        fprintf(stderr, "Error opening trace file %s: %s\n", trace_path, strerror(errno));
+        if (settings.accounting) {
+            fclose(settings.accounting);
+        }
+        fclose(log_file);
+        return 1;
+    }
+    trace_name_thread("main");
+
+    analysis_db = analysisdb_open_default();
+    if (!analysis_db && verbose) {
+        fprintf(stderr, "Analysis database unavailable\n");
+    }
+
+    int result = manifest_path ? process_manifest(manifest_path, output_dir, &settings)
+               : stems_mode    ? process_stems(input_dir, output_dir, &settings)
+                               : process_audio_files(input_dir, output_dir, &settings);
+    if (trace_path && trace_stop() != 0) {
+        fprintf(stderr, "Error writing trace file %s: %s\n", trace_path, strerror(errno));
+        result = 1;
+    }
+    analysisdb_close(analysis_db);
+    if (settings.accounting) {
+        fclose(settings.accounting);
+    }
     fclose(log_file);
     return result;
 }
 
-int check_ffmpeg_installed(void) {
-    return system("ffmpeg -version > /dev/null 2>&1") == 0;
+/* Records what a file was last mastered with, keyed like the GUI's analysis. */
+static void record_render(const char* input_file, const SlopSettings* settings) {
+    AnalysisKey key;
+    if (analysisdb_key(input_file, &key) != 0) {
+        return;
+    }
+    AnalysisRecord record;
+    memset(&record, 0, sizeof(record));
+    record.fields = ANALYSISDB_HAS_RENDER;
+    record.render_hash = slopmaster_settings_hash(settings);
+    record.render_time = time(NULL);
+    analysisdb_update(analysis_db, &key, &record);
 }
 
-void master_audio_file(const char* input_file, const char* output_file, int vocal_mode, const char* output_format, int reverb, double reverb_delay, double reverb_decay, int bass_boost, int wet) {
-    char filter_complex[COMMAND_SIZE / 2];
-    snprintf(filter_complex, COMMAND_SIZE / 2,
-        "aformat=channel_layouts=stereo:sample_rates=48000,"
-        "highpass=f=20,lowpass=f=20000,"
-        "afftdn=nr=10:nf=-25,"
-        "compand=attacks=0:points=-80/-900|-45/-15|-27/-9|-15/-5|-5/-2|0/-1|20/0,"
-        "equalizer=f=60:t=q:w=1.5:g=1,"
-        "equalizer=f=120:t=q:w=1:g=-1,"
-        "equalizer=f=1000:t=q:w=1.5:g=-1,"
-        "equalizer=f=4000:t=q:w=1:g=2,"
-        "equalizer=f=6000:t=q:w=1:g=1.5,"
-        "equalizer=f=8000:t=q:w=1:g=1,"
-        "equalizer=f=12000:t=q:w=1.5:g=1,"
-        "stereotools=mlev=1:slev=1.2:sbal=0.2:phase=0:mode=lr>lr,"
-        "loudnorm=I=-14:TP=-1:LRA=9,"
-        "alimiter=level_in=1:level_out=1:limit=0.95:attack=5:release=30,"
-        "volume=1.1,pan=stereo|c0=c0|c1=c1"
-    );
-
-    if (reverb) {
-        char reverb_filter[100];
-        snprintf(reverb_filter, sizeof(reverb_filter), 
-                ",aecho=0.8:0.5:%d|%d|%d:%.1f|%.1f|%.1f",
-                (int)reverb_delay, (int)(reverb_delay*1.5), (int)(reverb_delay*2),
-                reverb_decay, reverb_decay*0.8, reverb_decay*0.6);
-        strncat(filter_complex, reverb_filter, COMMAND_SIZE / 2 - strlen(filter_complex) - 1);
-    }
-
-    if (bass_boost) {
-        strncat(filter_complex, ",equalizer=f=100:t=q:w=1:g=5", COMMAND_SIZE / 2 - strlen(filter_complex) - 1);
-    }
-
-    if (wet) {
-        strncat(filter_complex, ",asplit[dry][wet];"
-                                "[wet]aecho=0.8:0.88:60:0.4[wet];"
-                                "[dry][wet]amix=inputs=2:weights=0.7 0.3", 
-                COMMAND_SIZE / 2 - strlen(filter_complex) - 1);
-    }
-
-    if (vocal_mode) {
-        char vocal_filters[COMMAND_SIZE / 4];
-        snprintf(vocal_filters, COMMAND_SIZE / 4,
-            ",highpass=f=100,equalizer=f=200:t=q:w=1:g=-2,"
-            "equalizer=f=2500:t=q:w=1:g=2,equalizer=f=6000:t=q:w=1:g=1,"
-            "acompressor=threshold=0.15:ratio=3:attack=2:release=40:makeup=1:knee=2,"
-            "adeclick=w=100:o=50:a=100,deesser"
-        );
-        strncat(filter_complex, vocal_filters, COMMAND_SIZE / 2 - strlen(filter_complex) - 1);
-    }
-
-    char* command = malloc(COMMAND_SIZE);
-    if (!command) {
-        fprintf(stderr, "Memory allocation failed for command\n");
-        return;
+/* Fills input_files with the audio files in input_dir. */
+int collect_audio_files(const char* input_dir) {
+    DIR *dir = opendir(input_dir);
+    if (!dir) {
+        fprintf(stderr, "Error opening input directory: %s\n", strerror(errno));
+        return 1;
     }
 
-    char ffmpeg_command[COMMAND_SIZE / 4];
-    char output_options[COMMAND_SIZE / 4];
+    struct dirent *entry;
+    char input_file[MAX_PATH];
+    struct stat st;
+    int capacity = 0;
+
+    while ((entry = readdir(dir)) != NULL) {
+        snprintf(input_file, MAX_PATH, "%s/%s", input_dir, entry->d_name);
+        if (stat(input_file, &st) != 0 || !S_ISREG(st.st_mode) || !slopmaster_is_audio_file(entry->d_name)) {
+            continue;
+        }
+        if (total_files == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            input_files = realloc(input_files, capacity * sizeof(char*));
+            if (!input_files) {
+                fprintf(stderr, "Memory allocation failed\n");
+                closedir(dir);
+                return 1;
+            }
+        }
+        input_files[total_files++] = strdup(input_file);
+    }
+    closedir(dir);
+    return 0;
+}
 
-    snprintf(ffmpeg_command, COMMAND_SIZE / 4, "ffmpeg -i \"%s\" -filter_complex '", input_file);
-    snprintf(output_options, COMMAND_SIZE / 4, "' -ar 48000 -c:a %s \"%s\" -y", 
-             strcmp(output_format, "wav") == 0 ? "pcm_s24le" : 
-             strcmp(output_format, "flac") == 0 ? "flac" : "libmp3lame", 
-             output_file);
+int process_audio_files(const char* input_dir, const char* output_dir, const SlopSettings* settings) {
+    uint64_t traced = trace_begin();
+    if (collect_audio_files(input_dir) != 0) {
+        return 1;
+    }
+    trace_end("scan", traced);
+
+    file_progress = calloc(total_files ? total_files : 1, sizeof(double));
+    master_settings = settings;
+    if (cluster_workers) {
+        SlopCallbacks* callbacks = calloc(total_files ? total_files : 1, sizeof(SlopCallbacks));
+        if (!file_progress || !callbacks) {
+            fprintf(stderr, "Memory allocation failed\n");
+            free(file_progress);
+            free(callbacks);
+            return 1;
+        }
+        for (int i = 0; i < total_files; i++) {
+            callbacks[i] = (SlopCallbacks){ on_job_progress, on_job_done, (void*)(intptr_t)i };
+        }
+        int failed = slopcluster_coordinate(cluster_workers, input_files, total_files, output_dir, settings,
+                                            callbacks);
+        printf("\n");
+        for (int i = 0; i < total_files; i++) {
+            free(input_files[i]);
+        }
+        free(input_files);
+        free(file_progress);
+        free(callbacks);
+        return failed > 0;
+    }
 
-    size_t remaining_space = COMMAND_SIZE - strlen(ffmpeg_command) - strlen(output_options) - 1;
-    if (strlen(filter_complex) > remaining_space) {
-        fprintf(stderr, "Filter complex too long for command buffer\n");
-        free(command);
-        return;
+    SlopMaster* master = slopmaster_new(settings);
+    if (!file_progress || !master) {
+        fprintf(stderr, "Could not start the mastering engine\n");
+        free(file_progress);
+        return 1;
     }
 
-    snprintf(command, COMMAND_SIZE, "%s%s%s", ffmpeg_command, filter_complex, output_options);
+    for (int i = 0; i < total_files; i++) {
+        SlopCallbacks callbacks = { on_job_progress, on_job_done, (void*)(intptr_t)i };
+        char* output_file = slopmaster_output_path(output_dir, input_files[i], settings->format);
+        if (!output_file || slopmaster_submit_file(master, input_files[i], output_file, &callbacks) == 0) {
+            fprintf(stderr, "Could not queue %s\n", input_files[i]);
+        }
+        free(output_file);
+    }
 
-    FILE* fp = popen(command, "r");
-    if (!fp) {
-        fprintf(stderr, "Error executing FFmpeg command for %s\n", input_file);
-        free(command);
-        return;
+    slopmaster_wait_all(master);
+    printf("\n");
+    slopmaster_usage_summary(master, stdout);
+    if (verbose) {
+        SlopAllocStats stats;
+        slopmaster_alloc_stats(master, &stats);
+        printf("Allocations: %lu over %lu jobs, %lu after each worker's first; arena peak %zu KB\n",
+               stats.allocations, stats.jobs, stats.steady_allocations, stats.arena_peak / 1024);
     }
+    slopmaster_free(master);
 
-    char buffer[1024];
-    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-        fprintf(log_file, "%s", buffer);
+    for (int i = 0; i < total_files; i++) {
+        free(input_files[i]);
     }
+    free(input_files);
+    free(file_progress);
+    return 0;
+}
 
-    int status = pclose(fp);
-    if (status == 0) {
-        fprintf(log_file, "Successfully mastered: %s\n", input_file);
-    } else {
-        fprintf(stderr, "Error processing %s. FFmpeg exited with status: %d\n", input_file, status);
-        fprintf(log_file, "Command that caused the error:\n%s\n", command);
+static int name_contains(const char* name, const char* word) {
+    size_t len = strlen(word);
+    for (; *name; name++) {
+        if (strncasecmp(name, word, len) == 0) {
+            return 1;
+        }
     }
+    return 0;
+}
 
-    free(command);
-    pthread_mutex_lock(&mutex);
-    processed_files++;
-    update_progress();
-    pthread_mutex_unlock(&mutex);
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
 }
 
-int process_audio_files(const char* input_dir, const char* output_dir, int vocal_mode, const char* output_format, int reverb, double reverb_delay, double reverb_decay, int bass_boost, int wet) {
+/*
+ * Gathers the stems in a song directory, each with the master chain plus
+ * the stage its name asks for: vocal mode for vocals, bass boost for bass.
+ * Sorted, so the float sum is the same from run to run; none if there
+ * are more than SLOPMASTER_MAX_STEMS.
+ */
+static int collect_stems(const char* song_dir, const SlopSettings* settings, SlopStem* stems) {
+    DIR *dir = opendir(song_dir);
+    if (!dir) {
+        return 0;
+    }
+
+    struct dirent *entry;
+    char path[MAX_PATH];
+    struct stat st;
+    char* names[SLOPMASTER_MAX_STEMS];
+    int count = 0;
+
+    while ((entry = readdir(dir)) != NULL) {
+        snprintf(path, MAX_PATH, "%s/%s", song_dir, entry->d_name);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode) || !slopmaster_is_audio_file(entry->d_name)) {
+            continue;
+        }
+        if (count == SLOPMASTER_MAX_STEMS) {
+            fprintf(stderr, "Error: %s has more than %d stems\n", song_dir, SLOPMASTER_MAX_STEMS);
+            while (count > 0) {
+                free(names[--count]);
+            }
+            break;
+        }
+        if (!(names[count] = strdup(path))) {
+            break;
+        }
+        count++;
+    }
+    closedir(dir);
+
+    qsort(names, count, sizeof(char*), compare_names);
+    for (int i = 0; i < count; i++) {
+        const char* name = strrchr(names[i], '/') + 1;
+        stems[i].input = names[i];
+        stems[i].chain = settings->chain;
+        if (name_contains(name, "vocal") || name_contains(name, "vox")) {
+            stems[i].chain.vocal_mode = 1;
+        }
+        if (name_contains(name, "bass")) {
+            stems[i].chain.bass_boost = 1;
+        }
+    }
+    return count;
+}
+
+/* Masters each subdirectory of input_dir as one song from its stems. */
+int process_stems(const char* input_dir, const char* output_dir, const SlopSettings* settings) {
     DIR *dir = opendir(input_dir);
     if (!dir) {
         fprintf(stderr, "Error opening input directory: %s\n", strerror(errno));
@@ -202,94 +394,372 @@ int process_audio_files(const char* input_dir, const char* output_dir, int vocal
     }
 
     struct dirent *entry;
-    char input_file[MAX_PATH], output_file[MAX_PATH];
+    char song_dir[MAX_PATH];
     struct stat st;
+    int capacity = 0;
+    uint64_t traced = trace_begin();
 
-    // Count total files
     while ((entry = readdir(dir)) != NULL) {
-        snprintf(input_file, MAX_PATH, "%s/%s", input_dir, entry->d_name);
-        if (stat(input_file, &st) == 0 && S_ISREG(st.st_mode)) {
-            size_t name_len = strlen(entry->d_name);
-            const char *ext = entry->d_name + name_len - 4;
-            if (name_len > 4 && (strcmp(ext, ".wav") == 0 || strcmp(ext, ".mp3") == 0 ||
-                strcmp(ext, ".aac") == 0 || strcmp(ext, ".ogg") == 0 ||
-                (name_len > 5 && strcmp(entry->d_name + name_len - 5, ".flac") == 0))) {
-                total_files++;
+        snprintf(song_dir, MAX_PATH, "%s/%s", input_dir, entry->d_name);
+        if (entry->d_name[0] == '.' || stat(song_dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            continue;
+        }
+        if (total_files == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            input_files = realloc(input_files, capacity * sizeof(char*));
+            if (!input_files) {
+                fprintf(stderr, "Memory allocation failed\n");
+                closedir(dir);
+                return 1;
             }
         }
+        input_files[total_files++] = strdup(song_dir);
+    }
+    closedir(dir);
+    trace_end("scan", traced);
+
+    file_progress = calloc(total_files ? total_files : 1, sizeof(double));
+    master_settings = settings;
+    SlopMaster* master = slopmaster_new(settings);
+    if (!file_progress || !master) {
+        fprintf(stderr, "Could not start the mastering engine\n");
+        free(file_progress);
+        return 1;
     }
 
-    rewinddir(dir);
+    int failed = 0;
+    for (int i = 0; i < total_files; i++) {
+        SlopCallbacks callbacks = { on_job_progress, on_job_done, (void*)(intptr_t)i };
+        SlopStem stems[SLOPMASTER_MAX_STEMS];
+        traced = trace_begin();
+        int count = collect_stems(input_files[i], settings, stems);
+        trace_end("scan", traced);
+        const char* name = strrchr(input_files[i], '/') + 1;
+        const char* ext = slopmaster_format_extension(settings->format);
+        size_t size = strlen(output_dir) + strlen(name) + strlen(ext) + 16;
+        char* output_file = malloc(size);
+        if (output_file) {
+            snprintf(output_file, size, "%s/%sMastered.%s", output_dir, name, ext);
+        }
+        if (count == 0 || !output_file ||
+            slopmaster_submit_stems(master, stems, count, output_file, settings, &callbacks) == 0) {
+            fprintf(stderr, "Could not queue %s\n", input_files[i]);
+            file_progress[i] = 1.0;
+            failed++;
+        }
+        for (int j = 0; j < count; j++) {
+            free((char*)stems[j].input);
+        }
+        free(output_file);
+    }
 
-    pthread_t threads[MAX_THREADS];
-    int thread_count = 0;
+    slopmaster_wait_all(master);
+    printf("\n");
+    slopmaster_usage_summary(master, stdout);
+    slopmaster_free(master);
 
-    while ((entry = readdir(dir)) != NULL) {
-        snprintf(input_file, MAX_PATH, "%s/%s", input_dir, entry->d_name);
-        if (stat(input_file, &st) == 0 && S_ISREG(st.st_mode)) {
-            size_t name_len = strlen(entry->d_name);
-            const char *ext = entry->d_name + name_len - 4;
-            if (name_len > 4 && (strcmp(ext, ".wav") == 0 || strcmp(ext, ".mp3") == 0 ||
-                strcmp(ext, ".aac") == 0 || strcmp(ext, ".ogg") == 0 ||
-                (name_len > 5 && strcmp(entry->d_name + name_len - 5, ".flac") == 0))) {
-                snprintf(output_file, MAX_PATH, "%s/%.*sMastered.%s", output_dir, (int)(name_len - 4), entry->d_name, output_format);
-                
-                ThreadArgs* args = malloc(sizeof(ThreadArgs));
-                strcpy(args->input_file, input_file);
-                strcpy(args->output_file, output_file);
-                args->vocal_mode = vocal_mode;
-                strcpy(args->output_format, output_format);
-                args->reverb = reverb;
-                args->reverb_delay = reverb_delay;
-                args->reverb_decay = reverb_decay;
-                args->bass_boost = bass_boost;
-                args->wet = wet;
-
-                pthread_create(&threads[thread_count], NULL, process_file_thread, args);
-                thread_count++;
-
-                if (thread_count == MAX_THREADS) {
-                    for (int i = 0; i < MAX_THREADS; i++) {
-                        pthread_join(threads[i], NULL);
-                    }
-                    thread_count = 0;
-                }
+    for (int i = 0; i < total_files; i++) {
+        free(input_files[i]);
+    }
+    free(input_files);
+    free(file_progress);
+    return failed > 0;
+}
+
+/* What a manifest job's done callback needs once its line is gone. */
+typedef struct {
+    char* input;
+    SlopSettings settings;
+} ManifestJob;
+
+static void print_manifest_progress(void) {
+    printf("\rManifest: %lu done, %lu failed, %lu queued", manifest_done, manifest_failed,
+           manifest_queued - manifest_done - manifest_failed);
+    fflush(stdout);
+}
+
+/*
+ * Streams the manifest into the queue, holding at most a few jobs per
+ * thread, so a manifest of any length runs in constant memory.
+ */
+int process_manifest(const char* path, const char* output_dir, const SlopSettings* settings) {
+    char message[512];
+    Manifest* manifest = manifest_open(path, settings, message, sizeof(message));
+    if (!manifest) {
+        fprintf(stderr, "Error: %s\n", message);
+        return 1;
+    }
+    SlopMaster* master = slopmaster_new(settings);
+    if (!master) {
+        fprintf(stderr, "Could not start the mastering engine\n");
+        manifest_close(manifest);
+        return 1;
+    }
+
+    ManifestEntry entry;
+    int result, skipped = 0;
+    for (;;) {
+        uint64_t traced = trace_begin();
+        result = manifest_next(manifest, &entry, message, sizeof(message));
+        trace_end("scan", traced);
+        if (result == 0) {
+            break;
+        }
+        if (result < 0) {
+            pthread_mutex_lock(&mutex);
+            fprintf(stderr, "\nError: %s\n", message);
+            pthread_mutex_unlock(&mutex);
+            skipped++;
+            continue;
+        }
+        slopmaster_throttle(master, settings->threads * 4);
+
+        char* output_file = entry.output ? strdup(entry.output)
+                                         : slopmaster_output_path(output_dir, entry.input, entry.settings.format);
+        ManifestJob* job = malloc(sizeof(ManifestJob));
+        char* input = strdup(entry.input);
+        if (job && input && output_file) {
+            job->input = input;
+            job->settings = entry.settings;
+            pthread_mutex_lock(&mutex);
+            manifest_queued++;
+            pthread_mutex_unlock(&mutex);
+            SlopCallbacks callbacks = { NULL, on_manifest_job_done, job };
+            if (slopmaster_submit_file_settings(master, entry.input, output_file, &entry.settings, &callbacks) != 0) {
+                free(output_file);
+                continue;
             }
+            pthread_mutex_lock(&mutex);
+            manifest_queued--;
+            pthread_mutex_unlock(&mutex);
         }
+        fprintf(stderr, "\nCould not queue %s\n", entry.input);
+        free(job);
+        free(input);
+        free(output_file);
+        skipped++;
+    }
+    manifest_close(manifest);
+
+    slopmaster_wait_all(master);
+    printf("\n");
+    slopmaster_usage_summary(master, stdout);
+    if (verbose) {
+        SlopAllocStats stats;
+        slopmaster_alloc_stats(master, &stats);
+        printf("Allocations: %lu over %lu jobs, %lu after each worker's first; arena peak %zu KB\n",
+               stats.allocations, stats.jobs, stats.steady_allocations, stats.arena_peak / 1024);
     }
+    slopmaster_free(master);
+    return skipped > 0 || manifest_failed > 0;
+}
 
-    for (int i = 0; i < thread_count; i++) {
-        pthread_join(threads[i], NULL);
+void on_manifest_job_done(int job, SlopStatus status, const char* message, void* user_data) {
+    ManifestJob* manifest_job = user_data;
+    (void)job;
+    if (status == SLOPMASTER_OK) {
+        record_render(manifest_job->input, &manifest_job->settings);
     }
 
-    closedir(dir);
-    return 0;
+    pthread_mutex_lock(&mutex);
+    if (status == SLOPMASTER_OK) {
+        fprintf(log_file, "Successfully mastered: %s\n", manifest_job->input);
+        manifest_done++;
+    } else {
+        fprintf(stderr, "\nError processing %s: %s\n", manifest_job->input, message ? message : "cancelled");
+        manifest_failed++;
+    }
+    print_manifest_progress();
+    pthread_mutex_unlock(&mutex);
+
+    free(manifest_job->input);
+    free(manifest_job);
 }
 
-void* process_file_thread(void* arg) {
-    ThreadArgs* args = (ThreadArgs*)arg;
-    master_audio_file(args->input_file, args->output_file, args->vocal_mode, args->output_format, 
-                      args->reverb, args->reverb_delay, args->reverb_decay, args->bass_boost, args->wet);
-    free(arg);
-    return NULL;
+void on_job_progress(int job, double fraction, void* user_data) {
+    (void)job;
+    pthread_mutex_lock(&mutex);
+    file_progress[(intptr_t)user_data] = fraction;
+    update_progress();
+    pthread_mutex_unlock(&mutex);
 }
 
-void update_progress() {
-    float progress = (float)processed_files / total_files * 100;
-    printf("\rProgress: [%-20s] %.2f%%", "==================== ", progress);
+void on_job_done(int job, SlopStatus status, const char* message, void* user_data) {
+    const char* file = input_files[(intptr_t)user_data];
+    (void)job;
+    /* A stem song is a directory mastered with per-stem settings; there is no one render to record. */
+    if (status == SLOPMASTER_OK && !stems_mode) {
+        record_render(file, master_settings);
+    }
+
+    pthread_mutex_lock(&mutex);
+    if (status == SLOPMASTER_OK) {
+        fprintf(log_file, "Successfully mastered: %s\n", file);
+    } else {
+        fprintf(stderr, "\nError processing %s: %s\n", file, message ? message : "cancelled");
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+void update_progress(void) {
+    double sum = 0.0;
+    for (int i = 0; i < total_files; i++) {
+        sum += file_progress[i];
+    }
+    float progress = total_files > 0 ? (float)(sum / total_files * 100) : 100.0f;
+    int filled = (int)(progress / 5);
+    printf("\rProgress: [%-20.*s] %.2f%%", filled, "====================", progress);
     fflush(stdout);
 }
 
-int is_directory_writable(const char* path) {
-    char test_file[MAX_PATH];
-    snprintf(test_file, sizeof(test_file), "%s/test_write", path);
-    FILE* fp = fopen(test_file, "w");
-    if (fp) {
-        fclose(fp);
-        remove(test_file);
+static void print_comparison(const char* name, const CompareResult* result) {
+    printf("%s: offset %+lld (%.2f ms), gain %+.2f dB%s, correlation %.4f, "
+           "residual %.1f dB RMS / %.1f dB peak, null %.1f dB\n",
+           name, (long long)result->offset, result->offset * 1000.0 / result->sample_rate,
+           result->gain_db, result->inverted ? " inverted" : "", result->correlation,
+           result->residual_db, result->residual_peak_db, result->null_db);
+    if (verbose) {
+        for (int b = 0; b < COMPARE_BANDS; b++) {
+            printf("  %7.1f Hz: residual %6.1f dB, null %6.1f dB\n", result->band_center[b],
+                   result->band_residual_db[b], result->band_null_db[b]);
+        }
+    }
+}
+
+/* Compares one original with its mastered file, writing the difference if asked. */
+static int compare_pair(const char* original, const char* processed, const char* difference) {
+    CompareResult result;
+    char message[512];
+    int status = compare_files(original, processed, difference, &result, message, sizeof(message));
+
+    pthread_mutex_lock(&mutex);
+    if (status == 0) {
+        const char* name = strrchr(original, '/');
+        print_comparison(name ? name + 1 : original, &result);
+    } else {
+        fprintf(stderr, "Error: %s\n", message);
+    }
+    fflush(stdout);
+    pthread_mutex_unlock(&mutex);
+    return status;
+}
+
+static char* difference_path(const char* dir, const char* input) {
+    const char* base = strrchr(input, '/');
+    base = base ? base + 1 : input;
+    const char* dot = strrchr(base, '.');
+    int stem = dot && dot != base ? (int)(dot - base) : (int)strlen(base);
+    size_t size = strlen(dir) + stem + 32;
+    char* path = malloc(size);
+    if (path) {
+        snprintf(path, size, "%s/%.*sDifference.wav", dir, stem, base);
+    }
+    return path;
+}
+
+static void* compare_thread(void* data) {
+    (void)data;
+    for (;;) {
+        pthread_mutex_lock(&mutex);
+        int i = compare_next++;
+        pthread_mutex_unlock(&mutex);
+        if (i >= total_files) {
+            return NULL;
+        }
+
+        char* processed = slopmaster_output_path(compare_processed_dir, input_files[i], compare_format);
+        char* difference = compare_difference_dir ? difference_path(compare_difference_dir, input_files[i]) : NULL;
+        int failed = !processed || (compare_difference_dir && !difference) ||
+                     compare_pair(input_files[i], processed, difference) != 0;
+        pthread_mutex_lock(&mutex);
+        compare_failed += failed;
+        pthread_mutex_unlock(&mutex);
+        free(processed);
+        free(difference);
+    }
+}
+
+/*
+ * Null-tests mastered files against their originals: either one pair
+ * given on the command line, or every file in the input directory
+ * against its mastered file in the output directory.
+ */
+int compare_main(int argc, char *argv[]) {
+    const char* input_dir = ".";
+    int opt;
+    compare_processed_dir = ".";
+    compare_format = SLOPMASTER_FORMAT_WAV;
+
+    while ((opt = getopt(argc, argv, "i:o:f:D:nh")) != -1) {
+        switch (opt) {
+            case 'i': input_dir = optarg; break;
+            case 'o': compare_processed_dir = optarg; break;
+            case 'f':
+                if (slopmaster_parse_format(optarg, &compare_format) != 0) {
+                    fprintf(stderr, "Unknown output format: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'D': compare_difference_dir = optarg; break;
+            case 'n': verbose = 1; break;
+            case 'h': print_usage("slopTerminal"); return 0;
+            default: print_usage("slopTerminal"); return 1;
+        }
+    }
+
+    if (compare_difference_dir && !slopmaster_is_directory_writable(compare_difference_dir)) {
+        fprintf(stderr, "Error: Difference directory is not writable\n");
         return 1;
     }
-    return 0;
+
+    if (optind + 2 == argc) {
+        char* difference = compare_difference_dir ? difference_path(compare_difference_dir, argv[optind]) : NULL;
+        int status = compare_pair(argv[optind], argv[optind + 1], difference);
+        free(difference);
+        return status != 0;
+    }
+    if (optind != argc) {
+        print_usage("slopTerminal");
+        return 1;
+    }
+
+    if (collect_audio_files(input_dir) != 0) {
+        return 1;
+    }
+    /* Mastered files sharing the directory have no mastered file of their own. */
+    int kept = 0;
+    struct stat st;
+    for (int i = 0; i < total_files; i++) {
+        char* processed = slopmaster_output_path(compare_processed_dir, input_files[i], compare_format);
+        if (processed && stat(processed, &st) == 0) {
+            input_files[kept++] = input_files[i];
+        } else {
+            free(input_files[i]);
+        }
+        free(processed);
+    }
+    int skipped = total_files - kept;
+    total_files = kept;
+
+    pthread_t threads[MAX_THREADS];
+    int started = 0;
+    while (started < MAX_THREADS && pthread_create(&threads[started], NULL, compare_thread, NULL) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        compare_thread(NULL);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    printf("Compared %d files, %d failed, %d without a mastered file\n", total_files - compare_failed,
+           compare_failed, skipped);
+    for (int i = 0; i < total_files; i++) {
+        free(input_files[i]);
+    }
+    free(input_files);
+    return compare_failed > 0;
 }
 
 void print_usage(const char* program_name) {
@@ -303,7 +773,29 @@ void print_usage(const char* program_name) {
            "  -r               Enable reverb\n"
            "  -d <delay>       Set reverb delay (default: 60.0)\n"
            "  -e <decay>       Set reverb decay (default: 0.5)\n"
+           "  -I <ir_file>     Enable convolution reverb with an impulse response\n"
            "  -b               Enable bass boost\n"
            "  -w               Enable wet effect\n"
-           "  -h               Display this help message\n", program_name);
-}
\ No newline at end of file
+           "  -N               Master in-process with the native engine (no FFmpeg)\n"
+           "  -P <profile>     Share one noise profile file across all files (native engine)\n"
+           "  -F               Run every stage on every file (no analysis-driven plan)\n"
+           "  -K, --keep-rate  Keep each file's sample rate instead of converting to 48 kHz\n"
+           "  -C <workers>     Shard files across workers (host:port,host:port,...)\n"
+           "  -W <port>        Run as a worker on port, working in the output directory\n"
+           "  -M, --manifest <file>  Master the files listed in a CSV or JSONL manifest\n"
+           "  -S, --stems      Master each subdirectory of the input directory as one song from\n"
+           "                   its stems; vocal and bass stems get vocal mode and bass boost\n"
+           "  -G, --stage-cache <MB>  Checkpoint each file before loudness normalisation, in a\n"
+           "                   cache of at most MB, so re-rendering with later stages changed is fast\n"
+           "  -A, --accounting <file>  Append each job's time, CPU, memory and I/O to file as JSON\n"
+           "                   lines, and print percentiles and the slowest files at the end\n"
+           "  -T, --trace <file>  Write a timeline of every thread's work to file, for\n"
+           "                   chrome://tracing or ui.perfetto.dev\n"
+           "  -h               Display this help message\n"
+           "\n"
+           "Null test: %s compare [-i <input_dir>] [-o <output_dir>] [-f <format>] [-D <dir>] [-n]\n"
+           "           %s compare [-D <dir>] [-n] <original> <mastered>\n"
+           "  Aligns and gain-matches each original with its mastered file and reports the residual.\n"
+           "  -D <dir>         Write each residual to <dir> as a float WAV\n"
+           "  -n               Also report the residual per octave band\n", program_name, program_name, program_name);
+}
@@ -0,0 +1,305 @@
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "slopTrace.h"
+
+typedef struct {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+    int file;
+    /* Nonzero for async spans. */
+    int id;
+} TraceEvent;
+
+typedef struct {
+    TraceEvent events[TRACE_CHUNK_EVENTS];
+    int count;
+} TraceChunk;
+
+typedef struct TraceThread {
+    int tid;
+    int file;
+    /* Written out and reused each time it fills. */
+    TraceChunk chunk;
+    struct TraceThread* next;
+} TraceThread;
+
+static atomic_int enabled;
+/* Bumped by each recording, so a thread notices its buffers are gone. */
+static atomic_uint generation;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct timespec epoch;
+static FILE* trace_out;
+static long pid;
+static int write_failed;
+static TraceThread* threads;
+static int thread_count;
+/* File names by id - 1, and an open-addressed index of them, twice file_cap slots. */
+static char** files;
+static int* file_slots;
+static int file_count, file_cap;
+
+static _Thread_local TraceThread* current;
+static _Thread_local unsigned current_generation;
+
+/* Microseconds since trace_start, plus one so a start is never 0. */
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)(ts.tv_sec - epoch.tv_sec) * 1000000 + (ts.tv_nsec - epoch.tv_nsec) / 1000 + 1;
+}
+
+static void free_recording(void) {
+    while (threads) {
+        TraceThread* next = threads->next;
+        free(threads);
+        threads = next;
+    }
+    for (int i = 0; i < file_count; i++) {
+        free(files[i]);
+    }
+    free(files);
+    free(file_slots);
+    files = NULL;
+    file_slots = NULL;
+    thread_count = file_count = file_cap = 0;
+}
+
+static void write_json_string(const char* text) {
+    fputc('"', trace_out);
+    for (const unsigned char* p = (const unsigned char*)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(trace_out, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(trace_out, "\\u%04x", *p);
+        } else {
+            fputc(*p, trace_out);
+        }
+    }
+    fputc('"', trace_out);
+}
+
+static void write_args(int file) {
+    if (file > 0 && file <= file_count) {
+        fprintf(trace_out, ",\"args\":{\"file\":");
+        write_json_string(files[file - 1]);
+        fputc('}', trace_out);
+    }
+}
+
+/* Complete events for thread spans; async spans become a begin and end pair. */
+static void write_event(const TraceThread* thread, const TraceEvent* event) {
+    uint64_t start = event->start - 1, end = event->end - 1;
+    if (event->id) {
+        fprintf(trace_out, ",\n{\"ph\":\"b\",\"cat\":\"slopmaster\",\"id\":%d,\"pid\":%ld,\"tid\":%d,\"ts\":%llu,\"name\":",
+                event->id, pid, thread->tid, (unsigned long long)start);
+        write_json_string(event->name);
+        write_args(event->file);
+        fprintf(trace_out, "},\n{\"ph\":\"e\",\"cat\":\"slopmaster\",\"id\":%d,\"pid\":%ld,\"tid\":%d,\"ts\":%llu,\"name\":",
+                event->id, pid, thread->tid, (unsigned long long)end);
+        write_json_string(event->name);
+        fputc('}', trace_out);
+        return;
+    }
+    fprintf(trace_out, ",\n{\"ph\":\"X\",\"cat\":\"slopmaster\",\"pid\":%ld,\"tid\":%d,\"ts\":%llu,\"dur\":%llu,\"name\":",
+            pid, thread->tid, (unsigned long long)start, (unsigned long long)(end - start));
+    write_json_string(event->name);
+    write_args(event->file);
+    fputc('}', trace_out);
+}
+
+/* Appends the thread's spans to the file and empties its chunk; under trace_mutex. */
+static void flush_chunk(TraceThread* thread) {
+    for (int i = 0; i < thread->chunk.count; i++) {
+        write_event(thread, &thread->chunk.events[i]);
+    }
+    thread->chunk.count = 0;
+    write_failed |= ferror(trace_out) != 0;
+}
+
+int trace_start(const char* path) {
+    pthread_mutex_lock(&trace_mutex);
+    FILE* file = trace_out ? NULL : fopen(path, "w");
+    if (!file) {
+        pthread_mutex_unlock(&trace_mutex);
+        return -1;
+    }
+    trace_out = file;
+    pid = (long)getpid();
+    write_failed = 0;
+    fprintf(trace_out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+            "{\"ph\":\"M\",\"pid\":%ld,\"name\":\"process_name\",\"args\":{\"name\":\"slopmaster\"}}", pid);
+    clock_gettime(CLOCK_MONOTONIC, &epoch);
+    atomic_fetch_add(&generation, 1);
+    atomic_store(&enabled, 1);
+    pthread_mutex_unlock(&trace_mutex);
+    return 0;
+}
+
+int trace_enabled(void) {
+    return atomic_load_explicit(&enabled, memory_order_relaxed);
+}
+
+/* The calling thread's buffers, registered on first use in a recording. */
+static TraceThread* this_thread(void) {
+    unsigned gen = atomic_load(&generation);
+    if (current && current_generation == gen) {
+        return current;
+    }
+    TraceThread* thread = calloc(1, sizeof(TraceThread));
+    if (!thread) {
+        return NULL;
+    }
+    pthread_mutex_lock(&trace_mutex);
+    thread->tid = ++thread_count;
+    thread->next = threads;
+    threads = thread;
+    pthread_mutex_unlock(&trace_mutex);
+    current = thread;
+    current_generation = gen;
+    return thread;
+}
+
+void trace_name_thread(const char* name) {
+    TraceThread* thread = trace_enabled() ? this_thread() : NULL;
+    if (!thread) {
+        return;
+    }
+    pthread_mutex_lock(&trace_mutex);
+    if (trace_out) {
+        fprintf(trace_out, ",\n{\"ph\":\"M\",\"pid\":%ld,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":",
+                pid, thread->tid);
+        write_json_string(name);
+        fprintf(trace_out, "}}");
+    }
+    pthread_mutex_unlock(&trace_mutex);
+}
+
+/* FNV-1a. */
+static unsigned hash_name(const char* name) {
+    unsigned hash = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash;
+}
+
+/* The slot holding name's id, or the empty slot it belongs in. */
+static int* file_slot(const char* name) {
+    unsigned mask = (unsigned)file_cap * 2 - 1;
+    unsigned i = hash_name(name) & mask;
+    while (file_slots[i] && strcmp(files[file_slots[i] - 1], name) != 0) {
+        i = (i + 1) & mask;
+    }
+    return &file_slots[i];
+}
+
+static int grow_files(void) {
+    int cap = file_cap ? file_cap * 2 : 64;
+    char** grown = realloc(files, (size_t)cap * sizeof(char*));
+    if (!grown) {
+        return -1;
+    }
+    files = grown;
+    int* slots = calloc((size_t)cap * 2, sizeof(int));
+    if (!slots) {
+        return -1;
+    }
+    free(file_slots);
+    file_slots = slots;
+    file_cap = cap;
+    for (int id = 1; id <= file_count; id++) {
+        *file_slot(files[id - 1]) = id;
+    }
+    return 0;
+}
+
+int trace_file(const char* name) {
+    int id = 0;
+    if (!trace_enabled() || !name) {
+        return 0;
+    }
+    pthread_mutex_lock(&trace_mutex);
+    if (trace_out && (file_count < file_cap || grow_files() == 0)) {
+        int* slot = file_slot(name);
+        if (*slot) {
+            id = *slot;
+        } else if ((files[file_count] = strdup(name)) != NULL) {
+            id = *slot = ++file_count;
+        }
+    }
+    pthread_mutex_unlock(&trace_mutex);
+    return id;
+}
+
+void trace_set_file(int file) {
+    TraceThread* thread = trace_enabled() ? this_thread() : NULL;
+    if (thread) {
+        thread->file = file;
+    }
+}
+
+int trace_current_file(void) {
+    TraceThread* thread = trace_enabled() ? this_thread() : NULL;
+    return thread ? thread->file : 0;
+}
+
+uint64_t trace_begin(void) {
+    return trace_enabled() ? now_us() : 0;
+}
+
+static void record(const char* name, uint64_t start, int id) {
+    if (start == 0 || !trace_enabled()) {
+        return;
+    }
+    TraceThread* thread = this_thread();
+    if (!thread) {
+        return;
+    }
+    if (thread->chunk.count == TRACE_CHUNK_EVENTS) {
+        pthread_mutex_lock(&trace_mutex);
+        flush_chunk(thread);
+        pthread_mutex_unlock(&trace_mutex);
+    }
+    TraceEvent* event = &thread->chunk.events[thread->chunk.count++];
+    event->name = name;
+    event->start = start;
+    event->end = now_us();
+    event->file = thread->file;
+    event->id = id;
+}
+
+void trace_end(const char* name, uint64_t start) {
+    record(name, start, 0);
+}
+
+void trace_end_async(const char* name, uint64_t start, int id) {
+    record(name, start, id);
+}
+
+int trace_stop(void) {
+    atomic_store(&enabled, 0);
+    pthread_mutex_lock(&trace_mutex);
+    if (!trace_out) {
+        pthread_mutex_unlock(&trace_mutex);
+        return -1;
+    }
+    for (TraceThread* thread = threads; thread; thread = thread->next) {
+        flush_chunk(thread);
+    }
+    fprintf(trace_out, "\n]}\n");
+    int failed = write_failed || ferror(trace_out);
+    failed |= fclose(trace_out) != 0;
+    trace_out = NULL;
+    free_recording();
+    pthread_mutex_unlock(&trace_mutex);
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,49 @@
+#ifndef SLOP_TRACE_H
+#define SLOP_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Records spans of work per thread and writes them as Chrome trace
+ * events, for chrome://tracing or ui.perfetto.dev: one track per thread,
+ * each span tagged with the file it worked on. A thread appends to a
+ * buffer of its own and, every TRACE_CHUNK_EVENTS spans, writes it to
+ * the file under a lock and starts it over. Memory stays at one buffer
+ * per thread and one copy of each file name, so tracing can stay on for
+ * whole batches. While it is off, a span costs one atomic load.
+ */
+
+#define TRACE_CHUNK_EVENTS 2048
+
+/* Starts recording to path; -1 if it cannot be created or a recording is running. */
+int trace_start(const char* path);
+int trace_enabled(void);
+/*
+ * Stops recording, writes the spans the threads still hold and closes
+ * the file; -1 if any of it could not be written. Call it once the
+ * traced threads are done.
+ */
+int trace_stop(void);
+
+/* Names the calling thread's track. */
+void trace_name_thread(const char* name);
+/*
+ * The id spans carry for a file name, the same one for the same name;
+ * 0, meaning none, while off or for NULL.
+ */
+int trace_file(const char* name);
+/* The file the calling thread's spans are tagged with from now on. */
+void trace_set_file(int file);
+int trace_current_file(void);
+
+/* A span's start, or 0 while off. */
+uint64_t trace_begin(void);
+/* Ends a span on the calling thread's track; name must outlive the recording. */
+void trace_end(const char* name, uint64_t start);
+/*
+ * Ends a span that is not tied to the calling thread, e.g. the time a job
+ * spent queued, shown on a track of its own for each id.
+ */
+void trace_end_async(const char* name, uint64_t start, int id);
+
+#endif
@@ -0,0 +1,242 @@
+/* RUSAGE_THREAD is a Linux extension. */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "slopUsage.h"
+
+/* Per job: wall, queue, CPU and peak memory. */
+#define USAGE_COLUMNS 4
+
+static double timeval_seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void usage_thread_cpu(ResourceUsage* usage) {
+    memset(usage, 0, sizeof(*usage));
+#ifdef RUSAGE_THREAD
+    struct rusage ru;
+    if (getrusage(RUSAGE_THREAD, &ru) == 0) {
+        usage->user_seconds = timeval_seconds(ru.ru_utime);
+        usage->system_seconds = timeval_seconds(ru.ru_stime);
+    }
+#else
+    /* Without a per-thread split, all of it counts as user time. */
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+        usage->user_seconds = ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+#endif
+}
+
+/* rchar and wchar count every byte through read and write, page cache hits included. */
+static void read_io(const char* path, ResourceUsage* usage) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        return;
+    }
+    char line[128];
+    unsigned long long value;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "rchar: %llu", &value) == 1) {
+            usage->bytes_read = value;
+        } else if (sscanf(line, "wchar: %llu", &value) == 1) {
+            usage->bytes_written = value;
+        }
+    }
+    fclose(fp);
+}
+
+void usage_thread(ResourceUsage* usage) {
+    usage_thread_cpu(usage);
+    read_io("/proc/thread-self/io", usage);
+}
+
+pid_t usage_wait_child(pid_t pid, int* status, ResourceUsage* usage, long* max_rss_kb) {
+    ResourceUsage io = { 0, 0, 0, 0 };
+    struct rusage ru;
+    pid_t result;
+    if (usage) {
+        /* A zombie still has its I/O counters; wait for it to exit without reaping it. */
+        siginfo_t info;
+        char path[64];
+        while (waitid(P_PID, (id_t)pid, &info, WEXITED | WNOWAIT) < 0 && errno == EINTR) {
+        }
+        snprintf(path, sizeof(path), "/proc/%ld/io", (long)pid);
+        read_io(path, &io);
+    }
+    while ((result = wait4(pid, status, 0, &ru)) < 0 && errno == EINTR) {
+    }
+    if (usage && result == pid) {
+        io.user_seconds = timeval_seconds(ru.ru_utime);
+        io.system_seconds = timeval_seconds(ru.ru_stime);
+        usage_add(usage, &io);
+        if (ru.ru_maxrss > *max_rss_kb) {
+            *max_rss_kb = ru.ru_maxrss;
+        }
+    }
+    return result;
+}
+
+long usage_process_peak_kb(void) {
+    struct rusage ru;
+    return getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_maxrss : 0;
+}
+
+void usage_add(ResourceUsage* total, const ResourceUsage* usage) {
+    total->user_seconds += usage->user_seconds;
+    total->system_seconds += usage->system_seconds;
+    total->bytes_read += usage->bytes_read;
+    total->bytes_written += usage->bytes_written;
+}
+
+void usage_add_delta(ResourceUsage* total, const ResourceUsage* end, const ResourceUsage* start) {
+    total->user_seconds += end->user_seconds - start->user_seconds;
+    total->system_seconds += end->system_seconds - start->system_seconds;
+    total->bytes_read += end->bytes_read - start->bytes_read;
+    total->bytes_written += end->bytes_written - start->bytes_written;
+}
+
+void usage_log_init(UsageLog* log, FILE* out) {
+    memset(log, 0, sizeof(*log));
+    log->out = out;
+}
+
+static void write_json_string(FILE* out, const char* text) {
+    fputc('"', out);
+    for (const unsigned char* p = (const unsigned char*)(text ? text : ""); *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(out, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(out, "\\u%04x", *p);
+        } else {
+            fputc(*p, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static double realtime_factor(double audio, double wall) {
+    return wall > 0 ? audio / wall : 0;
+}
+
+/* Keeps the slowest jobs by wall time, slowest first. */
+static void keep_slowest(UsageLog* log, const JobUsage* usage) {
+    int i = log->slowest_count;
+    if (i == USAGE_SLOWEST && usage->wall_seconds <= log->slowest_wall[i - 1]) {
+        return;
+    }
+    char* input = strdup(usage->input ? usage->input : "");
+    if (!input) {
+        return;
+    }
+    if (i == USAGE_SLOWEST) {
+        free(log->slowest_input[--i]);
+    } else {
+        log->slowest_count++;
+    }
+    for (; i > 0 && log->slowest_wall[i - 1] < usage->wall_seconds; i--) {
+        log->slowest_input[i] = log->slowest_input[i - 1];
+        log->slowest_wall[i] = log->slowest_wall[i - 1];
+        log->slowest_audio[i] = log->slowest_audio[i - 1];
+    }
+    log->slowest_input[i] = input;
+    log->slowest_wall[i] = usage->wall_seconds;
+    log->slowest_audio[i] = usage->audio_seconds;
+}
+
+void usage_log_add(UsageLog* log, const JobUsage* usage) {
+    const ResourceUsage* r = &usage->usage;
+    if (log->out) {
+        fprintf(log->out, "{\"job\":%d,\"input\":", usage->job);
+        write_json_string(log->out, usage->input);
+        fprintf(log->out, ",\"output\":");
+        write_json_string(log->out, usage->output);
+        fprintf(log->out, ",\"engine\":\"%s\",\"status\":\"%s\",\"finished\":%lld,"
+                "\"queue_s\":%.6f,\"wall_s\":%.6f,\"user_s\":%.6f,\"sys_s\":%.6f,\"max_rss_kb\":%ld,"
+                "\"bytes_read\":%llu,\"bytes_written\":%llu,\"audio_s\":%.6f,\"realtime\":%.3f}\n",
+                usage->engine, usage->status, (long long)time(NULL), usage->queue_seconds, usage->wall_seconds,
+                r->user_seconds, r->system_seconds, usage->max_rss_kb, (unsigned long long)r->bytes_read,
+                (unsigned long long)r->bytes_written, usage->audio_seconds,
+                realtime_factor(usage->audio_seconds, usage->wall_seconds));
+        fflush(log->out);
+    }
+
+    if (log->count == log->cap) {
+        size_t cap = log->cap ? log->cap * 2 : 256;
+        double* grown = realloc(log->samples, cap * USAGE_COLUMNS * sizeof(double));
+        if (!grown) {
+            return;
+        }
+        log->samples = grown;
+        log->cap = cap;
+    }
+    double* row = log->samples + log->count++ * USAGE_COLUMNS;
+    row[0] = usage->wall_seconds;
+    row[1] = usage->queue_seconds;
+    row[2] = r->user_seconds + r->system_seconds;
+    row[3] = (double)usage->max_rss_kb;
+    log->wall_total += usage->wall_seconds;
+    log->audio_total += usage->audio_seconds;
+    log->cpu_total += row[2];
+    log->failed += strcmp(usage->status, "ok") != 0;
+    keep_slowest(log, usage);
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* Nearest rank on sorted values. */
+static double percentile(const double* sorted, size_t count, int p) {
+    size_t rank = (count * (size_t)p + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+void usage_log_summary(const UsageLog* log, FILE* out) {
+    static const char* names[USAGE_COLUMNS] = { "Wall time", "Queue wait", "CPU time", "Peak memory" };
+    if (log->count == 0) {
+        return;
+    }
+    double* column = malloc(log->count * sizeof(double));
+    if (!column) {
+        return;
+    }
+
+    fprintf(out, "Accounting: %zu jobs, %lu failed; %.1f s wall, %.1f s CPU, %.1fx realtime overall\n",
+            log->count, log->failed, log->wall_total, log->cpu_total,
+            realtime_factor(log->audio_total, log->wall_total));
+    for (int c = 0; c < USAGE_COLUMNS; c++) {
+        for (size_t i = 0; i < log->count; i++) {
+            column[i] = log->samples[i * USAGE_COLUMNS + c];
+        }
+        qsort(column, log->count, sizeof(double), compare_doubles);
+        const char* unit = c == 3 ? "MB" : "s";
+        double scale = c == 3 ? 1.0 / 1024 : 1.0;
+        fprintf(out, "  %-12s p50 %8.2f %s  p95 %8.2f %s  p99 %8.2f %s\n", names[c],
+                percentile(column, log->count, 50) * scale, unit, percentile(column, log->count, 95) * scale,
+                unit, percentile(column, log->count, 99) * scale, unit);
+    }
+    free(column);
+
+    fprintf(out, "  Slowest:\n");
+    for (int i = 0; i < log->slowest_count; i++) {
+        fprintf(out, "    %8.2f s  %6.1fx  %s\n", log->slowest_wall[i],
+                realtime_factor(log->slowest_audio[i], log->slowest_wall[i]), log->slowest_input[i]);
+    }
+}
+
+void usage_log_free(UsageLog* log) {
+    for (int i = 0; i < log->slowest_count; i++) {
+        free(log->slowest_input[i]);
+    }
+    free(log->samples);
+    memset(log, 0, sizeof(*log));
+}
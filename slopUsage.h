@@ -0,0 +1,72 @@
+#ifndef SLOP_USAGE_H
+#define SLOP_USAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/* CPU time and bytes moved by read and write calls, of a thread or process. */
+typedef struct {
+    double user_seconds;
+    double system_seconds;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+} ResourceUsage;
+
+/* The calling thread's CPU time only: one system call, cheap enough per block. */
+void usage_thread_cpu(ResourceUsage* usage);
+/* The calling thread's CPU time and I/O, which also reads /proc. */
+void usage_thread(ResourceUsage* usage);
+/*
+ * waitpid that also adds the child's CPU time and I/O, read before it is
+ * reaped, to usage, and raises max_rss_kb to its peak. usage may be NULL.
+ */
+pid_t usage_wait_child(pid_t pid, int* status, ResourceUsage* usage, long* max_rss_kb);
+/* The whole process's peak resident set in KB. */
+long usage_process_peak_kb(void);
+void usage_add(ResourceUsage* total, const ResourceUsage* usage);
+/* Adds end - start to total. */
+void usage_add_delta(ResourceUsage* total, const ResourceUsage* end, const ResourceUsage* start);
+
+/* What one finished job cost. */
+typedef struct {
+    int job;
+    const char* input;
+    const char* output;
+    const char* engine;
+    const char* status;
+    double queue_seconds;
+    double wall_seconds;
+    ResourceUsage usage;
+    long max_rss_kb;
+    /* 0 when unknown, e.g. ffmpeg never reported a duration. */
+    double audio_seconds;
+} JobUsage;
+
+#define USAGE_SLOWEST 5
+
+/*
+ * Appends one JSON line per job to a file and keeps what a batch summary
+ * needs: a few numbers per job for the percentiles and the slowest jobs'
+ * names. Not thread-safe; the caller serialises it.
+ */
+typedef struct {
+    FILE* out;
+    double* samples;
+    size_t count, cap;
+    double wall_total, audio_total, cpu_total;
+    unsigned long failed;
+    char* slowest_input[USAGE_SLOWEST];
+    double slowest_wall[USAGE_SLOWEST];
+    double slowest_audio[USAGE_SLOWEST];
+    int slowest_count;
+} UsageLog;
+
+void usage_log_init(UsageLog* log, FILE* out);
+void usage_log_add(UsageLog* log, const JobUsage* usage);
+/* p50/p95/p99 of wall time, queue wait, CPU and peak memory, and the slowest jobs. */
+void usage_log_summary(const UsageLog* log, FILE* out);
+void usage_log_free(UsageLog* log);
+
+#endif
@@ -0,0 +1,486 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "slopWaveView.h"
+
+struct WaveView {
+    GtkWidget* area;
+    PeakData* peaks;
+    SpectroData* spectro;
+    gboolean show_spectrogram;
+    double color[3];
+    double frames_per_pixel;
+    double scroll_px;
+    gboolean fit;
+    int tile_height;
+    GHashTable* tiles;
+    double playhead;
+    double sel_start;
+    double sel_end;
+    gboolean dragging;
+    gboolean drag_moved;
+    double drag_origin_x;
+    WaveViewSeekFunc seek_func;
+    gpointer seek_data;
+};
+
+static gboolean waveview_draw(GtkWidget* widget, cairo_t* cr, gpointer data);
+static gboolean waveview_scroll(GtkWidget* widget, GdkEventScroll* event, gpointer data);
+static gboolean waveview_button_press(GtkWidget* widget, GdkEventButton* event, gpointer data);
+static gboolean waveview_button_release(GtkWidget* widget, GdkEventButton* event, gpointer data);
+static gboolean waveview_motion(GtkWidget* widget, GdkEventMotion* event, gpointer data);
+
+WaveView* waveview_new(void) {
+    WaveView* view = g_new0(WaveView, 1);
+    view->color[1] = 0.8;
+    view->fit = TRUE;
+    view->frames_per_pixel = WAVEVIEW_MIN_FRAMES_PER_PIXEL;
+    view->playhead = -1.0;
+    view->sel_start = view->sel_end = -1.0;
+    view->tiles = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                        (GDestroyNotify)cairo_surface_destroy);
+
+    view->area = gtk_drawing_area_new();
+    g_object_ref_sink(view->area);
+    gtk_widget_add_events(view->area, GDK_SCROLL_MASK | GDK_BUTTON_PRESS_MASK |
+                                      GDK_BUTTON_RELEASE_MASK | GDK_BUTTON1_MOTION_MASK);
+    g_signal_connect(view->area, "draw", G_CALLBACK(waveview_draw), view);
+    g_signal_connect(view->area, "scroll-event", G_CALLBACK(waveview_scroll), view);
+    g_signal_connect(view->area, "button-press-event", G_CALLBACK(waveview_button_press), view);
+    g_signal_connect(view->area, "button-release-event", G_CALLBACK(waveview_button_release), view);
+    g_signal_connect(view->area, "motion-notify-event", G_CALLBACK(waveview_motion), view);
+    return view;
+}
+
+void waveview_free(WaveView* view) {
+    if (!view) {
+        return;
+    }
+    g_hash_table_destroy(view->tiles);
+    peaks_free(view->peaks);
+    spectro_free(view->spectro);
+    g_object_unref(view->area);
+    g_free(view);
+}
+
+GtkWidget* waveview_widget(WaveView* view) {
+    return view->area;
+}
+
+static void waveview_invalidate(WaveView* view) {
+    g_hash_table_remove_all(view->tiles);
+    gtk_widget_queue_draw(view->area);
+}
+
+static double waveview_rate(WaveView* view) {
+    return (view->peaks && view->peaks->sample_rate > 0) ? view->peaks->sample_rate : 48000.0;
+}
+
+static double waveview_seconds_to_x(WaveView* view, double seconds) {
+    return seconds * waveview_rate(view) / view->frames_per_pixel - view->scroll_px;
+}
+
+static double waveview_x_to_seconds(WaveView* view, double x) {
+    return (x + view->scroll_px) * view->frames_per_pixel / waveview_rate(view);
+}
+
+static double waveview_fit_frames_per_pixel(WaveView* view) {
+    int width = gtk_widget_get_allocated_width(view->area);
+    if (!view->peaks || width <= 0) {
+        return WAVEVIEW_MIN_FRAMES_PER_PIXEL;
+    }
+    double fpp = (double)view->peaks->frames / width;
+    return fpp > WAVEVIEW_MIN_FRAMES_PER_PIXEL ? fpp : WAVEVIEW_MIN_FRAMES_PER_PIXEL;
+}
+
+static void waveview_clamp_scroll(WaveView* view) {
+    int width = gtk_widget_get_allocated_width(view->area);
+    double total_px = view->peaks ? ceil(view->peaks->frames / view->frames_per_pixel) : 0;
+    double max_scroll = total_px - width;
+    if (view->scroll_px > max_scroll) view->scroll_px = max_scroll;
+    if (view->scroll_px < 0) view->scroll_px = 0;
+    view->scroll_px = floor(view->scroll_px);
+}
+
+void waveview_set_peaks(WaveView* view, PeakData* peaks) {
+    peaks_free(view->peaks);
+    view->peaks = peaks;
+    view->sel_start = view->sel_end = -1.0;
+    if (view->fit) {
+        view->frames_per_pixel = waveview_fit_frames_per_pixel(view);
+    }
+    waveview_clamp_scroll(view);
+    waveview_invalidate(view);
+}
+
+const PeakData* waveview_get_peaks(WaveView* view) {
+    return view->peaks;
+}
+
+void waveview_set_spectrogram(WaveView* view, SpectroData* spectro) {
+    spectro_free(view->spectro);
+    view->spectro = spectro;
+    if (view->show_spectrogram) {
+        waveview_invalidate(view);
+    }
+}
+
+void waveview_show_spectrogram(WaveView* view, gboolean show) {
+    if (view->show_spectrogram == show) {
+        return;
+    }
+    view->show_spectrogram = show;
+    waveview_invalidate(view);
+}
+
+void waveview_set_color(WaveView* view, double r, double g, double b) {
+    if (view->color[0] == r && view->color[1] == g && view->color[2] == b) {
+        return;
+    }
+    view->color[0] = r;
+    view->color[1] = g;
+    view->color[2] = b;
+    waveview_invalidate(view);
+}
+
+static void waveview_queue_column(WaveView* view, double seconds) {
+    if (seconds < 0) {
+        return;
+    }
+    int x = (int)floor(waveview_seconds_to_x(view, seconds));
+    gtk_widget_queue_draw_area(view->area, x - 1, 0, 3, gtk_widget_get_allocated_height(view->area));
+}
+
+void waveview_set_playhead(WaveView* view, double seconds) {
+    if (seconds == view->playhead) {
+        return;
+    }
+
+    double x = waveview_seconds_to_x(view, seconds);
+    int width = gtk_widget_get_allocated_width(view->area);
+
+    if (seconds >= 0 && !view->fit && !view->dragging && (x < 0 || x >= width)) {
+        view->scroll_px = seconds * waveview_rate(view) / view->frames_per_pixel - width * 0.1;
+        waveview_clamp_scroll(view);
+        view->playhead = seconds;
+        gtk_widget_queue_draw(view->area);
+        return;
+    }
+
+    waveview_queue_column(view, view->playhead);
+    view->playhead = seconds;
+    waveview_queue_column(view, view->playhead);
+}
+
+void waveview_set_selection(WaveView* view, double start_seconds, double end_seconds) {
+    view->sel_start = start_seconds < end_seconds ? start_seconds : end_seconds;
+    view->sel_end = start_seconds < end_seconds ? end_seconds : start_seconds;
+    gtk_widget_queue_draw(view->area);
+}
+
+void waveview_zoom(WaveView* view, double factor, double anchor_x) {
+    if (!view->peaks || factor <= 0) {
+        return;
+    }
+
+    double anchor_frame = (anchor_x + view->scroll_px) * view->frames_per_pixel;
+    double fit_fpp = waveview_fit_frames_per_pixel(view);
+    double fpp = view->frames_per_pixel * factor;
+
+    if (fpp < WAVEVIEW_MIN_FRAMES_PER_PIXEL) fpp = WAVEVIEW_MIN_FRAMES_PER_PIXEL;
+    if (fpp >= fit_fpp) {
+        waveview_zoom_to_fit(view);
+        return;
+    }
+
+    view->fit = FALSE;
+    view->frames_per_pixel = fpp;
+    view->scroll_px = anchor_frame / fpp - anchor_x;
+    waveview_clamp_scroll(view);
+    waveview_invalidate(view);
+}
+
+void waveview_zoom_to_fit(WaveView* view) {
+    view->fit = TRUE;
+    view->frames_per_pixel = waveview_fit_frames_per_pixel(view);
+    view->scroll_px = 0;
+    waveview_invalidate(view);
+}
+
+void waveview_set_seek_func(WaveView* view, WaveViewSeekFunc func, gpointer user_data) {
+    view->seek_func = func;
+    view->seek_data = user_data;
+}
+
+/* Black through blue, magenta and orange to white, 0 being the floor. */
+static guint32 waveview_heat(int value) {
+    static const double stops[][3] = {
+        { 0.0, 0.0, 0.0 }, { 0.1, 0.0, 0.5 }, { 0.7, 0.0, 0.6 }, { 1.0, 0.5, 0.0 }, { 1.0, 1.0, 1.0 },
+    };
+    double pos = value / 255.0 * 4.0;
+    int i = pos >= 4.0 ? 3 : (int)pos;
+    double t = pos - i;
+    guint32 rgb = 0;
+    for (int c = 0; c < 3; c++) {
+        double v = stops[i][c] + (stops[i + 1][c] - stops[i][c]) * t;
+        rgb = (rgb << 8) | (guint32)lrint(v * 255.0);
+    }
+    return rgb;
+}
+
+/*
+ * Spectrogram strip for the same tile: each pixel column takes the louder
+ * of the spectrogram columns it covers, the highest band at the top.
+ */
+static cairo_surface_t* waveview_render_spectro_tile(WaveView* view, int index, int height) {
+    static guint32 palette[256];
+    if (!palette[255]) {
+        for (int i = 0; i < 256; i++) {
+            palette[i] = waveview_heat(i);
+        }
+    }
+
+    cairo_surface_t* tile = cairo_image_surface_create(CAIRO_FORMAT_RGB24, WAVEVIEW_TILE_WIDTH, height);
+    cairo_surface_flush(tile);
+    guint8* pixels = cairo_image_surface_get_data(tile);
+    int stride = cairo_image_surface_get_stride(tile);
+    const SpectroData* spectro = view->spectro;
+    double fpp = view->frames_per_pixel;
+    int level = spectro_pick_level(spectro, fpp);
+    double fpc = (double)spectro->frames_per_column[level];
+    guint8 column[SPECTRO_BANDS];
+
+    for (int px = 0; px < WAVEVIEW_TILE_WIDTH; px++) {
+        double abs_px = (double)index * WAVEVIEW_TILE_WIDTH + px;
+        double first_frame = abs_px * fpp;
+        int64_t first_col = (int64_t)(first_frame / fpc);
+        int64_t last_col = (int64_t)ceil((abs_px + 1) * fpp / fpc) - 1;
+        if (last_col < first_col) last_col = first_col;
+
+        for (int band = 0; band < SPECTRO_BANDS; band++) {
+            column[band] = first_frame < spectro->frames ? spectro_value(spectro, level, first_col, last_col, band) : 0;
+        }
+        for (int y = 0; y < height; y++) {
+            int band = (int)((int64_t)(height - 1 - y) * SPECTRO_BANDS / height);
+            *(guint32*)(pixels + (size_t)y * stride + px * 4) = palette[column[band]];
+        }
+    }
+
+    cairo_surface_mark_dirty(tile);
+    return tile;
+}
+
+/*
+ * Renders one WAVEVIEW_TILE_WIDTH column strip of min/max envelope at the
+ * current zoom. Tiles are addressed in absolute pixels, so scrolling only
+ * changes where existing tiles are painted.
+ */
+static cairo_surface_t* waveview_render_tile(WaveView* view, int index, int height) {
+    cairo_surface_t* tile = gdk_window_create_similar_surface(gtk_widget_get_window(view->area),
+                                                              CAIRO_CONTENT_COLOR_ALPHA,
+                                                              WAVEVIEW_TILE_WIDTH, height);
+    cairo_t* cr = cairo_create(tile);
+    const PeakData* peaks = view->peaks;
+    double fpp = view->frames_per_pixel;
+    int level = peaks_pick_level(peaks, fpp);
+    double fpb = (double)peaks->frames_per_bin[level];
+    double half = height / 2.0;
+
+    cairo_set_source_rgb(cr, view->color[0], view->color[1], view->color[2]);
+    cairo_set_line_width(cr, 1);
+
+    for (int px = 0; px < WAVEVIEW_TILE_WIDTH; px++) {
+        double abs_px = (double)index * WAVEVIEW_TILE_WIDTH + px;
+        double first_frame = abs_px * fpp;
+        if (first_frame >= peaks->frames) {
+            break;
+        }
+
+        int64_t first_bin = (int64_t)(first_frame / fpb);
+        int64_t last_bin = (int64_t)ceil((abs_px + 1) * fpp / fpb) - 1;
+        if (last_bin < first_bin) last_bin = first_bin;
+
+        float min = 0.0f, max = 0.0f;
+        for (int c = 0; c < peaks->channels; c++) {
+            float ch_min, ch_max;
+            peaks_range(peaks, level, first_bin, last_bin, c, &ch_min, &ch_max);
+            if (c == 0 || ch_min < min) min = ch_min;
+            if (c == 0 || ch_max > max) max = ch_max;
+        }
+
+        cairo_move_to(cr, px + 0.5, half - max * half);
+        cairo_line_to(cr, px + 0.5, half - min * half + 1);
+    }
+
+    cairo_stroke(cr);
+    cairo_destroy(cr);
+    return tile;
+}
+
+static void waveview_evict_tiles(WaveView* view, int first_visible, int last_visible) {
+    if (g_hash_table_size(view->tiles) <= WAVEVIEW_MAX_TILES) {
+        return;
+    }
+
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, view->tiles);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        int index = GPOINTER_TO_INT(key);
+        if (index < first_visible || index > last_visible) {
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+}
+
+static gboolean waveview_draw(GtkWidget* widget, cairo_t* cr, gpointer data) {
+    WaveView* view = (WaveView*)data;
+    int width = gtk_widget_get_allocated_width(widget);
+    int height = gtk_widget_get_allocated_height(widget);
+
+    gtk_render_background(gtk_widget_get_style_context(widget), cr, 0, 0, width, height);
+
+    if (!view->peaks || view->peaks->frames <= 0 || width <= 0) {
+        return FALSE;
+    }
+
+    if (height != view->tile_height) {
+        view->tile_height = height;
+        g_hash_table_remove_all(view->tiles);
+    }
+    if (view->fit) {
+        double fpp = waveview_fit_frames_per_pixel(view);
+        if (fpp != view->frames_per_pixel) {
+            view->frames_per_pixel = fpp;
+            view->scroll_px = 0;
+            g_hash_table_remove_all(view->tiles);
+        }
+    }
+
+    GdkRectangle clip;
+    if (!gdk_cairo_get_clip_rectangle(cr, &clip)) {
+        return FALSE;
+    }
+
+    int first_tile = (int)floor((view->scroll_px + clip.x) / WAVEVIEW_TILE_WIDTH);
+    int last_tile = (int)floor((view->scroll_px + clip.x + clip.width - 1) / WAVEVIEW_TILE_WIDTH);
+
+    for (int index = first_tile; index <= last_tile; index++) {
+        cairo_surface_t* tile = g_hash_table_lookup(view->tiles, GINT_TO_POINTER(index));
+        if (!tile) {
+            tile = view->show_spectrogram && view->spectro
+                   ? waveview_render_spectro_tile(view, index, height)
+                   : waveview_render_tile(view, index, height);
+            g_hash_table_insert(view->tiles, GINT_TO_POINTER(index), tile);
+        }
+        cairo_set_source_surface(cr, tile, (double)index * WAVEVIEW_TILE_WIDTH - view->scroll_px, 0);
+        cairo_paint(cr);
+    }
+
+    waveview_evict_tiles(view,
+                         (int)floor(view->scroll_px / WAVEVIEW_TILE_WIDTH),
+                         (int)floor((view->scroll_px + width - 1) / WAVEVIEW_TILE_WIDTH));
+
+    if (view->sel_start >= 0 && view->sel_end > view->sel_start) {
+        double x0 = waveview_seconds_to_x(view, view->sel_start);
+        double x1 = waveview_seconds_to_x(view, view->sel_end);
+        cairo_set_source_rgba(cr, 1.0, 1.0, 1.0, 0.15);
+        cairo_rectangle(cr, x0, 0, x1 - x0, height);
+        cairo_fill(cr);
+    }
+
+    if (view->playhead >= 0) {
+        double x = floor(waveview_seconds_to_x(view, view->playhead)) + 0.5;
+        cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+        cairo_set_line_width(cr, 1);
+        cairo_move_to(cr, x, 0);
+        cairo_line_to(cr, x, height);
+        cairo_stroke(cr);
+    }
+
+    return FALSE;
+}
+
+static gboolean waveview_scroll(GtkWidget* widget, GdkEventScroll* event, gpointer data) {
+    WaveView* view = (WaveView*)data;
+    int width = gtk_widget_get_allocated_width(widget);
+    double steps = 0;
+
+    switch (event->direction) {
+        case GDK_SCROLL_UP:
+        case GDK_SCROLL_LEFT:
+            steps = -1;
+            break;
+        case GDK_SCROLL_DOWN:
+        case GDK_SCROLL_RIGHT:
+            steps = 1;
+            break;
+        case GDK_SCROLL_SMOOTH:
+            steps = fabs(event->delta_x) > fabs(event->delta_y) ? event->delta_x : event->delta_y;
+            break;
+        default:
+            return FALSE;
+    }
+
+    if (event->state & GDK_CONTROL_MASK) {
+        waveview_zoom(view, pow(1.25, steps), event->x);
+    } else if (!view->fit) {
+        view->scroll_px += steps * width * 0.1;
+        waveview_clamp_scroll(view);
+        gtk_widget_queue_draw(widget);
+    }
+    return TRUE;
+}
+
+static gboolean waveview_button_press(GtkWidget* widget, GdkEventButton* event, gpointer data) {
+    WaveView* view = (WaveView*)data;
+    if (event->button != GDK_BUTTON_PRIMARY) {
+        return FALSE;
+    }
+
+    if (event->type == GDK_2BUTTON_PRESS) {
+        view->dragging = FALSE;
+        waveview_zoom_to_fit(view);
+        return TRUE;
+    }
+
+    view->dragging = TRUE;
+    view->drag_moved = FALSE;
+    view->drag_origin_x = event->x;
+    return TRUE;
+}
+
+static gboolean waveview_motion(GtkWidget* widget, GdkEventMotion* event, gpointer data) {
+    WaveView* view = (WaveView*)data;
+    if (!view->dragging || !view->peaks) {
+        return FALSE;
+    }
+
+    if (fabs(event->x - view->drag_origin_x) > 3) {
+        view->drag_moved = TRUE;
+    }
+    if (view->drag_moved) {
+        waveview_set_selection(view,
+                               waveview_x_to_seconds(view, view->drag_origin_x),
+                               waveview_x_to_seconds(view, event->x));
+    }
+    return TRUE;
+}
+
+static gboolean waveview_button_release(GtkWidget* widget, GdkEventButton* event, gpointer data) {
+    WaveView* view = (WaveView*)data;
+    if (!view->dragging || event->button != GDK_BUTTON_PRIMARY) {
+        return FALSE;
+    }
+
+    view->dragging = FALSE;
+    if (!view->drag_moved && view->peaks) {
+        double seconds = waveview_x_to_seconds(view, event->x);
+        view->sel_start = view->sel_end = -1.0;
+        gtk_widget_queue_draw(widget);
+        if (view->seek_func) {
+            view->seek_func(seconds, view->seek_data);
+        }
+    }
+    return TRUE;
+}
@@ -0,0 +1,32 @@
+#ifndef SLOP_WAVE_VIEW_H
+#define SLOP_WAVE_VIEW_H
+
+#include <gtk/gtk.h>
+
+#include "slopPeaks.h"
+#include "slopSpectro.h"
+
+#define WAVEVIEW_TILE_WIDTH 256
+#define WAVEVIEW_MAX_TILES 64
+#define WAVEVIEW_MIN_FRAMES_PER_PIXEL 16.0
+
+typedef struct WaveView WaveView;
+typedef void (*WaveViewSeekFunc)(double seconds, gpointer user_data);
+
+WaveView* waveview_new(void);
+void waveview_free(WaveView* view);
+GtkWidget* waveview_widget(WaveView* view);
+
+void waveview_set_peaks(WaveView* view, PeakData* peaks);
+const PeakData* waveview_get_peaks(WaveView* view);
+/* Takes ownership; the timeline still follows the peaks. */
+void waveview_set_spectrogram(WaveView* view, SpectroData* spectro);
+void waveview_show_spectrogram(WaveView* view, gboolean show);
+void waveview_set_color(WaveView* view, double r, double g, double b);
+void waveview_set_playhead(WaveView* view, double seconds);
+void waveview_set_selection(WaveView* view, double start_seconds, double end_seconds);
+void waveview_zoom(WaveView* view, double factor, double anchor_x);
+void waveview_zoom_to_fit(WaveView* view);
+void waveview_set_seek_func(WaveView* view, WaveViewSeekFunc func, gpointer user_data);
+
+#endif